@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch_mode.h"
+#include "model.h"
+#include "row_reader.h"
+#include "profiler.h"
+#include "sparse.h"
+#include "streaming.h"
+#include "numa.h"
+#include "pipeline.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define DEFAULT_BATCH_SIZE 256
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// stdio buffer for the output stream. Static because stdout may still use it at exit.
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+typedef struct {
+    const char* model_path;
+    const char* input_path;
+    const char* output_path;
+    TinyNN_RowFormat input_format;
+    TinyNN_RowFormat output_format;
+    int batch_size;
+    int quiet;
+    int skip_bad_rows;    // Report input rows of the wrong width and go on without them
+    int profile;          // 0 = off, 1 = table, 2 = JSON, printed on stderr at the end
+    TinyNN_OutputMode output_mode;
+    int argmax;           // Write only each row's winning class
+    int top_k;            // > 0: write each row's top_k classes and scores instead of every output
+    int pipelined;        // Run the layers as a pipeline of stages (pipeline.h)
+    TinyNN_PipelineOptions pipeline;
+    TinyNN_LoadOptions load;
+} BatchOptions;
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s --model <path> [options]\n"
+        "Streams input rows through a model without the interactive menu.\n"
+        "\n"
+        "  -m, --model <path>          Model directory or .tnn file (required)\n"
+        "  -i, --input <file|->        Input rows, '-' for stdin (default)\n"
+        "  -o, --output <file|->       Output rows, '-' for stdout (default)\n"
+        "      --input-format csv|bin  CSV lines or raw float32 rows (default csv)\n"
+        "      --output-format csv|bin CSV lines or raw float32 rows (default csv)\n"
+        "      --skip-bad-rows         Report CSV rows of the wrong width and go on without them,\n"
+        "                              instead of stopping at the first one\n"
+        "  -b, --batch <n>             Rows per forward pass (default %d)\n"
+        "  -t, --threads <n>           Inference threads, 0 = one per CPU (default 1)\n"
+        "  -w, --weights <type>        Weight storage: fp32, fp16, bf16 or int8 (default fp32)\n"
+        "      --sparse <fraction>     Store fp32 layers with at least this share of zero weights\n"
+        "                              sparse, 0 = never (default %.2f)\n"
+        "      --stream <layers>       Stream the weights of a .tnn model from disk, keeping at\n"
+        "                              most this many layers in memory (e.g. %d)\n"
+        "      --numa <mode>           Weight placement on NUMA machines: off (default), interleave\n"
+        "                              or replicate (one copy per node)\n"
+        "      --pipeline <stages>     Run groups of layers on their own cores, micro-batches flowing\n"
+        "                              between them; 0 = one stage per CPU\n"
+        "      --micro-batch <n>       Rows per micro-batch with --pipeline (default 16)\n"
+        "      --output-mode <mode>    default (the model's activation), logits, log-softmax or\n"
+        "                              argmax (the winning class only)\n"
+        "  -k, --top-k <n>             Write the n best classes and their scores per row\n"
+        "  -p, --profile table|json    Print per-layer times and hardware counters on stderr\n"
+        "  -q, --quiet                 Do not print the summary on stderr\n"
+        "  -h, --help                  Show this help\n",
+        program, DEFAULT_BATCH_SIZE, DEFAULT_SPARSE_THRESHOLD, DEFAULT_STREAM_WINDOW);
+}
+
+// Returns 1 if argv[*i] is 'short_name' or 'long_name' and stores the following argument
+static int flag_value(int argc, char** argv, int* i, const char* short_name, const char* long_name,
+                      const char** value) {
+    if (!(short_name && strcmp(argv[*i], short_name) == 0) && strcmp(argv[*i], long_name) != 0) return 0;
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "ERROR: %s needs a value\n", argv[*i]);
+        *value = NULL;
+        return 1;
+    }
+    *value = argv[++*i];
+    return 1;
+}
+
+static int parse_options(int argc, char** argv, BatchOptions* options) {
+    options->model_path = NULL;
+    options->input_path = "-";
+    options->output_path = "-";
+    options->input_format = TINYNN_ROWS_CSV;
+    options->output_format = TINYNN_ROWS_CSV;
+    options->batch_size = DEFAULT_BATCH_SIZE;
+    options->quiet = 0;
+    options->skip_bad_rows = 0;
+    options->profile = 0;
+    options->load = default_load_options();
+    options->output_mode = TINYNN_OUTPUT_DEFAULT;
+    options->argmax = 0;
+    options->top_k = 0;
+    options->pipelined = 0;
+    options->pipeline = default_pipeline_options();
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            return 0;
+        } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0) {
+            options->quiet = 1;
+        } else if (strcmp(argv[i], "--skip-bad-rows") == 0) {
+            options->skip_bad_rows = 1;
+        } else if (flag_value(argc, argv, &i, "-m", "--model", &value)) {
+            if (!value) return 0;
+            options->model_path = value;
+        } else if (flag_value(argc, argv, &i, "-i", "--input", &value)) {
+            if (!value) return 0;
+            options->input_path = value;
+        } else if (flag_value(argc, argv, &i, "-o", "--output", &value)) {
+            if (!value) return 0;
+            options->output_path = value;
+        } else if (flag_value(argc, argv, &i, NULL, "--input-format", &value)) {
+            if (!value || !parse_row_format(value, &options->input_format)) {
+                fprintf(stderr, "ERROR: Unknown input format '%s'\n", value ? value : "");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--output-format", &value)) {
+            if (!value || !parse_row_format(value, &options->output_format)) {
+                fprintf(stderr, "ERROR: Unknown output format '%s'\n", value ? value : "");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-b", "--batch", &value)) {
+            if (!value || (options->batch_size = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --batch needs a positive number\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-t", "--threads", &value)) {
+            if (!value) return 0;
+            options->load.num_threads = atoi(value);
+        } else if (flag_value(argc, argv, &i, "-w", "--weights", &value)) {
+            if (!value || !parse_weight_type(value, &options->load.weight_type)) {
+                fprintf(stderr, "ERROR: Unknown weight type '%s'\n", value ? value : "");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--sparse", &value)) {
+            if (!value || atof(value) < 0.0 || atof(value) > 1.0) {
+                fprintf(stderr, "ERROR: --sparse needs a fraction between 0 and 1\n");
+                return 0;
+            }
+            options->load.sparse_threshold = (float)atof(value);
+        } else if (flag_value(argc, argv, &i, NULL, "--numa", &value)) {
+            if (!value || !parse_numa_mode(value, &options->load.numa)) {
+                fprintf(stderr, "ERROR: --numa needs off, interleave or replicate\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--stream", &value)) {
+            if (!value || (options->load.stream_window = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --stream needs a positive number of layers\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--pipeline", &value)) {
+            if (!value || (options->pipeline.num_stages = atoi(value)) < 0) {
+                fprintf(stderr, "ERROR: --pipeline needs a number of stages\n");
+                return 0;
+            }
+            options->pipelined = 1;
+        } else if (flag_value(argc, argv, &i, NULL, "--micro-batch", &value)) {
+            if (!value || (options->pipeline.micro_batch = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --micro-batch needs a positive number\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--output-mode", &value)) {
+            if (value && strcmp(value, "default") == 0) {
+                options->output_mode = TINYNN_OUTPUT_DEFAULT;
+            } else if (value && strcmp(value, "logits") == 0) {
+                options->output_mode = TINYNN_OUTPUT_LOGITS;
+            } else if (value && strcmp(value, "log-softmax") == 0) {
+                options->output_mode = TINYNN_OUTPUT_LOG_SOFTMAX;
+            } else if (value && strcmp(value, "argmax") == 0) {
+                options->argmax = 1;
+            } else {
+                fprintf(stderr, "ERROR: --output-mode needs default, logits, log-softmax or argmax\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-k", "--top-k", &value)) {
+            if (!value || (options->top_k = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --top-k needs a positive number\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-p", "--profile", &value)) {
+            if (value && strcmp(value, "table") == 0) {
+                options->profile = 1;
+            } else if (value && strcmp(value, "json") == 0) {
+                options->profile = 2;
+            } else {
+                fprintf(stderr, "ERROR: --profile needs 'table' or 'json'\n");
+                return 0;
+            }
+        } else {
+            fprintf(stderr, "ERROR: Unknown argument '%s'\n", argv[i]);
+            return 0;
+        }
+    }
+
+    if (options->model_path == NULL) {
+        fprintf(stderr, "ERROR: --model is required\n");
+        return 0;
+    }
+    if ((options->argmax || options->output_mode != TINYNN_OUTPUT_DEFAULT) && options->top_k > 0) {
+        fprintf(stderr, "ERROR: --top-k cannot be combined with another --output-mode\n");
+        return 0;
+    }
+    if (options->pipelined) {
+        if (options->argmax || options->top_k > 0) {
+            fprintf(stderr, "ERROR: --pipeline writes whole output rows, not argmax or --top-k\n");
+            return 0;
+        }
+        if (options->profile) {
+            fprintf(stderr, "ERROR: --profile cannot be combined with --pipeline\n");
+            return 0;
+        }
+        // Rows are read and written one micro-batch at a time
+        options->batch_size = options->pipeline.micro_batch;
+        options->pipeline.output_mode = options->output_mode;
+    }
+    return 1;
+}
+
+static int write_outputs(FILE* fp, TinyNN_RowFormat format, const float* outputs, int rows, int cols) {
+    if (format == TINYNN_ROWS_BINARY) {
+        size_t count = (size_t)rows * cols;
+        return fwrite(outputs, sizeof(float), count, fp) == count;
+    }
+    for (int n = 0; n < rows; n++) {
+        const float* row = outputs + (size_t)n * cols;
+        for (int j = 0; j < cols; j++) {
+            // %.9g round-trips every float exactly
+            if (fprintf(fp, j + 1 < cols ? "%.9g," : "%.9g\n", row[j]) < 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// One class per row: CSV lines or raw little-endian int32
+static int write_classes(FILE* fp, TinyNN_RowFormat format, const int* classes, int rows) {
+    if (format == TINYNN_ROWS_BINARY) {
+        return fwrite(classes, sizeof(int), (size_t)rows, fp) == (size_t)rows;
+    }
+    for (int n = 0; n < rows; n++) {
+        if (fprintf(fp, "%d\n", classes[n]) < 0) return 0;
+    }
+    return 1;
+}
+
+// k (class, score) pairs per row: "class,score,class,score" lines or raw int32 + float32 pairs
+static int write_predictions(FILE* fp, TinyNN_RowFormat format, const TinyNN_Prediction* predictions, int rows,
+                             int k) {
+    size_t count = (size_t)rows * k;
+    if (format == TINYNN_ROWS_BINARY) {
+        return fwrite(predictions, sizeof(TinyNN_Prediction), count, fp) == count;
+    }
+    for (int n = 0; n < rows; n++) {
+        const TinyNN_Prediction* row = predictions + (size_t)n * k;
+        for (int j = 0; j < k; j++) {
+            if (fprintf(fp, j + 1 < k ? "%d,%.9g," : "%d,%.9g\n", row[j].index, row[j].score) < 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// Keeps the pipeline full: each micro-batch read is submitted, and whenever every slot is
+// in flight the oldest one is written out to make room. Returns 0 on success.
+static int score_pipelined(TinyNN_Pipeline* pipeline, TinyNN_BatchReader* reader, FILE* out,
+                           const BatchOptions* options, int output_size, float* outputs, long long* total_rows) {
+    int rows;
+    const float* inputs;
+    while ((rows = next_batch(reader, &inputs)) > 0) {
+        while (!pipeline_submit(pipeline, inputs, rows)) {
+            int done = pipeline_collect(pipeline, outputs);
+            if (!write_outputs(out, options->output_format, outputs, done, output_size)) return 1;
+            *total_rows += done;
+        }
+    }
+    if (rows < 0) return 1;
+    int done;
+    while ((done = pipeline_collect(pipeline, outputs)) > 0) {
+        if (!write_outputs(out, options->output_format, outputs, done, output_size)) return 1;
+        *total_rows += done;
+    }
+    return 0;
+}
+
+// Lists the layers stored sparse, e.g. "Sparse layers: 0 csr (91.2% zeros), 1 bsr4x1 (80.0% zeros)"
+static void print_sparse_layers(const TinyNN_Model* model) {
+    if (model->sparse == NULL) return;
+    fprintf(stderr, "Sparse layers:");
+    for (int i = 0, listed = 0; i <= model->hidden_layers; i++) {
+        if (!layer_is_sparse(model, i)) continue;
+        fprintf(stderr, "%s %d %s (%.1f%% zeros)", listed++ ? "," : "", i, layer_format_name(model, i),
+                100.0 * model->sparse[i].zero_fraction);
+    }
+    fprintf(stderr, "\n");
+}
+
+int run_batch_mode(int argc, char** argv) {
+    BatchOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    double start = get_time_seconds();
+    TinyNN_Model* model = create_model_with_options(options.model_path, &options.load);
+    if (!model) {
+        fprintf(stderr, "ERROR: Failed to load model from '%s'\n", options.model_path);
+        return 1;
+    }
+    double load_time = get_time_seconds() - start;
+    // A single caller reads one copy only: run next to the copy that is profiled and reported
+    for (int node = 0; model->numa && node < numa_node_count(); node++) {
+        if (numa_model_on_node(model, node) == model) {
+            numa_bind_thread_to_node(node);
+            break;
+        }
+    }
+    if (options.profile && !enable_profiling(model)) {
+        free_model(model);
+        return 1;
+    }
+
+    // Parses the next batch on its own thread while the current one is scored
+    TinyNN_BatchReader* reader = open_batch_reader(options.input_path, model->input_size, options.input_format,
+                                                   options.batch_size, options.skip_bad_rows);
+    FILE* out = stdout;
+    if (strcmp(options.output_path, "-") != 0) {
+        out = fopen(options.output_path, options.output_format == TINYNN_ROWS_BINARY ? "wb" : "w");
+        if (!out) fprintf(stderr, "ERROR: Could not create output file %s\n", options.output_path);
+    } else {
+        #ifdef _WIN32
+        if (options.output_format == TINYNN_ROWS_BINARY) _setmode(_fileno(stdout), _O_BINARY);
+        #endif
+    }
+
+    if (options.top_k > model->output_size) {
+        fprintf(stderr, "WARNING: The model has only %d outputs, writing the top %d\n", model->output_size,
+                model->output_size);
+        options.top_k = model->output_size;
+    }
+    TinyNN_Context* ctx = create_context(model, options.batch_size);
+    if (ctx) context_set_output_mode(ctx, options.output_mode);
+    TinyNN_Pipeline* pipeline = options.pipelined ? create_pipeline(model, &options.pipeline) : NULL;
+    // One buffer holds whichever kind of result the rows produce
+    size_t output_bytes = options.argmax ? sizeof(int)
+                          : options.top_k > 0 ? sizeof(TinyNN_Prediction) * options.top_k
+                                              : sizeof(float) * model->output_size;
+    void* outputs = malloc(output_bytes * options.batch_size);
+    int status = 1;
+    long long total_rows = 0;
+
+    if (reader && out && ctx && outputs && (pipeline || !options.pipelined)) {
+        setvbuf(out, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+        status = 0;
+        start = get_time_seconds();
+        if (pipeline &&
+            score_pipelined(pipeline, reader, out, &options, model->output_size, outputs, &total_rows)) {
+            fprintf(stderr, "ERROR: Failed scoring %s\n", options.input_path);
+            status = 1;
+        }
+        while (!pipeline) {
+            const float* inputs;
+            int rows = next_batch(reader, &inputs);
+            if (rows < 0) {
+                status = 1;
+                break;
+            }
+            if (rows == 0) break;
+            int written;
+            if (options.argmax) {
+                forward_pass_argmax_into(ctx, inputs, rows, (int*)outputs);
+                written = write_classes(out, options.output_format, (const int*)outputs, rows);
+            } else if (options.top_k > 0) {
+                forward_pass_top_k_into(ctx, inputs, rows, options.top_k, (TinyNN_Prediction*)outputs);
+                written = write_predictions(out, options.output_format, (const TinyNN_Prediction*)outputs, rows,
+                                            options.top_k);
+            } else {
+                forward_pass_batch_into(ctx, inputs, rows, (float*)outputs);
+                written = write_outputs(out, options.output_format, (const float*)outputs, rows, model->output_size);
+            }
+            if (!written) {
+                fprintf(stderr, "ERROR: Failed writing to %s\n", options.output_path);
+                status = 1;
+                break;
+            }
+            total_rows += rows;
+        }
+        if (fflush(out) != 0 && status == 0) {
+            fprintf(stderr, "ERROR: Failed writing to %s\n", options.output_path);
+            status = 1;
+        }
+        double run_time = get_time_seconds() - start;
+
+        if (!options.quiet) {
+            int threads = pipeline ? pipeline_stage_count(pipeline) : thread_pool_size(ctx->pool);
+            fprintf(stderr, "Scored %lld rows in %.3f s (%.0f rows/s; model load %.3f s, kernels %s, %d %s%s)\n",
+                    total_rows, run_time, run_time > 0.0 ? total_rows / run_time : 0.0, load_time,
+                    model->kernels->name, threads, pipeline ? "stage" : "thread", threads == 1 ? "" : "s");
+            if (pipeline && status == 0) print_pipeline_stats(pipeline, stderr);
+            long long skipped = batch_reader_skipped(reader);
+            if (skipped > 0) {
+                fprintf(stderr, "Skipped %lld input row%s that did not fit\n", skipped, skipped == 1 ? "" : "s");
+            }
+            print_sparse_layers(model);
+            TinyNN_StreamStats stream;
+            if (get_stream_stats(model, &stream)) {
+                fprintf(stderr, "Streamed %.1f MB in %lld layer reads, %.3f s spent waiting for the disk\n",
+                        stream.bytes_fetched / 1e6, stream.layers_fetched, stream.wait_seconds);
+            }
+        }
+        if (options.profile == 1) print_profile(model, stderr);
+        if (options.profile == 2) print_profile_json(model, stderr);
+    }
+
+    if (out && out != stdout) fclose(out);
+    free_pipeline(pipeline);
+    close_batch_reader(reader);
+    free_context(ctx);
+    free(outputs);
+    free_model(model);
+    return status;
+}
@@ -0,0 +1,14 @@
+#ifndef BATCH_MODE_H
+#define BATCH_MODE_H
+
+/**
+ * @brief Runs the non-interactive scoring mode selected by command-line flags.
+ * Loads the model once, then streams every input row from a file or stdin through it
+ * in batches and writes one output row per input row, as CSV or raw float32.
+ * Run 'tinynn --help' for the flags.
+ *
+ * @return The process exit code: 0 on success, 1 on any error.
+ */
+int run_batch_mode(int argc, char** argv);
+
+#endif
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "csv_parser.h"
+#include "utils.h"
+
+// Exact powers of ten representable in a double
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int is_separator(char c) {
+    // NUL is tolerated because older generated models end each row with one
+    return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+static int match_word(const char* p, const char* end, const char* word) {
+    for (; *word; word++, p++) {
+        if (p >= end || (*p | 0x20) != *word) return 0;
+    }
+    return 1;
+}
+
+const char* parse_float(const char* p, const char* end, float* out) {
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (match_word(p, end, "inf")) {
+        p += match_word(p, end, "infinity") ? 8 : 3;
+        *out = negative ? -INFINITY : INFINITY;
+        return p;
+    }
+    if (match_word(p, end, "nan")) {
+        *out = NAN;
+        return p + 3;
+    }
+
+    // Collect up to 19 significant digits into an integer mantissa
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int any_digits = 0;
+    while (p < end && is_digit(*p)) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa) significant++;
+        } else {
+            exponent++; // Digits beyond double precision only scale the value
+        }
+        any_digits = 1;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && is_digit(*p)) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa) significant++;
+                exponent--;
+            }
+            any_digits = 1;
+            p++;
+        }
+    }
+    if (!any_digits) return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int exp_negative = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p >= end || !is_digit(*p)) return NULL;
+        int exp_value = 0;
+        while (p < end && is_digit(*p)) {
+            if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+            p++;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    // Exact powers of ten keep the double result correctly rounded in the common
+    // case; the final float conversion then rounds once more.
+    double value = (double)mantissa;
+    if (mantissa != 0) {
+        while (exponent > 22) { value *= 1e22; exponent -= 22; if (isinf(value)) break; }
+        while (exponent < -22) { value /= 1e22; exponent += 22; if (value == 0.0) break; }
+        if (exponent >= 0) value *= powers_of_ten[exponent];
+        else value /= powers_of_ten[-exponent];
+    }
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+int load_float_csv(const char* filepath, float* array, int rows, int cols) {
+    size_t expected = (size_t)rows * (size_t)cols;
+    size_t size = 0;
+    const char* data = (const char*)map_file_readonly(filepath, &size);
+    if (data == NULL) {
+        // map_file_readonly() also fails on empty files; tell those apart from missing ones
+        FILE* fp = fopen(filepath, "rb");
+        if (fp == NULL) {
+            fprintf(stderr, "ERROR: Could not open file %s\n", filepath);
+            return 0;
+        }
+        fclose(fp);
+        fprintf(stderr, "ERROR: %s is empty, expected %zu values (%d x %d)\n", filepath, expected, rows, cols);
+        return 0;
+    }
+
+    const char* p = data;
+    const char* end = data + size;
+    const char* line_start = data;
+    size_t count = 0;
+    int line = 1;
+    int row_values = 0;        // Values seen on the current line
+    int lines_with_values = 0;
+    int bad_row_line = 0;      // First line whose width is not 'cols'
+    int bad_row_width = 0;
+    int after_comma = 0;       // A comma was seen and no value has followed it yet
+    int ok = 1;
+
+    while (p < end) {
+        char c = *p;
+        if (is_separator(c)) {
+            if (c == ',') {
+                if (after_comma || row_values == 0) {
+                    fprintf(stderr, "ERROR: %s line %d, column %d: empty field\n",
+                            filepath, line, (int)(p - line_start) + 1);
+                    ok = 0;
+                    break;
+                }
+                after_comma = 1;
+            } else if (c == '\n') {
+                if (row_values > 0) {
+                    lines_with_values++;
+                    if (row_values != cols && bad_row_line == 0) {
+                        bad_row_line = line;
+                        bad_row_width = row_values;
+                    }
+                }
+                row_values = 0;
+                after_comma = 0; // A trailing comma at the end of a row is allowed
+                line++;
+                line_start = p + 1;
+            }
+            p++;
+            continue;
+        }
+
+        float value;
+        const char* next = parse_float(p, end, &value);
+        if (next == NULL || (next < end && !is_separator(*next))) {
+            // Show the offending token, up to the next separator
+            const char* token_end = p;
+            while (token_end < end && !is_separator(*token_end) && token_end - p < 32) token_end++;
+            fprintf(stderr, "ERROR: %s line %d, column %d: malformed value '%.*s'\n",
+                    filepath, line, (int)(p - line_start) + 1, (int)(token_end - p), p);
+            ok = 0;
+            break;
+        }
+        if (array && count < expected) array[count] = value;
+        count++;
+        row_values++;
+        after_comma = 0;
+        p = next;
+    }
+
+    if (ok && row_values > 0) {
+        // Last line without a trailing newline
+        lines_with_values++;
+        if (row_values != cols && bad_row_line == 0) {
+            bad_row_line = line;
+            bad_row_width = row_values;
+        }
+    }
+
+    if (ok && lines_with_values == rows && bad_row_line != 0) {
+        fprintf(stderr, "ERROR: %s line %d has %d values, expected %d per row\n",
+                filepath, bad_row_line, bad_row_width, cols);
+        ok = 0;
+    } else if (ok && count != expected) {
+        fprintf(stderr, "ERROR: %s holds %zu values, expected %zu (%d x %d)\n",
+                filepath, count, expected, rows, cols);
+        ok = 0;
+    }
+
+    unmap_file((void*)data, size);
+    return ok;
+}
+
+int parse_float_line(const char* line, const char* line_end, float* row, int cols, int* error_column) {
+    const char* p = line;
+    int values = 0;
+    while (p < line_end) {
+        if (is_separator(*p)) { p++; continue; }
+        float value;
+        const char* next = parse_float(p, line_end, &value);
+        if (next == NULL || (next < line_end && !is_separator(*next))) {
+            if (error_column) *error_column = (int)(p - line) + 1;
+            return -1;
+        }
+        if (values < cols) row[values] = value;
+        values++;
+        p = next;
+    }
+    return values;
+}
+
+float* load_float_rows(const char* filepath, int cols, int* rows_out) {
+    *rows_out = 0;
+    size_t size = 0;
+    const char* data = (const char*)map_file_readonly(filepath, &size);
+    if (data == NULL) {
+        fprintf(stderr, "ERROR: Could not open file %s (or it is empty)\n", filepath);
+        return NULL;
+    }
+
+    size_t capacity = 64;
+    float* rows = (float*)malloc(sizeof(float) * cols * capacity);
+    size_t row_count = 0;
+    const char* p = data;
+    const char* end = data + size;
+    int line = 0;
+    int ok = rows != NULL;
+
+    while (ok && p < end) {
+        const char* line_start = p;
+        const char* line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (line_end == NULL) line_end = end;
+        line++;
+
+        if (row_count == capacity) {
+            capacity *= 2;
+            float* grown = (float*)realloc(rows, sizeof(float) * cols * capacity);
+            if (!grown) { ok = 0; break; }
+            rows = grown;
+        }
+        int column = 0;
+        int values = parse_float_line(line_start, line_end, rows + row_count * cols, cols, &column);
+        if (values < 0) {
+            fprintf(stderr, "ERROR: %s line %d, column %d: malformed value\n", filepath, line, column);
+            ok = 0;
+        } else if (values > 0 && values != cols) {
+            fprintf(stderr, "ERROR: %s line %d has %d values, expected %d\n", filepath, line, values, cols);
+            ok = 0;
+        }
+        if (ok && values > 0) row_count++;
+        p = line_end + 1;
+    }
+
+    unmap_file((void*)data, size);
+    if (!ok || row_count == 0) {
+        if (ok) fprintf(stderr, "ERROR: %s contains no rows\n", filepath);
+        free(rows);
+        return NULL;
+    }
+    *rows_out = (int)row_count;
+    return rows;
+}
@@ -0,0 +1,44 @@
+#ifndef CSV_PARSER_H
+#define CSV_PARSER_H
+
+#include <stddef.h>
+
+/**
+ * @brief Parses one floating-point number from [p, end).
+ * Accepts the formats written by printf("%f"/"%e") and numpy.savetxt, including
+ * "inf" and "nan". The result is within 1 ulp of strtof(). Does not skip leading
+ * whitespace and never reads past 'end', so it is safe on memory-mapped files.
+ * @return Pointer just past the number, or NULL if no number starts at p.
+ */
+const char* parse_float(const char* p, const char* end, float* out);
+
+/**
+ * @brief Loads a CSV file of rows x cols floats into 'array'.
+ * The whole file is memory-mapped and parsed in one go, without stdio.
+ * Values may be separated by commas, spaces, tabs or newlines. When the file has
+ * exactly 'rows' lines, each line must hold 'cols' values; other layouts (such as one
+ * value per line) are accepted as long as the total count is rows * cols.
+ * Malformed values, bad rows and count mismatches are reported on stderr with the
+ * file name and line/column. A NULL 'array' runs the same checks without storing anything.
+ * @return 1 on success, 0 on failure.
+ */
+int load_float_csv(const char* filepath, float* array, int rows, int cols);
+
+/**
+ * @brief Parses the values of one line [line, line_end) into 'row'.
+ * Values may be separated by commas, spaces or tabs. At most 'cols' values are stored,
+ * but all of them are counted so the caller can check the row width.
+ * @param error_column Receives the 1-based column of a malformed value (may be NULL).
+ * @return The number of values on the line, or -1 if one of them is malformed.
+ */
+int parse_float_line(const char* line, const char* line_end, float* row, int cols, int* error_column);
+
+/**
+ * @brief Loads a multi-row CSV file where every non-empty line is one sample of 'cols' values.
+ * A line with a different number of values is reported with its line number and fails the load.
+ * @param rows_out Receives the number of rows read.
+ * @return A malloc'd row-major [rows][cols] matrix that the caller frees, or NULL on failure.
+ */
+float* load_float_rows(const char* filepath, int cols, int* rows_out);
+
+#endif
@@ -1,152 +1,851 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include <errno.h>
-#include "generate_model.h" // Include its own header for consistency
-
-// Platform-Specific Includes
-#ifdef _WIN32
-    #include <windows.h>
-    #include <direct.h>
-    #define MKDIR(path) _mkdir(path)
-#else
-    #include <sys/stat.h>
-    #include <dirent.h>
-    #include <unistd.h>
-    #define MKDIR(path) mkdir(path, 0755)
-#endif
-
-// --- "Private" data for this module ---
-
-typedef struct {
-    const char* name;
-    int input_size;
-    int output_size;
-    int num_layers;
-    const int* layer_sizes;
-} ModelPreset;
-
-static const int micro_layers[] = {8, 4};
-static const int small_layers[] = {32, 16, 8};
-static const int medium_layers[] = {64, 32, 32, 16};
-static const int large_layers[] = {128, 64, 64, 32, 16};
-static const int huge_layers[] = {512, 256, 128, 64, 32};
-
-static ModelPreset presets[] = {
-    {"Micro", 16, 4, 2, micro_layers},
-    {"Small", 64, 8, 3, small_layers},
-    {"Medium", 128, 16, 4, medium_layers},
-    {"Large", 256, 16, 5, large_layers},
-    {"Huge", 1024, 32, 5, huge_layers}
-};
-static const int num_presets = sizeof(presets) / sizeof(presets[0]);
-
-static float random_float() {
-    return ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
-}
-
-#ifdef _WIN32
-static void clear_directory(const char* path) {
-    char search_path[512];
-    snprintf(search_path, sizeof(search_path), "%s\\*", path);
-    WIN32_FIND_DATA fd;
-    HANDLE hFind = FindFirstFile(search_path, &fd);
-    if (hFind != INVALID_HANDLE_VALUE) {
-        printf("Clearing contents of directory '%s'...\n", path);
-        do {
-            if (strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0) {
-                char file_path[512];
-                snprintf(file_path, sizeof(file_path), "%s\\%s", path, fd.cFileName);
-                DeleteFile(file_path);
-            }
-        } while (FindNextFile(hFind, &fd));
-        FindClose(hFind);
-    }
-}
-#else
-static void clear_directory(const char* path) {
-    DIR* dir = opendir(path);
-    if (dir) {
-        printf("Clearing contents of directory '%s'...\n", path);
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-                char filepath[512];
-                snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
-                remove(filepath);
-            }
-        }
-        closedir(dir);
-    }
-}
-#endif
-
-void run_model_generator(const char* model_dir) {
-    printf("\n========================\n");
-    printf("    \033[35mModel Generator\033[0m\n");
-    printf("========================\n");
-    printf("Please choose a model preset to generate\n");
-    printf("Keep in mind that the bigger the model, the more storage it needs:\n");
-    for (int i = 0; i < num_presets; i++) {
-        // Calculate color gradient (green to red)
-        int red = (255 * i) / (num_presets - 1);
-        int green = 255 - red;
-        printf("\033[38;2;%d;%d;0m", red, green);
-        printf("  %d. %s (Input: %d, Output: %d, Layers: %d)\033[0m\n",
-               i + 1, presets[i].name, presets[i].input_size, presets[i].output_size, presets[i].num_layers);
-    }
-    
-    int choice = 0;
-    while (choice < 1 || choice > num_presets) {
-        printf("\nEnter your choice (1-%d): ", num_presets);
-        if (scanf("%d", &choice) != 1) {
-            while(getchar() != '\n'); // Clear invalid input
-        }
-    }
-    const ModelPreset* preset = &presets[choice - 1];
-
-    const char* parent_dir = "models";
-    const char* default_model_dir = "models/generated_model";
-
-    MKDIR(parent_dir);
-
-    srand(time(NULL));
-    clear_directory(default_model_dir);
-    if (MKDIR(default_model_dir) != 0 && errno != EEXIST) {
-        fprintf(stderr, "Error: Could not create directory '%s'.\n", default_model_dir);
-        return;
-    } else {
-        printf("Created directory: %s\n", default_model_dir);
-    }
-
-    char filepath[256];
-    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", default_model_dir);
-    FILE* fp = fopen(filepath, "w");
-    fprintf(fp, "%d\n%d\n%d\n", preset->input_size, preset->output_size, preset->num_layers - 1);
-    for (int i = 0; i < preset->num_layers; i++) fprintf(fp, "%d\n", preset->layer_sizes[i]);
-    fclose(fp);
-    printf("\033[32m Saved architecture.txt\033[0m\n");
-
-    int prev_layer_size = preset->input_size;
-    for (int i = 0; i < preset->num_layers; i++) {
-        int current_layer_size = preset->layer_sizes[i];
-        printf("  - Processing Layer %d (size: %d)\n", i, current_layer_size);
-        snprintf(filepath, sizeof(filepath), "%s/layer_%d_weights.csv", default_model_dir, i);
-        fp = fopen(filepath, "w");
-        for (int r = 0; r < current_layer_size; r++) {
-            for (int c = 0; c < prev_layer_size; c++) fprintf(fp, "%f%c", random_float(), (c == prev_layer_size - 1) ? '\0' : ',');
-            fprintf(fp, "\n");
-        }
-        fclose(fp);
-        printf("\033[32m Saved layer_%d_weights.csv\033[0m\n", i);
-
-        snprintf(filepath, sizeof(filepath), "%s/layer_%d_biases.csv", default_model_dir, i);
-        fp = fopen(filepath, "w");
-        for (int b = 0; b < current_layer_size; b++) fprintf(fp, "%f%c", random_float(), (b == current_layer_size - 1) ? '\0' : ',');
-        fclose(fp);
-        printf("\033[32m Saved layer_%d_biases.csv\033[0m\n", i);
-        prev_layer_size = current_layer_size;
-    }
-    printf("\nModel generation complete!\n");
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include "generate_model.h" // Include its own header for consistency
+#include "kernels.h"
+#include "utils.h"
+#include "pack.h"
+#include "model_binary.h"
+#include "thread_pool.h"
+#include "model_manager.h"
+
+// Platform-Specific Includes
+#ifdef _WIN32
+    #include <windows.h>
+    #include <direct.h>
+    #define MKDIR(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #include <dirent.h>
+    #include <unistd.h>
+    #define MKDIR(path) mkdir(path, 0755)
+#endif
+
+// --- "Private" data for this module ---
+
+static const int micro_layers[] = {8, 4};
+static const int small_layers[] = {32, 16, 8};
+static const int medium_layers[] = {64, 32, 32, 16};
+static const int large_layers[] = {128, 64, 64, 32, 16};
+static const int huge_layers[] = {512, 256, 128, 64, 32};
+
+static ModelPreset presets[] = {
+    {"Micro", 16, 4, 2, micro_layers},
+    {"Small", 64, 8, 3, small_layers},
+    {"Medium", 128, 16, 4, medium_layers},
+    {"Large", 256, 16, 5, large_layers},
+    {"Huge", 1024, 32, 5, huge_layers}
+};
+static const int num_presets = sizeof(presets) / sizeof(presets[0]);
+
+int model_preset_count(void) {
+    return num_presets;
+}
+
+const ModelPreset* get_model_preset(int index) {
+    if (index < 0 || index >= num_presets) return NULL;
+    return &presets[index];
+}
+
+const ModelPreset* find_model_preset(const char* name) {
+    for (int i = 0; i < num_presets; i++) {
+        const char* a = presets[i].name;
+        const char* b = name;
+        while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') return &presets[i];
+    }
+    return NULL;
+}
+
+// xorshift32, so in-memory models do not depend on (or disturb) the rand() state
+static float seeded_random_float(unsigned int* state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)(x >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+TinyNN_Model* create_random_model(int input_size, int num_layers, const int* layer_sizes, unsigned int seed) {
+    if (input_size <= 0 || num_layers <= 0) return NULL;
+    TinyNN_Model* model = (TinyNN_Model*)calloc(1, sizeof(TinyNN_Model));
+    if (!model) return NULL;
+    model->input_size = input_size;
+    model->output_size = layer_sizes[num_layers - 1];
+    model->hidden_layers = num_layers - 1;
+    model->kernels = select_kernels();
+    model->layer_sizes = (int*)malloc(sizeof(int) * num_layers);
+    model->weights = (float**)calloc(num_layers, sizeof(float*));
+    model->biases = (float**)calloc(num_layers, sizeof(float*));
+    if (!model->layer_sizes || !model->weights || !model->biases || !init_activations(model)) {
+        free_model(model);
+        return NULL;
+    }
+
+    unsigned int state = seed ? seed : 1; // xorshift never leaves 0
+    int prev_layer_size = input_size;
+    for (int i = 0; i < num_layers; i++) {
+        if (layer_sizes[i] <= 0) {
+            fprintf(stderr, "ERROR: Layer %d has invalid size %d\n", i, layer_sizes[i]);
+            free_model(model);
+            return NULL;
+        }
+        model->layer_sizes[i] = layer_sizes[i];
+        size_t weight_count = (size_t)prev_layer_size * layer_sizes[i];
+        model->weights[i] = (float*)malloc(sizeof(float) * weight_count);
+        model->biases[i] = (float*)malloc(sizeof(float) * layer_sizes[i]);
+        if (!model->weights[i] || !model->biases[i]) {
+            free_model(model);
+            return NULL;
+        }
+        for (size_t k = 0; k < weight_count; k++) model->weights[i][k] = seeded_random_float(&state);
+        for (int k = 0; k < layer_sizes[i]; k++) model->biases[i][k] = seeded_random_float(&state);
+        prev_layer_size = layer_sizes[i];
+    }
+    // Laid out like a model loaded from disk
+    if (packing_enabled() && !pack_model_weights(model)) {
+        free_model(model);
+        return NULL;
+    }
+    return model;
+}
+
+#ifdef _WIN32
+static void clear_directory(const char* path) {
+    char search_path[512];
+    snprintf(search_path, sizeof(search_path), "%s\\*", path);
+    WIN32_FIND_DATA fd;
+    HANDLE hFind = FindFirstFile(search_path, &fd);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        printf("Clearing contents of directory '%s'...\n", path);
+        do {
+            if (strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0) {
+                char file_path[512];
+                snprintf(file_path, sizeof(file_path), "%s\\%s", path, fd.cFileName);
+                DeleteFile(file_path);
+            }
+        } while (FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    }
+}
+#else
+static void clear_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (dir) {
+        printf("Clearing contents of directory '%s'...\n", path);
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                char filepath[SAFE_PATH_MAX];
+                int length = snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
+                if (length > 0 && (size_t)length < sizeof(filepath)) remove(filepath);
+            }
+        }
+        closedir(dir);
+    }
+}
+#endif
+
+// --- Scalable generator ---
+
+// A generation step covers whole panels of rows and about this many weights; it is split
+// between the threads, then written out before the next step starts
+#define GENERATOR_STEP_FLOATS (2 << 20)
+// Longest "%.9g" value ("-1.23456789e-38") plus its separator
+#define CSV_VALUE_CHARS 16
+#define DEFAULT_GENERATED_MODEL "generated_model"
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t splitmix64_next(uint64_t* state) {
+    return mix64(*state += 0x9E3779B97F4A7C15ULL);
+}
+
+// Every row of every layer draws from its own stream, so the model only depends on the
+// seed and not on how rows are split between threads. Row 'rows' is the bias stream.
+static uint64_t row_stream(uint64_t seed, int layer, int row) {
+    return mix64(mix64(seed) ^ mix64(((uint64_t)(uint32_t)layer << 32) | (uint32_t)row));
+}
+
+// Resolved distribution of one layer
+typedef struct {
+    int normal;          // Normal instead of uniform
+    float spread;        // Half-range of a uniform, deviation of a normal
+    float bias_spread;   // 0 = zero biases
+} LayerDistribution;
+
+static LayerDistribution layer_distribution(const TinyNN_GeneratorOptions* options, int fan_in, int fan_out) {
+    LayerDistribution d;
+    float scale = options->scale > 0.0f ? options->scale : 1.0f;
+    switch (options->distribution) {
+        case TINYNN_DIST_NORMAL:
+            d.normal = 1;
+            d.spread = d.bias_spread = scale;
+            break;
+        case TINYNN_DIST_XAVIER:
+            d.normal = 0;
+            d.spread = sqrtf(6.0f / (float)(fan_in + fan_out));
+            d.bias_spread = 0.0f;
+            break;
+        case TINYNN_DIST_HE:
+            d.normal = 1;
+            d.spread = sqrtf(2.0f / (float)fan_in);
+            d.bias_spread = 0.0f;
+            break;
+        default:
+            d.normal = 0;
+            d.spread = d.bias_spread = scale;
+            break;
+    }
+    return d;
+}
+
+static void fill_random(uint64_t state, int normal, float spread, float* out, int count) {
+    if (!normal) {
+        for (int i = 0; i < count; i++) {
+            float u = (float)(splitmix64_next(&state) >> 40) * (1.0f / 16777216.0f);
+            out[i] = (2.0f * u - 1.0f) * spread;
+        }
+        return;
+    }
+    // Box-Muller: one 64-bit draw gives both uniforms and two normal values
+    for (int i = 0; i < count; i += 2) {
+        uint64_t x = splitmix64_next(&state);
+        float u1 = (float)((x >> 40) + 1) * (1.0f / 16777216.0f); // (0, 1], so the log is finite
+        float u2 = (float)(x & 0xFFFFFF) * (1.0f / 16777216.0f);
+        float r = sqrtf(-2.0f * logf(u1)) * spread;
+        float theta = 6.28318530718f * u2;
+        out[i] = r * cosf(theta);
+        if (i + 1 < count) out[i + 1] = r * sinf(theta);
+    }
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+// v * 10^power rounded to an integer, ties to even like printf
+static uint64_t scaled_digits(double v, int power) {
+    double scaled = v * powers_of_ten[power];
+    uint64_t digits = (uint64_t)scaled;
+    double fraction = scaled - (double)digits;
+    if (fraction > 0.5 || (fraction == 0.5 && (digits & 1))) digits++;
+    return digits;
+}
+
+// Writes 'value' like "%.9g" (9 significant digits read back as the same float) and
+// returns its length. Magnitudes in [1e-10, 1e9), where generated weights live, are
+// formatted directly, several times faster than printf; anything else goes to sprintf().
+static int format_float(float value, char* out) {
+    double v = fabs((double)value);
+    if (value == 0.0f) {
+        out[0] = '0';
+        return 1;
+    }
+    if (!(v >= 1e-10 && v < 1e9)) return sprintf(out, "%.9g", value);
+
+    // The 9 leading digits as an integer in [1e8, 1e9)
+    int exponent = (int)floor(log10(v));
+    if (exponent < -10) exponent = -10;
+    uint64_t digits = scaled_digits(v, 8 - exponent);
+    // log10() may be off by one next to a power of ten
+    if (digits >= 1000000000ULL || digits < 100000000ULL) {
+        exponent += digits >= 1000000000ULL ? 1 : -1;
+        if (exponent > 8 || exponent < -10) return sprintf(out, "%.9g", value);
+        digits = scaled_digits(v, 8 - exponent);
+    }
+
+    char d[9];
+    for (int i = 8; i >= 0; i--) {
+        d[i] = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+    int count = 9;
+    while (count > 1 && d[count - 1] == '0') count--;
+
+    char* p = out;
+    if (value < 0.0f) *p++ = '-';
+    if (exponent < -4) {
+        // Scientific notation, as "%g" uses below 1e-4
+        *p++ = d[0];
+        if (count > 1) {
+            *p++ = '.';
+            for (int i = 1; i < count; i++) *p++ = d[i];
+        }
+        *p++ = 'e';
+        *p++ = '-';
+        *p++ = (char)('0' + (-exponent) / 10);
+        *p++ = (char)('0' + (-exponent) % 10);
+    } else if (exponent < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exponent; i--) *p++ = '0';
+        for (int i = 0; i < count; i++) *p++ = d[i];
+    } else {
+        for (int i = 0; i <= exponent; i++) *p++ = i < count ? d[i] : '0';
+        if (count > exponent + 1) {
+            *p++ = '.';
+            for (int i = exponent + 1; i < count; i++) *p++ = d[i];
+        }
+    }
+    return (int)(p - out);
+}
+
+// Formats values as one CSV line
+static size_t format_csv_line(const float* values, int count, char* out) {
+    char* p = out;
+    for (int i = 0; i < count; i++) {
+        p += format_float(values[i], p);
+        *p++ = i + 1 < count ? ',' : '\n';
+    }
+    return (size_t)(p - out);
+}
+
+// One step: rows [first_row, first_row + row_count) of a layer
+typedef struct {
+    uint64_t seed;
+    int layer;
+    int cols;
+    LayerDistribution dist;
+    int first_row;
+    int row_count;
+    int rows_per_task;    // A multiple of PACK_PANEL_ROWS, so every task packs whole panels
+    float* weights;       // [row_count][cols]
+    float* packed;        // Panels of the step, or NULL
+    char** text;          // Per-task CSV text and its length, or NULL
+    size_t* text_length;
+} GenerateStep;
+
+static void generate_step_task(void* arg, int task) {
+    GenerateStep* step = (GenerateStep*)arg;
+    int begin = task * step->rows_per_task;
+    int end = begin + step->rows_per_task < step->row_count ? begin + step->rows_per_task : step->row_count;
+    float* weights = step->weights + (size_t)begin * step->cols;
+    for (int r = begin; r < end; r++) {
+        fill_random(row_stream(step->seed, step->layer, step->first_row + r), step->dist.normal, step->dist.spread,
+                    step->weights + (size_t)r * step->cols, step->cols);
+    }
+    if (step->packed) pack_layer(weights, end - begin, step->cols, step->packed + (size_t)begin * step->cols);
+    if (step->text) {
+        size_t length = 0;
+        for (int r = begin; r < end; r++) {
+            length += format_csv_line(step->weights + (size_t)r * step->cols, step->cols, step->text[task] + length);
+        }
+        step->text_length[task] = length;
+    }
+}
+
+static void generate_biases(const TinyNN_GeneratorOptions* options, int layer, int rows, LayerDistribution dist,
+                            float* biases) {
+    if (dist.bias_spread == 0.0f) {
+        memset(biases, 0, sizeof(float) * rows);
+    } else {
+        fill_random(row_stream(options->seed, layer, rows), dist.normal, dist.bias_spread, biases, rows);
+    }
+}
+
+static int check_generator_options(const TinyNN_GeneratorOptions* options) {
+    if (options->input_size <= 0 || options->num_layers <= 0 || options->layer_sizes == NULL) {
+        fprintf(stderr, "ERROR: A model needs an input size and at least one layer\n");
+        return 0;
+    }
+    for (int i = 0; i < options->num_layers; i++) {
+        if (options->layer_sizes[i] <= 0) {
+            fprintf(stderr, "ERROR: Layer %d has invalid size %d\n", i, options->layer_sizes[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Shared by both output formats: generates every layer step by step and hands each one
+// to 'write_step' (weights) and 'write_biases', in file order
+typedef struct {
+    FILE* fp;                     // CSV: the open weights file of the layer
+    TinyNN_BinaryWriter* writer;  // Binary
+    const char* model_dir;
+    int packed;
+} GenerateOutput;
+
+static int write_step(GenerateOutput* out, const GenerateStep* step, int tasks) {
+    if (out->writer) {
+        size_t count = step->packed ? packed_layer_floats(step->row_count, step->cols)
+                                    : (size_t)step->row_count * step->cols;
+        return write_binary_floats(out->writer, step->packed ? step->packed : step->weights, count);
+    }
+    for (int t = 0; t < tasks; t++) {
+        if (fwrite(step->text[t], 1, step->text_length[t], out->fp) != step->text_length[t]) return 0;
+    }
+    return 1;
+}
+
+static int begin_csv_layer(GenerateOutput* out, int layer) {
+    char filepath[SAFE_PATH_MAX];
+    snprintf(filepath, sizeof(filepath), "%s/layer_%d_weights.csv", out->model_dir, layer);
+    out->fp = fopen(filepath, "wb");
+    if (!out->fp) {
+        fprintf(stderr, "ERROR: Could not create %s\n", filepath);
+        return 0;
+    }
+    return 1;
+}
+
+static int write_biases(GenerateOutput* out, int layer, const float* biases, int rows, char* text) {
+    if (out->writer) return write_binary_floats(out->writer, biases, rows);
+
+    int ok = fclose(out->fp) == 0;
+    out->fp = NULL;
+    char filepath[SAFE_PATH_MAX];
+    snprintf(filepath, sizeof(filepath), "%s/layer_%d_biases.csv", out->model_dir, layer);
+    FILE* fp = fopen(filepath, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERROR: Could not create %s\n", filepath);
+        return 0;
+    }
+    size_t length = format_csv_line(biases, rows, text);
+    if (fwrite(text, 1, length, fp) != length) ok = 0;
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+// Rows per step: whole panels, about GENERATOR_STEP_FLOATS weights
+static int step_rows_for(int rows, int cols) {
+    int step_rows = (int)(GENERATOR_STEP_FLOATS / cols) / PACK_PANEL_ROWS * PACK_PANEL_ROWS;
+    if (step_rows < PACK_PANEL_ROWS) step_rows = PACK_PANEL_ROWS;
+    return step_rows < rows ? step_rows : rows;
+}
+
+// Rows per task: the step split evenly between the threads, rounded up to whole panels
+static int task_rows_for(int step_rows, int threads) {
+    int per_task = (step_rows + threads - 1) / threads;
+    return (per_task + PACK_PANEL_ROWS - 1) / PACK_PANEL_ROWS * PACK_PANEL_ROWS;
+}
+
+static int generate_layers(const TinyNN_GeneratorOptions* options, GenerateOutput* out) {
+    TinyNN_ThreadPool* pool = create_thread_pool(options->num_threads);
+    if (!pool) return 0;
+    int threads = thread_pool_size(pool);
+
+    // Buffers sized for the biggest step and task of any layer
+    int prev_layer_size = options->input_size;
+    size_t max_step_floats = 0;
+    size_t max_task_floats = 0;
+    int max_rows = 0;
+    for (int i = 0; i < options->num_layers; i++) {
+        int cols = prev_layer_size;
+        int rows = options->layer_sizes[i];
+        int step_rows = step_rows_for(rows, cols);
+        size_t step_floats = packed_layer_floats(step_rows, cols);
+        size_t task_floats = (size_t)task_rows_for(step_rows, threads) * cols;
+        if (step_floats > max_step_floats) max_step_floats = step_floats;
+        if (task_floats > max_task_floats) max_task_floats = task_floats;
+        if (rows > max_rows) max_rows = rows;
+        prev_layer_size = rows;
+    }
+
+    int csv = out->writer == NULL;
+    float* weights = (float*)aligned_malloc(sizeof(float) * max_step_floats, 64);
+    float* packed = out->packed ? (float*)aligned_malloc(sizeof(float) * max_step_floats, 64) : NULL;
+    float* biases = (float*)malloc(sizeof(float) * max_rows);
+    size_t text_capacity = max_task_floats * CSV_VALUE_CHARS + 1;
+    char* text_block = csv ? (char*)malloc(text_capacity * threads) : NULL;
+    char** text = csv ? (char**)malloc(sizeof(char*) * threads) : NULL;
+    size_t* text_length = csv ? (size_t*)calloc(threads, sizeof(size_t)) : NULL;
+    char* bias_text = csv ? (char*)malloc((size_t)max_rows * CSV_VALUE_CHARS + 1) : NULL;
+    int ok = weights && biases && (!out->packed || packed) && (!csv || (text_block && text && text_length && bias_text));
+    if (!ok) fprintf(stderr, "ERROR: Out of memory while generating the model\n");
+    for (int t = 0; ok && csv && t < threads; t++) text[t] = text_block + text_capacity * t;
+
+    prev_layer_size = options->input_size;
+    for (int i = 0; ok && i < options->num_layers; i++) {
+        int cols = prev_layer_size;
+        int rows = options->layer_sizes[i];
+        GenerateStep step;
+        memset(&step, 0, sizeof(step));
+        step.seed = options->seed;
+        step.layer = i;
+        step.cols = cols;
+        step.dist = layer_distribution(options, cols, rows);
+        step.weights = weights;
+        step.packed = packed;
+        step.text = text;
+        step.text_length = text_length;
+
+        int step_rows = step_rows_for(rows, cols);
+        if (csv) ok = begin_csv_layer(out, i);
+        for (int first = 0; ok && first < rows; first += step_rows) {
+            step.first_row = first;
+            step.row_count = rows - first < step_rows ? rows - first : step_rows;
+            step.rows_per_task = task_rows_for(step.row_count, threads);
+            int tasks = (step.row_count + step.rows_per_task - 1) / step.rows_per_task;
+            thread_pool_run(pool, generate_step_task, &step, tasks);
+            ok = write_step(out, &step, tasks);
+        }
+        if (ok) {
+            generate_biases(options, i, rows, step.dist, biases);
+            ok = write_biases(out, i, biases, rows, bias_text);
+        }
+        if (out->fp) {
+            fclose(out->fp);
+            out->fp = NULL;
+        }
+        if (!ok) fprintf(stderr, "ERROR: Failed to write layer %d\n", i);
+        prev_layer_size = rows;
+    }
+
+    aligned_free(weights);
+    aligned_free(packed);
+    free(biases);
+    free(text_block);
+    free(text);
+    free(text_length);
+    free(bias_text);
+    free_thread_pool(pool);
+    return ok;
+}
+
+int generate_model_csv(const char* model_dir, const TinyNN_GeneratorOptions* options) {
+    if (!check_generator_options(options)) return 0;
+    if (MKDIR(model_dir) != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: Could not create directory '%s'\n", model_dir);
+        return 0;
+    }
+
+    char filepath[SAFE_PATH_MAX];
+    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", model_dir);
+    FILE* fp = fopen(filepath, "w");
+    if (!fp) {
+        fprintf(stderr, "ERROR: Could not create %s\n", filepath);
+        return 0;
+    }
+    fprintf(fp, "%d\n%d\n%d\n", options->input_size, options->layer_sizes[options->num_layers - 1],
+            options->num_layers - 1);
+    for (int i = 0; i < options->num_layers; i++) fprintf(fp, "%d\n", options->layer_sizes[i]);
+    if (fclose(fp) != 0) return 0;
+
+    GenerateOutput out;
+    memset(&out, 0, sizeof(out));
+    out.model_dir = model_dir;
+    return generate_layers(options, &out);
+}
+
+int generate_model_binary(const char* filepath, const TinyNN_GeneratorOptions* options) {
+    if (!check_generator_options(options)) return 0;
+    GenerateOutput out;
+    memset(&out, 0, sizeof(out));
+    // Stored the way the loader would lay the model out anyway
+    out.packed = packing_enabled();
+    out.writer = open_binary_writer(filepath, options->input_size, options->num_layers, options->layer_sizes, NULL,
+                                    out.packed);
+    if (!out.writer) return 0;
+    int ok = generate_layers(options, &out);
+    // Closing after a failure removes the partial file
+    return close_binary_writer(out.writer) && ok;
+}
+
+int parse_distribution(const char* name, TinyNN_Distribution* distribution) {
+    static const char* names[] = {"uniform", "normal", "xavier", "he"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *distribution = (TinyNN_Distribution)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// --- Command line ---
+
+static void print_generate_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s generate -o <name> (-l <sizes> -i <n> | --preset <name>) [options]\n"
+        "Generates a model with random weights.\n"
+        "\n"
+        "  -o, --output <name>         Model name (written to models/<name>), a directory path,\n"
+        "                              or a file ending in .tnn for a single binary file\n"
+        "  -i, --input <n>             Input size\n"
+        "  -l, --layers <sizes>        Comma-separated layer sizes, the last one being the output\n"
+        "                              size, e.g. 4096,4096,10\n"
+        "  -p, --preset <name>         Take the shape from a preset (Micro, Small, Medium, Large, Huge)\n"
+        "  -s, --seed <n>              Random seed; the same seed gives the same model (default 1)\n"
+        "  -d, --dist <name>           uniform, normal, xavier or he (default uniform)\n"
+        "      --scale <x>             Range of uniform and deviation of normal weights (default 1)\n"
+        "  -f, --format <csv|tnn>      Format of a model directory (default csv)\n"
+        "  -t, --threads <n>           Generator threads, 0 = one per CPU (default 0)\n"
+        "      --force                 Overwrite an existing model\n"
+        "  -h, --help                  Show this help\n",
+        program);
+}
+
+// Returns 1 if argv[*i] is 'short_name' or 'long_name' and stores the following argument
+static int flag_value(int argc, char** argv, int* i, const char* short_name, const char* long_name,
+                      const char** value) {
+    if (!(short_name && strcmp(argv[*i], short_name) == 0) && strcmp(argv[*i], long_name) != 0) return 0;
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "ERROR: %s needs a value\n", argv[*i]);
+        *value = NULL;
+        return 1;
+    }
+    *value = argv[++*i];
+    return 1;
+}
+
+// Parses "4096,4096,10". Returns the malloc'd sizes, or NULL if the list is malformed.
+static int* parse_layer_sizes(const char* text, int* count) {
+    int n = 1;
+    for (const char* p = text; *p; p++) n += *p == ',';
+    int* sizes = (int*)malloc(sizeof(int) * n);
+    if (!sizes) return NULL;
+    const char* p = text;
+    for (int i = 0; i < n; i++) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || value > INT32_MAX || (*end != ',' && *end != '\0')) {
+            free(sizes);
+            return NULL;
+        }
+        sizes[i] = (int)value;
+        p = end + 1;
+    }
+    *count = n;
+    return sizes;
+}
+
+static int has_suffix(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int join_path(char* dest, size_t dest_size, const char* base, const char* component) {
+    int written = snprintf(dest, dest_size, "%s/%s", base, component);
+    if (written < 0 || (size_t)written >= dest_size) {
+        fprintf(stderr, "ERROR: Path '%s' is too long\n", base);
+        return 0;
+    }
+    return 1;
+}
+
+static int path_exists(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp) fclose(fp);
+    return fp != NULL;
+}
+
+// Removes the files of a model directory (either format) for --force, and nothing else:
+// the directory may be one the user keeps other files in
+static void remove_model_files(const char* dir) {
+    char filepath[SAFE_PATH_MAX];
+    if (join_path(filepath, sizeof(filepath), dir, TNN_DIR_FILENAME)) remove(filepath);
+    if (join_path(filepath, sizeof(filepath), dir, "architecture.txt")) remove(filepath);
+    for (int i = 0;; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "layer_%d_weights.csv", i);
+        int weights = join_path(filepath, sizeof(filepath), dir, name) && remove(filepath) == 0;
+        snprintf(name, sizeof(name), "layer_%d_biases.csv", i);
+        int biases = join_path(filepath, sizeof(filepath), dir, name) && remove(filepath) == 0;
+        if (!weights && !biases) break;
+    }
+}
+
+int run_generate_mode(int argc, char** argv) {
+    TinyNN_GeneratorOptions options;
+    memset(&options, 0, sizeof(options));
+    options.seed = 1;
+    options.distribution = TINYNN_DIST_UNIFORM;
+    const char* output = NULL;
+    const char* format = "csv";
+    int force = 0;
+    int* sizes = NULL;
+    const ModelPreset* preset = NULL;
+    int ok = 1;
+
+    for (int i = 1; ok && i < argc; i++) {
+        const char* value = NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            ok = 0;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = 1;
+        } else if (flag_value(argc, argv, &i, "-o", "--output", &value)) {
+            ok = value != NULL;
+            output = value;
+        } else if (flag_value(argc, argv, &i, "-i", "--input", &value)) {
+            if (!value || (options.input_size = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --input needs a positive size\n");
+                ok = 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-l", "--layers", &value)) {
+            free(sizes);
+            sizes = value ? parse_layer_sizes(value, &options.num_layers) : NULL;
+            if (!sizes) {
+                fprintf(stderr, "ERROR: --layers needs positive sizes separated by commas\n");
+                ok = 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-p", "--preset", &value)) {
+            if (!value || !(preset = find_model_preset(value))) {
+                fprintf(stderr, "ERROR: Unknown preset '%s'\n", value ? value : "");
+                ok = 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-s", "--seed", &value)) {
+            ok = value != NULL;
+            if (ok) options.seed = strtoull(value, NULL, 10);
+        } else if (flag_value(argc, argv, &i, "-d", "--dist", &value)) {
+            if (!value || !parse_distribution(value, &options.distribution)) {
+                fprintf(stderr, "ERROR: Unknown distribution '%s'\n", value ? value : "");
+                ok = 0;
+            }
+        } else if (flag_value(argc, argv, &i, NULL, "--scale", &value)) {
+            if (!value || (options.scale = (float)atof(value)) <= 0.0f) {
+                fprintf(stderr, "ERROR: --scale needs a positive number\n");
+                ok = 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-f", "--format", &value)) {
+            if (!value || (strcmp(value, "csv") != 0 && strcmp(value, "tnn") != 0)) {
+                fprintf(stderr, "ERROR: --format must be csv or tnn\n");
+                ok = 0;
+            }
+            format = value;
+        } else if (flag_value(argc, argv, &i, "-t", "--threads", &value)) {
+            ok = value != NULL;
+            if (ok) options.num_threads = atoi(value);
+        } else {
+            fprintf(stderr, "ERROR: Unknown argument '%s'\n", argv[i]);
+            ok = 0;
+        }
+    }
+    if (ok && preset) {
+        if (!options.input_size) options.input_size = preset->input_size;
+        if (!sizes) {
+            options.num_layers = preset->num_layers;
+            options.layer_sizes = preset->layer_sizes;
+        }
+    }
+    if (sizes) options.layer_sizes = sizes;
+    if (ok && (!output || !options.input_size || !options.layer_sizes)) {
+        fprintf(stderr, "ERROR: Give an output name and a shape (--input and --layers, or --preset)\n");
+        ok = 0;
+    }
+    if (!ok) {
+        print_generate_usage("tinynn");
+        free(sizes);
+        return 1;
+    }
+
+    // A bare name goes into models/, like the models the interactive generator makes
+    char path[SAFE_PATH_MAX];
+    int binary_file = has_suffix(output, ".tnn");
+    if (binary_file || strchr(output, '/') || strchr(output, '\\')) {
+        snprintf(path, sizeof(path), "%s", output);
+    } else {
+        MKDIR("models");
+        snprintf(path, sizeof(path), "models/%s", output);
+    }
+    int tnn = strcmp(format, "tnn") == 0;
+    char target[SAFE_PATH_MAX];
+    char other[SAFE_PATH_MAX]; // The other format's file would shadow or outlive the new model
+    if (binary_file) {
+        snprintf(target, sizeof(target), "%s", path);
+        other[0] = '\0';
+    } else if (!join_path(target, sizeof(target), path, tnn ? TNN_DIR_FILENAME : "architecture.txt") ||
+               !join_path(other, sizeof(other), path, tnn ? "architecture.txt" : TNN_DIR_FILENAME)) {
+        free(sizes);
+        return 1;
+    }
+    if (!force && (path_exists(target) || (!binary_file && path_exists(other)))) {
+        fprintf(stderr, "ERROR: '%s' already holds a model; use --force to overwrite it\n", path);
+        free(sizes);
+        return 1;
+    }
+    if (force && !binary_file) remove_model_files(path);
+
+    double bytes = 0.0;
+    int prev_layer_size = options.input_size;
+    for (int i = 0; i < options.num_layers; i++) {
+        bytes += ((double)prev_layer_size + 1.0) * options.layer_sizes[i] * sizeof(float);
+        prev_layer_size = options.layer_sizes[i];
+    }
+    double start = get_time_seconds();
+    if (binary_file) {
+        ok = generate_model_binary(path, &options);
+    } else if (tnn) {
+        ok = (MKDIR(path) == 0 || errno == EEXIST) && generate_model_binary(target, &options);
+    } else {
+        ok = generate_model_csv(path, &options);
+    }
+    double seconds = get_time_seconds() - start;
+    if (ok) {
+        fprintf(stderr, "Generated %s: %d layers, %.1f MB of weights in %.2f s (%.0f MB/s)\n",
+                path, options.num_layers, bytes / 1e6, seconds,
+                seconds > 0.0 ? bytes / 1e6 / seconds : 0.0);
+    }
+    free(sizes);
+    return ok ? 0 : 1;
+}
+
+void run_model_generator(void) {
+    printf("\n========================\n");
+    printf("    \033[35mModel Generator\033[0m\n");
+    printf("========================\n");
+    printf("Please choose a model preset to generate\n");
+    printf("Keep in mind that the bigger the model, the more storage it needs:\n");
+    for (int i = 0; i < num_presets; i++) {
+        // Calculate color gradient (green to red)
+        int red = (255 * i) / (num_presets - 1);
+        int green = 255 - red;
+        printf("\033[38;2;%d;%d;0m", red, green);
+        printf("  %d. %s (Input: %d, Output: %d, Layers: %d)\033[0m\n",
+               i + 1, presets[i].name, presets[i].input_size, presets[i].output_size, presets[i].num_layers);
+    }
+    
+    int choice = 0;
+    while (choice < 1 || choice > num_presets) {
+        printf("\nEnter your choice (1-%d): ", num_presets);
+        if (scanf("%d", &choice) != 1) {
+            while(getchar() != '\n'); // Clear invalid input
+        }
+    }
+    while (getchar() != '\n'); // Rest of the line, before reading the name
+    const ModelPreset* preset = &presets[choice - 1];
+
+    char name[128];
+    printf("Model name [%s]: ", DEFAULT_GENERATED_MODEL);
+    if (!fgets(name, sizeof(name), stdin)) name[0] = '\0';
+    name[strcspn(name, "\r\n")] = '\0';
+    if (name[0] == '\0') snprintf(name, sizeof(name), "%s", DEFAULT_GENERATED_MODEL);
+    if (strchr(name, '/') || strchr(name, '\\') || strcmp(name, "..") == 0 || strcmp(name, ".") == 0) {
+        fprintf(stderr, "Error: '%s' is not a valid model name.\n", name);
+        return;
+    }
+
+    char model_dir[SAFE_PATH_MAX];
+    snprintf(model_dir, sizeof(model_dir), "models/%s", name);
+    MKDIR("models");
+    clear_directory(model_dir);
+
+    TinyNN_GeneratorOptions options;
+    memset(&options, 0, sizeof(options));
+    options.input_size = preset->input_size;
+    options.num_layers = preset->num_layers;
+    options.layer_sizes = preset->layer_sizes;
+    options.seed = (unsigned long long)time(NULL);
+    options.distribution = TINYNN_DIST_UNIFORM;
+    if (!generate_model_csv(model_dir, &options)) {
+        fprintf(stderr, "Error: Could not generate the model in '%s'.\n", model_dir);
+        return;
+    }
+    printf("\033[32m Saved %s with %d layers (seed %llu)\033[0m\n", model_dir, preset->num_layers, options.seed);
+    printf("\nModel generation complete!\n");
+}
@@ -1,6 +1,71 @@
-#ifndef GENERATE_MODEL_H
-#define GENERATE_MODEL_H
-
-void run_model_generator();
-
+#ifndef GENERATE_MODEL_H
+#define GENERATE_MODEL_H
+
+#include "model.h"
+
+// A built-in model shape offered by the generator
+typedef struct {
+    const char* name;
+    int input_size;
+    int output_size;
+    int num_layers;         // Including the output layer
+    const int* layer_sizes;
+} ModelPreset;
+
+// Interactive generator: asks for a preset and a model name, then writes models/<name>
+void run_model_generator(void);
+
+int model_preset_count(void);
+// Returns preset 'index' (0 = Micro), or NULL if out of range
+const ModelPreset* get_model_preset(int index);
+// Finds a preset by name, ignoring case. Returns NULL if there is none.
+const ModelPreset* find_model_preset(const char* name);
+
+/**
+ * @brief Builds an fp32 model in memory with weights and biases drawn uniformly from [-1, 1],
+ * without touching the disk. The same seed always gives the same model.
+ * @param layer_sizes 'num_layers' sizes, the last one being the output size.
+ * @return The model (release with free_model()), or NULL on failure.
+ */
+TinyNN_Model* create_random_model(int input_size, int num_layers, const int* layer_sizes, unsigned int seed);
+
+// Weight distributions of the scalable generator
+typedef enum {
+    TINYNN_DIST_UNIFORM,    // Uniform in [-scale, scale], biases too
+    TINYNN_DIST_NORMAL,     // Normal with mean 0 and deviation 'scale', biases too
+    TINYNN_DIST_XAVIER,     // Uniform in +-sqrt(6 / (fan_in + fan_out)), zero biases
+    TINYNN_DIST_HE          // Normal with deviation sqrt(2 / fan_in), zero biases
+} TinyNN_Distribution;
+
+typedef struct {
+    int input_size;
+    int num_layers;             // Including the output layer
+    const int* layer_sizes;
+    unsigned long long seed;
+    TinyNN_Distribution distribution;
+    float scale;                // For uniform and normal; <= 0 means 1
+    int num_threads;            // <= 0 uses one per logical CPU
+} TinyNN_GeneratorOptions;
+
+// Parses "uniform", "normal", "xavier" or "he". Returns 0 for any other name.
+int parse_distribution(const char* name, TinyNN_Distribution* distribution);
+
+/**
+ * @brief Generates a model of any size without holding it in memory. Rows are drawn in
+ * parallel from per-row random streams derived from the seed, so the same options give
+ * the same weights on any number of threads, and written out in large blocks.
+ * generate_model_csv() writes a model directory in the text format (values printed with
+ * 9 significant digits, which read back exactly); generate_model_binary() writes one .tnn file.
+ * @return 1 on success, 0 on failure (a partial .tnn file is removed).
+ */
+int generate_model_csv(const char* model_dir, const TinyNN_GeneratorOptions* options);
+int generate_model_binary(const char* filepath, const TinyNN_GeneratorOptions* options);
+
+/**
+ * @brief Entry point of 'tinynn generate': builds TinyNN_GeneratorOptions from the
+ * command line. argv[0] is "generate".
+ * @return The process exit code.
+ */
+int run_generate_mode(int argc, char** argv);
+
 #endif
\ No newline at end of file
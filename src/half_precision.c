@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "half_precision.h"
+#include "utils.h"
+#include "pack.h"
+#include "sparse.h"
+
+int convert_weights_to_half(TinyNN_Model* model, TinyNN_WeightType type) {
+    if (model == NULL || model->weight_type != TINYNN_WEIGHTS_FP32 ||
+        (type != TINYNN_WEIGHTS_FP16 && type != TINYNN_WEIGHTS_BF16)) {
+        fprintf(stderr, "ERROR: Only fp32 models can be converted to FP16/BF16 storage\n");
+        return 0;
+    }
+
+    if (!unpack_model_weights(model) || !densify_model_weights(model)) return 0;
+
+    int total_layers = model->hidden_layers + 1;
+    uint16_t** half_weights = (uint16_t**)calloc(total_layers, sizeof(uint16_t*));
+    if (!half_weights) return 0;
+
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        size_t count = (size_t)model->layer_sizes[i] * prev_layer_size;
+        half_weights[i] = (uint16_t*)aligned_malloc(sizeof(uint16_t) * count, 64);
+        if (!half_weights[i]) {
+            for (int j = 0; j < i; j++) aligned_free(half_weights[j]);
+            free(half_weights);
+            return 0;
+        }
+        const float* w = model->weights[i];
+        if (type == TINYNN_WEIGHTS_FP16) {
+            for (size_t k = 0; k < count; k++) half_weights[i][k] = float_to_half(w[k]);
+        } else {
+            for (size_t k = 0; k < count; k++) half_weights[i][k] = float_to_bfloat16(w[k]);
+        }
+        prev_layer_size = model->layer_sizes[i];
+    }
+
+    // Drop the fp32 weights; mapped ones go away with the mapping in free_model()
+    for (int i = 0; i < total_layers; i++) {
+        if (!points_into_mapping(model, model->weights[i])) free(model->weights[i]);
+        model->weights[i] = NULL;
+    }
+    model->half_weights = half_weights;
+    model->owns_half_weights = 1;
+    model->weight_type = type;
+    return 1;
+}
@@ -0,0 +1,77 @@
+#ifndef HALF_PRECISION_H
+#define HALF_PRECISION_H
+
+#include <stdint.h>
+#include <string.h>
+#include "model.h"
+
+// Scalar conversions between fp32 and the 16-bit storage formats. They are inline
+// because the portable dense kernels call them once per weight.
+
+// IEEE 754 binary16 -> binary32. Exact for every input, including subnormals, inf and NaN:
+// the exponent and mantissa are moved into fp32 position and rescaled by 2^112, which
+// also normalizes subnormals, then inf/NaN get the all-ones fp32 exponent back.
+static inline float half_to_float(uint16_t h) {
+    uint32_t magnitude = (uint32_t)(h & 0x7fff) << 13;
+    float f;
+    memcpy(&f, &magnitude, 4);
+    f *= 0x1p112f;
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    if (magnitude >= 0x0f800000) bits |= 0x7f800000;
+    bits |= (uint32_t)(h & 0x8000) << 16;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// binary32 -> binary16 with round-to-nearest-even; out-of-range values become +-inf.
+static inline uint16_t float_to_half(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t abs_bits = bits & 0x7fffffff;
+    if (abs_bits >= 0x7f800000) {
+        return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0); // inf / quiet NaN
+    }
+    if (abs_bits >= 0x477ff000) return sign | 0x7c00;               // rounds past 65504
+    if (abs_bits < 0x38800000) {
+        // Result is subnormal (or zero): shift the full mantissa into place and round
+        if (abs_bits < 0x33000000) return sign;
+        uint32_t exponent = abs_bits >> 23;
+        uint32_t mantissa = (abs_bits & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+        return sign | (uint16_t)half;
+    }
+    uint32_t rounded = abs_bits + 0xfff + ((abs_bits >> 13) & 1);
+    return sign | (uint16_t)((rounded - 0x38000000) >> 13);
+}
+
+// bfloat16 is the top half of a binary32, so widening is a shift.
+static inline float bfloat16_to_float(uint16_t b) {
+    uint32_t bits = (uint32_t)b << 16;
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// binary32 -> bfloat16 with round-to-nearest-even, keeping NaNs quiet.
+static inline uint16_t float_to_bfloat16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    if ((bits & 0x7fffffff) > 0x7f800000) return (uint16_t)((bits >> 16) | 0x40);
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+}
+
+/**
+ * @brief Converts the fp32 weights of a loaded model to FP16 or BF16 storage in place.
+ * Biases stay in fp32 and the fp32 weight arrays are released afterwards.
+ * @return 1 on success, 0 on failure (the model is left unchanged).
+ */
+int convert_weights_to_half(TinyNN_Model* model, TinyNN_WeightType type);
+
+#endif
@@ -0,0 +1,1707 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "kernels.h"
+#include "half_precision.h"
+#include "utils.h"
+
+// x86 SIMD variants are compiled per-function with target attributes, so the rest
+// of the project keeps building with plain flags and the choice is made at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define TINYNN_X86 1
+    #include <immintrin.h>
+    #include <cpuid.h>
+    #define TARGET(isa) __attribute__((target(isa)))
+    #define FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define TINYNN_X86 1
+    #include <immintrin.h>
+    #include <intrin.h>
+    #define TARGET(isa)
+    #define FORCE_INLINE __forceinline
+#endif
+
+// Whether the SIMD sets use the exp/sigmoid/tanh approximations (see set_fast_math())
+static int fast_math = 1;
+
+void set_fast_math(int enabled) {
+    fast_math = enabled != 0;
+}
+
+int fast_math_enabled(void) {
+    return fast_math;
+}
+
+// --- Portable fallback ---
+
+// Elementwise activation of one finished output (see TinyNN_Activation)
+static inline float activate(float x, int activation) {
+    switch (activation) {
+        case TINYNN_ACT_RELU:    return x > 0.0f ? x : 0.0f;
+        case TINYNN_ACT_SIGMOID: return 1.0f / (1.0f + expf(-x));
+        case TINYNN_ACT_TANH:    return tanhf(x);
+        default:                 return x;
+    }
+}
+
+static void activate_array_portable(float* values, int count, int activation) {
+    if (activation == TINYNN_ACT_NONE || activation == TINYNN_ACT_SOFTMAX) return;
+    for (int i = 0; i < count; i++) values[i] = activate(values[i], activation);
+}
+
+static void dense_portable(const float* weights, const float* biases, const float* input,
+                           float* output, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j++) {
+        const float* w = weights + (size_t)j * cols;
+        // Four independent accumulators break the serial dependency on one sum
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+        int k = 0;
+        for (; k + 4 <= cols; k += 4) {
+            s0 += w[k + 0] * input[k + 0];
+            s1 += w[k + 1] * input[k + 1];
+            s2 += w[k + 2] * input[k + 2];
+            s3 += w[k + 3] * input[k + 3];
+        }
+        for (; k < cols; k++) {
+            s0 += w[k] * input[k];
+        }
+        float sum = (s0 + s1) + (s2 + s3) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+static void dense_int8_portable(const int8_t* weights, const float* row_scales, const float* biases,
+                                const int8_t* input, float input_scale, float* output,
+                                int rows, int padded_cols, int activation) {
+    for (int j = 0; j < rows; j++) {
+        const int8_t* w = weights + (size_t)j * padded_cols;
+        // Integer addition is associative, so the compiler is free to vectorize this reduction
+        int32_t dot = 0;
+        for (int k = 0; k < padded_cols; k++) {
+            dot += (int32_t)w[k] * input[k];
+        }
+        float sum = (float)dot * row_scales[j] * input_scale + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+// FP16/BF16 weights are widened one at a time with the scalar conversions
+static void dense_half_portable(const uint16_t* weights, const float* biases, const float* input,
+                                float* output, int rows, int cols, int activation, int bf16) {
+    for (int j = 0; j < rows; j++) {
+        const uint16_t* w = weights + (size_t)j * cols;
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+        int k = 0;
+        if (bf16) {
+            for (; k + 4 <= cols; k += 4) {
+                s0 += bfloat16_to_float(w[k + 0]) * input[k + 0];
+                s1 += bfloat16_to_float(w[k + 1]) * input[k + 1];
+                s2 += bfloat16_to_float(w[k + 2]) * input[k + 2];
+                s3 += bfloat16_to_float(w[k + 3]) * input[k + 3];
+            }
+            for (; k < cols; k++) s0 += bfloat16_to_float(w[k]) * input[k];
+        } else {
+            for (; k + 4 <= cols; k += 4) {
+                s0 += half_to_float(w[k + 0]) * input[k + 0];
+                s1 += half_to_float(w[k + 1]) * input[k + 1];
+                s2 += half_to_float(w[k + 2]) * input[k + 2];
+                s3 += half_to_float(w[k + 3]) * input[k + 3];
+            }
+            for (; k < cols; k++) s0 += half_to_float(w[k]) * input[k];
+        }
+        float sum = (s0 + s1) + (s2 + s3) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+static void dense_fp16_portable(const uint16_t* weights, const float* biases, const float* input,
+                                float* output, int rows, int cols, int activation) {
+    dense_half_portable(weights, biases, input, output, rows, cols, activation, 0);
+}
+
+static void dense_bf16_portable(const uint16_t* weights, const float* biases, const float* input,
+                                float* output, int rows, int cols, int activation) {
+    dense_half_portable(weights, biases, input, output, rows, cols, activation, 1);
+}
+
+// Packed layers: the accumulator for each row runs over k in order, in every kernel tier's
+// matrix-matrix path and in the portable matrix-vector path alike.
+
+static void dense_packed_portable(const float* panels, const float* biases, const float* input,
+                                  float* output, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        float acc[PACK_PANEL_ROWS] = {0.0f};
+        for (int k = 0; k < cols; k++) {
+            float x = input[k];
+            for (int r = 0; r < PACK_PANEL_ROWS; r++) acc[r] += p[(size_t)k * PACK_PANEL_ROWS + r] * x;
+        }
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        for (int r = 0; r < valid; r++) {
+            float sum = acc[r] + biases[j + r];
+            output[j + r] = activate(sum, activation);
+        }
+    }
+}
+
+// Tiles of 4 samples x one panel
+static void gemm_packed_portable(const float* panels, const float* biases, const float* input,
+                                 int input_stride, float* output, int output_stride,
+                                 int samples, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        for (int n = 0; n < samples; n += 4) {
+            int tile = samples - n < 4 ? samples - n : 4;
+            const float* x = input + (size_t)n * input_stride;
+            float acc[4][PACK_PANEL_ROWS] = {{0.0f}};
+            for (int k = 0; k < cols; k++) {
+                const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+                for (int s = 0; s < tile; s++) {
+                    float xs = x[(size_t)s * input_stride + k];
+                    for (int r = 0; r < PACK_PANEL_ROWS; r++) acc[s][r] += w[r] * xs;
+                }
+            }
+            for (int s = 0; s < tile; s++) {
+                float* y = output + (size_t)(n + s) * output_stride + j;
+                for (int r = 0; r < valid; r++) {
+                    float sum = acc[s][r] + biases[j + r];
+                    y[r] = activate(sum, activation);
+                }
+            }
+        }
+    }
+}
+
+// Sparse layers: each block row accumulates its blocks in order, with one accumulator per
+// row (per row and sample in the tile kernels).
+
+static void sparse_portable(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                            int block_rows, const float* biases, const float* input,
+                            float* output, int rows, int activation) {
+    for (int j = 0, b = 0; j < rows; j += block_rows, b++) {
+        float acc[SPARSE_MAX_BLOCK_ROWS] = {0.0f};
+        for (int32_t i = block_ptr[b]; i < block_ptr[b + 1]; i++) {
+            const float* v = values + (size_t)i * block_rows;
+            float x = input[columns[i]];
+            for (int r = 0; r < block_rows; r++) acc[r] += v[r] * x;
+        }
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        for (int r = 0; r < valid; r++) {
+            output[j + r] = activate(acc[r] + biases[j + r], activation);
+        }
+    }
+}
+
+static void sparse_tile_portable(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                                 int block_rows, const float* biases, const float* tile, int samples,
+                                 float* output, int output_stride, int rows, int activation) {
+    for (int j = 0, b = 0; j < rows; j += block_rows, b++) {
+        float acc[SPARSE_MAX_BLOCK_ROWS][SPARSE_TILE_SAMPLES] = {{0.0f}};
+        for (int32_t i = block_ptr[b]; i < block_ptr[b + 1]; i++) {
+            const float* v = values + (size_t)i * block_rows;
+            const float* x = tile + (size_t)columns[i] * SPARSE_TILE_SAMPLES;
+            for (int r = 0; r < block_rows; r++) {
+                for (int s = 0; s < SPARSE_TILE_SAMPLES; s++) acc[r][s] += v[r] * x[s];
+            }
+        }
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        for (int s = 0; s < samples; s++) {
+            float* y = output + (size_t)s * output_stride + j;
+            for (int r = 0; r < valid; r++) y[r] = activate(acc[r][s] + biases[j + r], activation);
+        }
+    }
+}
+
+float quantize_activations(const float* input, int count, int padded_count, float scale, int8_t* output) {
+    if (scale <= 0.0f) {
+        float max_abs = 0.0f;
+        for (int k = 0; k < count; k++) {
+            float a = fabsf(input[k]);
+            if (a > max_abs) max_abs = a;
+        }
+        scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+    }
+    float inverse = 1.0f / scale;
+    for (int k = 0; k < count; k++) {
+        float q = input[k] * inverse;
+        // -127..127 keeps |q| within 7 bits, which the pmaddubsw path relies on
+        if (q > 127.0f) q = 127.0f;
+        if (q < -127.0f) q = -127.0f;
+        output[k] = (int8_t)lrintf(q);
+    }
+    memset(output + count, 0, (size_t)(padded_count - count));
+    return scale;
+}
+
+#ifdef TINYNN_X86
+
+// --- Fast math: exp, sigmoid and tanh of a whole register (see set_fast_math()) ---
+
+// exp(x) = 2^n * exp(r) with n = round(x * log2(e)) and r = x - n * ln(2), |r| <= ln(2)/2.
+// ln(2) is split in two so n * LN2_HI is exact. Inputs are clamped so 2^n stays a normal
+// float; NaN passes through.
+#define EXP_MIN_INPUT -87.3365447f   // ln(FLT_MIN)
+#define EXP_MAX_INPUT 88.0f          // n <= 127
+#define EXP_LOG2E 1.44269504f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+// exp(r) ~= 1 + r + r^2 * (P5 + r * (P4 + ... + r * P0)) on [-ln(2)/2, ln(2)/2] (Cephes expf)
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+// Below this |x|, tanh(x) = x + x^3 * (T3 + x^2 * (T5 + x^2 * (T7 + x^2 * T9))) avoids the
+// cancellation in 1 - exp(-2|x|)
+#define TANH_SERIES_LIMIT 0.25f
+#define TANH_T3 -3.33333333e-1f
+#define TANH_T5 1.33333333e-1f
+#define TANH_T7 -5.39682540e-2f
+#define TANH_T9 2.18694885e-2f
+
+TARGET("sse2")
+static inline __m128 exp_sse2(__m128 x) {
+    x = _mm_min_ps(_mm_set1_ps(EXP_MAX_INPUT), _mm_max_ps(_mm_set1_ps(EXP_MIN_INPUT), x));
+    __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(EXP_LOG2E)));
+    __m128 fn = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(EXP_LN2_HI)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(EXP_LN2_LO)));
+    __m128 p = _mm_set1_ps(EXP_P0);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P1));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P2));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P3));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P4));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(EXP_P5));
+    p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), r), _mm_set1_ps(1.0f));
+    // 2^n built directly in the exponent field
+    __m128i scale = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+
+TARGET("sse2")
+static inline __m128 sigmoid_sse2(__m128 x) {
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 y = _mm_div_ps(one, _mm_add_ps(one, exp_sse2(_mm_sub_ps(_mm_setzero_ps(), x))));
+    // Below ln(FLT_MIN) exp(-x) saturates and y would stick at 6e-39: flush it to 0
+    return _mm_and_ps(y, _mm_cmpnlt_ps(x, _mm_set1_ps(EXP_MIN_INPUT)));
+}
+
+// tanh(|x|) = (1 - e) / (1 + e) with e = exp(-2|x|), or the series near zero; the sign is
+// put back at the end
+TARGET("sse2")
+static inline __m128 tanh_sse2(__m128 x) {
+    __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 a = _mm_andnot_ps(sign_bit, x);
+    __m128 e = exp_sse2(_mm_mul_ps(a, _mm_set1_ps(-2.0f)));
+    __m128 large = _mm_div_ps(_mm_sub_ps(one, e), _mm_add_ps(one, e));
+    __m128 a2 = _mm_mul_ps(a, a);
+    __m128 p = _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(TANH_T9)), _mm_set1_ps(TANH_T7));
+    p = _mm_add_ps(_mm_mul_ps(a2, p), _mm_set1_ps(TANH_T5));
+    p = _mm_add_ps(_mm_mul_ps(a2, p), _mm_set1_ps(TANH_T3));
+    __m128 small = _mm_add_ps(a, _mm_mul_ps(_mm_mul_ps(a, a2), p));
+    __m128 use_series = _mm_cmplt_ps(a, _mm_set1_ps(TANH_SERIES_LIMIT));
+    __m128 t = _mm_or_ps(_mm_and_ps(use_series, small), _mm_andnot_ps(use_series, large));
+    return _mm_or_ps(t, _mm_and_ps(sign_bit, x));
+}
+
+// --- SSE2: 4 rows at a time, one 4-wide accumulator per row ---
+
+// Activation of a register of outputs before it is stored. ReLU stays in the register, and
+// so do sigmoid and tanh with fast math; without it they are applied lane by lane by libm.
+TARGET("sse2")
+static inline __m128 activate_sse2(__m128 v, int activation) {
+    if (activation == TINYNN_ACT_RELU) return _mm_max_ps(v, _mm_setzero_ps());
+    if (fast_math && activation == TINYNN_ACT_SIGMOID) return sigmoid_sse2(v);
+    if (fast_math && activation == TINYNN_ACT_TANH) return tanh_sse2(v);
+    if (activation == TINYNN_ACT_SIGMOID || activation == TINYNN_ACT_TANH) {
+        float lanes[4];
+        _mm_storeu_ps(lanes, v);
+        for (int i = 0; i < 4; i++) lanes[i] = activate(lanes[i], activation);
+        return _mm_loadu_ps(lanes);
+    }
+    return v;
+}
+
+TARGET("sse2")
+static void dense_sse2(const float* weights, const float* biases, const float* input,
+                       float* output, int rows, int cols, int activation) {
+    const __m128 zero = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= rows; j += 4) {
+        const float* w0 = weights + (size_t)(j + 0) * cols;
+        const float* w1 = weights + (size_t)(j + 1) * cols;
+        const float* w2 = weights + (size_t)(j + 2) * cols;
+        const float* w3 = weights + (size_t)(j + 3) * cols;
+        __m128 a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+        int k = 0;
+        for (; k + 4 <= cols; k += 4) {
+            __m128 x = _mm_loadu_ps(input + k);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(w0 + k), x));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(w1 + k), x));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(w2 + k), x));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(w3 + k), x));
+        }
+        // Transpose so lane r of the sum holds the dot product of row j + r
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        __m128 sum = _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3));
+        float tail[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (; k < cols; k++) {
+            tail[0] += w0[k] * input[k];
+            tail[1] += w1[k] * input[k];
+            tail[2] += w2[k] * input[k];
+            tail[3] += w3[k] * input[k];
+        }
+        sum = _mm_add_ps(sum, _mm_loadu_ps(tail));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(biases + j));
+        sum = activate_sse2(sum, activation);
+        _mm_storeu_ps(output + j, sum);
+    }
+    if (j < rows) {
+        dense_portable(weights + (size_t)j * cols, biases + j, input, output + j, rows - j, cols, activation);
+    }
+}
+
+// --- SSE2 packed: a panel is four 4-wide vectors ---
+
+// Adds the bias, applies the activation and stores the first 'valid' rows of a panel's four vectors
+TARGET("sse2")
+static inline void store_panel_sse2(__m128 acc[4], const float* biases, float* output, int valid, int activation) {
+    float staged[PACK_PANEL_ROWS];
+    for (int r = 0; r < PACK_PANEL_ROWS; r++) staged[r] = r < valid ? biases[r] : 0.0f;
+    for (int q = 0; q < 4; q++) {
+        __m128 v = _mm_add_ps(acc[q], _mm_loadu_ps(staged + 4 * q));
+        v = activate_sse2(v, activation);
+        if (valid >= PACK_PANEL_ROWS) {
+            _mm_storeu_ps(output + 4 * q, v);
+        } else {
+            _mm_storeu_ps(staged + 4 * q, v);
+        }
+    }
+    if (valid < PACK_PANEL_ROWS) memcpy(output, staged, sizeof(float) * valid);
+}
+
+// Two interleaved accumulator sets (even and odd k) keep eight additions in flight
+TARGET("sse2")
+static void dense_packed_sse2(const float* panels, const float* biases, const float* input,
+                              float* output, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        __m128 a[4], b[4];
+        for (int q = 0; q < 4; q++) a[q] = b[q] = _mm_setzero_ps();
+        int k = 0;
+        for (; k + 2 <= cols; k += 2) {
+            __m128 x0 = _mm_set1_ps(input[k]);
+            __m128 x1 = _mm_set1_ps(input[k + 1]);
+            const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+            for (int q = 0; q < 4; q++) {
+                a[q] = _mm_add_ps(a[q], _mm_mul_ps(_mm_load_ps(w + 4 * q), x0));
+                b[q] = _mm_add_ps(b[q], _mm_mul_ps(_mm_load_ps(w + PACK_PANEL_ROWS + 4 * q), x1));
+            }
+        }
+        if (k < cols) {
+            __m128 x0 = _mm_set1_ps(input[k]);
+            const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+            for (int q = 0; q < 4; q++) a[q] = _mm_add_ps(a[q], _mm_mul_ps(_mm_load_ps(w + 4 * q), x0));
+        }
+        for (int q = 0; q < 4; q++) a[q] = _mm_add_ps(a[q], b[q]);
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        store_panel_sse2(a, biases + j, output + j, valid, activation);
+    }
+}
+
+// Tiles of 2 samples x one panel: eight accumulators, four weight vectors and a broadcast
+// fit in the sixteen SSE registers
+TARGET("sse2")
+static void gemm_packed_sse2(const float* panels, const float* biases, const float* input,
+                             int input_stride, float* output, int output_stride,
+                             int samples, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        int n = 0;
+        for (; n + 2 <= samples; n += 2) {
+            const float* x0 = input + (size_t)n * input_stride;
+            const float* x1 = x0 + input_stride;
+            __m128 a[4], b[4];
+            for (int q = 0; q < 4; q++) a[q] = b[q] = _mm_setzero_ps();
+            for (int k = 0; k < cols; k++) {
+                const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+                __m128 s0 = _mm_set1_ps(x0[k]);
+                __m128 s1 = _mm_set1_ps(x1[k]);
+                for (int q = 0; q < 4; q++) {
+                    __m128 wq = _mm_load_ps(w + 4 * q);
+                    a[q] = _mm_add_ps(a[q], _mm_mul_ps(wq, s0));
+                    b[q] = _mm_add_ps(b[q], _mm_mul_ps(wq, s1));
+                }
+            }
+            store_panel_sse2(a, biases + j, output + (size_t)n * output_stride + j, valid, activation);
+            store_panel_sse2(b, biases + j, output + (size_t)(n + 1) * output_stride + j, valid, activation);
+        }
+        if (n < samples) {
+            const float* x0 = input + (size_t)n * input_stride;
+            __m128 a[4];
+            for (int q = 0; q < 4; q++) a[q] = _mm_setzero_ps();
+            for (int k = 0; k < cols; k++) {
+                const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+                __m128 s0 = _mm_set1_ps(x0[k]);
+                for (int q = 0; q < 4; q++) a[q] = _mm_add_ps(a[q], _mm_mul_ps(_mm_load_ps(w + 4 * q), s0));
+            }
+            store_panel_sse2(a, biases + j, output + (size_t)n * output_stride + j, valid, activation);
+        }
+    }
+}
+
+// --- INT8 SSE2: sign-extend bytes to int16 and multiply-add pairs into int32 ---
+
+TARGET("sse2")
+static inline __m128i madd_int8_sse2(__m128i w, __m128i x_lo, __m128i x_hi) {
+    __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), w);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(w, sign), x_lo);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(w, sign), x_hi);
+    return _mm_add_epi32(lo, hi);
+}
+
+TARGET("sse2")
+static inline int32_t hsum_epi32_sse2(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+TARGET("sse2")
+static void dense_int8_sse2(const int8_t* weights, const float* row_scales, const float* biases,
+                            const int8_t* input, float input_scale, float* output,
+                            int rows, int padded_cols, int activation) {
+    int j = 0;
+    for (; j + 4 <= rows; j += 4) {
+        const int8_t* w = weights + (size_t)j * padded_cols;
+        __m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+        __m128i a2 = _mm_setzero_si128(), a3 = _mm_setzero_si128();
+        for (int k = 0; k < padded_cols; k += 16) {
+            // Widen the shared input once and reuse it for all four rows
+            __m128i x = _mm_loadu_si128((const __m128i*)(input + k));
+            __m128i x_sign = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+            __m128i x_lo = _mm_unpacklo_epi8(x, x_sign);
+            __m128i x_hi = _mm_unpackhi_epi8(x, x_sign);
+            a0 = _mm_add_epi32(a0, madd_int8_sse2(_mm_loadu_si128((const __m128i*)(w + k)), x_lo, x_hi));
+            a1 = _mm_add_epi32(a1, madd_int8_sse2(_mm_loadu_si128((const __m128i*)(w + padded_cols + k)), x_lo, x_hi));
+            a2 = _mm_add_epi32(a2, madd_int8_sse2(_mm_loadu_si128((const __m128i*)(w + 2 * (size_t)padded_cols + k)), x_lo, x_hi));
+            a3 = _mm_add_epi32(a3, madd_int8_sse2(_mm_loadu_si128((const __m128i*)(w + 3 * (size_t)padded_cols + k)), x_lo, x_hi));
+        }
+        int32_t dots[4] = {hsum_epi32_sse2(a0), hsum_epi32_sse2(a1), hsum_epi32_sse2(a2), hsum_epi32_sse2(a3)};
+        for (int r = 0; r < 4; r++) {
+            float sum = (float)dots[r] * row_scales[j + r] * input_scale + biases[j + r];
+            output[j + r] = activate(sum, activation);
+        }
+    }
+    if (j < rows) {
+        dense_int8_portable(weights + (size_t)j * padded_cols, row_scales + j, biases + j, input, input_scale,
+                            output + j, rows - j, padded_cols, activation);
+    }
+}
+
+// --- AVX2 + FMA: 8 rows at a time, eight independent FMA chains ---
+
+// exp_sse2() eight lanes at a time, with FMA
+TARGET("avx2,fma")
+static inline __m256 exp_avx(__m256 x) {
+    x = _mm256_min_ps(_mm256_set1_ps(EXP_MAX_INPUT), _mm256_max_ps(_mm256_set1_ps(EXP_MIN_INPUT), x));
+    __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(EXP_LOG2E)));
+    __m256 fn = _mm256_cvtepi32_ps(n);
+    __m256 r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(EXP_LN2_HI), x);
+    r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(EXP_LN2_LO), r);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(EXP_P0), r, _mm256_set1_ps(EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P5));
+    p = _mm256_add_ps(_mm256_fmadd_ps(p, _mm256_mul_ps(r, r), r), _mm256_set1_ps(1.0f));
+    __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+}
+
+TARGET("avx2,fma")
+static inline __m256 sigmoid_avx(__m256 x) {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 y = _mm256_div_ps(one, _mm256_add_ps(one, exp_avx(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+    return _mm256_and_ps(y, _mm256_cmp_ps(x, _mm256_set1_ps(EXP_MIN_INPUT), _CMP_NLT_UQ));
+}
+
+// As tanh_sse2()
+TARGET("avx2,fma")
+static inline __m256 tanh_avx(__m256 x) {
+    __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 a = _mm256_andnot_ps(sign_bit, x);
+    __m256 e = exp_avx(_mm256_mul_ps(a, _mm256_set1_ps(-2.0f)));
+    __m256 large = _mm256_div_ps(_mm256_sub_ps(one, e), _mm256_add_ps(one, e));
+    __m256 a2 = _mm256_mul_ps(a, a);
+    __m256 p = _mm256_fmadd_ps(a2, _mm256_set1_ps(TANH_T9), _mm256_set1_ps(TANH_T7));
+    p = _mm256_fmadd_ps(a2, p, _mm256_set1_ps(TANH_T5));
+    p = _mm256_fmadd_ps(a2, p, _mm256_set1_ps(TANH_T3));
+    __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(a, a2), p, a);
+    __m256 t = _mm256_blendv_ps(large, small, _mm256_cmp_ps(a, _mm256_set1_ps(TANH_SERIES_LIMIT), _CMP_LT_OQ));
+    return _mm256_or_ps(t, _mm256_and_ps(sign_bit, x));
+}
+
+// Activation of a register of outputs, as activate_sse2()
+TARGET("avx2,fma")
+static inline __m256 activate_avx(__m256 v, int activation) {
+    if (activation == TINYNN_ACT_RELU) return _mm256_max_ps(v, _mm256_setzero_ps());
+    if (fast_math && activation == TINYNN_ACT_SIGMOID) return sigmoid_avx(v);
+    if (fast_math && activation == TINYNN_ACT_TANH) return tanh_avx(v);
+    if (activation == TINYNN_ACT_SIGMOID || activation == TINYNN_ACT_TANH) {
+        float lanes[8];
+        _mm256_storeu_ps(lanes, v);
+        for (int i = 0; i < 8; i++) lanes[i] = activate(lanes[i], activation);
+        return _mm256_loadu_ps(lanes);
+    }
+    return v;
+}
+
+// Reduces eight accumulators to one vector whose lane r is the horizontal sum of a[r].
+TARGET("avx2,fma")
+static inline __m256 reduce8_avx(__m256 a[8]) {
+    __m256 h01 = _mm256_hadd_ps(a[0], a[1]);
+    __m256 h23 = _mm256_hadd_ps(a[2], a[3]);
+    __m256 h45 = _mm256_hadd_ps(a[4], a[5]);
+    __m256 h67 = _mm256_hadd_ps(a[6], a[7]);
+    __m256 h0123 = _mm256_hadd_ps(h01, h23);
+    __m256 h4567 = _mm256_hadd_ps(h45, h67);
+    __m256 lo = _mm256_permute2f128_ps(h0123, h4567, 0x20);
+    __m256 hi = _mm256_permute2f128_ps(h0123, h4567, 0x31);
+    return _mm256_add_ps(lo, hi);
+}
+
+// Mask for the last (cols % 8) columns, used with maskload so the tail stays vectorized.
+TARGET("avx2,fma")
+static inline __m256i tail_mask_avx(int remaining) {
+    static const int lanes[16] = {-1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0};
+    return _mm256_loadu_si256((const __m256i*)(lanes + 8 - remaining));
+}
+
+TARGET("avx2,fma")
+static void dense_avx2(const float* weights, const float* biases, const float* input,
+                       float* output, int rows, int cols, int activation) {
+    const int tail = cols & 7;
+    const int body = cols - tail;
+    const __m256i mask = tail_mask_avx(tail);
+    int j = 0;
+    for (; j + 8 <= rows; j += 8) {
+        const float* w = weights + (size_t)j * cols;
+        __m256 acc[8];
+        for (int r = 0; r < 8; r++) acc[r] = _mm256_setzero_ps();
+        for (int k = 0; k < body; k += 8) {
+            __m256 x = _mm256_loadu_ps(input + k);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm256_fmadd_ps(_mm256_loadu_ps(w + (size_t)r * cols + k), x, acc[r]);
+            }
+        }
+        if (tail) {
+            __m256 x = _mm256_maskload_ps(input + body, mask);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm256_fmadd_ps(_mm256_maskload_ps(w + (size_t)r * cols + body, mask), x, acc[r]);
+            }
+        }
+        __m256 sum = _mm256_add_ps(reduce8_avx(acc), _mm256_loadu_ps(biases + j));
+        sum = activate_avx(sum, activation);
+        _mm256_storeu_ps(output + j, sum);
+    }
+    // Remaining rows: one row at a time with four accumulators
+    for (; j < rows; j++) {
+        const float* w = weights + (size_t)j * cols;
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 32 <= body; k += 32) {
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k + 0),  _mm256_loadu_ps(input + k + 0),  a0);
+            a1 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k + 8),  _mm256_loadu_ps(input + k + 8),  a1);
+            a2 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k + 16), _mm256_loadu_ps(input + k + 16), a2);
+            a3 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k + 24), _mm256_loadu_ps(input + k + 24), a3);
+        }
+        for (; k < body; k += 8) {
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(input + k), a0);
+        }
+        if (tail) {
+            a1 = _mm256_fmadd_ps(_mm256_maskload_ps(w + body, mask), _mm256_maskload_ps(input + body, mask), a1);
+        }
+        __m256 v = _mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3));
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float sum = _mm_cvtss_f32(s) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+// --- AVX2 packed: a panel is two 8-wide vectors ---
+
+// Adds the bias, applies the activation and stores the first 'valid' rows of a panel
+TARGET("avx2,fma")
+static inline void store_panel_avx2(__m256 lo, __m256 hi, const float* biases, float* output, int valid,
+                                    int activation) {
+    __m256i mask_lo = tail_mask_avx(valid >= 8 ? 8 : valid);
+    __m256i mask_hi = tail_mask_avx(valid >= 16 ? 8 : (valid > 8 ? valid - 8 : 0));
+    lo = _mm256_add_ps(lo, _mm256_maskload_ps(biases, mask_lo));
+    hi = _mm256_add_ps(hi, _mm256_maskload_ps(biases + 8, mask_hi));
+    lo = activate_avx(lo, activation);
+    hi = activate_avx(hi, activation);
+    _mm256_maskstore_ps(output, mask_lo, lo);
+    _mm256_maskstore_ps(output + 8, mask_hi, hi);
+}
+
+// Four accumulator pairs over k mod 4 keep eight FMA chains in flight
+TARGET("avx2,fma")
+static void dense_packed_avx2(const float* panels, const float* biases, const float* input,
+                              float* output, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        __m256 lo[4], hi[4];
+        for (int u = 0; u < 4; u++) lo[u] = hi[u] = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 4 <= cols; k += 4) {
+            for (int u = 0; u < 4; u++) {
+                const float* w = p + (size_t)(k + u) * PACK_PANEL_ROWS;
+                __m256 x = _mm256_broadcast_ss(input + k + u);
+                lo[u] = _mm256_fmadd_ps(_mm256_load_ps(w), x, lo[u]);
+                hi[u] = _mm256_fmadd_ps(_mm256_load_ps(w + 8), x, hi[u]);
+            }
+        }
+        for (; k < cols; k++) {
+            const float* w = p + (size_t)k * PACK_PANEL_ROWS;
+            __m256 x = _mm256_broadcast_ss(input + k);
+            lo[0] = _mm256_fmadd_ps(_mm256_load_ps(w), x, lo[0]);
+            hi[0] = _mm256_fmadd_ps(_mm256_load_ps(w + 8), x, hi[0]);
+        }
+        __m256 sum_lo = _mm256_add_ps(_mm256_add_ps(lo[0], lo[1]), _mm256_add_ps(lo[2], lo[3]));
+        __m256 sum_hi = _mm256_add_ps(_mm256_add_ps(hi[0], hi[1]), _mm256_add_ps(hi[2], hi[3]));
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        store_panel_avx2(sum_lo, sum_hi, biases + j, output + j, valid, activation);
+    }
+}
+
+// One panel x 'tile' samples (a compile-time constant after inlining, so the
+// accumulators stay in registers): 12 accumulators, 2 weight loads and 6 broadcasts per k
+TARGET("avx2,fma")
+static FORCE_INLINE void gemm_tile_avx2(const float* p, const float* biases, const float* x, int input_stride,
+                                        float* y, int output_stride, int valid, int cols, int activation,
+                                        const int tile) {
+    __m256 lo[6], hi[6];
+    for (int s = 0; s < tile; s++) lo[s] = hi[s] = _mm256_setzero_ps();
+    for (int k = 0; k < cols; k++) {
+        __m256 w_lo = _mm256_load_ps(p + (size_t)k * PACK_PANEL_ROWS);
+        __m256 w_hi = _mm256_load_ps(p + (size_t)k * PACK_PANEL_ROWS + 8);
+        for (int s = 0; s < tile; s++) {
+            __m256 xs = _mm256_broadcast_ss(x + (size_t)s * input_stride + k);
+            lo[s] = _mm256_fmadd_ps(w_lo, xs, lo[s]);
+            hi[s] = _mm256_fmadd_ps(w_hi, xs, hi[s]);
+        }
+    }
+    for (int s = 0; s < tile; s++) {
+        store_panel_avx2(lo[s], hi[s], biases, y + (size_t)s * output_stride, valid, activation);
+    }
+}
+
+#define GEMM_TILE_AVX2(tile) \
+    gemm_tile_avx2(p, biases + j, x, input_stride, y, output_stride, valid, cols, activation, tile)
+
+TARGET("avx2,fma")
+static void gemm_packed_avx2(const float* panels, const float* biases, const float* input,
+                             int input_stride, float* output, int output_stride,
+                             int samples, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        for (int n = 0; n < samples; n += 6) {
+            const float* x = input + (size_t)n * input_stride;
+            float* y = output + (size_t)n * output_stride + j;
+            switch (samples - n < 6 ? samples - n : 6) {
+                case 6: GEMM_TILE_AVX2(6); break;
+                case 5: GEMM_TILE_AVX2(5); break;
+                case 4: GEMM_TILE_AVX2(4); break;
+                case 3: GEMM_TILE_AVX2(3); break;
+                case 2: GEMM_TILE_AVX2(2); break;
+                default: GEMM_TILE_AVX2(1); break;
+            }
+        }
+    }
+}
+
+#undef GEMM_TILE_AVX2
+
+// --- AVX-512F: 8 rows at a time with 16-wide FMA chains and masked column tails ---
+
+TARGET("avx512f,avx2,fma")
+static void dense_avx512(const float* weights, const float* biases, const float* input,
+                         float* output, int rows, int cols, int activation) {
+    const int tail = cols & 15;
+    const int body = cols - tail;
+    const __mmask16 mask = (__mmask16)((1u << tail) - 1);
+    int j = 0;
+    for (; j + 8 <= rows; j += 8) {
+        const float* w = weights + (size_t)j * cols;
+        __m512 acc[8];
+        for (int r = 0; r < 8; r++) acc[r] = _mm512_setzero_ps();
+        for (int k = 0; k < body; k += 16) {
+            __m512 x = _mm512_loadu_ps(input + k);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm512_fmadd_ps(_mm512_loadu_ps(w + (size_t)r * cols + k), x, acc[r]);
+            }
+        }
+        if (tail) {
+            __m512 x = _mm512_maskz_loadu_ps(mask, input + body);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w + (size_t)r * cols + body), x, acc[r]);
+            }
+        }
+        // Fold each 512-bit accumulator to 256 bits, then share the AVX2 reduction
+        __m256 half[8];
+        for (int r = 0; r < 8; r++) {
+            half[r] = _mm256_add_ps(_mm512_castps512_ps256(acc[r]),
+                                    _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc[r]), 1)));
+        }
+        __m256 sum = _mm256_add_ps(reduce8_avx(half), _mm256_loadu_ps(biases + j));
+        sum = activate_avx(sum, activation);
+        _mm256_storeu_ps(output + j, sum);
+    }
+    for (; j < rows; j++) {
+        const float* w = weights + (size_t)j * cols;
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+        int k = 0;
+        for (; k + 32 <= body; k += 32) {
+            a0 = _mm512_fmadd_ps(_mm512_loadu_ps(w + k),      _mm512_loadu_ps(input + k),      a0);
+            a1 = _mm512_fmadd_ps(_mm512_loadu_ps(w + k + 16), _mm512_loadu_ps(input + k + 16), a1);
+        }
+        for (; k < body; k += 16) {
+            a0 = _mm512_fmadd_ps(_mm512_loadu_ps(w + k), _mm512_loadu_ps(input + k), a0);
+        }
+        if (tail) {
+            a1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w + body), _mm512_maskz_loadu_ps(mask, input + body), a1);
+        }
+        float sum = _mm512_reduce_add_ps(_mm512_add_ps(a0, a1)) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+// --- AVX-512 packed: a panel is exactly one 16-wide vector ---
+
+// exp_sse2() sixteen lanes at a time
+TARGET("avx512f,avx2,fma")
+static inline __m512 exp_avx512(__m512 x) {
+    x = _mm512_min_ps(_mm512_set1_ps(EXP_MAX_INPUT), _mm512_max_ps(_mm512_set1_ps(EXP_MIN_INPUT), x));
+    __m512i n = _mm512_cvtps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(EXP_LOG2E)));
+    __m512 fn = _mm512_cvtepi32_ps(n);
+    __m512 r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(EXP_LN2_HI), x);
+    r = _mm512_fnmadd_ps(fn, _mm512_set1_ps(EXP_LN2_LO), r);
+    __m512 p = _mm512_fmadd_ps(_mm512_set1_ps(EXP_P0), r, _mm512_set1_ps(EXP_P1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P5));
+    p = _mm512_add_ps(_mm512_fmadd_ps(p, _mm512_mul_ps(r, r), r), _mm512_set1_ps(1.0f));
+    __m512i scale = _mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(scale));
+}
+
+TARGET("avx512f,avx2,fma")
+static inline __m512 sigmoid_avx512(__m512 x) {
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 y = _mm512_div_ps(one, _mm512_add_ps(one, exp_avx512(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+    return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_MIN_INPUT), _CMP_NLT_UQ), y);
+}
+
+// As tanh_sse2(); the sign is handled with integer ops, which need only AVX512F
+TARGET("avx512f,avx2,fma")
+static inline __m512 tanh_avx512(__m512 x) {
+    __m512i sign_bit = _mm512_set1_epi32((int)0x80000000u);
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 a = _mm512_abs_ps(x);
+    __m512 e = exp_avx512(_mm512_mul_ps(a, _mm512_set1_ps(-2.0f)));
+    __m512 large = _mm512_div_ps(_mm512_sub_ps(one, e), _mm512_add_ps(one, e));
+    __m512 a2 = _mm512_mul_ps(a, a);
+    __m512 p = _mm512_fmadd_ps(a2, _mm512_set1_ps(TANH_T9), _mm512_set1_ps(TANH_T7));
+    p = _mm512_fmadd_ps(a2, p, _mm512_set1_ps(TANH_T5));
+    p = _mm512_fmadd_ps(a2, p, _mm512_set1_ps(TANH_T3));
+    __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(a, a2), p, a);
+    __mmask16 use_series = _mm512_cmp_ps_mask(a, _mm512_set1_ps(TANH_SERIES_LIMIT), _CMP_LT_OQ);
+    __m512i t = _mm512_castps_si512(_mm512_mask_blend_ps(use_series, large, small));
+    return _mm512_castsi512_ps(_mm512_or_epi32(t, _mm512_and_epi32(sign_bit, _mm512_castps_si512(x))));
+}
+
+TARGET("avx512f,avx2,fma")
+static inline __m512 activate_avx512(__m512 v, int activation) {
+    if (activation == TINYNN_ACT_RELU) return _mm512_max_ps(v, _mm512_setzero_ps());
+    if (fast_math && activation == TINYNN_ACT_SIGMOID) return sigmoid_avx512(v);
+    if (fast_math && activation == TINYNN_ACT_TANH) return tanh_avx512(v);
+    if (activation == TINYNN_ACT_SIGMOID || activation == TINYNN_ACT_TANH) {
+        float lanes[16];
+        _mm512_storeu_ps(lanes, v);
+        for (int i = 0; i < 16; i++) lanes[i] = activate(lanes[i], activation);
+        return _mm512_loadu_ps(lanes);
+    }
+    return v;
+}
+
+TARGET("avx512f,avx2,fma")
+static inline __mmask16 panel_mask_avx512(int valid) {
+    if (valid >= PACK_PANEL_ROWS) return (__mmask16)0xFFFF;
+    return valid > 0 ? (__mmask16)((1u << valid) - 1) : (__mmask16)0;
+}
+
+TARGET("avx512f,avx2,fma")
+static FORCE_INLINE void store_panel_avx512(__m512 acc, const float* biases, float* output, int valid, int activation) {
+    __mmask16 mask = panel_mask_avx512(valid);
+    acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(mask, biases));
+    acc = activate_avx512(acc, activation);
+    _mm512_mask_storeu_ps(output, mask, acc);
+}
+
+// 'panels_in_tile' (1 or 2) panels with four accumulators each over k mod 4
+TARGET("avx512f,avx2,fma")
+static FORCE_INLINE void dense_tile_avx512(const float* p, const float* biases, const float* input,
+                                           float* output, int valid, int cols, int activation,
+                                           const int panels_in_tile) {
+    const size_t panel_stride = (size_t)cols * PACK_PANEL_ROWS;
+    __m512 acc[2][4];
+    for (int t = 0; t < panels_in_tile; t++) {
+        for (int u = 0; u < 4; u++) acc[t][u] = _mm512_setzero_ps();
+    }
+    int k = 0;
+    for (; k + 4 <= cols; k += 4) {
+        for (int u = 0; u < 4; u++) {
+            __m512 x = _mm512_set1_ps(input[k + u]);
+            for (int t = 0; t < panels_in_tile; t++) {
+                const float* w = p + t * panel_stride + (size_t)(k + u) * PACK_PANEL_ROWS;
+                acc[t][u] = _mm512_fmadd_ps(_mm512_load_ps(w), x, acc[t][u]);
+            }
+        }
+    }
+    for (; k < cols; k++) {
+        __m512 x = _mm512_set1_ps(input[k]);
+        for (int t = 0; t < panels_in_tile; t++) {
+            const float* w = p + t * panel_stride + (size_t)k * PACK_PANEL_ROWS;
+            acc[t][0] = _mm512_fmadd_ps(_mm512_load_ps(w), x, acc[t][0]);
+        }
+    }
+    for (int t = 0; t < panels_in_tile; t++) {
+        __m512 sum = _mm512_add_ps(_mm512_add_ps(acc[t][0], acc[t][1]), _mm512_add_ps(acc[t][2], acc[t][3]));
+        store_panel_avx512(sum, biases + t * PACK_PANEL_ROWS, output + t * PACK_PANEL_ROWS,
+                           valid - t * PACK_PANEL_ROWS, activation);
+    }
+}
+
+TARGET("avx512f,avx2,fma")
+static void dense_packed_avx512(const float* panels, const float* biases, const float* input,
+                                float* output, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += 2 * PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        int valid = rows - j;
+        if (valid > PACK_PANEL_ROWS) {
+            dense_tile_avx512(p, biases + j, input, output + j, valid, cols, activation, 2);
+        } else {
+            dense_tile_avx512(p, biases + j, input, output + j, valid, cols, activation, 1);
+        }
+    }
+}
+
+// 'panels_in_tile' panels x 'tile' samples, both compile-time constants after inlining:
+// up to 12 accumulators, 2 weight loads and 6 broadcasts per k
+TARGET("avx512f,avx2,fma")
+static FORCE_INLINE void gemm_tile_avx512(const float* p, const float* biases, const float* x, int input_stride,
+                                          float* y, int output_stride, int valid, int cols, int activation,
+                                          const int panels_in_tile, const int tile) {
+    const size_t panel_stride = (size_t)cols * PACK_PANEL_ROWS;
+    __m512 acc[6][2];
+    for (int s = 0; s < tile; s++) {
+        for (int t = 0; t < panels_in_tile; t++) acc[s][t] = _mm512_setzero_ps();
+    }
+    for (int k = 0; k < cols; k++) {
+        __m512 w[2];
+        for (int t = 0; t < panels_in_tile; t++) w[t] = _mm512_load_ps(p + t * panel_stride + (size_t)k * PACK_PANEL_ROWS);
+        for (int s = 0; s < tile; s++) {
+            __m512 xs = _mm512_set1_ps(x[(size_t)s * input_stride + k]);
+            for (int t = 0; t < panels_in_tile; t++) acc[s][t] = _mm512_fmadd_ps(w[t], xs, acc[s][t]);
+        }
+    }
+    for (int s = 0; s < tile; s++) {
+        for (int t = 0; t < panels_in_tile; t++) {
+            store_panel_avx512(acc[s][t], biases + t * PACK_PANEL_ROWS,
+                               y + (size_t)s * output_stride + t * PACK_PANEL_ROWS, valid - t * PACK_PANEL_ROWS,
+                               activation);
+        }
+    }
+}
+
+#define GEMM_TILE_AVX512(panels_in_tile, tile) \
+    gemm_tile_avx512(p, biases + j, x, input_stride, y, output_stride, valid, cols, activation, panels_in_tile, tile)
+
+TARGET("avx512f,avx2,fma")
+static void gemm_packed_avx512(const float* panels, const float* biases, const float* input,
+                               int input_stride, float* output, int output_stride,
+                               int samples, int rows, int cols, int activation) {
+    for (int j = 0; j < rows; j += 2 * PACK_PANEL_ROWS) {
+        const float* p = panels + (size_t)j * cols;
+        int valid = rows - j;
+        for (int n = 0; n < samples; n += 6) {
+            const float* x = input + (size_t)n * input_stride;
+            float* y = output + (size_t)n * output_stride + j;
+            int tile = samples - n < 6 ? samples - n : 6;
+            if (valid > PACK_PANEL_ROWS) {
+                switch (tile) {
+                    case 6: GEMM_TILE_AVX512(2, 6); break;
+                    case 5: GEMM_TILE_AVX512(2, 5); break;
+                    case 4: GEMM_TILE_AVX512(2, 4); break;
+                    case 3: GEMM_TILE_AVX512(2, 3); break;
+                    case 2: GEMM_TILE_AVX512(2, 2); break;
+                    default: GEMM_TILE_AVX512(2, 1); break;
+                }
+            } else {
+                switch (tile) {
+                    case 6: GEMM_TILE_AVX512(1, 6); break;
+                    case 5: GEMM_TILE_AVX512(1, 5); break;
+                    case 4: GEMM_TILE_AVX512(1, 4); break;
+                    case 3: GEMM_TILE_AVX512(1, 3); break;
+                    case 2: GEMM_TILE_AVX512(1, 2); break;
+                    default: GEMM_TILE_AVX512(1, 1); break;
+                }
+            }
+        }
+    }
+}
+
+#undef GEMM_TILE_AVX512
+
+// --- INT8 AVX2: pmaddubsw on |x| and sign-adjusted weights ---
+// pmaddubsw multiplies unsigned by signed bytes. Feeding it |x| and w * sign(x)
+// gives the same products as x * w, and since |x| <= 127 a pair of products never
+// exceeds 2 * 127 * 127, so the int16 intermediate cannot saturate.
+
+TARGET("avx2,fma")
+static inline int32_t hsum_epi32_avx(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+TARGET("avx2,fma")
+static void dense_int8_avx2(const int8_t* weights, const float* row_scales, const float* biases,
+                            const int8_t* input, float input_scale, float* output,
+                            int rows, int padded_cols, int activation) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    int j = 0;
+    for (; j + 4 <= rows; j += 4) {
+        const int8_t* w = weights + (size_t)j * padded_cols;
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256(), a3 = _mm256_setzero_si256();
+        for (int k = 0; k < padded_cols; k += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(input + k));
+            __m256i ax = _mm256_abs_epi8(x);
+            __m256i w0 = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w + k)), x);
+            __m256i w1 = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w + padded_cols + k)), x);
+            __m256i w2 = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w + 2 * (size_t)padded_cols + k)), x);
+            __m256i w3 = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w + 3 * (size_t)padded_cols + k)), x);
+            a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_maddubs_epi16(ax, w0), ones));
+            a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_maddubs_epi16(ax, w1), ones));
+            a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(_mm256_maddubs_epi16(ax, w2), ones));
+            a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(_mm256_maddubs_epi16(ax, w3), ones));
+        }
+        int32_t dots[4] = {hsum_epi32_avx(a0), hsum_epi32_avx(a1), hsum_epi32_avx(a2), hsum_epi32_avx(a3)};
+        for (int r = 0; r < 4; r++) {
+            float sum = (float)dots[r] * row_scales[j + r] * input_scale + biases[j + r];
+            output[j + r] = activate(sum, activation);
+        }
+    }
+    if (j < rows) {
+        dense_int8_portable(weights + (size_t)j * padded_cols, row_scales + j, biases + j, input, input_scale,
+                            output + j, rows - j, padded_cols, activation);
+    }
+}
+
+// --- INT8 AVX-512 VNNI: vpdpbusd fuses the multiply and the int32 accumulation ---
+
+TARGET("avx512f,avx512bw,avx512vnni,avx2,fma")
+static void dense_int8_vnni(const int8_t* weights, const float* row_scales, const float* biases,
+                            const int8_t* input, float input_scale, float* output,
+                            int rows, int padded_cols, int activation) {
+    const __m512i zero = _mm512_setzero_si512();
+    int j = 0;
+    for (; j + 4 <= rows; j += 4) {
+        const int8_t* w = weights + (size_t)j * padded_cols;
+        __m512i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+        for (int k = 0; k < padded_cols; k += 64) {
+            __m512i x = _mm512_loadu_si512((const void*)(input + k));
+            __m512i ax = _mm512_abs_epi8(x);
+            __mmask64 negative = _mm512_movepi8_mask(x);
+            // No vpsignb in AVX-512: negate the weights where x < 0 with a masked subtract
+            __m512i w0 = _mm512_loadu_si512((const void*)(w + k));
+            __m512i w1 = _mm512_loadu_si512((const void*)(w + padded_cols + k));
+            __m512i w2 = _mm512_loadu_si512((const void*)(w + 2 * (size_t)padded_cols + k));
+            __m512i w3 = _mm512_loadu_si512((const void*)(w + 3 * (size_t)padded_cols + k));
+            a0 = _mm512_dpbusd_epi32(a0, ax, _mm512_mask_sub_epi8(w0, negative, zero, w0));
+            a1 = _mm512_dpbusd_epi32(a1, ax, _mm512_mask_sub_epi8(w1, negative, zero, w1));
+            a2 = _mm512_dpbusd_epi32(a2, ax, _mm512_mask_sub_epi8(w2, negative, zero, w2));
+            a3 = _mm512_dpbusd_epi32(a3, ax, _mm512_mask_sub_epi8(w3, negative, zero, w3));
+        }
+        int32_t dots[4] = {_mm512_reduce_add_epi32(a0), _mm512_reduce_add_epi32(a1),
+                           _mm512_reduce_add_epi32(a2), _mm512_reduce_add_epi32(a3)};
+        for (int r = 0; r < 4; r++) {
+            float sum = (float)dots[r] * row_scales[j + r] * input_scale + biases[j + r];
+            output[j + r] = activate(sum, activation);
+        }
+    }
+    if (j < rows) {
+        dense_int8_portable(weights + (size_t)j * padded_cols, row_scales + j, biases + j, input, input_scale,
+                            output + j, rows - j, padded_cols, activation);
+    }
+}
+
+// Scalar dot product for the column tails of the SSE2 FP16/BF16 kernel
+static float dot_half_tail(const uint16_t* w, const float* x, int count, int bf16) {
+    float sum = 0.0f;
+    for (int k = 0; k < count; k++) {
+        sum += (bf16 ? bfloat16_to_float(w[k]) : half_to_float(w[k])) * x[k];
+    }
+    return sum;
+}
+
+// --- FP16/BF16 SSE2: 4 rows at a time, weights widened in registers ---
+// SSE2 has no half-precision conversion instruction, so FP16 is widened four lanes at a
+// time the same way as half_to_float(). BF16 only needs a 16-bit shift.
+
+TARGET("sse2")
+static inline __m128 load_half4_sse2(const uint16_t* p, int bf16) {
+    __m128i h = _mm_loadl_epi64((const __m128i*)p);
+    if (bf16) return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), h));
+    h = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i magnitude = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i inf_nan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x0f7fffff));
+    f = _mm_or_ps(f, _mm_castsi128_ps(_mm_and_si128(inf_nan, _mm_set1_epi32(0x7f800000))));
+    return _mm_or_ps(f, _mm_castsi128_ps(sign));
+}
+
+TARGET("sse2")
+static void dense_half_sse2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation, int bf16) {
+    const __m128 zero = _mm_setzero_ps();
+    const int body = cols & ~3;
+    int j = 0;
+    for (; j + 4 <= rows; j += 4) {
+        const uint16_t* w0 = weights + (size_t)(j + 0) * cols;
+        const uint16_t* w1 = weights + (size_t)(j + 1) * cols;
+        const uint16_t* w2 = weights + (size_t)(j + 2) * cols;
+        const uint16_t* w3 = weights + (size_t)(j + 3) * cols;
+        __m128 a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+        for (int k = 0; k < body; k += 4) {
+            __m128 x = _mm_loadu_ps(input + k);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(load_half4_sse2(w0 + k, bf16), x));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(load_half4_sse2(w1 + k, bf16), x));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(load_half4_sse2(w2 + k, bf16), x));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(load_half4_sse2(w3 + k, bf16), x));
+        }
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        __m128 sum = _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3));
+        if (body < cols) {
+            sum = _mm_add_ps(sum, _mm_setr_ps(dot_half_tail(w0 + body, input + body, cols - body, bf16),
+                                              dot_half_tail(w1 + body, input + body, cols - body, bf16),
+                                              dot_half_tail(w2 + body, input + body, cols - body, bf16),
+                                              dot_half_tail(w3 + body, input + body, cols - body, bf16)));
+        }
+        sum = _mm_add_ps(sum, _mm_loadu_ps(biases + j));
+        sum = activate_sse2(sum, activation);
+        _mm_storeu_ps(output + j, sum);
+    }
+    if (j < rows) {
+        dense_half_portable(weights + (size_t)j * cols, biases + j, input, output + j, rows - j, cols, activation, bf16);
+    }
+}
+
+TARGET("sse2")
+static void dense_fp16_sse2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation) {
+    dense_half_sse2(weights, biases, input, output, rows, cols, activation, 0);
+}
+
+TARGET("sse2")
+static void dense_bf16_sse2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation) {
+    dense_half_sse2(weights, biases, input, output, rows, cols, activation, 1);
+}
+
+// --- FP16/BF16 AVX2: F16C vcvtph2ps for FP16, zero-extend + shift for BF16 ---
+
+TARGET("avx2,fma,f16c")
+static inline __m256 load_half8_avx(const uint16_t* p, int bf16) {
+    __m128i h = _mm_loadu_si128((const __m128i*)p);
+    if (bf16) return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+    return _mm256_cvtph_ps(h);
+}
+
+// Copies the last 'count' (< lanes) weights of a row into a zero-filled vector-sized buffer,
+// so the column tail takes one more vector step instead of a scalar loop
+static inline void pad_half_tail(uint16_t* dst, const uint16_t* src, int count, int lanes) {
+    memset(dst, 0, (size_t)lanes * sizeof(uint16_t));
+    memcpy(dst, src, (size_t)count * sizeof(uint16_t));
+}
+
+TARGET("avx2,fma,f16c")
+static void dense_half_avx2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation, int bf16) {
+    const int body = cols & ~7;
+    float x_tail[8] = {0};
+    uint16_t w_tail[8];
+    memcpy(x_tail, input + body, (size_t)(cols - body) * sizeof(float));
+    int j = 0;
+    for (; j + 8 <= rows; j += 8) {
+        const uint16_t* w = weights + (size_t)j * cols;
+        __m256 acc[8];
+        for (int r = 0; r < 8; r++) acc[r] = _mm256_setzero_ps();
+        for (int k = 0; k < body; k += 8) {
+            __m256 x = _mm256_loadu_ps(input + k);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm256_fmadd_ps(load_half8_avx(w + (size_t)r * cols + k, bf16), x, acc[r]);
+            }
+        }
+        if (body < cols) {
+            __m256 x = _mm256_loadu_ps(x_tail);
+            for (int r = 0; r < 8; r++) {
+                pad_half_tail(w_tail, w + (size_t)r * cols + body, cols - body, 8);
+                acc[r] = _mm256_fmadd_ps(load_half8_avx(w_tail, bf16), x, acc[r]);
+            }
+        }
+        __m256 sum = _mm256_add_ps(reduce8_avx(acc), _mm256_loadu_ps(biases + j));
+        sum = activate_avx(sum, activation);
+        _mm256_storeu_ps(output + j, sum);
+    }
+    for (; j < rows; j++) {
+        const uint16_t* w = weights + (size_t)j * cols;
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        int k = 0;
+        for (; k + 16 <= body; k += 16) {
+            a0 = _mm256_fmadd_ps(load_half8_avx(w + k, bf16),     _mm256_loadu_ps(input + k),     a0);
+            a1 = _mm256_fmadd_ps(load_half8_avx(w + k + 8, bf16), _mm256_loadu_ps(input + k + 8), a1);
+        }
+        for (; k < body; k += 8) {
+            a0 = _mm256_fmadd_ps(load_half8_avx(w + k, bf16), _mm256_loadu_ps(input + k), a0);
+        }
+        if (body < cols) {
+            pad_half_tail(w_tail, w + body, cols - body, 8);
+            a1 = _mm256_fmadd_ps(load_half8_avx(w_tail, bf16), _mm256_loadu_ps(x_tail), a1);
+        }
+        __m256 v = _mm256_add_ps(a0, a1);
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        float sum = _mm_cvtss_f32(s) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+TARGET("avx2,fma,f16c")
+static void dense_fp16_avx2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation) {
+    dense_half_avx2(weights, biases, input, output, rows, cols, activation, 0);
+}
+
+TARGET("avx2,fma,f16c")
+static void dense_bf16_avx2(const uint16_t* weights, const float* biases, const float* input,
+                            float* output, int rows, int cols, int activation) {
+    dense_half_avx2(weights, biases, input, output, rows, cols, activation, 1);
+}
+
+// --- FP16/BF16 AVX-512F: 16 weights widened per load ---
+// AVX-512 BF16 (vdpbf16ps) would need the activations rounded to bf16 as well; widening
+// only the weights keeps fp32 activations and accumulation at the same throughput.
+
+TARGET("avx512f,avx2,fma,f16c")
+static inline __m512 load_half16_avx512(const uint16_t* p, int bf16) {
+    __m256i h = _mm256_loadu_si256((const __m256i*)p);
+    if (bf16) return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+    return _mm512_cvtph_ps(h);
+}
+
+TARGET("avx512f,avx2,fma,f16c")
+static void dense_half_avx512(const uint16_t* weights, const float* biases, const float* input,
+                              float* output, int rows, int cols, int activation, int bf16) {
+    const int body = cols & ~15;
+    // The input tail is a masked load; the weight tail goes through a zero-filled copy, as
+    // 16-bit masked loads need AVX-512BW
+    const __mmask16 tail_mask = (__mmask16)((1u << (cols - body)) - 1);
+    uint16_t w_tail[16];
+    int j = 0;
+    for (; j + 8 <= rows; j += 8) {
+        const uint16_t* w = weights + (size_t)j * cols;
+        __m512 acc[8];
+        for (int r = 0; r < 8; r++) acc[r] = _mm512_setzero_ps();
+        for (int k = 0; k < body; k += 16) {
+            __m512 x = _mm512_loadu_ps(input + k);
+            for (int r = 0; r < 8; r++) {
+                acc[r] = _mm512_fmadd_ps(load_half16_avx512(w + (size_t)r * cols + k, bf16), x, acc[r]);
+            }
+        }
+        if (body < cols) {
+            __m512 x = _mm512_maskz_loadu_ps(tail_mask, input + body);
+            for (int r = 0; r < 8; r++) {
+                pad_half_tail(w_tail, w + (size_t)r * cols + body, cols - body, 16);
+                acc[r] = _mm512_fmadd_ps(load_half16_avx512(w_tail, bf16), x, acc[r]);
+            }
+        }
+        __m256 half[8];
+        for (int r = 0; r < 8; r++) {
+            half[r] = _mm256_add_ps(_mm512_castps512_ps256(acc[r]),
+                                    _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc[r]), 1)));
+        }
+        __m256 sum = _mm256_add_ps(reduce8_avx(half), _mm256_loadu_ps(biases + j));
+        sum = activate_avx(sum, activation);
+        _mm256_storeu_ps(output + j, sum);
+    }
+    for (; j < rows; j++) {
+        const uint16_t* w = weights + (size_t)j * cols;
+        __m512 a0 = _mm512_setzero_ps();
+        for (int k = 0; k < body; k += 16) {
+            a0 = _mm512_fmadd_ps(load_half16_avx512(w + k, bf16), _mm512_loadu_ps(input + k), a0);
+        }
+        if (body < cols) {
+            pad_half_tail(w_tail, w + body, cols - body, 16);
+            a0 = _mm512_fmadd_ps(load_half16_avx512(w_tail, bf16), _mm512_maskz_loadu_ps(tail_mask, input + body), a0);
+        }
+        float sum = _mm512_reduce_add_ps(a0) + biases[j];
+        output[j] = activate(sum, activation);
+    }
+}
+
+TARGET("avx512f,avx2,fma,f16c")
+static void dense_fp16_avx512(const uint16_t* weights, const float* biases, const float* input,
+                              float* output, int rows, int cols, int activation) {
+    dense_half_avx512(weights, biases, input, output, rows, cols, activation, 0);
+}
+
+TARGET("avx512f,avx2,fma,f16c")
+static void dense_bf16_avx512(const uint16_t* weights, const float* biases, const float* input,
+                              float* output, int rows, int cols, int activation) {
+    dense_half_avx512(weights, biases, input, output, rows, cols, activation, 1);
+}
+
+// --- Sparse layers, AVX2 + FMA (also used by the AVX-512 tiers) ---
+
+// Sums the eight lanes of v
+TARGET("avx2,fma")
+static inline float hsum_avx(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// Finishes up to 'valid' outputs of one block row from the lanes of its accumulator
+static inline void store_sparse_lanes(const float* lanes, const float* biases, float* output, int valid,
+                                      int activation) {
+    for (int r = 0; r < valid; r++) output[r] = activate(lanes[r] + biases[r], activation);
+}
+
+// One sample: 8x1 blocks are one FMA each, 4x1 blocks half of one, and CSR rows gather
+// eight inputs at a time. Two accumulators per block row hide the FMA latency.
+TARGET("avx2,fma")
+static void sparse_avx2(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                        int block_rows, const float* biases, const float* input,
+                        float* output, int rows, int activation) {
+    float lanes[8];
+    for (int j = 0, b = 0; j < rows; j += block_rows, b++) {
+        int32_t i = block_ptr[b];
+        const int32_t end = block_ptr[b + 1];
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        if (block_rows == 8) {
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+            for (; i + 2 <= end; i += 2) {
+                acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + (size_t)i * 8), _mm256_set1_ps(input[columns[i]]), acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(values + (size_t)(i + 1) * 8),
+                                       _mm256_set1_ps(input[columns[i + 1]]), acc1);
+            }
+            if (i < end) {
+                acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + (size_t)i * 8), _mm256_set1_ps(input[columns[i]]), acc0);
+            }
+            __m256 acc = _mm256_add_ps(acc0, acc1);
+            if (valid == 8) {
+                _mm256_storeu_ps(output + j, activate_avx(_mm256_add_ps(acc, _mm256_loadu_ps(biases + j)), activation));
+                continue;
+            }
+            _mm256_storeu_ps(lanes, acc);
+        } else if (block_rows == 4) {
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+            for (; i + 2 <= end; i += 2) {
+                acc0 = _mm_fmadd_ps(_mm_loadu_ps(values + (size_t)i * 4), _mm_set1_ps(input[columns[i]]), acc0);
+                acc1 = _mm_fmadd_ps(_mm_loadu_ps(values + (size_t)(i + 1) * 4), _mm_set1_ps(input[columns[i + 1]]), acc1);
+            }
+            if (i < end) acc0 = _mm_fmadd_ps(_mm_loadu_ps(values + (size_t)i * 4), _mm_set1_ps(input[columns[i]]), acc0);
+            _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+        } else {
+            __m256 acc = _mm256_setzero_ps();
+            for (; i + 8 <= end; i += 8) {
+                __m256i index = _mm256_loadu_si256((const __m256i*)(columns + i));
+                acc = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), _mm256_i32gather_ps(input, index, 4), acc);
+            }
+            if (i < end) {
+                __m256i mask = tail_mask_avx(end - i);
+                __m256i index = _mm256_maskload_epi32(columns + i, mask);
+                __m256 x = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), input, index, _mm256_castsi256_ps(mask), 4);
+                acc = _mm256_fmadd_ps(_mm256_maskload_ps(values + i, mask), x, acc);
+            }
+            lanes[0] = hsum_avx(acc);
+        }
+        store_sparse_lanes(lanes, biases + j, output + j, valid, activation);
+    }
+}
+
+// Accumulates one block row over a tile. Inlined with a constant 'block_rows', so the
+// loops unroll and the accumulators stay in registers. CSR rows alternate between two
+// accumulators to hide the FMA latency.
+TARGET("avx2,fma")
+static FORCE_INLINE void sparse_tile_block_row_avx2(const int32_t* columns, const float* values, int32_t start,
+                                                    int32_t end, const int block_rows, const float* tile,
+                                                    __m256 acc[SPARSE_MAX_BLOCK_ROWS]) {
+    for (int r = 0; r < block_rows; r++) acc[r] = _mm256_setzero_ps();
+    int32_t i = start;
+    if (block_rows == 1) {
+        __m256 acc1 = _mm256_setzero_ps();
+        for (; i + 2 <= end; i += 2) {
+            acc[0] = _mm256_fmadd_ps(_mm256_set1_ps(values[i]),
+                                     _mm256_load_ps(tile + (size_t)columns[i] * SPARSE_TILE_SAMPLES), acc[0]);
+            acc1 = _mm256_fmadd_ps(_mm256_set1_ps(values[i + 1]),
+                                   _mm256_load_ps(tile + (size_t)columns[i + 1] * SPARSE_TILE_SAMPLES), acc1);
+        }
+        acc[0] = _mm256_add_ps(acc[0], acc1);
+    }
+    for (; i < end; i++) {
+        __m256 x = _mm256_load_ps(tile + (size_t)columns[i] * SPARSE_TILE_SAMPLES);
+        const float* v = values + (size_t)i * block_rows;
+        for (int r = 0; r < block_rows; r++) acc[r] = _mm256_fmadd_ps(_mm256_set1_ps(v[r]), x, acc[r]);
+    }
+}
+
+TARGET("avx2,fma")
+static void sparse_tile_avx2(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                             int block_rows, const float* biases, const float* tile, int samples,
+                             float* output, int output_stride, int rows, int activation) {
+    __m256 acc[SPARSE_MAX_BLOCK_ROWS];
+    float lanes[SPARSE_TILE_SAMPLES];
+    for (int j = 0, b = 0; j < rows; j += block_rows, b++) {
+        if (block_rows == 8) {
+            sparse_tile_block_row_avx2(columns, values, block_ptr[b], block_ptr[b + 1], 8, tile, acc);
+        } else if (block_rows == 4) {
+            sparse_tile_block_row_avx2(columns, values, block_ptr[b], block_ptr[b + 1], 4, tile, acc);
+        } else {
+            sparse_tile_block_row_avx2(columns, values, block_ptr[b], block_ptr[b + 1], 1, tile, acc);
+        }
+        // Lane s of acc[r] is row j + r of sample s
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        for (int r = 0; r < valid; r++) {
+            _mm256_storeu_ps(lanes, activate_avx(_mm256_add_ps(acc[r], _mm256_set1_ps(biases[j + r])), activation));
+            for (int s = 0; s < samples; s++) output[(size_t)s * output_stride + j + r] = lanes[s];
+        }
+    }
+}
+
+// --- Whole-array activations and softmax ---
+
+// Sums and maxima of the four lanes of v
+TARGET("sse2")
+static inline float hsum_sse2(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+
+TARGET("sse2")
+static inline float hmax_sse2(__m128 v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+
+static float max_value(const float* values, int count) {
+    float max = values[0];
+    for (int i = 1; i < count; i++) {
+        if (values[i] > max) max = values[i];
+    }
+    return max;
+}
+
+// The tail of each array is run through a zero-padded register, so every value gets the
+// same approximation whatever its position.
+TARGET("sse2")
+static void activate_array_sse2(float* values, int count, int activation) {
+    if (activation == TINYNN_ACT_NONE || activation == TINYNN_ACT_SOFTMAX) return;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) _mm_storeu_ps(values + i, activate_sse2(_mm_loadu_ps(values + i), activation));
+    if (i < count) {
+        float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        memcpy(lanes, values + i, sizeof(float) * (count - i));
+        _mm_storeu_ps(lanes, activate_sse2(_mm_loadu_ps(lanes), activation));
+        memcpy(values + i, lanes, sizeof(float) * (count - i));
+    }
+}
+
+// exp(values - max) stored in place; returns their sum (or only the sum when 'store' is 0)
+TARGET("sse2")
+static float exp_sum_sse2(float* values, int count, float max, int store) {
+    __m128 shift = _mm_set1_ps(max);
+    __m128 sum = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 e = exp_sse2(_mm_sub_ps(_mm_loadu_ps(values + i), shift));
+        if (store) _mm_storeu_ps(values + i, e);
+        sum = _mm_add_ps(sum, e);
+    }
+    float total = hsum_sse2(sum);
+    if (i < count) {
+        float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        memcpy(lanes, values + i, sizeof(float) * (count - i));
+        _mm_storeu_ps(lanes, exp_sse2(_mm_sub_ps(_mm_loadu_ps(lanes), shift)));
+        for (int k = 0; k < count - i; k++) total += lanes[k];
+        if (store) memcpy(values + i, lanes, sizeof(float) * (count - i));
+    }
+    return total;
+}
+
+TARGET("sse2")
+static float max_sse2(const float* values, int count) {
+    if (count < 4) return max_value(values, count);
+    __m128 max = _mm_loadu_ps(values);
+    int i = 4;
+    for (; i + 4 <= count; i += 4) max = _mm_max_ps(max, _mm_loadu_ps(values + i));
+    float m = hmax_sse2(max);
+    for (; i < count; i++) {
+        if (values[i] > m) m = values[i];
+    }
+    return m;
+}
+
+// Two passes over the inputs, one for the max and one that stores the exps and sums them,
+// then a multiply by 1 / sum while the row is still in cache
+TARGET("sse2")
+static void softmax_sse2(float* values, int count) {
+    if (!fast_math) {
+        softmax(values, count);
+        return;
+    }
+    float inverse = 1.0f / exp_sum_sse2(values, count, max_sse2(values, count), 1);
+    __m128 scale = _mm_set1_ps(inverse);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) _mm_storeu_ps(values + i, _mm_mul_ps(_mm_loadu_ps(values + i), scale));
+    for (; i < count; i++) values[i] *= inverse;
+}
+
+TARGET("sse2")
+static float log_sum_exp_sse2(const float* values, int count) {
+    if (!fast_math) return log_sum_exp(values, count);
+    float max = max_sse2(values, count);
+    return max + logf(exp_sum_sse2((float*)values, count, max, 0));
+}
+
+// AVX2 versions of the above, also used by the AVX-512 tiers: these passes are bound by
+// the exp arithmetic on rows that fit in L1, where 16 lanes gain little over 8
+TARGET("avx2,fma")
+static void activate_array_avx2(float* values, int count, int activation) {
+    if (activation == TINYNN_ACT_NONE || activation == TINYNN_ACT_SOFTMAX) return;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(values + i, activate_avx(_mm256_loadu_ps(values + i), activation));
+    }
+    if (i < count) {
+        __m256i mask = tail_mask_avx(count - i);
+        _mm256_maskstore_ps(values + i, mask, activate_avx(_mm256_maskload_ps(values + i, mask), activation));
+    }
+}
+
+TARGET("avx2,fma")
+static float exp_sum_avx2(float* values, int count, float max, int store) {
+    __m256 shift = _mm256_set1_ps(max);
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 e = exp_avx(_mm256_sub_ps(_mm256_loadu_ps(values + i), shift));
+        if (store) _mm256_storeu_ps(values + i, e);
+        sum = _mm256_add_ps(sum, e);
+    }
+    if (i < count) {
+        __m256i mask = tail_mask_avx(count - i);
+        __m256 e = exp_avx(_mm256_sub_ps(_mm256_maskload_ps(values + i, mask), shift));
+        if (store) _mm256_maskstore_ps(values + i, mask, e);
+        sum = _mm256_add_ps(sum, _mm256_and_ps(e, _mm256_castsi256_ps(mask)));
+    }
+    return hsum_avx(sum);
+}
+
+TARGET("avx2,fma")
+static float max_avx2(const float* values, int count) {
+    if (count < 8) return max_value(values, count);
+    __m256 max = _mm256_loadu_ps(values);
+    int i = 8;
+    for (; i + 8 <= count; i += 8) max = _mm256_max_ps(max, _mm256_loadu_ps(values + i));
+    // The last vector overlaps the one before; max does not mind
+    if (i < count) max = _mm256_max_ps(max, _mm256_loadu_ps(values + count - 8));
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+    return hmax_sse2(m);
+}
+
+TARGET("avx2,fma")
+static void softmax_avx2(float* values, int count) {
+    if (!fast_math) {
+        softmax(values, count);
+        return;
+    }
+    float inverse = 1.0f / exp_sum_avx2(values, count, max_avx2(values, count), 1);
+    __m256 scale = _mm256_set1_ps(inverse);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) _mm256_storeu_ps(values + i, _mm256_mul_ps(_mm256_loadu_ps(values + i), scale));
+    for (; i < count; i++) values[i] *= inverse;
+}
+
+TARGET("avx2,fma")
+static float log_sum_exp_avx2(const float* values, int count) {
+    if (!fast_math) return log_sum_exp(values, count);
+    float max = max_avx2(values, count);
+    return max + logf(exp_sum_avx2((float*)values, count, max, 0));
+}
+
+// --- CPU feature detection ---
+
+enum { CPU_SSE2 = 1, CPU_AVX2 = 2, CPU_AVX512 = 4, CPU_AVX512_VNNI = 8 };
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+    #ifdef _MSC_VER
+    __cpuidex((int*)regs, leaf, subleaf);
+    #else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+    #endif
+}
+
+static unsigned long long read_xcr0(void) {
+    #ifdef _MSC_VER
+    return _xgetbv(0);
+    #else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+    #endif
+}
+
+static int detect_cpu_features(void) {
+    unsigned int regs[4];
+    int features = 0;
+
+    cpuid(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+    if (max_leaf < 1) return 0;
+
+    cpuid(1, 0, regs);
+    if (regs[3] & (1u << 26)) features |= CPU_SSE2;
+
+    // AVX state must be enabled by the OS (OSXSAVE + XCR0 bits), not just present on the die
+    int has_osxsave = (regs[2] & (1u << 27)) != 0;
+    int has_avx = (regs[2] & (1u << 28)) != 0;
+    int has_fma = (regs[2] & (1u << 12)) != 0;
+    int has_f16c = (regs[2] & (1u << 29)) != 0;
+    if (!has_osxsave || !has_avx || max_leaf < 7) return features;
+
+    unsigned long long xcr0 = read_xcr0();
+    int ymm_enabled = (xcr0 & 0x6) == 0x6;
+    int zmm_enabled = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    // Every AVX2 part also has F16C; requiring it lets the AVX2 tier convert FP16 in hardware
+    if (ymm_enabled && has_fma && has_f16c && (regs[1] & (1u << 5))) features |= CPU_AVX2;
+    if (zmm_enabled && (features & CPU_AVX2) && (regs[1] & (1u << 16))) features |= CPU_AVX512;
+    // VNNI kernels also use AVX512BW byte operations
+    if ((features & CPU_AVX512) && (regs[1] & (1u << 30)) && (regs[2] & (1u << 11))) features |= CPU_AVX512_VNNI;
+    return features;
+}
+
+#endif // TINYNN_X86
+
+// --- Kernel table and dispatch ---
+
+static const TinyNN_Kernels portable_kernels = {"portable", dense_portable, dense_int8_portable,
+                                                dense_fp16_portable, dense_bf16_portable,
+                                                dense_packed_portable, gemm_packed_portable,
+                                                sparse_portable, sparse_tile_portable,
+                                                activate_array_portable, softmax, log_sum_exp};
+#ifdef TINYNN_X86
+static const TinyNN_Kernels sse2_kernels = {"sse2", dense_sse2, dense_int8_sse2,
+                                            dense_fp16_sse2, dense_bf16_sse2,
+                                            dense_packed_sse2, gemm_packed_sse2,
+                                            sparse_portable, sparse_tile_portable,
+                                            activate_array_sse2, softmax_sse2, log_sum_exp_sse2};
+static const TinyNN_Kernels avx2_kernels = {"avx2", dense_avx2, dense_int8_avx2,
+                                            dense_fp16_avx2, dense_bf16_avx2,
+                                            dense_packed_avx2, gemm_packed_avx2,
+                                            sparse_avx2, sparse_tile_avx2,
+                                            activate_array_avx2, softmax_avx2, log_sum_exp_avx2};
+static const TinyNN_Kernels avx512_kernels = {"avx512", dense_avx512, dense_int8_avx2,
+                                              dense_fp16_avx512, dense_bf16_avx512,
+                                              dense_packed_avx512, gemm_packed_avx512,
+                                              sparse_avx2, sparse_tile_avx2,
+                                              activate_array_avx2, softmax_avx2, log_sum_exp_avx2};
+static const TinyNN_Kernels avx512_vnni_kernels = {"avx512-vnni", dense_avx512, dense_int8_vnni,
+                                                   dense_fp16_avx512, dense_bf16_avx512,
+                                                   dense_packed_avx512, gemm_packed_avx512,
+                                                   sparse_avx2, sparse_tile_avx2,
+                                                   activate_array_avx2, softmax_avx2, log_sum_exp_avx2};
+#endif
+
+static int cpu_features = -1;
+
+static int supported_features(void) {
+    if (cpu_features < 0) {
+        #ifdef TINYNN_X86
+        cpu_features = detect_cpu_features();
+        #else
+        cpu_features = 0;
+        #endif
+    }
+    return cpu_features;
+}
+
+const TinyNN_Kernels* find_kernels(const char* name) {
+    if (name == NULL) return NULL;
+    if (strcmp(name, portable_kernels.name) == 0) return &portable_kernels;
+    #ifdef TINYNN_X86
+    int features = supported_features();
+    if (strcmp(name, sse2_kernels.name) == 0 && (features & CPU_SSE2)) return &sse2_kernels;
+    if (strcmp(name, avx2_kernels.name) == 0 && (features & CPU_AVX2)) return &avx2_kernels;
+    if (strcmp(name, avx512_kernels.name) == 0 && (features & CPU_AVX512)) return &avx512_kernels;
+    if (strcmp(name, avx512_vnni_kernels.name) == 0 && (features & CPU_AVX512_VNNI)) return &avx512_vnni_kernels;
+    #endif
+    return NULL;
+}
+
+const TinyNN_Kernels* select_kernels(void) {
+    static const TinyNN_Kernels* selected = NULL;
+    if (selected) return selected;
+
+    const char* math = getenv("TINYNN_FAST_MATH");
+    if (math && strcmp(math, "0") == 0) fast_math = 0;
+
+    const char* forced = getenv("TINYNN_KERNELS");
+    if (forced && forced[0] != '\0') {
+        selected = find_kernels(forced);
+        if (selected) return selected;
+        fprintf(stderr, "WARNING: TINYNN_KERNELS='%s' is unknown or unsupported on this CPU, auto-detecting.\n", forced);
+    }
+
+    #ifdef TINYNN_X86
+    int features = supported_features();
+    if (features & CPU_AVX512_VNNI) selected = &avx512_vnni_kernels;
+    else if (features & CPU_AVX512) selected = &avx512_kernels;
+    else if (features & CPU_AVX2) selected = &avx2_kernels;
+    else if (features & CPU_SSE2) selected = &sse2_kernels;
+    else selected = &portable_kernels;
+    #else
+    selected = &portable_kernels;
+    #endif
+    return selected;
+}
@@ -0,0 +1,149 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+
+// Activation applied to a layer's outputs.
+typedef enum {
+    TINYNN_ACT_NONE = 0,      // Raw pre-activation values (logits)
+    TINYNN_ACT_RELU = 1,
+    TINYNN_ACT_SIGMOID = 2,
+    TINYNN_ACT_TANH = 3,
+    TINYNN_ACT_SOFTMAX = 4    // Over the whole output row, so not applied by the kernels
+} TinyNN_Activation;
+
+// Dense layer kernel: output[j] = act(dot(weights[j * cols .. ], input) + biases[j]) for j in [0, rows).
+// 'weights' is row-major [rows][cols]. 'activation' is an elementwise TinyNN_Activation
+// (NONE, RELU, SIGMOID or TANH); it is applied to the accumulators together with the bias,
+// so every output is written once.
+typedef void (*dense_kernel_fn)(const float* weights, const float* biases, const float* input,
+                                float* output, int rows, int cols, int activation);
+
+// Packed fp32 layers group their output rows into panels of PACK_PANEL_ROWS rows. A panel
+// is stored column by column, panel[k * PACK_PANEL_ROWS + r] = W[first_row + r][k], so the
+// kernels read it front to back and the weights of a whole register block of rows are one
+// aligned load. Panels are 64-byte aligned; rows past the end of the layer are zero.
+#define PACK_PANEL_ROWS 16
+
+// Packed dense layer for one sample: like dense_kernel_fn over 'rows' rows, reading the
+// weights from 'panels' (which starts at the panel holding row 0).
+typedef void (*dense_packed_kernel_fn)(const float* panels, const float* biases, const float* input,
+                                       float* output, int rows, int cols, int activation);
+
+// Packed dense layer for a batch: input is [samples][input_stride], output is
+// [samples][output_stride], and output[n][j] = act(dot(W[j], input[n]) + biases[j]) for
+// j in [0, rows). Each panel is reused for a register tile of samples before moving on.
+typedef void (*gemm_packed_kernel_fn)(const float* panels, const float* biases, const float* input,
+                                      int input_stride, float* output, int output_stride,
+                                      int samples, int rows, int cols, int activation);
+
+// INT8 rows are zero-padded to a multiple of this many columns so the
+// integer kernels never need a column tail.
+#define INT8_COLUMN_PADDING 64
+
+// Quantized dense layer kernel. 'weights' is row-major int8 [rows][padded_cols] with one
+// symmetric scale per row; 'input' holds padded_cols int8 values in [-127, 127] with a
+// single scale. Products are accumulated in int32, then dequantized before the bias:
+// output[j] = act(row_scales[j] * input_scale * dot(weights[j], input) + biases[j]).
+typedef void (*dense_int8_kernel_fn)(const int8_t* weights, const float* row_scales, const float* biases,
+                                     const int8_t* input, float input_scale, float* output,
+                                     int rows, int padded_cols, int activation);
+
+// Dense layer kernel over 16-bit weights (FP16 or BF16, one kernel each). Same contract
+// as dense_kernel_fn: weights are widened to fp32 as they are loaded and the products
+// are accumulated in fp32, so only the storage precision changes.
+typedef void (*dense_half_kernel_fn)(const uint16_t* weights, const float* biases, const float* input,
+                                     float* output, int rows, int cols, int activation);
+
+// Sparse fp32 layers keep only the blocks of 'block_rows' consecutive rows x 1 column that
+// hold a nonzero weight (block_rows 1 is plain CSR). Block row b covers output rows
+// [b * block_rows, (b + 1) * block_rows) and owns blocks [block_ptr[b], block_ptr[b + 1]);
+// block i sits in input column columns[i] and holds values[i * block_rows + r] for row r.
+// The kernels get 'block_ptr' starting at the block row of output row 0, while the block
+// indices it holds count from the start of the layer.
+#define SPARSE_MAX_BLOCK_ROWS 8
+
+// Samples a sparse batch kernel processes at once
+#define SPARSE_TILE_SAMPLES 8
+
+// Sparse layer for one sample: same output contract as dense_kernel_fn.
+typedef void (*sparse_kernel_fn)(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                                 int block_rows, const float* biases, const float* input,
+                                 float* output, int rows, int activation);
+
+// Sparse layer for up to SPARSE_TILE_SAMPLES samples. The input is interleaved so one column
+// of the tile is one vector: tile[k * SPARSE_TILE_SAMPLES + s] is input k of sample s, with
+// zeros in the lanes past 'samples'. The tile is 32-byte aligned. Writes
+// output[s * output_stride + j] for j in [0, rows).
+typedef void (*sparse_tile_kernel_fn)(const int32_t* block_ptr, const int32_t* columns, const float* values,
+                                      int block_rows, const float* biases, const float* tile, int samples,
+                                      float* output, int output_stride, int rows, int activation);
+
+// Applies an elementwise TinyNN_Activation to 'count' values in place (SOFTMAX and NONE
+// leave them unchanged).
+typedef void (*activation_kernel_fn)(float* values, int count, int activation);
+// softmax() of 'count' values in place
+typedef void (*softmax_kernel_fn)(float* values, int count);
+// log(sum(exp(values))) without overflow
+typedef float (*log_sum_exp_kernel_fn)(const float* values, int count);
+
+// A set of compute kernels built for one instruction set.
+typedef struct {
+    const char* name;     // "portable", "sse2", "avx2", "avx512", "avx512-vnni"
+    dense_kernel_fn dense;
+    dense_int8_kernel_fn dense_int8;
+    dense_half_kernel_fn dense_fp16;
+    dense_half_kernel_fn dense_bf16;
+    dense_packed_kernel_fn dense_packed;
+    gemm_packed_kernel_fn gemm_packed;
+    sparse_kernel_fn sparse;
+    sparse_tile_kernel_fn sparse_tile;
+    activation_kernel_fn activate;
+    softmax_kernel_fn softmax;
+    log_sum_exp_kernel_fn log_sum_exp;
+} TinyNN_Kernels;
+
+// Fast math: the SIMD kernel sets compute exp, sigmoid and tanh a whole register at a time
+// (in the dense kernels' fused activations and in activate/softmax/log_sum_exp) instead of
+// calling libm once per value. exp(x) = 2^n * p(r) with n = round(x / ln 2), |r| <= ln(2)/2
+// and p a degree-7 polynomial. Maximum errors against a double-precision reference, sampled
+// over the whole float range:
+//   exp      relative 8.3e-8 (under 1 ulp) for x in [-87.33, 88]; outside that range it
+//            saturates (FLT_MIN below, exp(88) above) instead of reaching 0 or infinity
+//   sigmoid  absolute 8.9e-8, relative 1.5e-7 for x >= -87.33; below, where the exact
+//            result is subnormal, it returns 0 (absolute error under FLT_MIN)
+//   tanh     absolute 9.0e-8, relative 1.8e-7 (an odd series below |x| = 0.25)
+//   softmax  no larger than with libm expf: both are bound by rounding x - max to float
+// The portable kernels always use libm, as does every kernel set while fast math is off.
+
+/**
+ * @brief Turns the approximations on (the default) or off, e.g. to validate a model against
+ * the exact libm results. Setting the TINYNN_FAST_MATH environment variable to 0 turns them
+ * off at the first select_kernels(). Call it before inference starts, not during.
+ */
+void set_fast_math(int enabled);
+int fast_math_enabled(void);
+
+/**
+ * @brief Quantizes 'count' activations to int8 with a symmetric scale.
+ * If 'scale' is > 0 (a calibrated scale) values are clipped to it, otherwise the scale
+ * is taken from the largest magnitude in 'input'. Entries [count, padded_count) are zeroed.
+ * @return The scale used, so that input[k] ~= output[k] * scale.
+ */
+float quantize_activations(const float* input, int count, int padded_count, float scale, int8_t* output);
+
+/**
+ * @brief Picks the fastest kernel set the current CPU supports.
+ * Detection runs once (CPUID + OS register-state check); later calls return the cached
+ * result. Setting the TINYNN_KERNELS environment variable to one of the kernel names
+ * forces that variant, as long as the CPU supports it.
+ */
+const TinyNN_Kernels* select_kernels(void);
+
+/**
+ * @brief Looks up a kernel set by name.
+ * @return The kernel set, or NULL if the name is unknown or the CPU cannot run it.
+ */
+const TinyNN_Kernels* find_kernels(const char* name);
+
+#endif
@@ -1,157 +1,1155 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "model.h"
-#include "utils.h"
-
-// Function to load a float array from a CSV file
-static int load_float_array_from_csv(const char* filepath, float* array, int num_elements) {
-    FILE* fp = fopen(filepath, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "ERROR: Could not open file %s\n", filepath);
-        return 0; // Failure
-    }
-
-    for (int i = 0; i < num_elements; i++) {
-        // fscanf will read a float and skip over commas and whitespace
-        if (fscanf(fp, "%f,", &array[i]) != 1) {
-            fprintf(stderr, "ERROR: Failed to read element %d from %s\n", i, filepath);
-            fclose(fp);
-            return 0; // Failure
-        }
-    }
-
-    fclose(fp);
-    return 1; // Success
-}
-
-TinyNN_Model* create_model_from_path(const char* model_path) {
-    char filepath[256];
-
-    // 1. Read architecture file
-    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", model_path);
-    FILE* fp = fopen(filepath, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "ERROR: Could not open architecture file at %s\n", filepath);
-        return NULL;
-    }
-
-    TinyNN_Model* model = (TinyNN_Model*)malloc(sizeof(TinyNN_Model));
-
-    // Read sizes from the file
-    fscanf(fp, "%d", &model->input_size);
-    fscanf(fp, "%d", &model->output_size);
-    fscanf(fp, "%d", &model->hidden_layers);
-
-    int total_layers = model->hidden_layers + 1;
-    model->layer_sizes = (int*)malloc(sizeof(int) * total_layers);
-    for (int i = 0; i < total_layers; i++) {
-        fscanf(fp, "%d", &model->layer_sizes[i]);
-    }
-    fclose(fp);
-
-    // 2. Allocate memory for weights and biases
-    model->weights = (float**)malloc(sizeof(float*) * total_layers);
-    model->biases  = (float**)malloc(sizeof(float*) * total_layers);
-
-    int prev_layer_size = model->input_size;
-    for (int i = 0; i < total_layers; i++) {
-        int current_layer_size = model->layer_sizes[i];
-        int weight_count = prev_layer_size * current_layer_size;
-        int bias_count = current_layer_size;
-
-        model->weights[i] = (float*)malloc(sizeof(float) * weight_count);
-        model->biases[i]  = (float*)malloc(sizeof(float) * bias_count);
-
-        // 3. Load weights and biases from their respective CSV files
-        snprintf(filepath, sizeof(filepath), "%s/layer_%d_weights.csv", model_path, i);
-        if (!load_float_array_from_csv(filepath, model->weights[i], weight_count)) {
-            // On failure, free everything allocated so far and return NULL
-            free_model(model);
-            return NULL;
-        }
-
-        snprintf(filepath, sizeof(filepath), "%s/layer_%d_biases.csv", model_path, i);
-        if (!load_float_array_from_csv(filepath, model->biases[i], bias_count)) {
-            free_model(model);
-            return NULL;
-        }
-
-        prev_layer_size = current_layer_size;
-    }
-
-    return model;
-}
-
-void free_model(TinyNN_Model* model) {
-    if (model == NULL) return; // Safety check
-
-    if (model->weights) {
-        for (int i = 0; i <= model->hidden_layers; i++) {
-            if (model->weights[i]) free(model->weights[i]);
-        }
-        free(model->weights);
-    }
-    if (model->biases) {
-        for (int i = 0; i <= model->hidden_layers; i++) {
-            if (model->biases[i]) free(model->biases[i]);
-        }
-        free(model->biases);
-    }
-    if (model->layer_sizes) free(model->layer_sizes);
-    free(model);
-}
-
-float* forward_pass(TinyNN_Model* model, float* input) {
-    float* current_input = input;
-    float* layer_output = NULL;
-    int current_input_size = model->input_size;
-
-    // A flag to know if we've allocated memory for current_input that needs freeing later.
-    // The initial input is from the user, so we are not freeing it.
-    int input_is_dynamically_allocated = 0;
-
-    // Loop through each layer (hidden layers + output layer)
-    for (int i = 0; i <= model->hidden_layers; i++) {
-        int layer_output_size = model->layer_sizes[i];
-        layer_output = (float*)malloc(sizeof(float) * layer_output_size);
-
-        // Core Dense Layer Calculation: output = W * input + b
-        for (int j = 0; j < layer_output_size; j++) {
-            float sum = 0.0f;
-            // Dot product of weights row and current_input vector
-            for (int k = 0; k < current_input_size; k++) {
-                // Weights are stored as a flat array (row-major order)
-                // W[j][k] is equivalent to weights[j * current_input_size + k]
-                sum += model->weights[i][j * current_input_size + k] * current_input[k];
-            }
-            // Add the bias for this neuron
-            sum += model->biases[i][j];
-            layer_output[j] = sum;
-        }
-
-        // Apply Activation Function
-        if (i < model->hidden_layers) {
-            // Apply ReLU for all hidden layers
-            for (int j = 0; j < layer_output_size; j++) {
-                layer_output[j] = relu(layer_output[j]);
-            }
-        } else {
-            // Apply Softmax for the final output layer (common for classification)
-            softmax(layer_output, layer_output_size);
-        }
-
-        // Prepare for the next layer
-        if (input_is_dynamically_allocated) {
-            free(current_input); // Free the output from the previous layer
-        }
-
-        current_input = layer_output; // The output of this layer is the input to the next
-        current_input_size = layer_output_size;
-        input_is_dynamically_allocated = 1;
-    }
-
-    // The final 'current_input' is the network's output.
-    // The CALLER is now responsible for freeing this memory.
-    return current_input;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "model.h"
+#include "utils.h"
+#include "model_binary.h"
+#include "csv_parser.h"
+#include "threads.h"
+#include "quantize.h"
+#include "half_precision.h"
+#include "profiler.h"
+#include "pack.h"
+#include "sparse.h"
+#include "streaming.h"
+#include "numa.h"
+
+// Cache blocking for the batched path. A BLOCK_ROWS x BLOCK_COLS weight tile
+// (64 x 256 floats = 64 KB) stays resident in L2 while every sample of the
+// batch streams past it, instead of re-reading the whole matrix per sample.
+#define BLOCK_ROWS 64
+#define BLOCK_COLS 256
+
+// Below this many multiply-adds per task, handing a layer to other threads costs more
+// than it saves, so small layers run on the calling thread
+#define MIN_TASK_WORK 65536
+
+// Upper bound on loader threads; CSV parsing is mostly memory bound beyond this
+#define MAX_LOADER_THREADS 8
+
+// Top-k selections up to this size keep their indices on the stack
+#define TOP_K_STACK_LIMIT 64
+
+// One CSV file to parse into an already allocated array
+typedef struct {
+    char filepath[256];
+    float* array;
+    int rows;
+    int cols;
+} LoadJob;
+
+typedef struct {
+    LoadJob* jobs;
+    int job_count;
+    volatile int next_job;
+    volatile int failed;
+} LoadQueue;
+
+static void* load_worker(void* arg) {
+    LoadQueue* queue = (LoadQueue*)arg;
+    for (;;) {
+        int index = atomic_add_int(&queue->next_job, 1);
+        if (index >= queue->job_count) break;
+        LoadJob* job = &queue->jobs[index];
+        if (!load_float_csv(job->filepath, job->array, job->rows, job->cols)) {
+            atomic_store_int(&queue->failed, 1);
+        }
+    }
+    return NULL;
+}
+
+// Parses all layer files, spreading independent files over a small set of threads.
+// Returns 1 if every file loaded.
+static int run_load_jobs(LoadJob* jobs, int job_count) {
+    LoadQueue queue = {jobs, job_count, 0, 0};
+    int thread_count = cpu_count();
+    if (thread_count > MAX_LOADER_THREADS) thread_count = MAX_LOADER_THREADS;
+    if (thread_count > job_count) thread_count = job_count;
+
+    // The calling thread works too, so only thread_count - 1 helpers are started
+    TinyNN_Thread threads[MAX_LOADER_THREADS];
+    int started = 0;
+    for (int i = 1; i < thread_count; i++) {
+        if (!thread_create(&threads[started], load_worker, &queue)) break;
+        started++;
+    }
+    load_worker(&queue);
+    for (int i = 0; i < started; i++) {
+        thread_join(threads[i]);
+    }
+    return !queue.failed;
+}
+
+// Reads architecture.txt into a new model that has its sizes and activations but no weights
+static TinyNN_Model* read_architecture(const char* model_path) {
+    char filepath[256];
+
+    // 1. Read architecture file
+    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", model_path);
+    FILE* fp = fopen(filepath, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Could not open architecture file at %s\n", filepath);
+        return NULL;
+    }
+
+    TinyNN_Model* model = (TinyNN_Model*)calloc(1, sizeof(TinyNN_Model));
+    if (!model) {
+        fclose(fp);
+        return NULL;
+    }
+
+    // Read sizes from the file
+    if (fscanf(fp, "%d", &model->input_size) != 1 ||
+        fscanf(fp, "%d", &model->output_size) != 1 ||
+        fscanf(fp, "%d", &model->hidden_layers) != 1 ||
+        model->input_size <= 0 || model->output_size <= 0 || model->hidden_layers < 0) {
+        fprintf(stderr, "ERROR: Malformed header in %s (expected input size, output size, hidden layer count)\n", filepath);
+        fclose(fp);
+        free(model);
+        return NULL;
+    }
+
+    int total_layers = model->hidden_layers + 1;
+    model->layer_sizes = (int*)malloc(sizeof(int) * total_layers);
+    if (!model->layer_sizes || !init_activations(model)) {
+        fclose(fp);
+        free_model(model);
+        return NULL;
+    }
+    for (int i = 0; i < total_layers; i++) {
+        if (fscanf(fp, "%d", &model->layer_sizes[i]) != 1 || model->layer_sizes[i] <= 0) {
+            fprintf(stderr, "ERROR: %s is missing a valid size for layer %d\n", filepath, i);
+            fclose(fp);
+            free_model(model);
+            return NULL;
+        }
+        // The size may be followed by the layer's activation, e.g. "10 sigmoid"
+        char name[32];
+        if (fscanf(fp, " %31[A-Za-z]", name) == 1 && !parse_activation(name, &model->activations[i])) {
+            fprintf(stderr, "ERROR: %s names unknown activation '%s' for layer %d "
+                    "(expected none, relu, sigmoid, tanh or softmax)\n", filepath, name, i);
+            fclose(fp);
+            free_model(model);
+            return NULL;
+        }
+    }
+    fclose(fp);
+    if (model->layer_sizes[total_layers - 1] != model->output_size) {
+        fprintf(stderr, "ERROR: %s declares output size %d but its last layer has %d neurons\n",
+                filepath, model->output_size, model->layer_sizes[total_layers - 1]);
+        free_model(model);
+        return NULL;
+    }
+    return model;
+}
+
+// Points jobs[2 * i] and jobs[2 * i + 1] at layer i's weights and biases files. The arrays
+// are left NULL, which only checks the files.
+static void queue_layer_files(const TinyNN_Model* model, const char* model_path, LoadJob* jobs) {
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        LoadJob* weights_job = &jobs[2 * i];
+        snprintf(weights_job->filepath, sizeof(weights_job->filepath), "%s/layer_%d_weights.csv", model_path, i);
+        weights_job->array = NULL;
+        weights_job->rows = model->layer_sizes[i];
+        weights_job->cols = prev_layer_size;
+
+        LoadJob* biases_job = &jobs[2 * i + 1];
+        snprintf(biases_job->filepath, sizeof(biases_job->filepath), "%s/layer_%d_biases.csv", model_path, i);
+        biases_job->array = NULL;
+        biases_job->rows = 1;
+        biases_job->cols = model->layer_sizes[i];
+        prev_layer_size = model->layer_sizes[i];
+    }
+}
+
+static TinyNN_Model* create_model_from_csv_dir(const char* model_path) {
+    TinyNN_Model* model = read_architecture(model_path);
+    if (!model) return NULL;
+    int total_layers = model->hidden_layers + 1;
+
+    // Pick the fastest dense kernels this CPU supports once, instead of per call
+    model->kernels = select_kernels();
+
+    // 2. Allocate memory for weights and biases
+    model->weights = (float**)calloc(total_layers, sizeof(float*));
+    model->biases  = (float**)calloc(total_layers, sizeof(float*));
+    LoadJob* jobs = (LoadJob*)malloc(sizeof(LoadJob) * total_layers * 2);
+    if (!model->weights || !model->biases || !jobs) {
+        free(jobs);
+        free_model(model);
+        return NULL;
+    }
+
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        int current_layer_size = model->layer_sizes[i];
+        size_t weight_count = (size_t)prev_layer_size * current_layer_size;
+        size_t bias_count = current_layer_size;
+
+        model->weights[i] = (float*)malloc(sizeof(float) * weight_count);
+        model->biases[i]  = (float*)malloc(sizeof(float) * bias_count);
+        if (!model->weights[i] || !model->biases[i]) {
+            free(jobs);
+            free_model(model);
+            return NULL;
+        }
+
+        prev_layer_size = current_layer_size;
+    }
+
+    // 3. Queue the weights and biases files; each one is independent of the others
+    queue_layer_files(model, model_path, jobs);
+    for (int i = 0; i < total_layers; i++) {
+        jobs[2 * i].array = model->weights[i];
+        jobs[2 * i + 1].array = model->biases[i];
+    }
+    int loaded = run_load_jobs(jobs, total_layers * 2);
+    free(jobs);
+    if (!loaded) {
+        // On failure, free everything allocated so far and return NULL
+        free_model(model);
+        return NULL;
+    }
+
+    return model;
+}
+
+int validate_csv_model(const char* model_path) {
+    TinyNN_Model* model = read_architecture(model_path);
+    if (!model) return 0;
+    int job_count = (model->hidden_layers + 1) * 2;
+    LoadJob* jobs = (LoadJob*)malloc(sizeof(LoadJob) * job_count);
+    int ok = jobs != NULL;
+    if (ok) {
+        queue_layer_files(model, model_path, jobs);
+        ok = run_load_jobs(jobs, job_count);
+    }
+    free(jobs);
+    free_model(model);
+    return ok;
+}
+
+static TinyNN_Model* load_model(const char* model_path) {
+    // A .tnn file given directly
+    if (is_binary_model_file(model_path)) {
+        return create_model_from_binary(model_path);
+    }
+
+    // A model directory that has been converted to the binary container
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/%s", model_path, TNN_DIR_FILENAME);
+    if (is_binary_model_file(filepath)) {
+        return create_model_from_binary(filepath);
+    }
+
+    return create_model_from_csv_dir(model_path);
+}
+
+// Stores pruned fp32 layers sparse, then re-lays out the rest into kernel panels once; a
+// packed .tnn file maps them directly. If there is no memory for either, the layers left
+// dense and row-major still work.
+static void prepare_loaded_model(TinyNN_Model* model, const char* model_path, float sparse_threshold) {
+    if (model == NULL) return;
+    if (sparsify_model_weights(model, sparse_threshold) < 0) {
+        fprintf(stderr, "WARNING: Not enough memory to store the pruned layers of %s sparse\n", model_path);
+    }
+    if (packing_enabled() && !pack_model_weights(model)) {
+        fprintf(stderr, "WARNING: Not enough memory to pack the weights of %s, using the row-major layout\n",
+                model_path);
+    }
+}
+
+TinyNN_Model* create_model_from_path(const char* model_path) {
+    TinyNN_Model* model = load_model(model_path);
+    prepare_loaded_model(model, model_path, default_sparse_threshold());
+    return model;
+}
+
+TinyNN_LoadOptions default_load_options(void) {
+    TinyNN_LoadOptions options;
+    options.weight_type = TINYNN_WEIGHTS_FP32;
+    options.num_threads = 1;
+    // TINYNN_THREADS=n overrides the thread count, like TINYNN_KERNELS does for kernels
+    const char* threads = getenv("TINYNN_THREADS");
+    if (threads && threads[0] != '\0') options.num_threads = atoi(threads);
+    options.sparse_threshold = default_sparse_threshold();
+    options.stream_window = 0;
+    options.numa = TINYNN_NUMA_OFF;
+    return options;
+}
+
+// Maps a .tnn model for streaming; nothing is converted, since that would load every layer
+static TinyNN_Model* load_streaming_model(const char* model_path, const TinyNN_LoadOptions* options) {
+    char filepath[256];
+    const char* binary_path = model_path;
+    if (!is_binary_model_file(binary_path)) {
+        snprintf(filepath, sizeof(filepath), "%s/%s", model_path, TNN_DIR_FILENAME);
+        binary_path = filepath;
+        if (!is_binary_model_file(binary_path)) {
+            fprintf(stderr, "ERROR: Streaming needs a .tnn model, convert %s to binary first\n", model_path);
+            return NULL;
+        }
+    }
+
+    TinyNN_Model* model = create_model_from_binary_streaming(binary_path);
+    if (!model) return NULL;
+    if (model->weight_type != options->weight_type) {
+        fprintf(stderr, "ERROR: %s stores %s weights; a streamed model runs as stored, so convert the file to %s first\n",
+                binary_path, weight_type_name(model->weight_type), weight_type_name(options->weight_type));
+        free_model(model);
+        return NULL;
+    }
+    if (!enable_streaming(model, options->stream_window)) {
+        free_model(model);
+        return NULL;
+    }
+    return model;
+}
+
+TinyNN_Model* create_model_with_options(const char* model_path, const TinyNN_LoadOptions* options) {
+    TinyNN_LoadOptions defaults = default_load_options();
+    if (options == NULL) options = &defaults;
+
+    // Placed models are loaded once per node (or by an interleaving thread) with these
+    // same options and numa off
+    if (options->numa != TINYNN_NUMA_OFF) return load_numa_model(model_path, options);
+
+    TinyNN_Model* model = NULL;
+    if (options->stream_window > 0) {
+        model = load_streaming_model(model_path, options);
+    } else {
+        model = load_model(model_path);
+        // Weights converted to another type are read row by row, so only fp32 runs get
+        // sparse layers and panels
+        if (options->weight_type == TINYNN_WEIGHTS_FP32) prepare_loaded_model(model, model_path, options->sparse_threshold);
+    }
+    if (model && !convert_model_weights(model, options->weight_type)) {
+        free_model(model);
+        return NULL;
+    }
+    if (model && options->num_threads != 1) {
+        model->pool = create_thread_pool(options->num_threads);
+        if (!model->pool) {
+            fprintf(stderr, "ERROR: Could not start %d inference threads\n", options->num_threads);
+            free_model(model);
+            return NULL;
+        }
+    }
+    return model;
+}
+
+int convert_model_weights(TinyNN_Model* model, TinyNN_WeightType weight_type) {
+    if (model == NULL) return 0;
+    if (model->weight_type == weight_type) return 1;
+    if (model->weight_type != TINYNN_WEIGHTS_FP32) {
+        fprintf(stderr, "ERROR: Cannot convert %s weights to %s, reload the fp32 model instead\n",
+                weight_type_name(model->weight_type), weight_type_name(weight_type));
+        return 0;
+    }
+    switch (weight_type) {
+        case TINYNN_WEIGHTS_INT8:
+            return quantize_model(model, NULL, 0);
+        case TINYNN_WEIGHTS_FP16:
+        case TINYNN_WEIGHTS_BF16:
+            return convert_weights_to_half(model, weight_type);
+        default:
+            fprintf(stderr, "ERROR: Unknown weight type %d\n", (int)weight_type);
+            return 0;
+    }
+}
+
+const char* weight_type_name(TinyNN_WeightType weight_type) {
+    switch (weight_type) {
+        case TINYNN_WEIGHTS_FP32: return "fp32";
+        case TINYNN_WEIGHTS_INT8: return "int8";
+        case TINYNN_WEIGHTS_FP16: return "fp16";
+        case TINYNN_WEIGHTS_BF16: return "bf16";
+    }
+    return "unknown";
+}
+
+int parse_weight_type(const char* name, TinyNN_WeightType* weight_type) {
+    static const TinyNN_WeightType types[] = {TINYNN_WEIGHTS_FP32, TINYNN_WEIGHTS_INT8,
+                                              TINYNN_WEIGHTS_FP16, TINYNN_WEIGHTS_BF16};
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (name && strcmp(name, weight_type_name(types[i])) == 0) {
+            *weight_type = types[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+TinyNN_Activation default_activation(const TinyNN_Model* model, int layer) {
+    return layer < model->hidden_layers ? TINYNN_ACT_RELU : TINYNN_ACT_SOFTMAX;
+}
+
+int init_activations(TinyNN_Model* model) {
+    int total_layers = model->hidden_layers + 1;
+    model->activations = (TinyNN_Activation*)malloc(sizeof(TinyNN_Activation) * total_layers);
+    if (!model->activations) return 0;
+    for (int i = 0; i < total_layers; i++) model->activations[i] = default_activation(model, i);
+    return 1;
+}
+
+const char* activation_name(TinyNN_Activation activation) {
+    switch (activation) {
+        case TINYNN_ACT_NONE:    return "none";
+        case TINYNN_ACT_RELU:    return "relu";
+        case TINYNN_ACT_SIGMOID: return "sigmoid";
+        case TINYNN_ACT_TANH:    return "tanh";
+        case TINYNN_ACT_SOFTMAX: return "softmax";
+    }
+    return "unknown";
+}
+
+int parse_activation(const char* name, TinyNN_Activation* activation) {
+    static const TinyNN_Activation activations[] = {TINYNN_ACT_NONE, TINYNN_ACT_RELU, TINYNN_ACT_SIGMOID,
+                                                    TINYNN_ACT_TANH, TINYNN_ACT_SOFTMAX};
+    for (size_t i = 0; i < sizeof(activations) / sizeof(activations[0]); i++) {
+        if (name && strcmp(name, activation_name(activations[i])) == 0) {
+            *activation = activations[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int points_into_mapping(const TinyNN_Model* model, const void* p) {
+    const char* base = (const char*)model->mapping;
+    return base != NULL && (const char*)p >= base && (const char*)p < base + model->mapping_size;
+}
+
+size_t layer_weight_bytes(const TinyNN_Model* model, int layer) {
+    size_t rows = model->layer_sizes[layer];
+    size_t cols = layer == 0 ? model->input_size : model->layer_sizes[layer - 1];
+    if (layer_is_sparse(model, layer)) {
+        return sparse_layer_bytes(&model->sparse[layer], (int)rows);
+    } else if (model->weight_type == TINYNN_WEIGHTS_INT8) {
+        return rows * (model->quant[layer].padded_cols + sizeof(float));
+    } else if (model->weight_type == TINYNN_WEIGHTS_FP16 || model->weight_type == TINYNN_WEIGHTS_BF16) {
+        return rows * cols * sizeof(uint16_t);
+    }
+    return rows * cols * sizeof(float);
+}
+
+const char* layer_format_name(const TinyNN_Model* model, int layer) {
+    if (model->weight_type != TINYNN_WEIGHTS_FP32) return weight_type_name(model->weight_type);
+    if (layer_is_sparse(model, layer)) {
+        switch (model->sparse[layer].block_rows) {
+            case 1:  return "csr";
+            case 4:  return "bsr4x1";
+            default: return "bsr8x1";
+        }
+    }
+    return model->packed_weights ? "packed" : "row-major";
+}
+
+size_t model_weight_bytes(const TinyNN_Model* model) {
+    size_t total = 0;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        total += layer_weight_bytes(model, i);
+    }
+    return total;
+}
+
+// Copy of 'size' bytes from the mapping, or the array itself if it is already ours.
+// '*failed' is set when an allocation fails.
+static void* own_array(const TinyNN_Model* model, void* p, size_t size, int aligned, int* failed) {
+    if (p == NULL || !points_into_mapping(model, p)) return p;
+    void* copy = aligned ? aligned_malloc(size, 64) : malloc(size);
+    if (!copy) {
+        *failed = 1;
+        return p;
+    }
+    memcpy(copy, p, size);
+    return copy;
+}
+
+int copy_mapped_weights(TinyNN_Model* model) {
+    if (model == NULL || model->mapping == NULL) return model != NULL;
+    if (model->stream) {
+        fprintf(stderr, "ERROR: A streaming model must stay mapped\n");
+        return 0;
+    }
+
+    // Every array is copied before any pointer changes, so a failure leaves the model as it was
+    int layers = model->hidden_layers + 1;
+    void** copies = (void**)calloc((size_t)layers * 5, sizeof(void*));
+    if (!copies) return 0;
+    int failed = 0;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < layers; i++) {
+        size_t rows = (size_t)model->layer_sizes[i];
+        size_t cols = (size_t)prev_layer_size;
+        prev_layer_size = model->layer_sizes[i];
+        void** layer = copies + (size_t)i * 5;
+        layer[0] = own_array(model, model->biases[i], rows * sizeof(float), 0, &failed);
+        if (model->weights) layer[1] = own_array(model, model->weights[i], rows * cols * sizeof(float), 0, &failed);
+        if (model->packed_weights) {
+            layer[2] = own_array(model, model->packed_weights[i],
+                                 packed_layer_floats((int)rows, (int)cols) * sizeof(float), 1, &failed);
+        }
+        if (model->quant) {
+            layer[3] = own_array(model, model->quant[i].weights, rows * model->quant[i].padded_cols, 1, &failed);
+            layer[4] = own_array(model, model->quant[i].scales, rows * sizeof(float), 1, &failed);
+        } else if (model->half_weights) {
+            layer[3] = own_array(model, model->half_weights[i], rows * cols * sizeof(uint16_t), 1, &failed);
+        }
+    }
+
+    if (failed) {
+        // Only the copies differ from the model's own pointers
+        for (int i = 0; i < layers; i++) {
+            void** layer = copies + (size_t)i * 5;
+            if (layer[0] != model->biases[i]) free(layer[0]);
+            if (model->weights && layer[1] != model->weights[i]) free(layer[1]);
+            if (model->packed_weights && layer[2] != model->packed_weights[i]) aligned_free(layer[2]);
+            if (model->quant) {
+                if (layer[3] != model->quant[i].weights) aligned_free(layer[3]);
+                if (layer[4] != model->quant[i].scales) aligned_free(layer[4]);
+            } else if (model->half_weights && layer[3] != model->half_weights[i]) {
+                aligned_free(layer[3]);
+            }
+        }
+        free(copies);
+        fprintf(stderr, "ERROR: Not enough memory to copy the model's weights\n");
+        return 0;
+    }
+
+    // INT8 and half precision layers are either all mapped or all converted, so one flag
+    // per layer (INT8) or per model (half) still describes who frees them
+    for (int i = 0; i < layers; i++) {
+        void** layer = copies + (size_t)i * 5;
+        model->biases[i] = (float*)layer[0];
+        if (model->weights) model->weights[i] = (float*)layer[1];
+        if (model->packed_weights) model->packed_weights[i] = (float*)layer[2];
+        if (model->quant) {
+            model->quant[i].weights = (int8_t*)layer[3];
+            model->quant[i].scales = (float*)layer[4];
+            model->quant[i].owns_memory = 1;
+        } else if (model->half_weights) {
+            model->half_weights[i] = (uint16_t*)layer[3];
+        }
+    }
+    if (model->half_weights) model->owns_half_weights = 1;
+    free(copies);
+
+    unmap_file(model->mapping, model->mapping_size);
+    model->mapping = NULL;
+    model->mapping_size = 0;
+    return 1;
+}
+
+void free_model(TinyNN_Model* model) {
+    if (model == NULL) return; // Safety check
+
+    // Arrays inside a mapped file are released with the mapping at the end, only the
+    // pointer tables and anything converted after loading are ours
+    if (model->weights) {
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (model->weights[i] && !points_into_mapping(model, model->weights[i])) free(model->weights[i]);
+        }
+        free(model->weights);
+    }
+    if (model->packed_weights) {
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (!points_into_mapping(model, model->packed_weights[i])) aligned_free(model->packed_weights[i]);
+        }
+        free(model->packed_weights);
+    }
+    free_sparse_layers(model);
+    if (model->biases) {
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (model->biases[i] && !points_into_mapping(model, model->biases[i])) free(model->biases[i]);
+        }
+        free(model->biases);
+    }
+    if (model->quant) {
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (model->quant[i].owns_memory) {
+                aligned_free(model->quant[i].weights);
+                aligned_free(model->quant[i].scales);
+            }
+        }
+        free(model->quant);
+    }
+    if (model->half_weights) {
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (model->owns_half_weights) aligned_free(model->half_weights[i]);
+        }
+        free(model->half_weights);
+    }
+    if (model->layer_sizes) free(model->layer_sizes);
+    free(model->activations);
+    free_numa_replicas(model);
+    free_thread_pool(model->pool);
+    disable_profiling(model);
+    disable_streaming(model);
+    if (model->mapping) unmap_file(model->mapping, model->mapping_size);
+    free(model);
+}
+
+// Computes a tile of out[n][j] += sum_k in[n][k] * W[j][k] for the batch rows
+// [0, batch_size), weight rows [row_start, row_end) and columns [col_start, col_end).
+// Works on 4 samples x 4 neurons at a time so each loaded weight and input
+// value is used four times from registers.
+static void gemm_tile(const float* in, int in_stride, const float* weights, float* out, int out_stride,
+                      int batch_size, int row_start, int row_end, int col_start, int col_end) {
+    int n = 0;
+    for (; n + 4 <= batch_size; n += 4) {
+        const float* x0 = in + (n + 0) * in_stride;
+        const float* x1 = in + (n + 1) * in_stride;
+        const float* x2 = in + (n + 2) * in_stride;
+        const float* x3 = in + (n + 3) * in_stride;
+        int j = row_start;
+        for (; j + 4 <= row_end; j += 4) {
+            const float* w0 = weights + (j + 0) * in_stride;
+            const float* w1 = weights + (j + 1) * in_stride;
+            const float* w2 = weights + (j + 2) * in_stride;
+            const float* w3 = weights + (j + 3) * in_stride;
+            float acc[4][4] = {{0.0f}};
+            for (int k = col_start; k < col_end; k++) {
+                float a0 = x0[k], a1 = x1[k], a2 = x2[k], a3 = x3[k];
+                float b0 = w0[k], b1 = w1[k], b2 = w2[k], b3 = w3[k];
+                acc[0][0] += a0 * b0; acc[0][1] += a0 * b1; acc[0][2] += a0 * b2; acc[0][3] += a0 * b3;
+                acc[1][0] += a1 * b0; acc[1][1] += a1 * b1; acc[1][2] += a1 * b2; acc[1][3] += a1 * b3;
+                acc[2][0] += a2 * b0; acc[2][1] += a2 * b1; acc[2][2] += a2 * b2; acc[2][3] += a2 * b3;
+                acc[3][0] += a3 * b0; acc[3][1] += a3 * b1; acc[3][2] += a3 * b2; acc[3][3] += a3 * b3;
+            }
+            for (int r = 0; r < 4; r++) {
+                float* y = out + (n + r) * out_stride + j;
+                y[0] += acc[r][0]; y[1] += acc[r][1]; y[2] += acc[r][2]; y[3] += acc[r][3];
+            }
+        }
+        // Leftover neurons for this group of 4 samples
+        for (; j < row_end; j++) {
+            const float* w = weights + j * in_stride;
+            float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+            for (int k = col_start; k < col_end; k++) {
+                s0 += x0[k] * w[k]; s1 += x1[k] * w[k]; s2 += x2[k] * w[k]; s3 += x3[k] * w[k];
+            }
+            out[(n + 0) * out_stride + j] += s0;
+            out[(n + 1) * out_stride + j] += s1;
+            out[(n + 2) * out_stride + j] += s2;
+            out[(n + 3) * out_stride + j] += s3;
+        }
+    }
+    // Leftover samples
+    for (; n < batch_size; n++) {
+        const float* x = in + n * in_stride;
+        for (int j = row_start; j < row_end; j++) {
+            const float* w = weights + j * in_stride;
+            float sum = 0.0f;
+            for (int k = col_start; k < col_end; k++) {
+                sum += x[k] * w[k];
+            }
+            out[n * out_stride + j] += sum;
+        }
+    }
+}
+
+TinyNN_Context* create_context(const TinyNN_Model* model, int max_batch) {
+    if (model == NULL || max_batch <= 0) return NULL;
+    model = numa_local_model(model);
+
+    TinyNN_Context* ctx = (TinyNN_Context*)malloc(sizeof(TinyNN_Context));
+    if (!ctx) return NULL;
+    ctx->model = model;
+    ctx->kernels = model->kernels ? model->kernels : select_kernels();
+    ctx->max_batch = max_batch;
+    ctx->pool = model->pool;
+    ctx->counters = NULL;
+    ctx->output_mode = TINYNN_OUTPUT_DEFAULT;
+
+    // The input comes from the caller and the output layer normally writes straight into the
+    // caller's buffer, but top-k selection keeps the logits in the buffer the last hidden
+    // layer did not use, so the buffers fit every layer
+    ctx->max_width = 1;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        if (model->layer_sizes[i] > ctx->max_width) ctx->max_width = model->layer_sizes[i];
+    }
+
+    // Both ping-pong buffers live in one 64-byte aligned block
+    size_t buffer_floats = (size_t)ctx->max_width * max_batch;
+    buffer_floats = (buffer_floats + 15) & ~(size_t)15; // keep the second buffer cache-line aligned
+    ctx->workspace = (float*)aligned_malloc(sizeof(float) * buffer_floats * 2, 64);
+    if (!ctx->workspace) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->buffers[0] = ctx->workspace;
+    ctx->buffers[1] = ctx->workspace + buffer_floats;
+
+    // INT8 models quantize each layer's input once per sample before the integer kernels run
+    ctx->quantized = NULL;
+    ctx->quantized_scales = NULL;
+    ctx->sparse_tiles = NULL;
+    if (model->weight_type == TINYNN_WEIGHTS_INT8) {
+        int max_padded_cols = 0;
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (model->quant[i].padded_cols > max_padded_cols) max_padded_cols = model->quant[i].padded_cols;
+        }
+        ctx->quantized = (int8_t*)aligned_malloc((size_t)max_padded_cols * max_batch, 64);
+        ctx->quantized_scales = (float*)malloc(sizeof(float) * max_batch);
+        if (!ctx->quantized || !ctx->quantized_scales) {
+            free_context(ctx);
+            return NULL;
+        }
+    }
+
+    // Sparse layers read batches as interleaved tiles, built once per layer by interleave_layer_inputs()
+    ctx->sparse_tiles = NULL;
+    if (model->sparse && max_batch > 1) {
+        int max_cols = 0;
+        int prev_layer_size = model->input_size;
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            if (layer_is_sparse(model, i) && prev_layer_size > max_cols) max_cols = prev_layer_size;
+            prev_layer_size = model->layer_sizes[i];
+        }
+        size_t tiles = ((size_t)max_batch + SPARSE_TILE_SAMPLES - 1) / SPARSE_TILE_SAMPLES;
+        ctx->sparse_tiles = (float*)aligned_malloc(sizeof(float) * tiles * SPARSE_TILE_SAMPLES * max_cols, 64);
+        if (!ctx->sparse_tiles) {
+            free_context(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+void free_context(TinyNN_Context* ctx) {
+    if (ctx == NULL) return;
+    close_context_counters(ctx);
+    aligned_free(ctx->workspace);
+    aligned_free(ctx->quantized);
+    free(ctx->quantized_scales);
+    aligned_free(ctx->sparse_tiles);
+    free(ctx);
+}
+
+// One layer of one chunk. Tasks compute it for a range of samples (batched mode) or a
+// range of output neurons; ranges never overlap, so tasks write disjoint outputs.
+typedef struct {
+    TinyNN_Context* ctx;
+    int layer;
+    const float* input;
+    int input_size;
+    float* output;
+    int output_size;
+    int batch_size;
+    int activation;       // Elementwise part of the layer's activation, applied by the kernels
+    int split_samples;    // Non-zero: each task takes per_task samples, otherwise per_task neurons
+    int per_task;
+} LayerJob;
+
+void context_set_thread_pool(TinyNN_Context* ctx, TinyNN_ThreadPool* pool) {
+    if (ctx) ctx->pool = pool;
+}
+
+void context_set_output_mode(TinyNN_Context* ctx, TinyNN_OutputMode mode) {
+    if (ctx) ctx->output_mode = mode;
+}
+
+// INT8 layer: run the integer kernel over blocks of weight rows so each block is reused by
+// every sample while it is still in cache. Inputs were quantized by quantize_layer_inputs().
+static void int8_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    const TinyNN_Context* ctx = job->ctx;
+    const TinyNN_QuantLayer* q = &ctx->model->quant[job->layer];
+    const float* biases = ctx->model->biases[job->layer];
+    for (int row = row_start; row < row_end; row += BLOCK_ROWS) {
+        int rows = row_end - row < BLOCK_ROWS ? row_end - row : BLOCK_ROWS;
+        for (int n = sample_start; n < sample_end; n++) {
+            ctx->kernels->dense_int8(q->weights + (size_t)row * q->padded_cols, q->scales + row, biases + row,
+                                     ctx->quantized + (size_t)n * q->padded_cols, ctx->quantized_scales[n],
+                                     job->output + (size_t)n * job->output_size + row, rows, q->padded_cols,
+                                     job->activation);
+        }
+    }
+}
+
+// FP16/BF16 layer: like the INT8 path, each block of weight rows is widened and reused
+// by the whole batch while it is still in cache.
+static void half_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    const TinyNN_Model* model = job->ctx->model;
+    const uint16_t* weights = model->half_weights[job->layer];
+    const float* biases = model->biases[job->layer];
+    dense_half_kernel_fn dense = model->weight_type == TINYNN_WEIGHTS_BF16 ? job->ctx->kernels->dense_bf16
+                                                                         : job->ctx->kernels->dense_fp16;
+    for (int row = row_start; row < row_end; row += BLOCK_ROWS) {
+        int rows = row_end - row < BLOCK_ROWS ? row_end - row : BLOCK_ROWS;
+        for (int n = sample_start; n < sample_end; n++) {
+            dense(weights + (size_t)row * job->input_size, biases + row, job->input + (size_t)n * job->input_size,
+                  job->output + (size_t)n * job->output_size + row, rows, job->input_size, job->activation);
+        }
+    }
+}
+
+// Packed fp32 layer. Row ranges start on a panel boundary (see run_layer()). Batches go
+// through the weights one block of panels at a time, so each block stays in cache while
+// every sample tile passes over it.
+static void packed_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    const TinyNN_Model* model = job->ctx->model;
+    const float* panels = model->packed_weights[job->layer];
+    const float* biases = model->biases[job->layer];
+    int input_size = job->input_size;
+
+    if (job->batch_size == 1) {
+        job->ctx->kernels->dense_packed(panels + (size_t)row_start * input_size, biases + row_start, job->input,
+                                        job->output + row_start, row_end - row_start, input_size, job->activation);
+        return;
+    }
+    const float* input = job->input + (size_t)sample_start * input_size;
+    float* output = job->output + (size_t)sample_start * job->output_size;
+    for (int row = row_start; row < row_end; row += BLOCK_ROWS) {
+        int rows = row_end - row < BLOCK_ROWS ? row_end - row : BLOCK_ROWS;
+        job->ctx->kernels->gemm_packed(panels + (size_t)row * input_size, biases + row, input, input_size,
+                                       output + row, job->output_size, sample_end - sample_start, rows,
+                                       input_size, job->activation);
+    }
+}
+
+// Sparse fp32 layer. Row ranges start on a panel boundary, which is also a block row
+// boundary, and sample ranges on a tile boundary (see run_layer()). Batches go through
+// the layer one block of rows at a time, reading every tile of the interleaved input
+// from interleave_layer_inputs() while that block's weights are in cache.
+static void sparse_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    const TinyNN_Model* model = job->ctx->model;
+    const TinyNN_SparseLayer* sparse = &model->sparse[job->layer];
+    const float* biases = model->biases[job->layer];
+    const TinyNN_Kernels* kernels = job->ctx->kernels;
+    int block_rows = sparse->block_rows;
+
+    if (job->batch_size == 1) {
+        kernels->sparse(sparse->block_ptr + row_start / block_rows, sparse->columns, sparse->values, block_rows,
+                        biases + row_start, job->input, job->output + row_start, row_end - row_start,
+                        job->activation);
+        return;
+    }
+    for (int row = row_start; row < row_end; row += BLOCK_ROWS) {
+        int rows = row_end - row < BLOCK_ROWS ? row_end - row : BLOCK_ROWS;
+        for (int n = sample_start; n < sample_end; n += SPARSE_TILE_SAMPLES) {
+            int samples = sample_end - n < SPARSE_TILE_SAMPLES ? sample_end - n : SPARSE_TILE_SAMPLES;
+            kernels->sparse_tile(sparse->block_ptr + row / block_rows, sparse->columns, sparse->values, block_rows,
+                                 biases + row, job->ctx->sparse_tiles + (size_t)n * job->input_size, samples,
+                                 job->output + (size_t)n * job->output_size + row, job->output_size, rows,
+                                 job->activation);
+        }
+    }
+}
+
+// Score of one top-k class; the kernels apply their own activations
+static float activate(float x, int activation) {
+    switch (activation) {
+        case TINYNN_ACT_RELU:    return relu(x);
+        case TINYNN_ACT_SIGMOID: return sigmoid(x);
+        case TINYNN_ACT_TANH:    return tanhf(x);
+        default:                 return x;
+    }
+}
+
+static void fp32_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    const TinyNN_Model* model = job->ctx->model;
+    const float* weights = model->weights[job->layer];
+    const float* biases = model->biases[job->layer];
+    int input_size = job->input_size;
+    int output_size = job->output_size;
+
+    if (model->packed_weights) {
+        packed_layer_range(job, sample_start, sample_end, row_start, row_end);
+        return;
+    }
+
+    if (job->batch_size == 1) {
+        // Core Dense Layer Calculation: output = W * input + b
+        // Weights are stored as a flat array (row-major order), W[j][k] = weights[j * input_size + k].
+        // The bias and activation are fused into the kernel so the output is written only once.
+        job->ctx->kernels->dense(weights + (size_t)row_start * input_size, biases + row_start, job->input,
+                                 job->output + row_start, row_end - row_start, input_size, job->activation);
+        return;
+    }
+
+    // Batched: start every output row from the bias, then accumulate W * input tile by tile
+    const float* input = job->input + (size_t)sample_start * input_size;
+    float* output = job->output + (size_t)sample_start * output_size;
+    int samples = sample_end - sample_start;
+    for (int n = 0; n < samples; n++) {
+        memcpy(output + (size_t)n * output_size + row_start, biases + row_start, sizeof(float) * (row_end - row_start));
+    }
+    for (int row = row_start; row < row_end; row += BLOCK_ROWS) {
+        int block_end = row + BLOCK_ROWS < row_end ? row + BLOCK_ROWS : row_end;
+        for (int col = 0; col < input_size; col += BLOCK_COLS) {
+            int col_end = col + BLOCK_COLS < input_size ? col + BLOCK_COLS : input_size;
+            gemm_tile(input, input_size, weights, output, output_size, samples, row, block_end, col, col_end);
+        }
+    }
+    if (job->activation != TINYNN_ACT_NONE) {
+        for (int n = 0; n < samples; n++) {
+            job->ctx->kernels->activate(output + (size_t)n * output_size + row_start, row_end - row_start,
+                                        job->activation);
+        }
+    }
+}
+
+static void compute_layer_range(const LayerJob* job, int sample_start, int sample_end, int row_start, int row_end) {
+    switch (job->ctx->model->weight_type) {
+        case TINYNN_WEIGHTS_INT8:
+            int8_layer_range(job, sample_start, sample_end, row_start, row_end);
+            break;
+        case TINYNN_WEIGHTS_FP16:
+        case TINYNN_WEIGHTS_BF16:
+            half_layer_range(job, sample_start, sample_end, row_start, row_end);
+            break;
+        default:
+            if (layer_is_sparse(job->ctx->model, job->layer)) {
+                sparse_layer_range(job, sample_start, sample_end, row_start, row_end);
+            } else {
+                fp32_layer_range(job, sample_start, sample_end, row_start, row_end);
+            }
+            break;
+    }
+}
+
+static void layer_task(void* arg, int task) {
+    const LayerJob* job = (const LayerJob*)arg;
+    int total = job->split_samples ? job->batch_size : job->output_size;
+    int start = task * job->per_task;
+    int end = start + job->per_task < total ? start + job->per_task : total;
+    if (job->split_samples) {
+        compute_layer_range(job, start, end, 0, job->output_size);
+    } else {
+        compute_layer_range(job, 0, job->batch_size, start, end);
+    }
+}
+
+// Quantizes every sample's input once, before the rows of an INT8 layer are handed out
+static void quantize_layer_inputs(TinyNN_Context* ctx, int layer, const float* input, int input_size, int batch_size) {
+    const TinyNN_QuantLayer* q = &ctx->model->quant[layer];
+    for (int n = 0; n < batch_size; n++) {
+        ctx->quantized_scales[n] = quantize_activations(input + (size_t)n * input_size, input_size, q->padded_cols,
+                                                        q->input_scale, ctx->quantized + (size_t)n * q->padded_cols);
+    }
+}
+
+// Interleaves a batch's layer input into tiles of SPARSE_TILE_SAMPLES samples for the
+// sparse tile kernels, once before the rows of a sparse layer are handed out
+static void interleave_layer_inputs(TinyNN_Context* ctx, const float* input, int input_size, int batch_size) {
+    for (int n = 0; n < batch_size; n += SPARSE_TILE_SAMPLES) {
+        float* tile = ctx->sparse_tiles + (size_t)n * input_size;
+        int samples = batch_size - n < SPARSE_TILE_SAMPLES ? batch_size - n : SPARSE_TILE_SAMPLES;
+        for (int s = 0; s < SPARSE_TILE_SAMPLES; s++) {
+            if (s < samples) {
+                const float* x = input + (size_t)(n + s) * input_size;
+                for (int k = 0; k < input_size; k++) tile[(size_t)k * SPARSE_TILE_SAMPLES + s] = x[k];
+            } else {
+                for (int k = 0; k < input_size; k++) tile[(size_t)k * SPARSE_TILE_SAMPLES + s] = 0.0f;
+            }
+        }
+    }
+}
+
+// Splits a layer across the context's thread pool. Batches with at least one sample per
+// task are split by sample (whole tiles for sparse layers); otherwise the output neurons
+// are split in multiples of PACK_PANEL_ROWS (16), i.e. on panel boundaries of packed layers
+// and whole 8-row groups of the other SIMD kernels, so every row is computed exactly as in
+// a single-threaded run. Small layers stay on the calling thread.
+static void run_layer(TinyNN_Context* ctx, LayerJob* job) {
+    long long work = (long long)job->batch_size * job->output_size * job->input_size;
+    int sparse = layer_is_sparse(ctx->model, job->layer);
+    if (sparse) work = (long long)(work * (1.0f - ctx->model->sparse[job->layer].zero_fraction));
+    int tasks = thread_pool_size(ctx->pool);
+    if (work / MIN_TASK_WORK < tasks) tasks = (int)(work / MIN_TASK_WORK);
+    if (tasks <= 1) {
+        compute_layer_range(job, 0, job->batch_size, 0, job->output_size);
+        return;
+    }
+
+    if (job->batch_size >= tasks) {
+        job->split_samples = 1;
+        job->per_task = (job->batch_size + tasks - 1) / tasks;
+        if (sparse) job->per_task = (job->per_task + SPARSE_TILE_SAMPLES - 1) & ~(SPARSE_TILE_SAMPLES - 1);
+        tasks = (job->batch_size + job->per_task - 1) / job->per_task;
+    } else {
+        job->split_samples = 0;
+        // Whole panels per task, so packed layers split on panel boundaries
+        job->per_task = ((job->output_size + tasks - 1) / tasks + PACK_PANEL_ROWS - 1) & ~(PACK_PANEL_ROWS - 1);
+        tasks = (job->output_size + job->per_task - 1) / job->per_task;
+    }
+    thread_pool_run(ctx->pool, layer_task, job, tasks);
+}
+
+// Runs one chunk of at most ctx->max_batch samples through layers first..last.
+// Layers before 'last' alternate between the two context buffers; 'last' writes to
+// 'outputs', post-processed as 'mode' says if it is the output layer.
+static void run_layers(TinyNN_Context* ctx, int first, int last, const float* inputs, int batch_size,
+                       float* outputs, TinyNN_OutputMode mode) {
+    const TinyNN_Model* model = ctx->model;
+    const float* current_input = inputs;
+    int current_input_size = first > 0 ? model->layer_sizes[first - 1] : model->input_size;
+    TinyNN_LayerSample sample;
+
+    // Loop through each layer (hidden layers + output layer)
+    for (int i = first; i <= last; i++) {
+        int layer_output_size = model->layer_sizes[i];
+        int is_hidden = i < model->hidden_layers;
+        float* layer_output = i < last ? ctx->buffers[i & 1] : outputs;
+        if (model->profile) profile_layer_begin(ctx, &sample);
+        if (model->stream) stream_layer_begin(model->stream, i);
+
+        if (model->weight_type == TINYNN_WEIGHTS_INT8) {
+            quantize_layer_inputs(ctx, i, current_input, current_input_size, batch_size);
+        } else if (batch_size > 1 && layer_is_sparse(model, i)) {
+            interleave_layer_inputs(ctx, current_input, current_input_size, batch_size);
+        }
+        LayerJob job;
+        job.ctx = ctx;
+        job.layer = i;
+        job.input = current_input;
+        job.input_size = current_input_size;
+        job.output = layer_output;
+        job.output_size = layer_output_size;
+        job.batch_size = batch_size;
+        // Softmax needs the whole row, so the kernels store raw values and it runs below.
+        // Output modes other than the default start from the raw logits.
+        TinyNN_Activation activation = is_hidden || mode == TINYNN_OUTPUT_DEFAULT ? model->activations[i]
+                                                                                  : TINYNN_ACT_NONE;
+        job.activation = activation == TINYNN_ACT_SOFTMAX ? TINYNN_ACT_NONE : activation;
+        job.split_samples = 0;
+        job.per_task = 0;
+        run_layer(ctx, &job);
+
+        if (activation == TINYNN_ACT_SOFTMAX) {
+            for (int n = 0; n < batch_size; n++) {
+                ctx->kernels->softmax(layer_output + (size_t)n * layer_output_size, layer_output_size);
+            }
+        } else if (!is_hidden && mode == TINYNN_OUTPUT_LOG_SOFTMAX) {
+            for (int n = 0; n < batch_size; n++) {
+                float* row = layer_output + (size_t)n * layer_output_size;
+                float lse = ctx->kernels->log_sum_exp(row, layer_output_size);
+                for (int j = 0; j < layer_output_size; j++) row[j] -= lse;
+            }
+        }
+        if (model->stream) stream_layer_end(model->stream, i);
+        if (model->profile) profile_layer_end(ctx, i, batch_size, &sample);
+
+        // The output of this layer is the input to the next
+        current_input = layer_output;
+        current_input_size = layer_output_size;
+    }
+}
+
+int forward_pass_into(TinyNN_Context* ctx, const float* input, float* output) {
+    if (ctx == NULL || input == NULL || output == NULL) return 0;
+    run_layers(ctx, 0, ctx->model->hidden_layers, input, 1, output, ctx->output_mode);
+    return 1;
+}
+
+int forward_pass_batch_into(TinyNN_Context* ctx, const float* inputs, int batch_size, float* outputs) {
+    if (ctx == NULL || inputs == NULL || outputs == NULL || batch_size < 0) return 0;
+    const TinyNN_Model* model = ctx->model;
+
+    // Batches larger than the context was planned for are processed in chunks
+    for (int start = 0; start < batch_size; start += ctx->max_batch) {
+        int chunk = batch_size - start < ctx->max_batch ? batch_size - start : ctx->max_batch;
+        run_layers(ctx, 0, model->hidden_layers, inputs + (size_t)start * model->input_size, chunk,
+                   outputs + (size_t)start * model->output_size, ctx->output_mode);
+    }
+    return 1;
+}
+
+int forward_layers_into(TinyNN_Context* ctx, int first_layer, int last_layer, const float* inputs,
+                        int batch_size, float* outputs) {
+    if (ctx == NULL || inputs == NULL || outputs == NULL || batch_size < 0) return 0;
+    const TinyNN_Model* model = ctx->model;
+    if (first_layer < 0 || last_layer < first_layer || last_layer > model->hidden_layers) return 0;
+    int input_size = first_layer > 0 ? model->layer_sizes[first_layer - 1] : model->input_size;
+    int output_size = model->layer_sizes[last_layer];
+
+    for (int start = 0; start < batch_size; start += ctx->max_batch) {
+        int chunk = batch_size - start < ctx->max_batch ? batch_size - start : ctx->max_batch;
+        run_layers(ctx, first_layer, last_layer, inputs + (size_t)start * input_size, chunk,
+                   outputs + (size_t)start * output_size, ctx->output_mode);
+    }
+    return 1;
+}
+
+// Buffer for a chunk's logits: the one the last hidden layer did not write
+static float* logits_buffer(const TinyNN_Context* ctx) {
+    return ctx->buffers[ctx->model->hidden_layers & 1];
+}
+
+int forward_pass_top_k_into(TinyNN_Context* ctx, const float* inputs, int batch_size, int k,
+                            TinyNN_Prediction* predictions) {
+    if (ctx == NULL || inputs == NULL || predictions == NULL || batch_size < 0) return 0;
+    const TinyNN_Model* model = ctx->model;
+    int output_size = model->output_size;
+    if (k < 1 || k > output_size) return 0;
+    TinyNN_Activation activation = model->activations[model->hidden_layers];
+    float* logits = logits_buffer(ctx);
+    int indices[TOP_K_STACK_LIMIT];
+    int* selected = k <= TOP_K_STACK_LIMIT ? indices : (int*)malloc(sizeof(int) * k);
+    if (!selected) return 0;
+
+    for (int start = 0; start < batch_size; start += ctx->max_batch) {
+        int chunk = batch_size - start < ctx->max_batch ? batch_size - start : ctx->max_batch;
+        run_layers(ctx, 0, model->hidden_layers, inputs + (size_t)start * model->input_size, chunk, logits,
+                   TINYNN_OUTPUT_LOGITS);
+        for (int n = 0; n < chunk; n++) {
+            const float* row = logits + (size_t)n * output_size;
+            TinyNN_Prediction* out = predictions + (size_t)(start + n) * k;
+            top_k_indices(row, output_size, k, selected);
+            // Every activation is monotonic, so ranking the logits ranks the outputs
+            float lse = activation == TINYNN_ACT_SOFTMAX ? ctx->kernels->log_sum_exp(row, output_size) : 0.0f;
+            for (int j = 0; j < k; j++) {
+                float logit = row[selected[j]];
+                out[j].index = selected[j];
+                out[j].score = activation == TINYNN_ACT_SOFTMAX ? expf(logit - lse) : activate(logit, activation);
+            }
+        }
+    }
+    if (selected != indices) free(selected);
+    return 1;
+}
+
+int forward_pass_argmax_into(TinyNN_Context* ctx, const float* inputs, int batch_size, int* classes) {
+    if (ctx == NULL || inputs == NULL || classes == NULL || batch_size < 0) return 0;
+    const TinyNN_Model* model = ctx->model;
+    float* logits = logits_buffer(ctx);
+    for (int start = 0; start < batch_size; start += ctx->max_batch) {
+        int chunk = batch_size - start < ctx->max_batch ? batch_size - start : ctx->max_batch;
+        run_layers(ctx, 0, model->hidden_layers, inputs + (size_t)start * model->input_size, chunk, logits,
+                   TINYNN_OUTPUT_LOGITS);
+        for (int n = 0; n < chunk; n++) {
+            top_k_indices(logits + (size_t)n * model->output_size, model->output_size, 1, &classes[start + n]);
+        }
+    }
+    return 1;
+}
+
+float* forward_pass(TinyNN_Model* model, float* input) {
+    // Convenience wrapper: plans a one-off context for this call.
+    // Callers running many inferences should keep a context and use forward_pass_into().
+    TinyNN_Context* ctx = create_context(model, 1);
+    if (!ctx) return NULL;
+
+    // The CALLER is responsible for freeing this memory.
+    float* output = (float*)malloc(sizeof(float) * model->output_size);
+    if (output) forward_pass_into(ctx, input, output);
+
+    free_context(ctx);
+    return output;
+}
+
+float* forward_pass_batch(TinyNN_Model* model, const float* inputs, int batch_size) {
+    if (batch_size <= 0) return NULL;
+    TinyNN_Context* ctx = create_context(model, batch_size);
+    if (!ctx) return NULL;
+
+    // The CALLER is responsible for freeing this memory.
+    float* outputs = (float*)malloc(sizeof(float) * (size_t)batch_size * model->output_size);
+    if (outputs) forward_pass_batch_into(ctx, inputs, batch_size, outputs);
+
+    free_context(ctx);
+    return outputs;
+}
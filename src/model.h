@@ -1,17 +1,215 @@
-#ifndef MODEL_H
-#define MODEL_H
-
-typedef struct {
-    int input_size;
-    int output_size;
-    int hidden_layers;
-    int* layer_sizes;     // e.g., [64, 32, 10]
-    float** weights;      // All weights flattened by layer
-    float** biases;       // All biases per layer
-} TinyNN_Model;
-
-TinyNN_Model* create_model_from_path(const char* model_path);
-void free_model(TinyNN_Model* model);
-float* forward_pass(TinyNN_Model* model, float* input);
-
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kernels.h"
+#include "thread_pool.h"
+
+// Storage type of the layer weights.
+typedef enum {
+    TINYNN_WEIGHTS_FP32 = 0,
+    TINYNN_WEIGHTS_INT8 = 1,
+    TINYNN_WEIGHTS_FP16 = 2,  // IEEE half precision, widened to fp32 in the kernels
+    TINYNN_WEIGHTS_BF16 = 3   // bfloat16 (fp32 exponent, 7-bit mantissa)
+} TinyNN_WeightType;
+
+// INT8 form of one layer, produced by quantize_model().
+typedef struct {
+    int8_t* weights;      // [rows][padded_cols], symmetric per-row quantization, zero padded
+    float* scales;        // One dequantization scale per output row
+    int padded_cols;      // Row stride in bytes, a multiple of INT8_COLUMN_PADDING
+    float input_scale;    // Calibrated scale for this layer's input activations; 0 = per sample
+    int owns_memory;      // 0 when weights/scales point into a mapped model file
+} TinyNN_QuantLayer;
+
+// Sparse form of one pruned fp32 layer, produced by sparsify_model_weights() (sparse.h).
+// The layout is described next to SPARSE_MAX_BLOCK_ROWS in kernels.h.
+typedef struct {
+    int block_rows;       // 0 = the layer is dense; 1 = CSR; 4 or 8 = blocks of block_rows x 1
+    int32_t* block_ptr;   // One entry per block row, plus the end
+    int32_t* columns;     // Input column of every block
+    float* values;        // block_rows weights per block, zero for rows past the end of the layer
+    int32_t block_count;
+    float zero_fraction;  // Share of the layer's weights that are zero
+} TinyNN_SparseLayer;
+
+// Per-layer profiling report and hardware counters, see profiler.h
+typedef struct TinyNN_Profile TinyNN_Profile;
+typedef struct TinyNN_PerfCounters TinyNN_PerfCounters;
+// Out-of-core state of a streaming model, see streaming.h
+typedef struct TinyNN_Stream TinyNN_Stream;
+// Per-node copies of a NUMA-replicated model, see numa.h
+typedef struct TinyNN_NumaReplicas TinyNN_NumaReplicas;
+
+typedef struct {
+    int input_size;
+    int output_size;
+    int hidden_layers;
+    int* layer_sizes;     // e.g., [64, 32, 10]
+    float** weights;      // All weights flattened by layer
+    float** packed_weights;   // fp32 models after packing (pack.h): panels per layer (weights[i] is then NULL)
+    TinyNN_SparseLayer* sparse; // One entry per layer once an fp32 layer is stored sparse, else NULL
+                              // (weights[i] and packed_weights[i] are then NULL for that layer)
+    float** biases;       // All biases per layer
+    TinyNN_Activation* activations; // One per layer (ReLU hidden, softmax output unless the model says otherwise)
+    TinyNN_WeightType weight_type;
+    TinyNN_QuantLayer* quant; // One entry per layer for INT8 models (weights[i] is then NULL)
+    uint16_t** half_weights;  // FP16/BF16 models: [rows][cols] per layer (weights[i] is then NULL)
+    int owns_half_weights;    // 0 when half_weights point into a mapped model file
+    const TinyNN_Kernels* kernels; // SIMD kernel set picked for this CPU at load time
+    void* mapping;        // Non-NULL when weights/biases point into a mapped binary model file
+    size_t mapping_size;
+    TinyNN_ThreadPool* pool; // Workers started at load time (TinyNN_LoadOptions.num_threads), or NULL
+    TinyNN_Profile* profile; // Per-layer report while profiling is enabled, or NULL
+    TinyNN_Stream* stream;   // Prefetch window of a model streamed from disk, or NULL
+    TinyNN_NumaReplicas* numa; // Copies on the other NUMA nodes of a replicated model, or NULL
+} TinyNN_Model;
+
+// What forward passes write for the output layer, see context_set_output_mode().
+typedef enum {
+    TINYNN_OUTPUT_DEFAULT = 0,     // The output layer's activation (probabilities for softmax)
+    TINYNN_OUTPUT_LOGITS = 1,      // Raw values before the output activation
+    TINYNN_OUTPUT_LOG_SOFTMAX = 2  // log(softmax(logits)), whatever the output activation
+} TinyNN_OutputMode;
+
+// One class picked by forward_pass_top_k_into().
+typedef struct {
+    int index;            // Output neuron
+    float score;          // Its output after the model's activation (a probability for softmax)
+} TinyNN_Prediction;
+
+// Execution plan for one caller: workspace sized once from the model so that
+// inference does no heap allocation. The model itself is only read, so any number of
+// threads can share one model as long as each one uses its own context.
+typedef struct {
+    const TinyNN_Model* model;
+    const TinyNN_Kernels* kernels;
+    int max_batch;        // Largest batch processed in one go; bigger batches are chunked
+    int max_width;        // Widest layer
+    float* workspace;     // One aligned block holding both ping-pong buffers
+    float* buffers[2];    // Activations of even / odd layers
+    int8_t* quantized;    // INT8 models only: quantized inputs of the current layer, per sample
+    float* quantized_scales;
+    float* sparse_tiles;  // Models with sparse layers: a batch's layer input interleaved for the
+                          // sparse tile kernels, SPARSE_TILE_SAMPLES samples per tile
+    TinyNN_ThreadPool* pool; // Splits each layer across threads; NULL runs on the caller's thread
+    TinyNN_PerfCounters* counters; // Opened on the first profiled run, NULL until then
+    TinyNN_OutputMode output_mode;
+} TinyNN_Context;
+
+// Placement of the weights on machines with several NUMA nodes, see numa.h.
+typedef enum {
+    TINYNN_NUMA_OFF = 0,         // Wherever the loading thread's allocations land
+    TINYNN_NUMA_INTERLEAVE = 1,  // One copy spread page by page over all nodes
+    TINYNN_NUMA_REPLICATE = 2    // One copy per node, used by threads running on that node
+} TinyNN_NumaMode;
+
+// Choices made once when a model is loaded.
+typedef struct {
+    // Storage type to run with. fp32 models are converted after loading; a model file that
+    // already holds this type is used as is. TINYNN_WEIGHTS_INT8 without calibration
+    // scales activations per sample (see quantize_model() for calibrated scales).
+    TinyNN_WeightType weight_type;
+    // Threads each forward pass is spread over, counting the caller. 1 (the default) keeps
+    // inference on the calling thread; <= 0 uses one per logical CPU. The workers are
+    // started once with the model and shared by all of its contexts.
+    int num_threads;
+    // fp32 layers with at least this share of zero weights are stored sparse (sparse.h);
+    // 0 keeps every layer dense.
+    float sparse_threshold;
+    // 0 (the default) loads the whole model. n >= 1 streams it from a .tnn file with at
+    // most n layers resident at a time (streaming.h); the weights are then used as the
+    // file stores them, so weight_type must match the file and sparse_threshold is ignored.
+    int stream_window;
+    // TINYNN_NUMA_OFF (the default) leaves placement to the OS. Replicating counts
+    // num_threads per node.
+    TinyNN_NumaMode numa;
+} TinyNN_LoadOptions;
+
+// fp32 weights, single-threaded unless the TINYNN_THREADS environment variable says otherwise,
+// and the sparse threshold from default_sparse_threshold().
+TinyNN_LoadOptions default_load_options(void);
+// Loads a model from a CSV model directory, a directory holding a converted
+// model.tnn, or a .tnn binary file directly. Pruned fp32 layers are stored sparse, and
+// the rest are packed into panels for the kernels unless the file already holds them
+// packed (or TINYNN_PACK=0).
+TinyNN_Model* create_model_from_path(const char* model_path);
+// Checks a CSV model directory without loading it: architecture.txt must parse, and every
+// layer_N_weights.csv / layer_N_biases.csv must hold well-formed values in the shape the
+// architecture implies. Files are checked in parallel and problems are reported on stderr
+// with the file and line. Returns 1 if the directory would load.
+int validate_csv_model(const char* model_path);
+// 'options' may be NULL for default_load_options().
+TinyNN_Model* create_model_with_options(const char* model_path, const TinyNN_LoadOptions* options);
+// Converts a loaded model's weights to another storage type in place. Returns 1 on
+// success; only conversions away from fp32 are possible.
+int convert_model_weights(TinyNN_Model* model, TinyNN_WeightType weight_type);
+const char* weight_type_name(TinyNN_WeightType weight_type);
+// Parses "fp32", "int8", "fp16" or "bf16". Returns 1 on success.
+int parse_weight_type(const char* name, TinyNN_WeightType* weight_type);
+// Activation of a layer whose model does not name one: ReLU for hidden layers, softmax
+// for the output layer.
+TinyNN_Activation default_activation(const TinyNN_Model* model, int layer);
+// Allocates model->activations holding every layer's default. Returns 1 on success.
+int init_activations(TinyNN_Model* model);
+const char* activation_name(TinyNN_Activation activation);
+// Parses "none", "relu", "sigmoid", "tanh" or "softmax". Returns 1 on success.
+int parse_activation(const char* name, TinyNN_Activation* activation);
+// 1 if 'p' points into the model's mapped file (memory that free_model() does not free).
+int points_into_mapping(const TinyNN_Model* model, const void* p);
+// Moves every array that still points into the mapped file into memory of the model's
+// own, allocated by the calling thread, and unmaps the file. Returns 1 on success.
+int copy_mapped_weights(TinyNN_Model* model);
+// Bytes of layer weights (in their stored type, INT8 scales included) that one forward
+// pass reads. Biases are not counted.
+size_t model_weight_bytes(const TinyNN_Model* model);
+size_t layer_weight_bytes(const TinyNN_Model* model, int layer);
+// How a layer's weights are stored: "packed", "row-major", "csr", "bsr4x1", "bsr8x1",
+// "int8", "fp16" or "bf16".
+const char* layer_format_name(const TinyNN_Model* model, int layer);
+void free_model(TinyNN_Model* model);
+float* forward_pass(TinyNN_Model* model, float* input);
+// Runs 'batch_size' samples at once. 'inputs' is row-major [batch_size][input_size];
+// the result is row-major [batch_size][output_size] and must be freed by the caller.
+float* forward_pass_batch(TinyNN_Model* model, const float* inputs, int batch_size);
+
+// The context uses the model's thread pool, if it has one. For a NUMA-replicated model
+// both the weights and the pool are those of the calling thread's node.
+TinyNN_Context* create_context(const TinyNN_Model* model, int max_batch);
+void free_context(TinyNN_Context* ctx);
+// Runs this context's inferences on 'pool' instead (NULL = single-threaded). The pool is
+// not owned by the context and must outlive it.
+void context_set_thread_pool(TinyNN_Context* ctx, TinyNN_ThreadPool* pool);
+// Allocation-free inference: 'output' must hold output_size floats. Returns 1 on success.
+int forward_pass_into(TinyNN_Context* ctx, const float* input, float* output);
+// Allocation-free batched inference: 'outputs' must hold batch_size * output_size floats.
+int forward_pass_batch_into(TinyNN_Context* ctx, const float* inputs, int batch_size, float* outputs);
+/**
+ * @brief Runs only layers first_layer..last_layer (0-based, inclusive) of 'batch_size'
+ * samples, e.g. one stage of a pipeline (pipeline.h). 'inputs' holds the input of
+ * first_layer per sample and 'outputs' receives the output of last_layer. The output mode
+ * applies when last_layer is the output layer.
+ * @return 1 on success, 0 if the range is not a valid run of layers.
+ */
+int forward_layers_into(TinyNN_Context* ctx, int first_layer, int last_layer, const float* inputs,
+                        int batch_size, float* outputs);
+// Chooses what forward_pass_into() and forward_pass_batch_into() write (default:
+// TINYNN_OUTPUT_DEFAULT). Logits skip the output activation entirely, and log-softmax
+// needs one exp per class but no division.
+void context_set_output_mode(TinyNN_Context* ctx, TinyNN_OutputMode mode);
+/**
+ * @brief Runs 'batch_size' samples and keeps only the 'k' highest-scoring classes of each,
+ * best first (equal scores by index). The classes are selected on the raw logits, and
+ * only the k survivors get the output activation. Softmax models still sum exp() over
+ * every class once for the normalizer, but never store or divide the full distribution.
+ * @param predictions Receives batch_size * k entries, sample by sample.
+ * @return 1 on success, 0 if k is not in [1, output_size].
+ */
+int forward_pass_top_k_into(TinyNN_Context* ctx, const float* inputs, int batch_size, int k,
+                            TinyNN_Prediction* predictions);
+// Writes the winning class of each sample to 'classes' (batch_size entries). No
+// activation or exp() is computed for the output layer. Returns 1 on success.
+int forward_pass_argmax_into(TinyNN_Context* ctx, const float* inputs, int batch_size, int* classes);
+
 #endif
\ No newline at end of file
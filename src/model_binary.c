@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "model_binary.h"
+#include "utils.h"
+#include "pack.h"
+#include "sparse.h"
+
+// Header field offsets (all little-endian)
+#define HDR_MAGIC          0   // char[4]  "TNNB"
+#define HDR_VERSION        4   // u32
+#define HDR_FLAGS          8   // u32      reserved, 0
+#define HDR_LAYER_COUNT    12  // u32      hidden_layers + 1
+#define HDR_INPUT_SIZE     16  // u32
+#define HDR_OUTPUT_SIZE    20  // u32
+#define HDR_HIDDEN_LAYERS  24  // u32
+#define HDR_DATA_OFFSET    32  // u64      start of the first section, 64-byte aligned
+#define HDR_FILE_SIZE      40  // u64
+#define HDR_CHECKSUM       48  // u64      over [data_offset, file_size)
+
+// Layer table entry field offsets
+#define LAYER_ROWS         0   // u32      neurons in this layer
+#define LAYER_COLS         4   // u32      neurons in the previous layer (or input size)
+#define LAYER_WEIGHT_TYPE  8   // u32      TinyNN_WeightType
+#define LAYER_LAYOUT       12  // u32      TNN_LAYOUT_ROW_MAJOR [rows][row_stride] or TNN_LAYOUT_PACKED
+#define LAYER_WEIGHTS_OFF  16  // u64
+#define LAYER_BIASES_OFF   24  // u64
+// Version 2 and later
+#define LAYER_SCALES_OFF   32  // u64      INT8: per-row fp32 scales, otherwise 0
+#define LAYER_INPUT_SCALE  40  // f32      INT8: calibrated activation scale, 0 = per sample
+#define LAYER_ROW_STRIDE   44  // u32      stored elements per row (>= cols)
+// Version 3 and later
+#define LAYER_ACTIVATION   48  // u32      TinyNN_Activation
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static uint64_t align_up(uint64_t value) {
+    return (value + TNN_ALIGNMENT - 1) & ~(uint64_t)(TNN_ALIGNMENT - 1);
+}
+
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+// --- Checksum ---
+// Fletcher-style running sums over 32-bit little-endian words. Sections are padded to
+// 64 bytes, so the data region length is always a multiple of 4, but a single write
+// (e.g. an FP16 section with an odd element count) may end mid-word; those bytes are
+// carried over to the next update so the result does not depend on how data is chunked.
+
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+    unsigned char pending[4];
+    int pending_count;
+} Checksum;
+
+static void checksum_update(Checksum* c, const unsigned char* data, size_t size) {
+    uint64_t a = c->a, b = c->b;
+    size_t i = 0;
+    if (c->pending_count > 0) {
+        while (c->pending_count < 4 && i < size) c->pending[c->pending_count++] = data[i++];
+        if (c->pending_count < 4) return;
+        a += get_u32(c->pending);
+        b += a;
+        c->pending_count = 0;
+    }
+    for (; i + 4 <= size; i += 4) {
+        a += get_u32(data + i);
+        b += a;
+    }
+    while (i < size) c->pending[c->pending_count++] = data[i++];
+    c->a = a;
+    c->b = b;
+}
+
+static uint64_t checksum_final(const Checksum* c) {
+    return (c->b << 32) ^ c->a ^ (c->b >> 32);
+}
+
+// --- Writer ---
+
+static int write_bytes(FILE* fp, const void* data, size_t size, Checksum* c) {
+    if (size == 0) return 1;
+    if (c) checksum_update(c, (const unsigned char*)data, size);
+    return fwrite(data, 1, size, fp) == size;
+}
+
+static int write_padding(FILE* fp, uint64_t* offset, Checksum* c) {
+    static const unsigned char zeros[TNN_ALIGNMENT] = {0};
+    uint64_t aligned = align_up(*offset);
+    size_t pad = (size_t)(aligned - *offset);
+    *offset = aligned;
+    return write_bytes(fp, zeros, pad, c);
+}
+
+static int write_floats(FILE* fp, const float* values, size_t count, uint64_t* offset, Checksum* c) {
+    if (host_is_little_endian()) {
+        *offset += count * sizeof(float);
+        return write_bytes(fp, values, count * sizeof(float), c);
+    }
+    // Big-endian host: byte-swap through a small staging buffer
+    unsigned char staging[4096];
+    size_t done = 0;
+    while (done < count) {
+        size_t n = count - done < sizeof(staging) / 4 ? count - done : sizeof(staging) / 4;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t bits;
+            memcpy(&bits, &values[done + i], 4);
+            put_u32(staging + i * 4, bits);
+        }
+        if (!write_bytes(fp, staging, n * 4, c)) return 0;
+        done += n;
+    }
+    *offset += count * sizeof(float);
+    return 1;
+}
+
+static int write_halves(FILE* fp, const uint16_t* values, size_t count, uint64_t* offset, Checksum* c) {
+    *offset += count * sizeof(uint16_t);
+    if (host_is_little_endian()) {
+        return write_bytes(fp, values, count * sizeof(uint16_t), c);
+    }
+    unsigned char staging[4096];
+    size_t done = 0;
+    while (done < count) {
+        size_t n = count - done < sizeof(staging) / 2 ? count - done : sizeof(staging) / 2;
+        for (size_t i = 0; i < n; i++) {
+            staging[i * 2] = (unsigned char)values[done + i];
+            staging[i * 2 + 1] = (unsigned char)(values[done + i] >> 8);
+        }
+        if (!write_bytes(fp, staging, n * 2, c)) return 0;
+        done += n;
+    }
+    return 1;
+}
+
+// Bytes per stored weight for each TinyNN_WeightType; 0 marks a type the format cannot hold
+static size_t weight_element_size(uint32_t weight_type) {
+    switch (weight_type) {
+        case TINYNN_WEIGHTS_FP32: return sizeof(float);
+        case TINYNN_WEIGHTS_INT8: return sizeof(int8_t);
+        case TINYNN_WEIGHTS_FP16:
+        case TINYNN_WEIGHTS_BF16: return sizeof(uint16_t);
+    }
+    return 0;
+}
+
+// Sparse layers are written dense, in the file's layout; loading picks them out again
+static int write_sparse_layer(FILE* fp, const TinyNN_SparseLayer* layer, int rows, int cols, int packed,
+                              uint64_t* offset, Checksum* c) {
+    float* weights = (float*)malloc(sizeof(float) * (size_t)rows * cols);
+    float* panels = packed ? (float*)aligned_malloc(sizeof(float) * packed_layer_floats(rows, cols), 64) : NULL;
+    int ok = weights != NULL && (!packed || panels != NULL);
+    if (ok) {
+        sparse_to_dense(layer, rows, cols, weights);
+        if (packed) pack_layer(weights, rows, cols, panels);
+        ok = packed ? write_floats(fp, panels, packed_layer_floats(rows, cols), offset, c)
+                    : write_floats(fp, weights, (size_t)rows * cols, offset, c);
+    }
+    free(weights);
+    aligned_free(panels);
+    return ok;
+}
+
+// Everything in the header except the file size and checksum
+static void put_header(unsigned char* header, int layer_count, int input_size, int output_size,
+                       uint64_t data_offset) {
+    memcpy(header + HDR_MAGIC, TNN_MAGIC, 4);
+    put_u32(header + HDR_VERSION, TNN_VERSION);
+    put_u32(header + HDR_FLAGS, 0);
+    put_u32(header + HDR_LAYER_COUNT, (uint32_t)layer_count);
+    put_u32(header + HDR_INPUT_SIZE, (uint32_t)input_size);
+    put_u32(header + HDR_OUTPUT_SIZE, (uint32_t)output_size);
+    put_u32(header + HDR_HIDDEN_LAYERS, (uint32_t)(layer_count - 1));
+    put_u64(header + HDR_DATA_OFFSET, data_offset);
+}
+
+int save_model_binary(const TinyNN_Model* model, const char* filepath) {
+    int layer_count = model->hidden_layers + 1;
+    size_t table_size = (size_t)layer_count * TNN_LAYER_ENTRY_SIZE;
+    unsigned char header[TNN_HEADER_SIZE];
+    unsigned char* table = (unsigned char*)calloc(1, table_size);
+    if (!table) return 0;
+    memset(header, 0, sizeof(header));
+
+    // Lay out the sections first so the layer table can be written up front
+    int is_int8 = model->weight_type == TINYNN_WEIGHTS_INT8;
+    int is_half = model->weight_type == TINYNN_WEIGHTS_FP16 || model->weight_type == TINYNN_WEIGHTS_BF16;
+    int is_packed = model->weight_type == TINYNN_WEIGHTS_FP32 && model->packed_weights != NULL;
+    uint64_t data_offset = align_up(TNN_HEADER_SIZE + table_size);
+    uint64_t offset = data_offset;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < layer_count; i++) {
+        unsigned char* entry = table + (size_t)i * TNN_LAYER_ENTRY_SIZE;
+        uint64_t rows = (uint64_t)model->layer_sizes[i];
+        int row_stride = is_int8 ? model->quant[i].padded_cols : prev_layer_size;
+        uint64_t weight_bytes = is_packed ? packed_layer_floats((int)rows, prev_layer_size) * sizeof(float)
+                                          : rows * row_stride * weight_element_size(model->weight_type);
+        uint64_t bias_bytes = rows * sizeof(float);
+        put_u32(entry + LAYER_ROWS, (uint32_t)rows);
+        put_u32(entry + LAYER_COLS, (uint32_t)prev_layer_size);
+        put_u32(entry + LAYER_WEIGHT_TYPE, (uint32_t)model->weight_type);
+        put_u32(entry + LAYER_LAYOUT, is_packed ? TNN_LAYOUT_PACKED : TNN_LAYOUT_ROW_MAJOR);
+        put_u32(entry + LAYER_ROW_STRIDE, (uint32_t)row_stride);
+        put_u32(entry + LAYER_ACTIVATION, (uint32_t)model->activations[i]);
+        put_u64(entry + LAYER_WEIGHTS_OFF, offset);
+        offset = align_up(offset + weight_bytes);
+        if (is_int8) {
+            uint32_t scale_bits;
+            memcpy(&scale_bits, &model->quant[i].input_scale, 4);
+            put_u32(entry + LAYER_INPUT_SCALE, scale_bits);
+            put_u64(entry + LAYER_SCALES_OFF, offset);
+            offset = align_up(offset + rows * sizeof(float));
+        }
+        put_u64(entry + LAYER_BIASES_OFF, offset);
+        offset = align_up(offset + bias_bytes);
+        prev_layer_size = model->layer_sizes[i];
+    }
+
+    // Written next to the target and renamed over it, so mappings of the old file (the
+    // versions a model registry still serves) keep their bytes
+    char* temp_path;
+    FILE* fp = begin_file_replace(filepath, &temp_path);
+    if (!fp) {
+        fprintf(stderr, "ERROR: Could not create binary model file %s\n", filepath);
+        free(table);
+        return 0;
+    }
+
+    // Header is written twice: once as a placeholder, then again with the final checksum
+    put_header(header, layer_count, model->input_size, model->output_size, data_offset);
+
+    Checksum checksum;
+    memset(&checksum, 0, sizeof(checksum));
+    uint64_t written = TNN_HEADER_SIZE + table_size;
+    int ok = write_bytes(fp, header, sizeof(header), NULL) &&
+             write_bytes(fp, table, table_size, NULL) &&
+             write_padding(fp, &written, NULL);
+
+    prev_layer_size = model->input_size;
+    for (int i = 0; ok && i < layer_count; i++) {
+        size_t rows = (size_t)model->layer_sizes[i];
+        if (is_int8) {
+            const TinyNN_QuantLayer* q = &model->quant[i];
+            size_t weight_bytes = rows * q->padded_cols;
+            ok = write_bytes(fp, q->weights, weight_bytes, &checksum);
+            written += weight_bytes;
+            ok = ok && write_padding(fp, &written, &checksum) &&
+                 write_floats(fp, q->scales, rows, &written, &checksum) &&
+                 write_padding(fp, &written, &checksum);
+        } else if (is_half) {
+            ok = write_halves(fp, model->half_weights[i], rows * prev_layer_size, &written, &checksum) &&
+                 write_padding(fp, &written, &checksum);
+        } else if (layer_is_sparse(model, i)) {
+            ok = write_sparse_layer(fp, &model->sparse[i], (int)rows, prev_layer_size, is_packed, &written,
+                                    &checksum) &&
+                 write_padding(fp, &written, &checksum);
+        } else if (is_packed) {
+            ok = write_floats(fp, model->packed_weights[i], packed_layer_floats((int)rows, prev_layer_size),
+                              &written, &checksum) &&
+                 write_padding(fp, &written, &checksum);
+        } else {
+            ok = write_floats(fp, model->weights[i], rows * prev_layer_size, &written, &checksum) &&
+                 write_padding(fp, &written, &checksum);
+        }
+        ok = ok && write_floats(fp, model->biases[i], rows, &written, &checksum) &&
+             write_padding(fp, &written, &checksum);
+        prev_layer_size = model->layer_sizes[i];
+    }
+
+    if (ok) {
+        put_u64(header + HDR_FILE_SIZE, written);
+        put_u64(header + HDR_CHECKSUM, checksum_final(&checksum));
+        ok = fseek(fp, 0, SEEK_SET) == 0 && write_bytes(fp, header, sizeof(header), NULL);
+    }
+    ok = finish_file_replace(fp, temp_path, filepath, ok);
+    free(table);
+
+    if (!ok) fprintf(stderr, "ERROR: Failed while writing binary model file %s\n", filepath);
+    return ok;
+}
+
+// --- Streaming writer ---
+
+struct TinyNN_BinaryWriter {
+    FILE* fp;
+    char* filepath;
+    char* temp_path;           // Written instead of filepath, renamed over it when closed
+    unsigned char header[TNN_HEADER_SIZE];
+    uint64_t* section_floats;  // Weights then biases of every layer
+    int section_count;
+    int section;               // Section being written
+    uint64_t remaining;        // Floats it still needs
+    uint64_t written;
+    Checksum checksum;
+    int ok;
+};
+
+TinyNN_BinaryWriter* open_binary_writer(const char* filepath, int input_size, int num_layers, const int* layer_sizes,
+                                        const TinyNN_Activation* activations, int packed) {
+    if (input_size <= 0 || num_layers <= 0) return NULL;
+    TinyNN_BinaryWriter* writer = (TinyNN_BinaryWriter*)calloc(1, sizeof(TinyNN_BinaryWriter));
+    size_t table_size = (size_t)num_layers * TNN_LAYER_ENTRY_SIZE;
+    unsigned char* table = (unsigned char*)calloc(1, table_size);
+    if (!writer || !table) {
+        free(writer);
+        free(table);
+        return NULL;
+    }
+    writer->section_count = num_layers * 2;
+    writer->section_floats = (uint64_t*)malloc(sizeof(uint64_t) * writer->section_count);
+    writer->filepath = (char*)malloc(strlen(filepath) + 1);
+    if (!writer->section_floats || !writer->filepath) {
+        free(table);
+        free(writer->section_floats);
+        free(writer->filepath);
+        free(writer);
+        return NULL;
+    }
+    strcpy(writer->filepath, filepath);
+
+    // Same layout as save_model_binary() gives an fp32 model
+    uint64_t data_offset = align_up(TNN_HEADER_SIZE + table_size);
+    uint64_t offset = data_offset;
+    int prev_layer_size = input_size;
+    for (int i = 0; i < num_layers; i++) {
+        unsigned char* entry = table + (size_t)i * TNN_LAYER_ENTRY_SIZE;
+        uint64_t rows = (uint64_t)layer_sizes[i];
+        uint64_t weight_floats = packed ? packed_layer_floats(layer_sizes[i], prev_layer_size)
+                                        : rows * prev_layer_size;
+        TinyNN_Activation activation = activations ? activations[i]
+                                       : i + 1 < num_layers ? TINYNN_ACT_RELU : TINYNN_ACT_SOFTMAX;
+        put_u32(entry + LAYER_ROWS, (uint32_t)rows);
+        put_u32(entry + LAYER_COLS, (uint32_t)prev_layer_size);
+        put_u32(entry + LAYER_WEIGHT_TYPE, TINYNN_WEIGHTS_FP32);
+        put_u32(entry + LAYER_LAYOUT, packed ? TNN_LAYOUT_PACKED : TNN_LAYOUT_ROW_MAJOR);
+        put_u32(entry + LAYER_ROW_STRIDE, (uint32_t)prev_layer_size);
+        put_u32(entry + LAYER_ACTIVATION, (uint32_t)activation);
+        put_u64(entry + LAYER_WEIGHTS_OFF, offset);
+        offset = align_up(offset + weight_floats * sizeof(float));
+        put_u64(entry + LAYER_BIASES_OFF, offset);
+        offset = align_up(offset + rows * sizeof(float));
+        writer->section_floats[2 * i] = weight_floats;
+        writer->section_floats[2 * i + 1] = rows;
+        prev_layer_size = layer_sizes[i];
+    }
+    put_header(writer->header, num_layers, input_size, layer_sizes[num_layers - 1], data_offset);
+
+    writer->fp = begin_file_replace(filepath, &writer->temp_path);
+    if (!writer->fp) {
+        fprintf(stderr, "ERROR: Could not create binary model file %s\n", filepath);
+        free(table);
+        free(writer->section_floats);
+        free(writer->filepath);
+        free(writer);
+        return NULL;
+    }
+    writer->written = TNN_HEADER_SIZE + table_size;
+    writer->remaining = writer->section_floats[0];
+    writer->ok = write_bytes(writer->fp, writer->header, sizeof(writer->header), NULL) &&
+                 write_bytes(writer->fp, table, table_size, NULL) &&
+                 write_padding(writer->fp, &writer->written, NULL);
+    free(table);
+    return writer;
+}
+
+int write_binary_floats(TinyNN_BinaryWriter* writer, const float* values, size_t count) {
+    while (writer->ok && count > 0) {
+        if (writer->section >= writer->section_count) {
+            fprintf(stderr, "ERROR: More values than the layers of %s hold\n", writer->filepath);
+            writer->ok = 0;
+            break;
+        }
+        size_t n = count < writer->remaining ? count : (size_t)writer->remaining;
+        writer->ok = write_floats(writer->fp, values, n, &writer->written, &writer->checksum);
+        values += n;
+        count -= n;
+        writer->remaining -= n;
+        // Finished sections are padded to the next boundary, like save_model_binary() does
+        while (writer->ok && writer->remaining == 0 && writer->section < writer->section_count) {
+            writer->ok = write_padding(writer->fp, &writer->written, &writer->checksum);
+            writer->section++;
+            if (writer->section < writer->section_count) writer->remaining = writer->section_floats[writer->section];
+        }
+    }
+    return writer->ok;
+}
+
+int close_binary_writer(TinyNN_BinaryWriter* writer) {
+    if (writer == NULL) return 0;
+    int ok = writer->ok;
+    if (ok && writer->section < writer->section_count) {
+        fprintf(stderr, "ERROR: %s was closed before every layer was written\n", writer->filepath);
+        ok = 0;
+    }
+    if (ok) {
+        put_u64(writer->header + HDR_FILE_SIZE, writer->written);
+        put_u64(writer->header + HDR_CHECKSUM, checksum_final(&writer->checksum));
+        ok = fseek(writer->fp, 0, SEEK_SET) == 0 && write_bytes(writer->fp, writer->header, sizeof(writer->header), NULL);
+    }
+    ok = finish_file_replace(writer->fp, writer->temp_path, writer->filepath, ok);
+    if (!ok) fprintf(stderr, "ERROR: Failed while writing binary model file %s\n", writer->filepath);
+    free(writer->section_floats);
+    free(writer->filepath);
+    free(writer);
+    return ok;
+}
+
+int convert_csv_model_to_binary(const char* model_dir, const char* filepath) {
+    char default_path[256];
+    if (filepath == NULL) {
+        snprintf(default_path, sizeof(default_path), "%s/%s", model_dir, TNN_DIR_FILENAME);
+        filepath = default_path;
+    }
+
+    TinyNN_Model* model = create_model_from_path(model_dir);
+    if (!model) return 0;
+    if (model->mapping) {
+        // Already binary; re-saving would just rewrite the same bytes
+        free_model(model);
+        return 1;
+    }
+    int ok = save_model_binary(model, filepath);
+    free_model(model);
+    return ok;
+}
+
+// --- Loader ---
+
+int is_binary_model_file(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    char magic[4];
+    int is_binary = fread(magic, 1, 4, fp) == 4 && memcmp(magic, TNN_MAGIC, 4) == 0;
+    fclose(fp);
+    return is_binary;
+}
+
+static int section_in_bounds(uint64_t offset, uint64_t bytes, uint64_t data_offset, uint64_t file_size) {
+    return offset >= data_offset && offset % TNN_ALIGNMENT == 0 &&
+           offset <= file_size && bytes <= file_size - offset;
+}
+
+// Checksums the data region. For streaming models each chunk is released once summed,
+// so verifying a file larger than memory never holds more than one chunk of it.
+#define STREAMING_CHECKSUM_CHUNK (8u << 20)
+
+static uint64_t checksum_data(const unsigned char* data, size_t size, int streaming) {
+    Checksum checksum;
+    memset(&checksum, 0, sizeof(checksum));
+    if (!streaming) {
+        checksum_update(&checksum, data, size);
+        return checksum_final(&checksum);
+    }
+    for (size_t offset = 0; offset < size; offset += STREAMING_CHECKSUM_CHUNK) {
+        size_t chunk = size - offset < STREAMING_CHECKSUM_CHUNK ? size - offset : STREAMING_CHECKSUM_CHUNK;
+        checksum_update(&checksum, data + offset, chunk);
+        release_mapped_range(data + offset, chunk);
+    }
+    return checksum_final(&checksum);
+}
+
+static TinyNN_Model* map_binary_model(const char* filepath, int streaming) {
+    if (!host_is_little_endian()) {
+        fprintf(stderr, "ERROR: Binary models can only be mapped on little-endian hosts (%s)\n", filepath);
+        return NULL;
+    }
+
+    size_t size = 0;
+    const unsigned char* base = (const unsigned char*)map_file_readonly(filepath, &size);
+    if (base == NULL) {
+        fprintf(stderr, "ERROR: Could not map binary model file %s\n", filepath);
+        return NULL;
+    }
+
+    if (size < TNN_HEADER_SIZE || memcmp(base + HDR_MAGIC, TNN_MAGIC, 4) != 0) {
+        fprintf(stderr, "ERROR: %s is not a TinyNN binary model\n", filepath);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+    uint32_t version = get_u32(base + HDR_VERSION);
+    if (version < 1 || version > TNN_VERSION) {
+        fprintf(stderr, "ERROR: %s has unsupported format version %u (expected %d)\n", filepath, version, TNN_VERSION);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+
+    uint32_t layer_count = get_u32(base + HDR_LAYER_COUNT);
+    uint64_t data_offset = get_u64(base + HDR_DATA_OFFSET);
+    uint64_t file_size = get_u64(base + HDR_FILE_SIZE);
+    if (file_size != size) {
+        fprintf(stderr, "ERROR: %s is %zu bytes but its header records %llu (truncated?)\n",
+                filepath, size, (unsigned long long)file_size);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+    size_t entry_size = version == 1 ? TNN_LAYER_ENTRY_SIZE_V1 : TNN_LAYER_ENTRY_SIZE;
+    if (layer_count == 0 || get_u32(base + HDR_HIDDEN_LAYERS) != layer_count - 1 ||
+        data_offset < TNN_HEADER_SIZE + (uint64_t)layer_count * entry_size ||
+        data_offset % TNN_ALIGNMENT != 0 || data_offset > file_size) {
+        fprintf(stderr, "ERROR: %s has a corrupt header\n", filepath);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+
+    if (checksum_data(base + data_offset, (size_t)(file_size - data_offset), streaming) !=
+        get_u64(base + HDR_CHECKSUM)) {
+        fprintf(stderr, "ERROR: Checksum mismatch in %s, the file is corrupted\n", filepath);
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+
+    TinyNN_Model* model = (TinyNN_Model*)calloc(1, sizeof(TinyNN_Model));
+    if (!model) {
+        unmap_file((void*)base, size);
+        return NULL;
+    }
+    model->mapping = (void*)base;
+    model->mapping_size = size;
+    model->input_size = (int)get_u32(base + HDR_INPUT_SIZE);
+    model->output_size = (int)get_u32(base + HDR_OUTPUT_SIZE);
+    model->hidden_layers = (int)layer_count - 1;
+    model->layer_sizes = (int*)malloc(sizeof(int) * layer_count);
+    model->weights = (float**)calloc(layer_count, sizeof(float*));
+    model->biases = (float**)calloc(layer_count, sizeof(float*));
+    if (!model->layer_sizes || !model->weights || !model->biases || !init_activations(model)) {
+        free_model(model);
+        return NULL;
+    }
+
+    // Every layer must share the first layer's storage type and layout
+    uint32_t weight_type = get_u32(base + TNN_HEADER_SIZE + LAYER_WEIGHT_TYPE);
+    uint32_t layout = get_u32(base + TNN_HEADER_SIZE + LAYER_LAYOUT);
+    int is_int8 = weight_type == TINYNN_WEIGHTS_INT8;
+    int is_half = weight_type == TINYNN_WEIGHTS_FP16 || weight_type == TINYNN_WEIGHTS_BF16;
+    int is_packed = weight_type == TINYNN_WEIGHTS_FP32 && layout == TNN_LAYOUT_PACKED;
+    if (is_packed) {
+        model->packed_weights = (float**)calloc(layer_count, sizeof(float*));
+        if (!model->packed_weights) {
+            free_model(model);
+            return NULL;
+        }
+    } else if (is_int8) {
+        model->quant = (TinyNN_QuantLayer*)calloc(layer_count, sizeof(TinyNN_QuantLayer));
+        if (!model->quant) {
+            free_model(model);
+            return NULL;
+        }
+    } else if (is_half) {
+        model->half_weights = (uint16_t**)calloc(layer_count, sizeof(uint16_t*));
+        if (!model->half_weights) {
+            free_model(model);
+            return NULL;
+        }
+    }
+    if (weight_element_size(weight_type) != 0) model->weight_type = (TinyNN_WeightType)weight_type;
+
+    uint64_t prev_layer_size = (uint64_t)model->input_size;
+    for (uint32_t i = 0; i < layer_count; i++) {
+        const unsigned char* entry = base + TNN_HEADER_SIZE + (size_t)i * entry_size;
+        uint64_t rows = get_u32(entry + LAYER_ROWS);
+        uint64_t cols = get_u32(entry + LAYER_COLS);
+        uint64_t weights_off = get_u64(entry + LAYER_WEIGHTS_OFF);
+        uint64_t biases_off = get_u64(entry + LAYER_BIASES_OFF);
+        uint64_t row_stride = version == 1 ? cols : get_u32(entry + LAYER_ROW_STRIDE);
+
+        if (get_u32(entry + LAYER_WEIGHT_TYPE) != weight_type || weight_element_size(weight_type) == 0 ||
+            get_u32(entry + LAYER_LAYOUT) != layout || (layout != TNN_LAYOUT_ROW_MAJOR && !is_packed)) {
+            fprintf(stderr, "ERROR: Layer %u in %s uses an unsupported weight encoding\n", i, filepath);
+            free_model(model);
+            return NULL;
+        }
+        uint64_t weight_bytes = is_packed ? packed_layer_floats((int)rows, (int)cols) * sizeof(float)
+                                          : rows * row_stride * weight_element_size(weight_type);
+        if (rows == 0 || cols != prev_layer_size ||
+            (is_int8 ? (row_stride < cols || row_stride % INT8_COLUMN_PADDING != 0) : row_stride != cols) ||
+            !section_in_bounds(weights_off, weight_bytes, data_offset, file_size) ||
+            !section_in_bounds(biases_off, rows * sizeof(float), data_offset, file_size)) {
+            fprintf(stderr, "ERROR: Layer %u in %s has an invalid shape or section offset\n", i, filepath);
+            free_model(model);
+            return NULL;
+        }
+
+        if (version >= 3) {
+            uint32_t activation = get_u32(entry + LAYER_ACTIVATION);
+            if (activation > TINYNN_ACT_SOFTMAX) {
+                fprintf(stderr, "ERROR: Layer %u in %s has unknown activation %u\n", i, filepath, activation);
+                free_model(model);
+                return NULL;
+            }
+            model->activations[i] = (TinyNN_Activation)activation;
+        }
+
+        model->layer_sizes[i] = (int)rows;
+        model->biases[i] = (float*)(base + biases_off);
+        if (is_int8) {
+            uint64_t scales_off = get_u64(entry + LAYER_SCALES_OFF);
+            if (!section_in_bounds(scales_off, rows * sizeof(float), data_offset, file_size)) {
+                fprintf(stderr, "ERROR: Layer %u in %s has an invalid scale section\n", i, filepath);
+                free_model(model);
+                return NULL;
+            }
+            uint32_t scale_bits = get_u32(entry + LAYER_INPUT_SCALE);
+            TinyNN_QuantLayer* q = &model->quant[i];
+            q->weights = (int8_t*)(base + weights_off);
+            q->scales = (float*)(base + scales_off);
+            q->padded_cols = (int)row_stride;
+            memcpy(&q->input_scale, &scale_bits, 4);
+            q->owns_memory = 0;
+        } else if (is_half) {
+            model->half_weights[i] = (uint16_t*)(base + weights_off);
+        } else if (is_packed) {
+            model->packed_weights[i] = (float*)(base + weights_off);
+        } else {
+            model->weights[i] = (float*)(base + weights_off);
+        }
+        prev_layer_size = rows;
+    }
+    if (model->layer_sizes[layer_count - 1] != model->output_size) {
+        fprintf(stderr, "ERROR: Output size in %s does not match its last layer\n", filepath);
+        free_model(model);
+        return NULL;
+    }
+
+    model->kernels = select_kernels();
+    return model;
+}
+
+TinyNN_Model* create_model_from_binary(const char* filepath) {
+    return map_binary_model(filepath, 0);
+}
+
+TinyNN_Model* create_model_from_binary_streaming(const char* filepath) {
+    return map_binary_model(filepath, 1);
+}
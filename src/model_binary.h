@@ -0,0 +1,92 @@
+#ifndef MODEL_BINARY_H
+#define MODEL_BINARY_H
+
+#include "model.h"
+
+// Single-file binary model container (".tnn").
+//
+// All integers are little-endian. Layout:
+//   [0, 64)           File header (see TNN_HEADER_SIZE)
+//   [64, 64 + E * L)  Layer table, one E-byte entry per layer (E = 64; 32 in version 1 files)
+//   data_offset ...   Weight, scale and bias sections, each starting on a 64-byte boundary
+//
+// Weights are stored as fp32 or 16-bit FP16/BF16 [rows][cols] or, for quantized models,
+// as int8 [rows][row_stride] with a section of per-row fp32 scales. fp32 weights may
+// instead be stored in the packed panel layout the kernels read (TNN_LAYOUT_PACKED, see
+// pack.h), which then maps without any load-time work. Since version 3 each layer entry
+// also records the layer's activation; older files get the default ones. Version 1 files
+// (fp32 only, 32-byte layer entries) are still accepted by the loader.
+//
+// The checksum covers every byte from data_offset to the end of the file, so a
+// truncated or corrupted download is rejected at load time.
+
+#define TNN_MAGIC "TNNB"
+#define TNN_VERSION 3
+#define TNN_ALIGNMENT 64
+#define TNN_HEADER_SIZE 64
+#define TNN_LAYER_ENTRY_SIZE 64
+#define TNN_LAYER_ENTRY_SIZE_V1 32
+
+// Layer weight layouts
+#define TNN_LAYOUT_ROW_MAJOR 0
+#define TNN_LAYOUT_PACKED 1      // fp32 only: panels of PACK_PANEL_ROWS rows, column-interleaved
+
+// File name used for the binary form inside a model directory.
+#define TNN_DIR_FILENAME "model.tnn"
+
+/**
+ * @brief Loads a binary model by memory-mapping the file.
+ * weights[i] and biases[i] (or quant[i] / half_weights[i] for INT8 / FP16 / BF16
+ * models) point straight into the read-only mapping; nothing is copied.
+ * The mapping is released by free_model().
+ * @return The model, or NULL if the file is missing, malformed or fails its checksum.
+ */
+TinyNN_Model* create_model_from_binary(const char* filepath);
+
+/**
+ * @brief Like create_model_from_binary(), for out-of-core execution (see streaming.h):
+ * the checksum pass drops each chunk of the file from memory once it has been read, so
+ * loading a model larger than RAM does not fill it.
+ */
+TinyNN_Model* create_model_from_binary_streaming(const char* filepath);
+
+/**
+ * @brief Writes a loaded model to 'filepath' in the binary container format.
+ * Packed fp32 models are written packed; call unpack_model_weights() first for a
+ * row-major file.
+ * @return 1 on success, 0 on failure.
+ */
+int save_model_binary(const TinyNN_Model* model, const char* filepath);
+
+// Writes an fp32 model section by section, for models too big to hold in memory (the
+// generator uses it). Pass each layer's weights (packed panels if 'packed', see pack.h)
+// and then its biases, layer by layer, in as many write_binary_floats() calls as suits.
+typedef struct TinyNN_BinaryWriter TinyNN_BinaryWriter;
+
+// 'activations' may be NULL for the defaults (ReLU hidden layers, softmax output).
+// Returns NULL if the file cannot be created.
+TinyNN_BinaryWriter* open_binary_writer(const char* filepath, int input_size, int num_layers, const int* layer_sizes,
+                                        const TinyNN_Activation* activations, int packed);
+// Returns 1 on success; after a failure every later call fails too.
+int write_binary_floats(TinyNN_BinaryWriter* writer, const float* values, size_t count);
+/**
+ * @brief Finishes the header (file size and checksum) and closes the file.
+ * @return 1 if every section was written in full; otherwise the file is removed.
+ */
+int close_binary_writer(TinyNN_BinaryWriter* writer);
+
+/**
+ * @brief Converts a CSV model directory into a binary file in one step.
+ * @param model_dir Directory holding architecture.txt and the layer CSV files.
+ * @param filepath  Output path. If NULL, writes model.tnn inside model_dir, where
+ *                  create_model_from_path() will pick it up automatically.
+ * @return 1 on success, 0 on failure.
+ */
+int convert_csv_model_to_binary(const char* model_dir, const char* filepath);
+
+/**
+ * @brief Checks whether 'path' is a file starting with the binary model magic.
+ */
+int is_binary_model_file(const char* path);
+
+#endif
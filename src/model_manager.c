@@ -1,187 +1,619 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "model_manager.h"
-
-#ifdef _WIN32
-    #include <windows.h>
-    #include <direct.h>
-    #define MKDIR(path) _mkdir(path)
-    #define PATH_SEPARATOR '\\'
-#else
-    #include <sys/stat.h>
-    #include <dirent.h>
-    #include <unistd.h>
-    #define MKDIR(path) mkdir(path, 0755)
-    #define PATH_SEPARATOR '/'
-#endif
-
-static int copy_file(const char* src, const char* dest) {
-    FILE *src_fp, *dest_fp;
-    char buffer[4096];
-    size_t n;
-    src_fp = fopen(src, "rb");
-    if (!src_fp) return 0;
-    dest_fp = fopen(dest, "wb");
-    if (!dest_fp) { fclose(src_fp); return 0; }
-    while ((n = fread(buffer, 1, sizeof(buffer), src_fp)) > 0) {
-        if (fwrite(buffer, 1, n, dest_fp) != n) {
-            fclose(src_fp);
-            fclose(dest_fp);
-            return 0;
-        }
-    }
-    fclose(src_fp);
-    fclose(dest_fp);
-    return 1;
-}
-
-static int safe_path_join(char* dest, size_t dest_size, const char* base, const char* component) {
-    int written = snprintf(dest, dest_size, "%s%c%s", base, PATH_SEPARATOR, component);
-    if (written < 0 || (size_t)written >= dest_size) {
-        fprintf(stderr, "Error: Path concatenation would result in a buffer overflow.\n");
-        return 0;
-    }
-    return 1;
-}
-
-static int is_valid_model_dir(const char* path) {
-    char arch_path[SAFE_PATH_MAX];
-    if (!safe_path_join(arch_path, sizeof(arch_path), path, "architecture.txt")) {
-        return 0;
-    }
-    FILE* fp = fopen(arch_path, "r");
-    if (fp) {
-        fclose(fp);
-        return 1;
-    }
-    return 0;
-}
-
-static void add_model_to_list(const char* path, DiscoveredModel** models_out, int* count, int* capacity) {
-    if (*count >= *capacity) {
-        *capacity *= 2;
-        *models_out = realloc(*models_out, (*capacity) * sizeof(DiscoveredModel));
-    }
-    snprintf((*models_out)[*count].path, SAFE_PATH_MAX, "%s", path);
-    (*count)++;
-}
-
-void run_model_importer() {
-    char src_path[SAFE_PATH_MAX];
-    char new_name[128];
-
-    printf("\n--- Import External Model ---\n");
-    printf("This tool will validate and copy a model folder (exported to our .csv format)\n");
-    printf("into a managed '\033[33mmodels/\033[0m' directory.\n");
-
-    printf("\nEnter the path to the source model directory: ");
-    scanf("%4095s", src_path);
-
-    if (!is_valid_model_dir(src_path)) { return; }
-
-    printf("Enter a new name for this model (no spaces): ");
-    scanf("%127s", new_name);
-
-    const char* parent_dir = "models";
-    MKDIR(parent_dir);
-
-    char dest_path[SAFE_PATH_MAX];
-    snprintf(dest_path, sizeof(dest_path), "%s/%s", parent_dir, new_name);
-
-    if (MKDIR(dest_path) != 0) { /* ... warning ... */ }
-
-    printf("Copying model files...\n");
-    #ifdef _WIN32
-        char search_path[SAFE_PATH_MAX];
-        if (strlen(src_path) + strlen("\\*") >= SAFE_PATH_MAX) {
-            fprintf(stderr, "Error: Source path is too long to process.\n");
-            return;
-        }
-        snprintf(search_path, sizeof(search_path), "%s\\*", src_path);
-
-        WIN32_FIND_DATA fd;
-        HANDLE hFind = FindFirstFile(search_path, &fd);
-        if (hFind != INVALID_HANDLE_VALUE) {
-            do {
-                if (strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0) {
-                    char src_file[SAFE_PATH_MAX], dest_file[SAFE_PATH_MAX];
-                    if (safe_path_join(src_file, sizeof(src_file), src_path, fd.cFileName) &&
-                        safe_path_join(dest_file, sizeof(dest_file), dest_path, fd.cFileName)) {
-                        if (!copy_file(src_file, dest_file)) {
-                             fprintf(stderr, "\033[31mFailed to copy %s\033[0m\n", fd.cFileName);
-                        }
-                    }
-                }
-            } while (FindNextFile(hFind, &fd));
-            FindClose(hFind);
-        }
-    #else // POSIX
-        DIR* dir = opendir(src_path);
-        if (dir) {
-            struct dirent* entry;
-            while ((entry = readdir(dir)) != NULL) {
-                 if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-                    char src_file[SAFE_PATH_MAX], dest_file[SAFE_PATH_MAX];
-                    if (safe_path_join(src_file, sizeof(src_file), src_path, entry->d_name) &&
-                        safe_path_join(dest_file, sizeof(dest_file), dest_path, entry->d_name)) {
-                        if (!copy_file(src_file, dest_file)) {
-                             fprintf(stderr, "\033[31mFailed to copy %s\033[0m\n", entry->d_name);
-                        }
-                    }
-                 }
-            }
-            closedir(dir);
-        }
-    #endif
-
-    printf("\033[32mModel '%s' imported successfully!\033[0m\n", new_name);
-}
-
-int discover_models(DiscoveredModel** models_out) {
-    int count = 0;
-    int capacity = 4;
-    *models_out = malloc(capacity * sizeof(DiscoveredModel));
-    if (!*models_out) return 0;
-
-    const char* models_dir_path = "models";
-
-    #ifdef _WIN32
-        char search_path[SAFE_PATH_MAX];
-        if (strlen(models_dir_path) + strlen("\\*") >= SAFE_PATH_MAX) return 0;
-        snprintf(search_path, sizeof(search_path), "%s\\*", models_dir_path);
-        WIN32_FIND_DATA fd;
-        HANDLE hFind = FindFirstFile(search_path, &fd);
-        if (hFind != INVALID_HANDLE_VALUE) {
-            do {
-                if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0) {
-                    char model_path[SAFE_PATH_MAX];
-                    if (safe_path_join(model_path, sizeof(model_path), models_dir_path, fd.cFileName)) {
-                        if (is_valid_model_dir(model_path)) {
-                            add_model_to_list(model_path, models_out, &count, &capacity);
-                        }
-                    }
-                }
-            } while (FindNextFile(hFind, &fd));
-            FindClose(hFind);
-        }
-    #else // POSIX
-        DIR* dir = opendir(models_dir_path);
-        if (dir) {
-            struct dirent* entry;
-            while ((entry = readdir(dir)) != NULL) {
-                if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-                    char model_path[SAFE_PATH_MAX];
-                    if (safe_path_join(model_path, sizeof(model_path), models_dir_path, entry->d_name)) {
-                        if (is_valid_model_dir(model_path)) {
-                            add_model_to_list(model_path, models_out, &count, &capacity);
-                        }
-                    }
-                }
-            }
-            closedir(dir);
-        }
-    #endif
-
-    return count;
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "model_manager.h"
+#include "model_binary.h"
+#include "model.h"
+#include "utils.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <direct.h>
+    #define MKDIR(path) _mkdir(path)
+    #define RMDIR(path) _rmdir(path)
+    #define PATH_SEPARATOR '\\'
+#else
+    #include <sys/stat.h>
+    #include <dirent.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #define MKDIR(path) mkdir(path, 0755)
+    #define RMDIR(path) rmdir(path)
+    #define PATH_SEPARATOR '/'
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+#define COPY_BUFFER_SIZE (1 << 20)    // Read/write fallback when the kernel cannot copy
+#define KERNEL_COPY_CHUNK (1 << 30)   // Bytes per copy_file_range()/sendfile() call
+
+static int safe_path_join(char* dest, size_t dest_size, const char* base, const char* component) {
+    int written = snprintf(dest, dest_size, "%s%c%s", base, PATH_SEPARATOR, component);
+    if (written < 0 || (size_t)written >= dest_size) {
+        fprintf(stderr, "Error: Path concatenation would result in a buffer overflow.\n");
+        return 0;
+    }
+    return 1;
+}
+
+static int is_valid_model_dir(const char* path) {
+    char arch_path[SAFE_PATH_MAX];
+    if (!safe_path_join(arch_path, sizeof(arch_path), path, "architecture.txt")) {
+        return 0;
+    }
+    FILE* fp = fopen(arch_path, "r");
+    if (fp) {
+        fclose(fp);
+        return 1;
+    }
+    // A directory holding only the converted binary form is a valid model too
+    char binary_path[SAFE_PATH_MAX];
+    if (!safe_path_join(binary_path, sizeof(binary_path), path, TNN_DIR_FILENAME)) {
+        return 0;
+    }
+    return is_binary_model_file(binary_path);
+}
+
+static void add_model_to_list(const char* path, DiscoveredModel** models_out, int* count, int* capacity) {
+    if (*count >= *capacity) {
+        *capacity *= 2;
+        *models_out = realloc(*models_out, (*capacity) * sizeof(DiscoveredModel));
+    }
+    snprintf((*models_out)[*count].path, SAFE_PATH_MAX, "%s", path);
+    (*count)++;
+}
+
+// --- Import ---
+
+// How a file reached the imported model, cheapest first
+typedef enum {
+    COPY_FAILED,
+    COPY_LINKED,       // Hard link to the source file
+    COPY_CLONED,       // Reflink: shares the source's blocks until either is written
+    COPY_IN_KERNEL,    // copy_file_range()/sendfile()/CopyFile(): no pass through user space
+    COPY_BUFFERED,
+    COPY_METHOD_COUNT
+} CopyMethod;
+
+static const char* copy_method_names[COPY_METHOD_COUNT] = {"failed", "linked", "cloned", "copied in the kernel", "copied"};
+
+#ifdef _WIN32
+
+static CopyMethod copy_model_file(const char* src, const char* dest, int link, long long* bytes) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExA(src, GetFileExInfoStandard, &attributes)) {
+        *bytes = ((long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    }
+    DeleteFileA(dest);
+    if (link && CreateHardLinkA(dest, src, NULL)) return COPY_LINKED;
+    return CopyFileA(src, dest, FALSE) ? COPY_IN_KERNEL : COPY_FAILED;
+}
+
+#else
+
+// Copies 'size' bytes from the start of in_fd without passing them through user space
+static CopyMethod kernel_copy(int in_fd, int out_fd, off_t size) {
+#ifdef __linux__
+    #ifdef FICLONE
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) return COPY_CLONED;
+    #endif
+    off_t copied = 0;
+    #ifdef __NR_copy_file_range
+    while (copied < size) {
+        size_t chunk = size - copied < KERNEL_COPY_CHUNK ? (size_t)(size - copied) : KERNEL_COPY_CHUNK;
+        ssize_t n = (ssize_t)syscall(__NR_copy_file_range, in_fd, NULL, out_fd, NULL, chunk, 0);
+        if (n <= 0) break;
+        copied += n;
+    }
+    #endif
+    // sendfile() continues from where copy_file_range() stopped, e.g. on kernels that do
+    // not copy across filesystems
+    while (copied < size) {
+        size_t chunk = size - copied < KERNEL_COPY_CHUNK ? (size_t)(size - copied) : KERNEL_COPY_CHUNK;
+        ssize_t n = sendfile(out_fd, in_fd, NULL, chunk);
+        if (n <= 0) break;
+        copied += n;
+    }
+    return copied == size ? COPY_IN_KERNEL : COPY_FAILED;
+#else
+    (void)in_fd;
+    (void)out_fd;
+    (void)size;
+    return COPY_FAILED;
+#endif
+}
+
+static CopyMethod buffered_copy(int in_fd, int out_fd) {
+    char* buffer = (char*)malloc(COPY_BUFFER_SIZE);
+    if (!buffer) return COPY_FAILED;
+    CopyMethod result = COPY_BUFFERED;
+    ssize_t n;
+    while ((n = read(in_fd, buffer, COPY_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            result = COPY_FAILED;
+            break;
+        }
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(out_fd, buffer + written, (size_t)(n - written));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                result = COPY_FAILED;
+                break;
+            }
+            written += w;
+        }
+        if (result == COPY_FAILED) break;
+    }
+    free(buffer);
+    return result;
+}
+
+static CopyMethod copy_model_file(const char* src, const char* dest, int link_files, long long* bytes) {
+    unlink(dest);
+    if (link_files && link(src, dest) == 0) {
+        struct stat st;
+        if (stat(src, &st) == 0) *bytes = (long long)st.st_size;
+        return COPY_LINKED;
+    }
+
+    int in_fd = open(src, O_RDONLY);
+    if (in_fd < 0) return COPY_FAILED;
+    struct stat st;
+    int out_fd = fstat(in_fd, &st) == 0 ? open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (out_fd < 0) {
+        close(in_fd);
+        return COPY_FAILED;
+    }
+    *bytes = (long long)st.st_size;
+    CopyMethod method = kernel_copy(in_fd, out_fd, st.st_size);
+    if (method == COPY_FAILED) {
+        // Start over with plain reads and writes
+        if (lseek(in_fd, 0, SEEK_SET) == 0 && lseek(out_fd, 0, SEEK_SET) == 0 && ftruncate(out_fd, 0) == 0) {
+            method = buffered_copy(in_fd, out_fd);
+        }
+    }
+    close(in_fd);
+    if (close(out_fd) != 0) method = COPY_FAILED;
+    return method;
+}
+
+#endif
+
+// Calls fn(dir, name, arg) for every regular file in 'dir' until it returns 0.
+// Returns 0 if the directory cannot be read or 'fn' stopped early.
+static int for_each_file(const char* dir, int (*fn)(const char* dir, const char* name, void* arg), void* arg) {
+    int ok = 1;
+    #ifdef _WIN32
+        char search_path[SAFE_PATH_MAX];
+        if (!safe_path_join(search_path, sizeof(search_path), dir, "*")) return 0;
+        WIN32_FIND_DATA fd;
+        HANDLE hFind = FindFirstFile(search_path, &fd);
+        if (hFind == INVALID_HANDLE_VALUE) return 0;
+        do {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) ok = fn(dir, fd.cFileName, arg);
+        } while (ok && FindNextFile(hFind, &fd));
+        FindClose(hFind);
+    #else // POSIX
+        DIR* d = opendir(dir);
+        if (!d) return 0;
+        struct dirent* entry;
+        while (ok && (entry = readdir(d)) != NULL) {
+            char path[SAFE_PATH_MAX];
+            struct stat st;
+            if (safe_path_join(path, sizeof(path), dir, entry->d_name) && stat(path, &st) == 0 &&
+                S_ISREG(st.st_mode)) {
+                ok = fn(dir, entry->d_name, arg);
+            }
+        }
+        closedir(d);
+    #endif
+    return ok;
+}
+
+typedef struct {
+    const char* dest_dir;
+    const TinyNN_ImportOptions* options;
+    int counts[COPY_METHOD_COUNT];
+    long long bytes;
+} ImportCopy;
+
+static int import_file(const char* dir, const char* name, void* arg) {
+    ImportCopy* copy = (ImportCopy*)arg;
+    // A converting import writes its own model.tnn
+    if (copy->options->convert && strcmp(name, TNN_DIR_FILENAME) == 0) return 1;
+    char src_file[SAFE_PATH_MAX], dest_file[SAFE_PATH_MAX];
+    if (!safe_path_join(src_file, sizeof(src_file), dir, name) ||
+        !safe_path_join(dest_file, sizeof(dest_file), copy->dest_dir, name)) {
+        return 0;
+    }
+    long long bytes = 0;
+    CopyMethod method = copy_model_file(src_file, dest_file, copy->options->link, &bytes);
+    if (method == COPY_FAILED) {
+        fprintf(stderr, "ERROR: Failed to copy %s to %s\n", src_file, dest_file);
+        return 0;
+    }
+    copy->counts[method]++;
+    copy->bytes += bytes;
+    return 1;
+}
+
+static int remove_file(const char* dir, const char* name, void* arg) {
+    (void)arg;
+    char path[SAFE_PATH_MAX];
+    if (safe_path_join(path, sizeof(path), dir, name)) remove(path);
+    return 1;
+}
+
+// Removes a file of the destination that the staged import does not replace: a stale
+// model.tnn would shadow the new CSV files
+static int remove_unstaged_file(const char* dir, const char* name, void* arg) {
+    const char* staging_dir = (const char*)arg;
+    char staged[SAFE_PATH_MAX];
+    if (!safe_path_join(staged, sizeof(staged), staging_dir, name)) return 0;
+    FILE* fp = fopen(staged, "rb");
+    if (fp) {
+        fclose(fp);
+        return 1;
+    }
+    return remove_file(dir, name, NULL);
+}
+
+// Moves a staged file over its counterpart in the destination ('arg')
+static int move_staged_file(const char* dir, const char* name, void* arg) {
+    const char* dest_dir = (const char*)arg;
+    char from[SAFE_PATH_MAX], to[SAFE_PATH_MAX];
+    if (!safe_path_join(from, sizeof(from), dir, name) || !safe_path_join(to, sizeof(to), dest_dir, name)) return 0;
+    #ifdef _WIN32
+    int ok = MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+    #else
+    int ok = rename(from, to) == 0;
+    #endif
+    if (!ok) fprintf(stderr, "ERROR: Could not move %s to %s\n", from, to);
+    return ok;
+}
+
+static void remove_directory(const char* dir) {
+    for_each_file(dir, remove_file, NULL);
+    RMDIR(dir);
+}
+
+// 1 if both paths name the same existing directory, however they are spelled
+static int same_directory(const char* a, const char* b) {
+    #ifdef _WIN32
+    char full_a[SAFE_PATH_MAX], full_b[SAFE_PATH_MAX];
+    if (!_fullpath(full_a, a, sizeof(full_a)) || !_fullpath(full_b, b, sizeof(full_b))) return 0;
+    size_t la = strlen(full_a), lb = strlen(full_b);
+    while (la > 3 && (full_a[la - 1] == '\\' || full_a[la - 1] == '/')) full_a[--la] = '\0';
+    while (lb > 3 && (full_b[lb - 1] == '\\' || full_b[lb - 1] == '/')) full_b[--lb] = '\0';
+    return _stricmp(full_a, full_b) == 0;
+    #else
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0) return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    #endif
+}
+
+// Checks everything the import would bring along. A converting import loads the model
+// instead, which checks the same things, and hands it back in 'model_out'.
+static int check_import_source(const char* src_dir, int convert, TinyNN_Model** model_out) {
+    char arch_path[SAFE_PATH_MAX], binary_path[SAFE_PATH_MAX];
+    if (!safe_path_join(arch_path, sizeof(arch_path), src_dir, "architecture.txt") ||
+        !safe_path_join(binary_path, sizeof(binary_path), src_dir, TNN_DIR_FILENAME)) {
+        return 0;
+    }
+    FILE* fp = fopen(arch_path, "r");
+    int has_csv = fp != NULL;
+    if (fp) fclose(fp);
+    int has_binary = is_binary_model_file(binary_path);
+    if (!has_csv && !has_binary) {
+        fprintf(stderr, "ERROR: '%s' holds neither an architecture.txt nor a %s\n", src_dir, TNN_DIR_FILENAME);
+        return 0;
+    }
+
+    // Loading prefers model.tnn, so the CSV files need their own check when both exist
+    if (has_csv && (!convert || has_binary) && !validate_csv_model(src_dir)) return 0;
+    if (convert) {
+        *model_out = create_model_from_path(src_dir);
+        return *model_out != NULL;
+    }
+    if (has_binary) {
+        TinyNN_Model* model = create_model_from_binary(binary_path);
+        if (!model) return 0;
+        free_model(model);
+    }
+    return 1;
+}
+
+int import_model(const char* src_dir, const char* dest_dir, const TinyNN_ImportOptions* options) {
+    TinyNN_ImportOptions defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    if (options == NULL) options = &defaults;
+    double start = get_time_seconds();
+
+    // 1. Validate first, so a broken model never lands next to the working ones
+    TinyNN_Model* model = NULL;
+    if (!check_import_source(src_dir, options->convert, &model)) {
+        fprintf(stderr, "ERROR: '%s' is not a valid model; nothing was imported\n", src_dir);
+        return 0;
+    }
+    double checked = get_time_seconds();
+
+    // Overwriting would start by replacing the very files being imported
+    if (same_directory(src_dir, dest_dir)) {
+        fprintf(stderr, "ERROR: '%s' and '%s' are the same directory; nothing was imported\n", src_dir, dest_dir);
+        free_model(model);
+        return 0;
+    }
+    if (is_valid_model_dir(dest_dir) && !options->overwrite) {
+        fprintf(stderr, "ERROR: '%s' already holds a model\n", dest_dir);
+        free_model(model);
+        return 0;
+    }
+
+    // 2. Copy every file, then 3. write the converted form, all into a staging directory
+    // next to the destination. A failure there leaves the destination as it was.
+    char staging_dir[SAFE_PATH_MAX];
+    int length = snprintf(staging_dir, sizeof(staging_dir), "%s.tmp", dest_dir);
+    if (length < 0 || (size_t)length >= sizeof(staging_dir)) {
+        fprintf(stderr, "ERROR: Path '%s' is too long\n", dest_dir);
+        free_model(model);
+        return 0;
+    }
+    remove_directory(staging_dir); // Left over from an interrupted import
+    if (MKDIR(staging_dir) != 0) {
+        fprintf(stderr, "ERROR: Could not create directory '%s'\n", staging_dir);
+        free_model(model);
+        return 0;
+    }
+    ImportCopy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.dest_dir = staging_dir;
+    copy.options = options;
+    int ok = for_each_file(src_dir, import_file, &copy);
+    int files = copy.counts[COPY_LINKED] + copy.counts[COPY_CLONED] + copy.counts[COPY_IN_KERNEL] +
+                copy.counts[COPY_BUFFERED];
+    int converted = model != NULL;
+    if (ok && converted) {
+        char binary_path[SAFE_PATH_MAX];
+        ok = safe_path_join(binary_path, sizeof(binary_path), staging_dir, TNN_DIR_FILENAME) &&
+             save_model_binary(model, binary_path);
+    }
+    free_model(model);
+    if (ok && files == 0 && !converted) {
+        fprintf(stderr, "ERROR: No files were copied from '%s'\n", src_dir);
+        ok = 0;
+    }
+
+    // 4. Move the files in one by one, each replacing its old version with a rename, so
+    // the destination directory (which a model registry may watch) stays the same one
+    if (ok && MKDIR(dest_dir) != 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: Could not create directory '%s'\n", dest_dir);
+        ok = 0;
+    }
+    ok = ok && for_each_file(dest_dir, remove_unstaged_file, staging_dir) &&
+         for_each_file(staging_dir, move_staged_file, (void*)dest_dir);
+    remove_directory(staging_dir);
+    if (!ok) {
+        fprintf(stderr, "ERROR: Importing '%s' failed\n", src_dir);
+        return 0;
+    }
+
+    double done = get_time_seconds();
+    printf("Checked in %.2f s, then %d files (%.1f MB) in %.2f s:", checked - start, files,
+           copy.bytes / 1e6, done - checked);
+    const char* separator = " ";
+    for (int m = COPY_LINKED; m < COPY_METHOD_COUNT; m++) {
+        if (copy.counts[m] == 0) continue;
+        printf("%s%d %s", separator, copy.counts[m], copy_method_names[m]);
+        separator = ", ";
+    }
+    printf("%s\n", options->convert ? ", converted to " TNN_DIR_FILENAME : "");
+    return 1;
+}
+
+// Reads a yes/no answer; anything but 'n' counts as yes
+static int ask_yes(const char* question) {
+    char answer[16];
+    printf("%s [Y/n]: ", question);
+    if (!fgets(answer, sizeof(answer), stdin)) return 1;
+    return answer[0] != 'n' && answer[0] != 'N';
+}
+
+void run_model_importer() {
+    char src_path[SAFE_PATH_MAX];
+    char new_name[128];
+
+    printf("\n--- Import External Model ---\n");
+    printf("This tool will validate and copy a model folder (exported to our .csv format)\n");
+    printf("into a managed '\033[33mmodels/\033[0m' directory.\n");
+
+    printf("\nEnter the path to the source model directory: ");
+    if (scanf("%4095s", src_path) != 1) return;
+
+    printf("Enter a new name for this model (no spaces): ");
+    if (scanf("%127s", new_name) != 1) return;
+    while (getchar() != '\n'); // Rest of the line, before the question below
+    if (strchr(new_name, '/') || strchr(new_name, '\\') || strcmp(new_name, "..") == 0 || strcmp(new_name, ".") == 0) {
+        fprintf(stderr, "\033[31m'%s' is not a valid model name.\033[0m\n", new_name);
+        return;
+    }
+
+    TinyNN_ImportOptions options;
+    memset(&options, 0, sizeof(options));
+    options.convert = ask_yes("Also convert it to a packed model.tnn, so it loads without parsing CSV?");
+
+    const char* parent_dir = "models";
+    MKDIR(parent_dir);
+
+    char dest_path[SAFE_PATH_MAX];
+    if (!safe_path_join(dest_path, sizeof(dest_path), parent_dir, new_name)) return;
+
+    printf("Validating and copying model files...\n");
+    if (import_model(src_path, dest_path, &options)) {
+        printf("\033[32mModel '%s' imported successfully!\033[0m\n", new_name);
+    } else {
+        fprintf(stderr, "\033[31mModel '%s' was not imported.\033[0m\n", new_name);
+    }
+}
+
+static void print_import_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s import <source dir> [options]\n"
+        "Validates a model folder and copies it into models/.\n"
+        "\n"
+        "  -o, --name <name>           Name of the imported model (default: the source folder's name)\n"
+        "  -c, --convert               Also write a packed %s, so the first load is fast\n"
+        "      --link                  Hard-link the files instead of copying them; edits to either\n"
+        "                              copy then change both\n"
+        "      --force                 Replace an existing model of the same name\n"
+        "  -h, --help                  Show this help\n",
+        program, TNN_DIR_FILENAME);
+}
+
+int run_import_mode(int argc, char** argv) {
+    TinyNN_ImportOptions options;
+    memset(&options, 0, sizeof(options));
+    const char* src_path = NULL;
+    const char* name = NULL;
+    int ok = 1;
+    for (int i = 1; ok && i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            ok = 0;
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--convert") == 0) {
+            options.convert = 1;
+        } else if (strcmp(argv[i], "--link") == 0) {
+            options.link = 1;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            options.overwrite = 1;
+        } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--name") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "ERROR: %s needs a value\n", argv[i]);
+                ok = 0;
+            } else {
+                name = argv[++i];
+            }
+        } else if (argv[i][0] == '-' || src_path) {
+            fprintf(stderr, "ERROR: Unknown argument '%s'\n", argv[i]);
+            ok = 0;
+        } else {
+            src_path = argv[i];
+        }
+    }
+    if (ok && !src_path) {
+        fprintf(stderr, "ERROR: Give the model folder to import\n");
+        ok = 0;
+    }
+    if (!ok) {
+        print_import_usage("tinynn");
+        return 1;
+    }
+
+    // The source folder's own name, without trailing separators
+    char default_name[128];
+    if (name == NULL) {
+        size_t end = strlen(src_path);
+        while (end > 1 && (src_path[end - 1] == '/' || src_path[end - 1] == '\\')) end--;
+        size_t begin = end;
+        while (begin > 0 && src_path[begin - 1] != '/' && src_path[begin - 1] != '\\') begin--;
+        snprintf(default_name, sizeof(default_name), "%.*s", (int)(end - begin), src_path + begin);
+        name = default_name;
+    }
+    if (name[0] == '\0' || strchr(name, '/') || strchr(name, '\\') || strcmp(name, "..") == 0 ||
+        strcmp(name, ".") == 0) {
+        fprintf(stderr, "ERROR: '%s' is not a valid model name; pick one with -o\n", name);
+        return 1;
+    }
+
+    MKDIR("models");
+    char dest_path[SAFE_PATH_MAX];
+    if (!safe_path_join(dest_path, sizeof(dest_path), "models", name)) return 1;
+    return import_model(src_path, dest_path, &options) ? 0 : 1;
+}
+
+void run_model_converter() {
+    printf("\n--- Convert Model to Binary ---\n");
+    printf("Packs a CSV model into a single memory-mappable '\033[33m%s\033[0m' file inside its folder.\n", TNN_DIR_FILENAME);
+    printf("Once converted, the model loads without parsing any CSV.\n");
+
+    DiscoveredModel* models = NULL;
+    int model_count = discover_models(&models);
+    if (model_count == 0) {
+        fprintf(stderr, "\033[31mNo models found. Please generate or import a model first.\033[0m\n");
+        free(models);
+        return;
+    }
+
+    printf("Please select a model to convert:\n");
+    for (int i = 0; i < model_count; i++) {
+        printf("  %d. %s\n", i + 1, models[i].path);
+    }
+    int choice = 0;
+    while (choice < 1 || choice > model_count) {
+        printf("Enter your choice (1-%d): ", model_count);
+        if (scanf("%d", &choice) != 1) while(getchar() != '\n');
+    }
+
+    const char* model_path = models[choice - 1].path;
+    printf("Converting '%s'...\n", model_path);
+    if (convert_csv_model_to_binary(model_path, NULL)) {
+        printf("\033[32mWrote %s%c%s\033[0m\n", model_path, PATH_SEPARATOR, TNN_DIR_FILENAME);
+    } else {
+        fprintf(stderr, "\033[31mConversion of '%s' failed.\033[0m\n", model_path);
+    }
+    free(models);
+}
+
+int discover_models(DiscoveredModel** models_out) {
+    int count = 0;
+    int capacity = 4;
+    *models_out = malloc(capacity * sizeof(DiscoveredModel));
+    if (!*models_out) return 0;
+
+    const char* models_dir_path = "models";
+
+    #ifdef _WIN32
+        char search_path[SAFE_PATH_MAX];
+        if (strlen(models_dir_path) + strlen("\\*") >= SAFE_PATH_MAX) return 0;
+        snprintf(search_path, sizeof(search_path), "%s\\*", models_dir_path);
+        WIN32_FIND_DATA fd;
+        HANDLE hFind = FindFirstFile(search_path, &fd);
+        if (hFind != INVALID_HANDLE_VALUE) {
+            do {
+                if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0) {
+                    char model_path[SAFE_PATH_MAX];
+                    if (safe_path_join(model_path, sizeof(model_path), models_dir_path, fd.cFileName)) {
+                        if (is_valid_model_dir(model_path)) {
+                            add_model_to_list(model_path, models_out, &count, &capacity);
+                        }
+                    }
+                }
+            } while (FindNextFile(hFind, &fd));
+            FindClose(hFind);
+        }
+    #else // POSIX
+        DIR* dir = opendir(models_dir_path);
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                    char model_path[SAFE_PATH_MAX];
+                    if (safe_path_join(model_path, sizeof(model_path), models_dir_path, entry->d_name)) {
+                        if (is_valid_model_dir(model_path)) {
+                            add_model_to_list(model_path, models_out, &count, &capacity);
+                        }
+                    }
+                }
+            }
+            closedir(dir);
+        }
+    #endif
+
+    return count;
 }
\ No newline at end of file
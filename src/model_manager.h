@@ -1,33 +1,65 @@
-#ifndef MODEL_MANAGER_H
-#define MODEL_MANAGER_H
-
-// *** FIX: Define a single, safe, cross-platform maximum path length. ***
-// 4096 is a common value for PATH_MAX on modern Linux systems and is
-// much larger than Windows' default, making it safe for both.
-#define SAFE_PATH_MAX 4096
-
-// A struct to hold information about a discovered model folder.
-typedef struct {
-    // *** FIX: Use the new safe max path length. ***
-    char path[SAFE_PATH_MAX];
-} DiscoveredModel;
-
-/**
- * @brief Runs the interactive process to import an external model.
- * Prompts the user for a source path and a new name, then validates and
- * copies the model into the 'custom_models' directory.
- */
-void run_model_importer();
-
-/**
- * @brief Scans the current directory for valid model folders.
- * A folder is considered a valid model if it contains an 'architecture.txt' file.
- *
- * @param models_out A pointer to an array of DiscoveredModel structs that will be
- *                   allocated by this function. The caller is responsible for
- *                   freeing this memory.
- * @return The number of models discovered. Returns 0 on failure or if no models are found.
- */
-int discover_models(DiscoveredModel** models_out);
-
+#ifndef MODEL_MANAGER_H
+#define MODEL_MANAGER_H
+
+// *** FIX: Define a single, safe, cross-platform maximum path length. ***
+// 4096 is a common value for PATH_MAX on modern Linux systems and is
+// much larger than Windows' default, making it safe for both.
+#define SAFE_PATH_MAX 4096
+
+// A struct to hold information about a discovered model folder.
+typedef struct {
+    // *** FIX: Use the new safe max path length. ***
+    char path[SAFE_PATH_MAX];
+} DiscoveredModel;
+
+typedef struct {
+    int convert;     // Also write a packed model.tnn into the imported folder, so it loads fast
+    int link;        // Hard-link files instead of copying them (falls back to a copy)
+    int overwrite;   // Replace a model already in the destination
+} TinyNN_ImportOptions;
+
+/**
+ * @brief Validates a model folder and copies it to 'dest_dir'.
+ * The architecture and the shape and format of every layer file are checked (in parallel)
+ * before anything is written, so a broken model is reported right away instead of at its
+ * first inference. Files are reflinked or copied inside the kernel where the system
+ * allows it into '<dest_dir>.tmp', then renamed into place, so a failed import leaves
+ * the destination as it was. Importing a directory onto itself is refused.
+ * @param options NULL copies without converting, and refuses to overwrite.
+ * @return 1 on success, 0 on failure (reported on stderr).
+ */
+int import_model(const char* src_dir, const char* dest_dir, const TinyNN_ImportOptions* options);
+
+/**
+ * @brief Runs the interactive process to import an external model.
+ * Prompts the user for a source path, a new name and whether to convert it, then
+ * validates and copies the model into the 'models' directory with import_model().
+ */
+void run_model_importer();
+
+/**
+ * @brief Entry point of 'tinynn import <dir>'. argv[0] is "import".
+ * @return The process exit code.
+ */
+int run_import_mode(int argc, char** argv);
+
+/**
+ * @brief Runs the interactive process to convert a model to the binary format.
+ * Lists the discovered models and writes the chosen one as a single 'model.tnn'
+ * file inside its own folder, which later loads take in preference to the CSV files.
+ */
+void run_model_converter();
+
+/**
+ * @brief Scans the current directory for valid model folders.
+ * A folder is considered a valid model if it contains an 'architecture.txt' file
+ * or a converted 'model.tnn' binary.
+ *
+ * @param models_out A pointer to an array of DiscoveredModel structs that will be
+ *                   allocated by this function. The caller is responsible for
+ *                   freeing this memory.
+ * @return The number of models discovered. Returns 0 on failure or if no models are found.
+ */
+int discover_models(DiscoveredModel** models_out);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "model_registry.h"
+#include "model_binary.h"
+#include "model_manager.h"
+#include "threads.h"
+#include "numa.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_TIMEOUT_MS 200    // Longest the watcher goes without checking for shutdown
+#define RELOAD_SETTLE_MS 100    // Quiet time after the last change before reloading
+#define RELOAD_POLL_MS 1000     // Modification time checks, where inotify is unavailable
+
+// One loaded version of a model. Reloads replace an entry's version, so a version lives on
+// until the last caller holding it releases it.
+typedef struct ModelVersion {
+    TinyNN_Model* model;
+    size_t bytes;
+    int refs;                   // Callers holding it, plus one while it is an entry's current version
+    struct ModelVersion* next;  // All live versions, current or replaced
+} ModelVersion;
+
+typedef struct {
+    char path[SAFE_PATH_MAX];
+    ModelVersion* current;      // NULL while the first load is running
+    unsigned long long signature; // Of the files 'current' was loaded from
+    unsigned long long last_used;
+    int reloading;              // A new version is being loaded; the entry is not evicted meanwhile
+    int watch;                  // inotify watch descriptor, or -1
+} RegistryEntry;
+
+struct TinyNN_Registry {
+    TinyNN_RegistryOptions options;
+    TinyNN_Mutex lock;
+    TinyNN_Cond loaded;         // Signalled whenever a first load finishes
+    RegistryEntry** entries;
+    int count;
+    int capacity;
+    ModelVersion* versions;
+    size_t resident_bytes;      // Of the current versions
+    unsigned long long clock;   // Advances on every acquire, for LRU order
+    TinyNN_RegistryStats stats;
+    TinyNN_Thread watcher;
+    int watcher_started;
+    volatile int stop;
+    int inotify_fd;
+};
+
+TinyNN_RegistryOptions default_registry_options(void) {
+    TinyNN_RegistryOptions options;
+    options.memory_budget = 0;
+    options.watch = 1;
+    options.load_options = default_load_options();
+    return options;
+}
+
+// --- Change detection ---
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+// Folds a file's size, inode and modification time (or its absence) into 'hash'. Returns 0 if
+// the file does not exist.
+static int hash_file_stat(const char* path, unsigned long long* hash) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *hash = (*hash ^ 0xFF) * FNV_PRIME;
+        return 0;
+    }
+    *hash = (*hash ^ (unsigned long long)st.st_size) * FNV_PRIME;
+    *hash = (*hash ^ (unsigned long long)st.st_ino) * FNV_PRIME;  // Files replaced by a rename
+    *hash = (*hash ^ (unsigned long long)st.st_mtime) * FNV_PRIME;
+    #ifdef __linux__
+    *hash = (*hash ^ (unsigned long long)st.st_mtim.tv_nsec) * FNV_PRIME;
+    #endif
+    return 1;
+}
+
+static int is_directory(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// Fingerprint of the files a model at 'path' is loaded from (see create_model_from_path()).
+// Taken before loading, so a change made during the load still triggers a reload.
+static unsigned long long model_signature(const char* path) {
+    unsigned long long hash = FNV_OFFSET;
+    if (!is_directory(path)) {
+        hash_file_stat(path, &hash);
+        return hash;
+    }
+    char filepath[SAFE_PATH_MAX];
+    snprintf(filepath, sizeof(filepath), "%s/%s", path, TNN_DIR_FILENAME);
+    if (hash_file_stat(filepath, &hash)) return hash;
+    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", path);
+    hash_file_stat(filepath, &hash);
+    for (int i = 0;; i++) {
+        snprintf(filepath, sizeof(filepath), "%s/layer_%d_weights.csv", path, i);
+        if (!hash_file_stat(filepath, &hash)) break;
+        snprintf(filepath, sizeof(filepath), "%s/layer_%d_biases.csv", path, i);
+        hash_file_stat(filepath, &hash);
+    }
+    return hash;
+}
+
+#ifdef __linux__
+// Watches the model's directory, or the directory holding a .tnn file: files replaced by
+// rename show up there, not on the old file
+static void add_watch(TinyNN_Registry* registry, RegistryEntry* entry) {
+    entry->watch = -1;
+    if (registry->inotify_fd < 0) return;
+    char dir[SAFE_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", entry->path);
+    if (!is_directory(dir)) {
+        char* slash = strrchr(dir, '/');
+        if (slash == NULL) snprintf(dir, sizeof(dir), ".");
+        else if (slash == dir) slash[1] = '\0';
+        else *slash = '\0';
+    }
+    entry->watch = inotify_add_watch(registry->inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                                                IN_CREATE | IN_DELETE | IN_ATTRIB);
+}
+
+// Watches on the same directory share one descriptor, so it goes with its last entry
+static void remove_watch(TinyNN_Registry* registry, RegistryEntry* entry) {
+    if (entry->watch < 0) return;
+    for (int i = 0; i < registry->count; i++) {
+        if (registry->entries[i] != entry && registry->entries[i]->watch == entry->watch) return;
+    }
+    inotify_rm_watch(registry->inotify_fd, entry->watch);
+}
+
+// Waits up to 'timeout_ms' for file events and drains them. Returns 1 if there were any.
+static int read_watch_events(TinyNN_Registry* registry, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = registry->inotify_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    char buffer[4096];
+    int any = 0;
+    while (read(registry->inotify_fd, buffer, sizeof(buffer)) > 0) any = 1;
+    return any;
+}
+#else
+static void add_watch(TinyNN_Registry* registry, RegistryEntry* entry) {
+    (void)registry;
+    entry->watch = -1;
+}
+
+static void remove_watch(TinyNN_Registry* registry, RegistryEntry* entry) {
+    (void)registry;
+    (void)entry;
+}
+#endif
+
+static void* watcher_main(void* arg) {
+    TinyNN_Registry* registry = (TinyNN_Registry*)arg;
+    int waited_ms = 0;
+    while (!atomic_load_int(&registry->stop)) {
+        #ifdef __linux__
+        if (registry->inotify_fd >= 0) {
+            if (!read_watch_events(registry, WATCH_TIMEOUT_MS)) continue;
+            // Let a burst of writes settle (a converter writes several files) before reloading
+            while (!atomic_load_int(&registry->stop) && read_watch_events(registry, RELOAD_SETTLE_MS)) {}
+            registry_reload_changed(registry);
+            continue;
+        }
+        #endif
+        thread_sleep_ms(WATCH_TIMEOUT_MS);
+        waited_ms += WATCH_TIMEOUT_MS;
+        if (waited_ms >= RELOAD_POLL_MS) {
+            waited_ms = 0;
+            registry_reload_changed(registry);
+        }
+    }
+    return NULL;
+}
+
+// --- Registry ---
+
+TinyNN_Registry* create_model_registry(const TinyNN_RegistryOptions* options) {
+    TinyNN_Registry* registry = (TinyNN_Registry*)calloc(1, sizeof(TinyNN_Registry));
+    if (!registry) return NULL;
+    registry->options = options ? *options : default_registry_options();
+    registry->inotify_fd = -1;
+    mutex_init(&registry->lock);
+    cond_init(&registry->loaded);
+
+    if (registry->options.watch) {
+        #ifdef __linux__
+        registry->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (registry->inotify_fd < 0) {
+            fprintf(stderr, "WARNING: inotify is unavailable, checking model files every %d ms instead\n",
+                    RELOAD_POLL_MS);
+        }
+        #endif
+        if (!thread_create(&registry->watcher, watcher_main, registry)) {
+            fprintf(stderr, "ERROR: Could not start the model watcher thread\n");
+            free_model_registry(registry);
+            return NULL;
+        }
+        registry->watcher_started = 1;
+    }
+    return registry;
+}
+
+void free_model_registry(TinyNN_Registry* registry) {
+    if (registry == NULL) return;
+    if (registry->watcher_started) {
+        atomic_store_int(&registry->stop, 1);
+        thread_join(registry->watcher);
+    }
+    #ifdef __linux__
+    if (registry->inotify_fd >= 0) close(registry->inotify_fd);
+    #endif
+    while (registry->versions) {
+        ModelVersion* next = registry->versions->next;
+        free_model(registry->versions->model);
+        free(registry->versions);
+        registry->versions = next;
+    }
+    for (int i = 0; i < registry->count; i++) free(registry->entries[i]);
+    free(registry->entries);
+    cond_destroy(&registry->loaded);
+    mutex_destroy(&registry->lock);
+    free(registry);
+}
+
+// Weights and biases, the part of a model that grows with its size
+static size_t model_resident_bytes(const TinyNN_Model* model) {
+    size_t bytes = model_weight_bytes(model);
+    for (int i = 0; i <= model->hidden_layers; i++) bytes += sizeof(float) * (size_t)model->layer_sizes[i];
+    // A NUMA-replicated model holds one copy per node
+    return bytes * (size_t)numa_replica_count(model);
+}
+
+// Loads a version without holding the lock, so other models keep being served meanwhile
+static ModelVersion* load_version(TinyNN_Registry* registry, const char* path) {
+    TinyNN_Model* model = create_model_with_options(path, &registry->options.load_options);
+    if (!model) return NULL;
+    ModelVersion* version = (ModelVersion*)calloc(1, sizeof(ModelVersion));
+    if (!version) {
+        free_model(model);
+        return NULL;
+    }
+    version->model = model;
+    version->bytes = model_resident_bytes(model);
+    return version;
+}
+
+static RegistryEntry* find_entry(const TinyNN_Registry* registry, const char* path) {
+    for (int i = 0; i < registry->count; i++) {
+        if (strcmp(registry->entries[i]->path, path) == 0) return registry->entries[i];
+    }
+    return NULL;
+}
+
+static RegistryEntry* add_entry(TinyNN_Registry* registry, const char* path) {
+    if (registry->count == registry->capacity) {
+        int capacity = registry->capacity ? registry->capacity * 2 : 16;
+        RegistryEntry** entries = (RegistryEntry**)realloc(registry->entries, sizeof(RegistryEntry*) * capacity);
+        if (!entries) return NULL;
+        registry->entries = entries;
+        registry->capacity = capacity;
+    }
+    RegistryEntry* entry = (RegistryEntry*)calloc(1, sizeof(RegistryEntry));
+    if (!entry) return NULL;
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->watch = -1;
+    registry->entries[registry->count++] = entry;
+    return entry;
+}
+
+static void remove_entry(TinyNN_Registry* registry, RegistryEntry* entry) {
+    remove_watch(registry, entry);
+    for (int i = 0; i < registry->count; i++) {
+        if (registry->entries[i] == entry) {
+            registry->entries[i] = registry->entries[--registry->count];
+            break;
+        }
+    }
+    free(entry);
+}
+
+// Drops one reference. A version nobody holds is unlinked and queued on 'dead', to be freed
+// once the lock is released.
+static void drop_version(TinyNN_Registry* registry, ModelVersion* version, ModelVersion** dead) {
+    if (--version->refs > 0) return;
+    for (ModelVersion** link = &registry->versions; *link; link = &(*link)->next) {
+        if (*link == version) {
+            *link = version->next;
+            break;
+        }
+    }
+    version->next = *dead;
+    *dead = version;
+}
+
+static void free_versions(ModelVersion* dead) {
+    while (dead) {
+        ModelVersion* next = dead->next;
+        free_model(dead->model);
+        free(dead);
+        dead = next;
+    }
+}
+
+// Evicts the least recently used models nobody holds until the budget is met
+static void evict_to_budget(TinyNN_Registry* registry, ModelVersion** dead) {
+    if (registry->options.memory_budget == 0) return;
+    while (registry->resident_bytes > registry->options.memory_budget) {
+        RegistryEntry* victim = NULL;
+        for (int i = 0; i < registry->count; i++) {
+            RegistryEntry* entry = registry->entries[i];
+            if (entry->current == NULL || entry->reloading || entry->current->refs > 1) continue;
+            if (victim == NULL || entry->last_used < victim->last_used) victim = entry;
+        }
+        if (victim == NULL) break;
+        registry->resident_bytes -= victim->current->bytes;
+        drop_version(registry, victim->current, dead);
+        remove_entry(registry, victim);
+        registry->stats.evictions++;
+    }
+}
+
+TinyNN_Model* registry_acquire(TinyNN_Registry* registry, const char* path) {
+    if (registry == NULL || path == NULL) return NULL;
+    mutex_lock(&registry->lock);
+    RegistryEntry* entry;
+    while ((entry = find_entry(registry, path)) != NULL && entry->current == NULL) {
+        // Another caller is loading it; a failed load removes the entry and this one retries
+        cond_wait(&registry->loaded, &registry->lock);
+    }
+    if (entry) {
+        entry->current->refs++;
+        entry->last_used = ++registry->clock;
+        registry->stats.hits++;
+        TinyNN_Model* model = entry->current->model;
+        mutex_unlock(&registry->lock);
+        return model;
+    }
+
+    // Claim the path with an empty entry so concurrent acquires wait for this one load
+    entry = add_entry(registry, path);
+    if (!entry) {
+        mutex_unlock(&registry->lock);
+        return NULL;
+    }
+    registry->stats.misses++;
+    mutex_unlock(&registry->lock);
+
+    unsigned long long signature = model_signature(path);
+    ModelVersion* version = load_version(registry, path);
+
+    ModelVersion* dead = NULL;
+    mutex_lock(&registry->lock);
+    if (version) {
+        version->refs = 2; // The entry's and the caller's
+        version->next = registry->versions;
+        registry->versions = version;
+        entry->current = version;
+        entry->signature = signature;
+        entry->last_used = ++registry->clock;
+        registry->resident_bytes += version->bytes;
+        add_watch(registry, entry);
+        evict_to_budget(registry, &dead);
+    } else {
+        remove_entry(registry, entry);
+    }
+    cond_broadcast(&registry->loaded);
+    mutex_unlock(&registry->lock);
+    free_versions(dead);
+    return version ? version->model : NULL;
+}
+
+void registry_release(TinyNN_Registry* registry, TinyNN_Model* model) {
+    if (registry == NULL || model == NULL) return;
+    ModelVersion* dead = NULL;
+    mutex_lock(&registry->lock);
+    for (ModelVersion* version = registry->versions; version; version = version->next) {
+        if (version->model == model) {
+            drop_version(registry, version, &dead);
+            break;
+        }
+    }
+    // A model held past the budget can go now that it is free
+    evict_to_budget(registry, &dead);
+    mutex_unlock(&registry->lock);
+    free_versions(dead);
+}
+
+int registry_reload_changed(TinyNN_Registry* registry) {
+    if (registry == NULL) return 0;
+    int swapped = 0;
+    mutex_lock(&registry->lock);
+    // Entries can be removed while the lock is dropped for a load; one that moves past 'i'
+    // is just checked again on the next call
+    for (int i = 0; i < registry->count; i++) {
+        RegistryEntry* entry = registry->entries[i];
+        if (entry->current == NULL || entry->reloading) continue;
+        unsigned long long signature = model_signature(entry->path);
+        if (signature == entry->signature) continue;
+
+        entry->reloading = 1;
+        mutex_unlock(&registry->lock);
+        ModelVersion* version = load_version(registry, entry->path);
+        ModelVersion* dead = NULL;
+        mutex_lock(&registry->lock);
+        entry->reloading = 0;
+        if (version == NULL) {
+            fprintf(stderr, "WARNING: Could not reload %s, keeping the loaded version\n", entry->path);
+            continue;
+        }
+
+        // The swap: acquires from here on get the new version, holders of the old one keep it
+        ModelVersion* old = entry->current;
+        version->refs = 1;
+        version->next = registry->versions;
+        registry->versions = version;
+        entry->current = version;
+        entry->signature = signature;
+        registry->resident_bytes = registry->resident_bytes - old->bytes + version->bytes;
+        registry->stats.reloads++;
+        swapped++;
+        drop_version(registry, old, &dead);
+        evict_to_budget(registry, &dead);
+
+        mutex_unlock(&registry->lock);
+        free_versions(dead);
+        mutex_lock(&registry->lock);
+    }
+    mutex_unlock(&registry->lock);
+    return swapped;
+}
+
+void registry_get_stats(TinyNN_Registry* registry, TinyNN_RegistryStats* stats) {
+    mutex_lock(&registry->lock);
+    *stats = registry->stats;
+    stats->resident = 0;
+    for (int i = 0; i < registry->count; i++) {
+        if (registry->entries[i]->current) stats->resident++;
+    }
+    stats->resident_bytes = registry->resident_bytes;
+    mutex_unlock(&registry->lock);
+}
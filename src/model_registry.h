@@ -0,0 +1,72 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <stddef.h>
+#include "model.h"
+
+// Keeps loaded models resident between requests, keyed by the path they were loaded from.
+//
+// Callers borrow a model with registry_acquire() and hand it back with registry_release().
+// Models nobody holds are evicted least recently used first once the resident weights
+// exceed the memory budget. With watching on, a model whose files change on disk is
+// reloaded in the background and swapped in atomically: new acquires get the new version,
+// while callers still holding the old one keep running on it until they release it.
+//
+// Binary (.tnn) models run straight from a read-only mapping of their file, so a new
+// version must replace the file (write a new one and rename it over the old), as every
+// writer in this project does. Rewriting the file in place would change the weights under
+// the versions still held, and truncating it would crash them.
+
+typedef struct TinyNN_Registry TinyNN_Registry;
+
+typedef struct {
+    // Bytes of weights and biases to keep resident; 0 = no limit. Models in use are never
+    // evicted, so the budget can be exceeded while they are held.
+    size_t memory_budget;
+    // Non-zero: reload models whose files change. Uses inotify on Linux and checks the
+    // files' modification times once a second elsewhere.
+    int watch;
+    // How every model is loaded (weight type, threads per model)
+    TinyNN_LoadOptions load_options;
+} TinyNN_RegistryOptions;
+
+typedef struct {
+    int resident;                 // Models currently loaded
+    size_t resident_bytes;
+    long long hits;               // Acquires served by a resident model
+    long long misses;             // Acquires that had to load the model
+    long long evictions;
+    long long reloads;            // New versions swapped in after their files changed
+} TinyNN_RegistryStats;
+
+// No budget, watching on, default_load_options().
+TinyNN_RegistryOptions default_registry_options(void);
+
+// 'options' may be NULL for default_registry_options(). Returns NULL on failure.
+TinyNN_Registry* create_model_registry(const TinyNN_RegistryOptions* options);
+// Stops watching and frees every model. All acquired models must be released first.
+void free_model_registry(TinyNN_Registry* registry);
+
+/**
+ * @brief Returns the resident model for 'path', loading it first if needed.
+ * Concurrent acquires of a model that is still loading wait for that one load.
+ * The model stays valid until it is passed to registry_release(), even if it is evicted or
+ * replaced by a newer version in the meantime. Contexts created for it belong to that
+ * version: after a reload, acquire again and create a new context.
+ * @return The model, or NULL if it could not be loaded.
+ */
+TinyNN_Model* registry_acquire(TinyNN_Registry* registry, const char* path);
+void registry_release(TinyNN_Registry* registry, TinyNN_Model* model);
+
+/**
+ * @brief Reloads every resident model whose files changed since it was loaded.
+ * The watcher calls this by itself; with watching off it can be called at convenient
+ * points instead. A version that fails to load (e.g. files still being written) is
+ * skipped and the old one stays in service.
+ * @return The number of models swapped.
+ */
+int registry_reload_changed(TinyNN_Registry* registry);
+
+void registry_get_stats(TinyNN_Registry* registry, TinyNN_RegistryStats* stats);
+
+#endif
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numa.h"
+#include "model.h"
+#include "threads.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#define MAX_NUMA_NODES 64
+#define MAX_NUMA_CPUS 1024
+
+struct TinyNN_NumaReplicas {
+    int node_count;
+    TinyNN_Model** models;    // One per node, NULL for nodes without CPUs; the primary is one of them
+};
+
+// Topology read once: the node of every CPU, -1 for CPUs that are offline or unknown
+static int topology_cpu_node[MAX_NUMA_CPUS];
+static int topology_node_count = 1;
+static volatile int topology_claimed = 0;
+static volatile int topology_ready = 0;
+
+// Parses a sysfs list such as "0-3,8-11" and sets flags[i] = value for every listed
+// i below 'max'. Returns the highest listed number, or -1 for an empty list.
+static int parse_cpu_list(const char* text, int* flags, int max, int value) {
+    int highest = -1;
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1) break;
+            p = end;
+        }
+        for (long i = first; i <= last && i < max; i++) {
+            if (i >= 0) flags[i] = value;
+        }
+        if (last > highest) highest = (int)last;
+        if (*p != ',') break;
+        p++;
+    }
+    return highest;
+}
+
+#ifdef __linux__
+// Reads a small sysfs file into 'buffer'. Returns 1 on success.
+static int read_sysfs(const char* path, char* buffer, size_t size) {
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    size_t n = fread(buffer, 1, size - 1, file);
+    fclose(file);
+    buffer[n] = '\0';
+    return n > 0;
+}
+#endif
+
+static void read_topology(void) {
+    for (int i = 0; i < MAX_NUMA_CPUS; i++) topology_cpu_node[i] = -1;
+    int nodes = 0;
+#ifdef __linux__
+    static int online[MAX_NUMA_NODES];
+    char buffer[4096];
+    char path[512];
+    memset(online, 0, sizeof(online));
+    int highest = -1;
+    if (read_sysfs(NUMA_SYSFS_ROOT "/online", buffer, sizeof(buffer))) {
+        highest = parse_cpu_list(buffer, online, MAX_NUMA_NODES, 1);
+    }
+    if (highest >= MAX_NUMA_NODES) highest = MAX_NUMA_NODES - 1;
+    for (int node = 0; node <= highest; node++) {
+        snprintf(path, sizeof(path), NUMA_SYSFS_ROOT "/node%d/cpulist", node);
+        if (!online[node] || !read_sysfs(path, buffer, sizeof(buffer))) continue;
+        parse_cpu_list(buffer, topology_cpu_node, MAX_NUMA_CPUS, node);
+        nodes = node + 1;
+    }
+#endif
+    if (nodes == 0) {
+        // No NUMA information: one node holding every CPU
+        int cpus = cpu_count();
+        for (int i = 0; i < cpus && i < MAX_NUMA_CPUS; i++) topology_cpu_node[i] = 0;
+        nodes = 1;
+    }
+    topology_node_count = nodes;
+}
+
+static void ensure_topology(void) {
+    if (atomic_load_int(&topology_ready)) return;
+    if (atomic_add_int(&topology_claimed, 1) == 0) {
+        read_topology();
+        atomic_store_int(&topology_ready, 1);
+        return;
+    }
+    while (!atomic_load_int(&topology_ready)) cpu_relax();
+}
+
+int numa_node_count(void) {
+    ensure_topology();
+    return topology_node_count;
+}
+
+int numa_node_cpus(int node, int* cpus, int max) {
+    ensure_topology();
+    int count = 0;
+    for (int cpu = 0; cpu < MAX_NUMA_CPUS; cpu++) {
+        if (topology_cpu_node[cpu] != node) continue;
+        if (count < max) cpus[count] = cpu;
+        count++;
+    }
+    return count;
+}
+
+int numa_current_node(void) {
+    ensure_topology();
+#ifdef __linux__
+    unsigned cpu = 0;
+    if (syscall(__NR_getcpu, &cpu, NULL, NULL) == 0 && cpu < MAX_NUMA_CPUS && topology_cpu_node[cpu] >= 0) {
+        return topology_cpu_node[cpu];
+    }
+#endif
+    return 0;
+}
+
+#ifdef __linux__
+// Applies a memory policy to the calling thread. A kernel without NUMA support (or a
+// node it does not know) refuses; allocations then simply land where they are touched.
+static void set_memory_policy(int mode, const unsigned long* nodemask) {
+    static volatile int warned = 0;
+    // maxnode counts bits; the kernel ignores the last one
+    unsigned long maxnode = nodemask ? MAX_NUMA_NODES + 1 : 0;
+    if (syscall(__NR_set_mempolicy, mode, nodemask, maxnode) != 0 && atomic_add_int(&warned, 1) == 0) {
+        fprintf(stderr, "WARNING: Could not set a NUMA memory policy (%s), relying on first touch\n", strerror(errno));
+    }
+}
+#endif
+
+int numa_bind_thread_to_node(int node) {
+    int cpus[MAX_NUMA_CPUS];
+    int count = numa_node_cpus(node, cpus, MAX_NUMA_CPUS);
+    if (count <= 0 || !pin_thread_to_cpus(cpus, count)) return 0;
+#ifdef __linux__
+    // Preferred rather than bound, so a full node spills over instead of failing
+    unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    set_memory_policy(MPOL_PREFERRED, nodemask);
+#endif
+    return 1;
+}
+
+// Spreads the calling thread's new pages over every node
+static void interleave_thread_memory(void) {
+#ifdef __linux__
+    unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+    memset(nodemask, 0, sizeof(nodemask));
+    for (int node = 0; node < numa_node_count(); node++) {
+        nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    }
+    set_memory_policy(MPOL_INTERLEAVE, nodemask);
+#endif
+}
+
+int numa_node_of_address(const void* p) {
+#ifdef __linux__
+    // An untouched page has no node yet
+    volatile unsigned char touch = *(const volatile unsigned char*)p;
+    (void)touch;
+    int node = -1;
+    if (syscall(__NR_get_mempolicy, &node, NULL, 0, p, MPOL_F_NODE | MPOL_F_ADDR) == 0) return node;
+#else
+    (void)p;
+#endif
+    return -1;
+}
+
+int parse_numa_mode(const char* name, TinyNN_NumaMode* mode) {
+    if (strcmp(name, "off") == 0) *mode = TINYNN_NUMA_OFF;
+    else if (strcmp(name, "interleave") == 0) *mode = TINYNN_NUMA_INTERLEAVE;
+    else if (strcmp(name, "replicate") == 0) *mode = TINYNN_NUMA_REPLICATE;
+    else return 0;
+    return 1;
+}
+
+const char* numa_mode_name(TinyNN_NumaMode mode) {
+    switch (mode) {
+        case TINYNN_NUMA_INTERLEAVE: return "interleave";
+        case TINYNN_NUMA_REPLICATE: return "replicate";
+        default: return "off";
+    }
+}
+
+// One model load placed on one node (or interleaved over all, node = -1)
+typedef struct {
+    const char* model_path;
+    TinyNN_LoadOptions options;
+    int node;
+    TinyNN_Model* model;
+} NodeLoad;
+
+// The loader's policy is inherited by the parallel CSV readers it starts, and the
+// weights are copied out of the mapped file, whose pages belong to the page cache
+// wherever they were first read
+static void* node_load_main(void* arg) {
+    NodeLoad* load = (NodeLoad*)arg;
+    if (load->node >= 0) numa_bind_thread_to_node(load->node);
+    else interleave_thread_memory();
+    load->model = create_model_with_options(load->model_path, &load->options);
+    if (load->model && !copy_mapped_weights(load->model)) {
+        free_model(load->model);
+        load->model = NULL;
+    }
+    return NULL;
+}
+
+// Starts the pool of a placed model on 'cpus'; num_threads 1 keeps it single-threaded
+static int start_placed_pool(TinyNN_Model* model, int num_threads, const int* cpus, int num_cpus) {
+    if (num_threads == 1) return 1;
+    model->pool = create_pinned_thread_pool(num_threads, cpus, num_cpus);
+    if (!model->pool) {
+        fprintf(stderr, "ERROR: Could not start %d inference threads\n", num_threads);
+        return 0;
+    }
+    return 1;
+}
+
+static TinyNN_Model* load_interleaved_model(const char* model_path, const TinyNN_LoadOptions* options) {
+    NodeLoad load;
+    load.model_path = model_path;
+    load.options = *options;
+    load.options.numa = TINYNN_NUMA_OFF;
+    load.options.num_threads = 1;
+    load.node = -1;
+    load.model = NULL;
+    TinyNN_Thread thread;
+    if (!thread_create(&thread, node_load_main, &load)) return NULL;
+    thread_join(thread);
+    if (!load.model) return NULL;
+
+    // Workers take turns over the nodes, so any number of them spreads evenly
+    int nodes = numa_node_count();
+    int* cpus = (int*)malloc(sizeof(int) * MAX_NUMA_CPUS * 2);
+    if (!cpus) {
+        free_model(load.model);
+        return NULL;
+    }
+    int* node_cpus = cpus + MAX_NUMA_CPUS;
+    int count = 0;
+    for (int round = 0; round < MAX_NUMA_CPUS; round++) {
+        int added = 0;
+        for (int node = 0; node < nodes; node++) {
+            int n = numa_node_cpus(node, node_cpus, MAX_NUMA_CPUS);
+            if (round < n) {
+                cpus[count++] = node_cpus[round];
+                added = 1;
+            }
+        }
+        if (!added) break;
+    }
+    int ok = start_placed_pool(load.model, options->num_threads, cpus, count);
+    free(cpus);
+    if (!ok) {
+        free_model(load.model);
+        return NULL;
+    }
+    return load.model;
+}
+
+static TinyNN_Model* load_replicated_model(const char* model_path, const TinyNN_LoadOptions* options) {
+    int nodes = numa_node_count();
+    NodeLoad* loads = (NodeLoad*)calloc(nodes, sizeof(NodeLoad));
+    TinyNN_Thread* threads = (TinyNN_Thread*)calloc(nodes, sizeof(TinyNN_Thread));
+    int* started = (int*)calloc(nodes, sizeof(int));
+    int* cpus = (int*)malloc(sizeof(int) * MAX_NUMA_CPUS);
+    TinyNN_NumaReplicas* replicas = (TinyNN_NumaReplicas*)calloc(1, sizeof(TinyNN_NumaReplicas));
+    TinyNN_Model** models = (TinyNN_Model**)calloc(nodes, sizeof(TinyNN_Model*));
+    int ok = loads && threads && started && cpus && replicas && models;
+
+    // Every node reads its copy at the same time, through its own memory controller
+    for (int node = 0; ok && node < nodes; node++) {
+        if (numa_node_cpus(node, cpus, MAX_NUMA_CPUS) == 0) continue;
+        loads[node].model_path = model_path;
+        loads[node].options = *options;
+        loads[node].options.numa = TINYNN_NUMA_OFF;
+        loads[node].options.num_threads = 1;
+        loads[node].node = node;
+        started[node] = thread_create(&threads[node], node_load_main, &loads[node]);
+        if (!started[node]) {
+            fprintf(stderr, "ERROR: Could not start the loader thread of NUMA node %d\n", node);
+            ok = 0;
+        }
+    }
+    TinyNN_Model* primary = NULL;
+    for (int node = 0; node < nodes && loads && threads && started; node++) {
+        if (!started[node]) continue;
+        thread_join(threads[node]);
+        if (!loads[node].model) ok = 0;
+        models[node] = loads[node].model;
+        if (!primary) primary = models[node];
+    }
+    if (!primary) ok = 0;
+
+    for (int node = 0; ok && node < nodes; node++) {
+        if (!models[node]) continue;
+        int count = numa_node_cpus(node, cpus, MAX_NUMA_CPUS);
+        if (count > MAX_NUMA_CPUS) count = MAX_NUMA_CPUS;
+        ok = start_placed_pool(models[node], options->num_threads, cpus, count);
+    }
+
+    free(loads);
+    free(threads);
+    free(started);
+    free(cpus);
+    if (!ok) {
+        for (int node = 0; models && node < nodes; node++) free_model(models[node]);
+        free(models);
+        free(replicas);
+        return NULL;
+    }
+    replicas->node_count = nodes;
+    replicas->models = models;
+    primary->numa = replicas;
+    return primary;
+}
+
+TinyNN_Model* load_numa_model(const char* model_path, const TinyNN_LoadOptions* options) {
+    if (options->stream_window > 0) {
+        fprintf(stderr, "ERROR: A streaming model cannot be placed on NUMA nodes, it is read from the file as it runs\n");
+        return NULL;
+    }
+    TinyNN_LoadOptions plain = *options;
+    plain.numa = TINYNN_NUMA_OFF;
+    if (numa_node_count() <= 1) return create_model_with_options(model_path, &plain);
+    // The kernel choice is made once on first use; make it before the loaders run together
+    select_kernels();
+    if (options->numa == TINYNN_NUMA_INTERLEAVE) return load_interleaved_model(model_path, options);
+    return load_replicated_model(model_path, options);
+}
+
+int numa_replica_count(const TinyNN_Model* model) {
+    if (model == NULL || model->numa == NULL) return 1;
+    int count = 0;
+    for (int node = 0; node < model->numa->node_count; node++) {
+        if (model->numa->models[node]) count++;
+    }
+    return count;
+}
+
+const TinyNN_Model* numa_model_on_node(const TinyNN_Model* model, int node) {
+    if (model == NULL) return NULL;
+    if (model->numa == NULL) return model;
+    if (node < 0 || node >= model->numa->node_count) return NULL;
+    return model->numa->models[node];
+}
+
+const TinyNN_Model* numa_local_model(const TinyNN_Model* model) {
+    if (model == NULL || model->numa == NULL) return model;
+    const TinyNN_Model* local = numa_model_on_node(model, numa_current_node());
+    return local ? local : model;
+}
+
+void free_numa_replicas(TinyNN_Model* model) {
+    if (model == NULL || model->numa == NULL) return;
+    TinyNN_NumaReplicas* replicas = model->numa;
+    model->numa = NULL;
+    for (int node = 0; node < replicas->node_count; node++) {
+        if (replicas->models[node] != model) free_model(replicas->models[node]);
+    }
+    free(replicas->models);
+    free(replicas);
+}
@@ -0,0 +1,60 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "model.h"
+
+// NUMA-aware placement for machines with several memory nodes. A forward pass mostly
+// streams weights, so a worker reading another node's memory is limited by the
+// interconnect rather than by its own memory controller. Two placements are offered:
+//
+// - Replicate: every node gets its own copy of the read-only weights, first-touched by a
+//   loader thread bound to that node, and its own thread pool pinned to the node's CPUs.
+//   create_context() picks the copy local to the calling thread, so a caller pinned to a
+//   node (numa_bind_thread_to_node()) only ever reads local memory. Costs one copy of the
+//   weights per node.
+// - Interleave: one copy whose pages are spread round-robin over all nodes, with one pool
+//   pinned across every node. No node is favoured, so single large requests get the
+//   combined bandwidth of all memory controllers.
+//
+// The topology is read from sysfs and memory is placed with the set_mempolicy system call,
+// so no libnuma is needed. On other platforms, or on machines with one node, every mode
+// behaves like TINYNN_NUMA_OFF.
+
+// Where the topology is read from; a fake tree can be passed in with -D for testing
+#ifndef NUMA_SYSFS_ROOT
+#define NUMA_SYSFS_ROOT "/sys/devices/system/node"
+#endif
+
+// Nodes with memory or CPUs, at least 1.
+int numa_node_count(void);
+// Writes up to 'max' CPU numbers of 'node' to 'cpus'. Returns how many there are.
+int numa_node_cpus(int node, int* cpus, int max);
+// Node of the CPU the calling thread runs on right now (0 when unknown).
+int numa_current_node(void);
+// Pins the calling thread to the CPUs of 'node' and makes its allocations prefer that
+// node. Returns 1 on success.
+int numa_bind_thread_to_node(int node);
+// Node that holds the page at 'p' (touching it first), or -1 when unknown.
+int numa_node_of_address(const void* p);
+
+// Parses "off", "interleave" or "replicate". Returns 1 on success.
+int parse_numa_mode(const char* name, TinyNN_NumaMode* mode);
+const char* numa_mode_name(TinyNN_NumaMode mode);
+
+/**
+ * @brief Loads a model for options->numa (called by create_model_with_options()). The
+ * returned model is node 0's copy; the other copies hang off it and are freed with it.
+ * options->num_threads counts per node when replicating (<= 0: every CPU of the node).
+ * Streaming models cannot be placed.
+ */
+TinyNN_Model* load_numa_model(const char* model_path, const TinyNN_LoadOptions* options);
+// Copies of the weights that exist: the number of nodes when replicated, else 1.
+int numa_replica_count(const TinyNN_Model* model);
+// The copy of 'model' local to the calling thread's node ('model' itself if not replicated).
+const TinyNN_Model* numa_local_model(const TinyNN_Model* model);
+// The copy placed on 'node', NULL if that node has none. A model that is not replicated
+// is its own copy on every node.
+const TinyNN_Model* numa_model_on_node(const TinyNN_Model* model, int node);
+void free_numa_replicas(TinyNN_Model* model);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pack.h"
+#include "kernels.h"
+#include "sparse.h"
+#include "utils.h"
+
+size_t packed_layer_floats(int rows, int cols) {
+    size_t panels = ((size_t)rows + PACK_PANEL_ROWS - 1) / PACK_PANEL_ROWS;
+    return panels * PACK_PANEL_ROWS * (size_t)cols;
+}
+
+void pack_layer(const float* weights, int rows, int cols, float* packed) {
+    for (int j = 0; j < rows; j += PACK_PANEL_ROWS) {
+        float* panel = packed + (size_t)j * cols;
+        int valid = rows - j < PACK_PANEL_ROWS ? rows - j : PACK_PANEL_ROWS;
+        for (int r = 0; r < valid; r++) {
+            const float* w = weights + (size_t)(j + r) * cols;
+            for (int k = 0; k < cols; k++) panel[(size_t)k * PACK_PANEL_ROWS + r] = w[k];
+        }
+        // Zero rows pad the last panel so the kernels never need a row tail when loading
+        for (int r = valid; r < PACK_PANEL_ROWS; r++) {
+            for (int k = 0; k < cols; k++) panel[(size_t)k * PACK_PANEL_ROWS + r] = 0.0f;
+        }
+    }
+}
+
+void unpack_layer(const float* packed, int rows, int cols, float* weights) {
+    for (int j = 0; j < rows; j++) {
+        const float* panel = packed + (size_t)(j / PACK_PANEL_ROWS) * PACK_PANEL_ROWS * cols;
+        float* w = weights + (size_t)j * cols;
+        for (int k = 0; k < cols; k++) w[k] = panel[(size_t)k * PACK_PANEL_ROWS + j % PACK_PANEL_ROWS];
+    }
+}
+
+int packing_enabled(void) {
+    const char* value = getenv("TINYNN_PACK");
+    return !(value && strcmp(value, "0") == 0);
+}
+
+int pack_model_weights(TinyNN_Model* model) {
+    if (model == NULL || model->weight_type != TINYNN_WEIGHTS_FP32 || model->packed_weights) return 1;
+
+    int total_layers = model->hidden_layers + 1;
+    float** packed = (float**)calloc(total_layers, sizeof(float*));
+    if (!packed) return 0;
+
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        int rows = model->layer_sizes[i];
+        // Sparse layers keep their own format and have no panels
+        if (layer_is_sparse(model, i)) {
+            prev_layer_size = rows;
+            continue;
+        }
+        packed[i] = (float*)aligned_malloc(sizeof(float) * packed_layer_floats(rows, prev_layer_size), 64);
+        if (!packed[i]) {
+            for (int j = 0; j < i; j++) aligned_free(packed[j]);
+            free(packed);
+            return 0;
+        }
+        pack_layer(model->weights[i], rows, prev_layer_size, packed[i]);
+        prev_layer_size = rows;
+    }
+
+    // Drop the row-major weights; mapped ones go away with the mapping in free_model()
+    for (int i = 0; i < total_layers; i++) {
+        if (!points_into_mapping(model, model->weights[i])) free(model->weights[i]);
+        model->weights[i] = NULL;
+    }
+    model->packed_weights = packed;
+    return 1;
+}
+
+int unpack_model_weights(TinyNN_Model* model) {
+    if (model == NULL || model->packed_weights == NULL) return 1;
+
+    int total_layers = model->hidden_layers + 1;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        int rows = model->layer_sizes[i];
+        if (layer_is_sparse(model, i)) {
+            prev_layer_size = rows;
+            continue;
+        }
+        model->weights[i] = (float*)malloc(sizeof(float) * (size_t)rows * prev_layer_size);
+        if (!model->weights[i]) {
+            for (int j = 0; j <= i; j++) {
+                free(model->weights[j]);
+                model->weights[j] = NULL;
+            }
+            return 0;
+        }
+        unpack_layer(model->packed_weights[i], rows, prev_layer_size, model->weights[i]);
+        prev_layer_size = rows;
+    }
+
+    for (int i = 0; i < total_layers; i++) {
+        if (!points_into_mapping(model, model->packed_weights[i])) aligned_free(model->packed_weights[i]);
+    }
+    free(model->packed_weights);
+    model->packed_weights = NULL;
+    return 1;
+}
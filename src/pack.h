@@ -0,0 +1,36 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include "model.h"
+
+// Load-time re-layout of fp32 weights into the panel format the packed kernels read
+// (see PACK_PANEL_ROWS in kernels.h).
+
+// Floats a packed [rows][cols] layer occupies: whole panels, so 'rows' rounded up
+size_t packed_layer_floats(int rows, int cols);
+
+// Packs row-major weights [rows][cols] into 'packed' (packed_layer_floats() floats)
+void pack_layer(const float* weights, int rows, int cols, float* packed);
+// Restores the row-major [rows][cols] layout from a packed layer
+void unpack_layer(const float* packed, int rows, int cols, float* weights);
+
+/**
+ * @brief Packs every layer of a row-major fp32 model into packed_weights and drops the
+ * row-major copy. Sparse layers keep their format (their panels are NULL). Models that
+ * are not fp32, or already packed, are left alone.
+ * @return 1 on success, 0 if out of memory (the model is then unchanged).
+ */
+int pack_model_weights(TinyNN_Model* model);
+
+/**
+ * @brief Restores row-major weights[i] for a packed fp32 model and drops the panels.
+ * Conversions to other weight types and code that reads W[j][k] directly need this.
+ * @return 1 on success (or if the model was not packed), 0 if out of memory.
+ */
+int unpack_model_weights(TinyNN_Model* model);
+
+// 0 when the TINYNN_PACK environment variable is "0", which keeps loaded models row-major
+int packing_enabled(void);
+
+#endif
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "threads.h"
+#include "utils.h"
+#include "sparse.h"
+
+#define DEFAULT_MICRO_BATCH 16
+// An idle stage spins briefly, then yields, then sleeps in 1 ms steps
+#define PIPELINE_SPIN_ITERATIONS 2000
+#define PIPELINE_YIELDS 200
+#define CACHE_LINE 64
+
+// Lock-free ring between one producer and one consumer. Each index is written by one side
+// only, and the two sit on separate cache lines so the sides do not fight over one line.
+typedef struct {
+    int* items;
+    int size;                 // One entry always stays empty, so full and empty differ
+    char pad0[CACHE_LINE];
+    volatile int head;        // Next entry to read, advanced by the consumer
+    char pad1[CACHE_LINE];
+    volatile int tail;        // Next entry to write, advanced by the producer
+    char pad2[CACHE_LINE];
+} SpscRing;
+
+// A micro-batch in flight. Each stage reads one buffer and writes the other.
+typedef struct {
+    float* buffers[2];
+    int current;              // Buffer holding the rows' latest values
+    int rows;
+} MicroBatch;
+
+typedef struct {
+    struct TinyNN_Pipeline* pipeline;
+    int index;
+    int first_layer;
+    int last_layer;
+    int cpu;
+    TinyNN_Context* ctx;
+    SpscRing* in;
+    SpscRing* out;
+    TinyNN_Thread thread;
+    // Written by the stage thread only, before it passes a micro-batch on
+    long long micro_batches;
+    long long rows;
+    double busy_seconds;
+    double starved_seconds;
+} PipelineStage;
+
+struct TinyNN_Pipeline {
+    const TinyNN_Model* model;
+    int micro_batch;
+    int depth;
+    int stage_count;
+    PipelineStage* stages;
+    SpscRing* rings;          // rings[s] feeds stage s; the last one holds finished micro-batches
+    int ring_count;
+    SpscRing free_slots;      // Collector -> submitter
+    MicroBatch* slots;
+    volatile int submitted;   // Micro-batches ever submitted
+    int collected;            // Owned by the collecting thread
+    volatile int stop;
+    double started;           // First submit since creation or the last reset, 0 before
+    double last_collect;
+};
+
+TinyNN_PipelineOptions default_pipeline_options(void) {
+    TinyNN_PipelineOptions options;
+    options.num_stages = 0;
+    options.micro_batch = DEFAULT_MICRO_BATCH;
+    options.depth = 0;
+    options.pin = 1;
+    options.output_mode = TINYNN_OUTPUT_DEFAULT;
+    return options;
+}
+
+// --- Rings ---
+
+static int init_ring(SpscRing* ring, int capacity) {
+    memset(ring, 0, sizeof(*ring));
+    ring->size = capacity + 1;
+    ring->items = (int*)malloc(sizeof(int) * ring->size);
+    return ring->items != NULL;
+}
+
+static int ring_try_push(SpscRing* ring, int item) {
+    int tail = ring->tail;  // Only this side writes it
+    int next = tail + 1 == ring->size ? 0 : tail + 1;
+    if (next == atomic_load_int(&ring->head)) return 0;
+    ring->items[tail] = item;
+    // The store publishes the item: the consumer reads the tail before the entry
+    atomic_store_int(&ring->tail, next);
+    return 1;
+}
+
+static int ring_try_pop(SpscRing* ring, int* item) {
+    int head = ring->head;  // Only this side writes it
+    if (head == atomic_load_int(&ring->tail)) return 0;
+    *item = ring->items[head];
+    atomic_store_int(&ring->head, head + 1 == ring->size ? 0 : head + 1);
+    return 1;
+}
+
+// Waits for an item. Returns 0 if the pipeline is stopped first.
+static int ring_wait_pop(SpscRing* ring, int* item, volatile int* stop) {
+    int spins = 0;
+    while (!ring_try_pop(ring, item)) {
+        if (atomic_load_int(stop)) return 0;
+        if (spins < PIPELINE_SPIN_ITERATIONS) {
+            cpu_relax();
+            spins++;
+        } else if (spins < PIPELINE_SPIN_ITERATIONS + PIPELINE_YIELDS) {
+            thread_yield();
+            spins++;
+        } else {
+            thread_sleep_ms(1);
+        }
+    }
+    return 1;
+}
+
+// --- Stages ---
+
+// Work of a layer for the split: multiply-adds, less the zeros a sparse layer skips
+static double layer_cost(const TinyNN_Model* model, int layer) {
+    int cols = layer > 0 ? model->layer_sizes[layer - 1] : model->input_size;
+    double cost = (double)model->layer_sizes[layer] * cols;
+    if (layer_is_sparse(model, layer)) cost *= 1.0 - model->sparse[layer].zero_fraction;
+    return cost;
+}
+
+// Cuts 'layers' layers into 'stages' consecutive runs so that the most expensive run is
+// as cheap as possible. first[s] receives the first layer of stage s. Returns 1 on success.
+static int split_layers(const TinyNN_Model* model, int layers, int stages, int* first) {
+    // best[s][i]: cheapest bottleneck for the first i layers in s + 1 stages
+    double* prefix = (double*)malloc(sizeof(double) * (layers + 1));
+    double* best = (double*)malloc(sizeof(double) * (size_t)stages * (layers + 1));
+    int* cut = (int*)malloc(sizeof(int) * (size_t)stages * (layers + 1));
+    if (!prefix || !best || !cut) {
+        free(prefix);
+        free(best);
+        free(cut);
+        return 0;
+    }
+    prefix[0] = 0.0;
+    for (int i = 0; i < layers; i++) prefix[i + 1] = prefix[i] + layer_cost(model, i);
+    for (int i = 0; i <= layers; i++) {
+        best[i] = prefix[i];
+        cut[i] = 0;
+    }
+    for (int s = 1; s < stages; s++) {
+        for (int i = 0; i <= layers; i++) {
+            double* row = best + (size_t)s * (layers + 1);
+            row[i] = -1.0;
+            cut[(size_t)s * (layers + 1) + i] = 0;
+            // Stage s takes layers j..i-1 and holds at least one layer
+            for (int j = s; j < i; j++) {
+                double previous = best[(size_t)(s - 1) * (layers + 1) + j];
+                double last = prefix[i] - prefix[j];
+                double bottleneck = previous > last ? previous : last;
+                if (row[i] < 0.0 || bottleneck < row[i]) {
+                    row[i] = bottleneck;
+                    cut[(size_t)s * (layers + 1) + i] = j;
+                }
+            }
+        }
+    }
+    int end = layers;
+    for (int s = stages - 1; s >= 0; s--) {
+        first[s] = cut[(size_t)s * (layers + 1) + end];
+        end = first[s];
+    }
+    free(prefix);
+    free(best);
+    free(cut);
+    return 1;
+}
+
+static void* stage_main(void* arg) {
+    PipelineStage* stage = (PipelineStage*)arg;
+    TinyNN_Pipeline* pipeline = stage->pipeline;
+    if (stage->cpu >= 0) pin_thread_to_cpus(&stage->cpu, 1);
+    int started = 0;
+    for (;;) {
+        double wait_start = get_time_seconds();
+        int index;
+        if (!ring_wait_pop(stage->in, &index, &pipeline->stop)) break;
+        double start = get_time_seconds();
+        // Waiting for the very first micro-batch is not the previous stage's fault
+        if (started) stage->starved_seconds += start - wait_start;
+        started = 1;
+
+        MicroBatch* batch = &pipeline->slots[index];
+        forward_layers_into(stage->ctx, stage->first_layer, stage->last_layer, batch->buffers[batch->current],
+                            batch->rows, batch->buffers[batch->current ^ 1]);
+        batch->current ^= 1;
+        stage->busy_seconds += get_time_seconds() - start;
+        stage->micro_batches++;
+        stage->rows += batch->rows;
+        // The ring holds every micro-batch there is, so this never waits
+        ring_try_push(stage->out, index);
+    }
+    return NULL;
+}
+
+// --- Pipeline ---
+
+TinyNN_Pipeline* create_pipeline(const TinyNN_Model* model, const TinyNN_PipelineOptions* options) {
+    TinyNN_PipelineOptions defaults = default_pipeline_options();
+    if (options == NULL) options = &defaults;
+    if (model == NULL || options->micro_batch <= 0) return NULL;
+    if (model->stream) {
+        fprintf(stderr, "ERROR: A streaming model runs one layer window at a time and cannot be pipelined\n");
+        return NULL;
+    }
+
+    // The CPUs this process may use: taskset or a cpuset can leave out any of them
+    int* cpus = (int*)malloc(sizeof(int) * cpu_count());
+    if (!cpus) return NULL;
+    int num_cpus = allowed_cpus(cpus, cpu_count());
+    int layers = model->hidden_layers + 1;
+    int stages = options->num_stages > 0 ? options->num_stages : num_cpus;
+    if (stages > layers) stages = layers;
+
+    TinyNN_Pipeline* pipeline = (TinyNN_Pipeline*)calloc(1, sizeof(TinyNN_Pipeline));
+    if (!pipeline) {
+        free(cpus);
+        return NULL;
+    }
+    pipeline->model = model;
+    pipeline->micro_batch = options->micro_batch;
+    pipeline->depth = options->depth > 0 ? options->depth : 2 * stages;
+    pipeline->stages = (PipelineStage*)calloc(stages, sizeof(PipelineStage));
+    pipeline->rings = (SpscRing*)calloc(stages + 1, sizeof(SpscRing));
+    if (pipeline->rings) pipeline->ring_count = stages + 1;
+    pipeline->slots = (MicroBatch*)calloc(pipeline->depth, sizeof(MicroBatch));
+    int* first = (int*)malloc(sizeof(int) * stages);
+    int ok = pipeline->stages && pipeline->rings && pipeline->slots && first && split_layers(model, layers, stages, first);
+
+    // Every ring can hold every micro-batch, so a stage never waits to pass one on
+    for (int r = 0; ok && r <= stages; r++) ok = init_ring(&pipeline->rings[r], pipeline->depth);
+    ok = ok && init_ring(&pipeline->free_slots, pipeline->depth);
+
+    int max_width = model->input_size;
+    for (int i = 0; i < layers; i++) {
+        if (model->layer_sizes[i] > max_width) max_width = model->layer_sizes[i];
+    }
+    size_t slot_floats = (size_t)max_width * pipeline->micro_batch;
+    for (int i = 0; ok && i < pipeline->depth; i++) {
+        MicroBatch* batch = &pipeline->slots[i];
+        batch->buffers[0] = (float*)aligned_malloc(sizeof(float) * slot_floats, 64);
+        batch->buffers[1] = (float*)aligned_malloc(sizeof(float) * slot_floats, 64);
+        ok = batch->buffers[0] && batch->buffers[1] && ring_try_push(&pipeline->free_slots, i);
+    }
+
+    for (int s = 0; ok && s < stages; s++) {
+        PipelineStage* stage = &pipeline->stages[s];
+        stage->pipeline = pipeline;
+        stage->index = s;
+        stage->first_layer = first[s];
+        stage->last_layer = s + 1 < stages ? first[s + 1] - 1 : layers - 1;
+        stage->cpu = options->pin ? cpus[s % num_cpus] : -1;
+        stage->in = &pipeline->rings[s];
+        stage->out = &pipeline->rings[s + 1];
+        // Each stage runs on its own thread, not on the model's pool
+        stage->ctx = create_context(model, pipeline->micro_batch);
+        if (!stage->ctx) {
+            ok = 0;
+            break;
+        }
+        context_set_thread_pool(stage->ctx, NULL);
+        context_set_output_mode(stage->ctx, options->output_mode);
+    }
+    free(first);
+    free(cpus);
+    for (int s = 0; ok && s < stages; s++) {
+        if (!thread_create(&pipeline->stages[s].thread, stage_main, &pipeline->stages[s])) {
+            fprintf(stderr, "ERROR: Could not start pipeline stage %d\n", s);
+            ok = 0;
+            break;
+        }
+        pipeline->stage_count++;
+    }
+    if (!ok) {
+        // Only started stages are joined; the others' contexts are freed all the same
+        for (int s = pipeline->stage_count; pipeline->stages && s < stages; s++) {
+            free_context(pipeline->stages[s].ctx);
+            pipeline->stages[s].ctx = NULL;
+        }
+        free_pipeline(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+void free_pipeline(TinyNN_Pipeline* pipeline) {
+    if (pipeline == NULL) return;
+    atomic_store_int(&pipeline->stop, 1);
+    for (int s = 0; s < pipeline->stage_count; s++) {
+        thread_join(pipeline->stages[s].thread);
+        free_context(pipeline->stages[s].ctx);
+    }
+    for (int r = 0; r < pipeline->ring_count; r++) free(pipeline->rings[r].items);
+    free(pipeline->rings);
+    free(pipeline->free_slots.items);
+    if (pipeline->slots) {
+        for (int i = 0; i < pipeline->depth; i++) {
+            aligned_free(pipeline->slots[i].buffers[0]);
+            aligned_free(pipeline->slots[i].buffers[1]);
+        }
+        free(pipeline->slots);
+    }
+    free(pipeline->stages);
+    free(pipeline);
+}
+
+int pipeline_micro_batch(const TinyNN_Pipeline* pipeline) {
+    return pipeline ? pipeline->micro_batch : 0;
+}
+
+int pipeline_stage_count(const TinyNN_Pipeline* pipeline) {
+    return pipeline ? pipeline->stage_count : 0;
+}
+
+int pipeline_submit(TinyNN_Pipeline* pipeline, const float* inputs, int rows) {
+    if (pipeline == NULL || inputs == NULL || rows < 1 || rows > pipeline->micro_batch) return 0;
+    int index;
+    if (!ring_try_pop(&pipeline->free_slots, &index)) return 0;
+    MicroBatch* batch = &pipeline->slots[index];
+    memcpy(batch->buffers[0], inputs, sizeof(float) * (size_t)rows * pipeline->model->input_size);
+    batch->current = 0;
+    batch->rows = rows;
+    if (pipeline->started == 0.0) pipeline->started = get_time_seconds();
+    ring_try_push(&pipeline->rings[0], index);
+    atomic_add_int(&pipeline->submitted, 1);
+    return 1;
+}
+
+int pipeline_collect(TinyNN_Pipeline* pipeline, float* outputs) {
+    if (pipeline == NULL || outputs == NULL) return 0;
+    if (pipeline->collected == atomic_load_int(&pipeline->submitted)) return 0;
+    int index;
+    if (!ring_wait_pop(&pipeline->rings[pipeline->stage_count], &index, &pipeline->stop)) return 0;
+    MicroBatch* batch = &pipeline->slots[index];
+    int rows = batch->rows;
+    memcpy(outputs, batch->buffers[batch->current], sizeof(float) * (size_t)rows * pipeline->model->output_size);
+    ring_try_push(&pipeline->free_slots, index);
+    pipeline->collected++;
+    pipeline->last_collect = get_time_seconds();
+    return rows;
+}
+
+void get_pipeline_stats(const TinyNN_Pipeline* pipeline, TinyNN_PipelineStageStats* stats) {
+    double wall = pipeline->last_collect - pipeline->started;
+    for (int s = 0; s < pipeline->stage_count; s++) {
+        const PipelineStage* stage = &pipeline->stages[s];
+        TinyNN_PipelineStageStats* out = &stats[s];
+        out->first_layer = stage->first_layer;
+        out->last_layer = stage->last_layer;
+        out->cpu = stage->cpu;
+        out->weight_bytes = 0;
+        for (int i = stage->first_layer; i <= stage->last_layer; i++) {
+            out->weight_bytes += layer_weight_bytes(pipeline->model, i);
+        }
+        out->micro_batches = stage->micro_batches;
+        out->rows = stage->rows;
+        out->busy_seconds = stage->busy_seconds;
+        out->starved_seconds = stage->starved_seconds;
+        out->occupancy = pipeline->started > 0.0 && wall > 0.0 ? stage->busy_seconds / wall : 0.0;
+    }
+}
+
+void reset_pipeline_stats(TinyNN_Pipeline* pipeline) {
+    for (int s = 0; s < pipeline->stage_count; s++) {
+        PipelineStage* stage = &pipeline->stages[s];
+        stage->micro_batches = 0;
+        stage->rows = 0;
+        stage->busy_seconds = 0.0;
+        stage->starved_seconds = 0.0;
+    }
+    pipeline->started = 0.0;
+    pipeline->last_collect = 0.0;
+}
+
+void print_pipeline_stats(const TinyNN_Pipeline* pipeline, FILE* out) {
+    TinyNN_PipelineStageStats* stats =
+        (TinyNN_PipelineStageStats*)malloc(sizeof(TinyNN_PipelineStageStats) * pipeline->stage_count);
+    if (!stats) return;
+    get_pipeline_stats(pipeline, stats);
+    int busiest = 0;
+    for (int s = 1; s < pipeline->stage_count; s++) {
+        if (stats[s].busy_seconds > stats[busiest].busy_seconds) busiest = s;
+    }
+    fprintf(out, "Pipeline: %d stage%s, micro-batches of %d rows, %d in flight\n", pipeline->stage_count,
+            pipeline->stage_count == 1 ? "" : "s", pipeline->micro_batch, pipeline->depth);
+    fprintf(out, "%-6s %-9s %4s %11s %14s %10s %11s %10s\n", "stage", "layers", "cpu", "weights KB",
+            "micro-batches", "busy s", "starved s", "occupancy");
+    for (int s = 0; s < pipeline->stage_count; s++) {
+        const TinyNN_PipelineStageStats* stage = &stats[s];
+        char layers[32];
+        char cpu[16];
+        if (stage->first_layer == stage->last_layer) snprintf(layers, sizeof(layers), "%d", stage->first_layer);
+        else snprintf(layers, sizeof(layers), "%d-%d", stage->first_layer, stage->last_layer);
+        if (stage->cpu >= 0) snprintf(cpu, sizeof(cpu), "%d", stage->cpu);
+        else snprintf(cpu, sizeof(cpu), "-");
+        fprintf(out, "%-6d %-9s %4s %11.1f %14lld %10.3f %11.3f %9.1f%%%s\n", s, layers, cpu,
+                stage->weight_bytes / 1024.0, stage->micro_batches, stage->busy_seconds, stage->starved_seconds,
+                stage->occupancy * 100.0, s == busiest && pipeline->stage_count > 1 ? "  <- bottleneck" : "");
+    }
+    free(stats);
+}
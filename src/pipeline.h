@@ -0,0 +1,93 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include "model.h"
+
+// Layer-pipelined execution for long input streams. The layers of a model are cut into
+// consecutive stages of about equal work, and each stage runs on its own thread, pinned
+// to its own core, so its weights stay in that core's caches. Micro-batches of rows flow
+// from stage to stage through lock-free single-producer/single-consumer rings: while
+// stage 2 works on micro-batch n, stage 1 is already on n + 1. Throughput is then set by
+// the slowest stage rather than by the whole forward pass, and no layer is ever split.
+//
+// Rows come out in the order they went in. One thread may submit and another collect,
+// or a single thread may do both (collecting whenever submit reports a full pipeline).
+//
+//     TinyNN_Pipeline* pipe = create_pipeline(model, NULL);
+//     while (rows = read(...)) {
+//         while (!pipeline_submit(pipe, inputs, rows)) write(pipeline_collect(pipe, outputs));
+//     }
+//     while ((rows = pipeline_collect(pipe, outputs)) > 0) write(...);
+
+typedef struct TinyNN_Pipeline TinyNN_Pipeline;
+
+typedef struct {
+    // Stages to cut the model into, at most one per layer. 0 (the default) uses one per
+    // CPU the process may run on, but never more than the layers.
+    int num_stages;
+    // Rows per micro-batch. Small batches keep the stages busy early; larger ones make
+    // each pass over a stage's weights do more work.
+    int micro_batch;
+    // Micro-batches in flight at once; <= 0 uses two per stage, so every stage has the
+    // next one waiting while it works.
+    int depth;
+    // 1 (the default) pins stage i to the i-th CPU of the process's affinity mask.
+    int pin;
+    TinyNN_OutputMode output_mode;
+} TinyNN_PipelineOptions;
+
+// Occupancy of one stage since the pipeline started (or its stats were reset)
+typedef struct {
+    int first_layer;
+    int last_layer;
+    int cpu;                // CPU the stage is pinned to, -1 if it is not
+    size_t weight_bytes;    // Weights the stage keeps hot
+    long long micro_batches;
+    long long rows;
+    double busy_seconds;    // Time spent computing
+    double starved_seconds; // Time spent waiting for the previous stage
+    double occupancy;       // busy_seconds over the wall time since the start
+} TinyNN_PipelineStageStats;
+
+// One stage per CPU, micro-batches of 16 rows, two per stage in flight, pinned stages.
+TinyNN_PipelineOptions default_pipeline_options(void);
+
+/**
+ * @brief Cuts 'model' into stages and starts one thread per stage. The model is only read
+ * and must outlive the pipeline; streaming models cannot be pipelined.
+ * @param options NULL for default_pipeline_options().
+ * @return The pipeline, or NULL on failure.
+ */
+TinyNN_Pipeline* create_pipeline(const TinyNN_Model* model, const TinyNN_PipelineOptions* options);
+// Stops the stages; micro-batches that were not collected are dropped.
+void free_pipeline(TinyNN_Pipeline* pipeline);
+
+// Largest 'rows' pipeline_submit() takes.
+int pipeline_micro_batch(const TinyNN_Pipeline* pipeline);
+int pipeline_stage_count(const TinyNN_Pipeline* pipeline);
+
+/**
+ * @brief Copies 'rows' input rows (row-major, input_size each) into the pipeline as one
+ * micro-batch. Never blocks.
+ * @return 1 if submitted, 0 if 'depth' micro-batches are already in flight (collect one
+ *         first) or 'rows' is not in [1, micro_batch].
+ */
+int pipeline_submit(TinyNN_Pipeline* pipeline, const float* inputs, int rows);
+/**
+ * @brief Waits for the oldest micro-batch still in flight and copies its output rows to
+ * 'outputs' (room for micro_batch * output_size floats).
+ * @return The rows written, or 0 if nothing is in flight.
+ */
+int pipeline_collect(TinyNN_Pipeline* pipeline, float* outputs);
+
+/**
+ * @brief Copies each stage's occupancy to 'stats' (pipeline_stage_count() entries).
+ * Call it once every submitted micro-batch has been collected.
+ */
+void get_pipeline_stats(const TinyNN_Pipeline* pipeline, TinyNN_PipelineStageStats* stats);
+void reset_pipeline_stats(TinyNN_Pipeline* pipeline);
+// Prints the stages as a table; the busiest stage bounds the throughput.
+void print_pipeline_stats(const TinyNN_Pipeline* pipeline, FILE* out);
+
+#endif
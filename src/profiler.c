@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "profiler.h"
+#include "sparse.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware counters of one context: one perf event group, read with a single syscall
+struct TinyNN_PerfCounters {
+    int leader_fd;
+    int fds[TINYNN_COUNTER_COUNT];
+    int slots[TINYNN_COUNTER_COUNT];  // Position of each counter in the group read, -1 if absent
+    int opened;
+    int available;                    // Bit mask of the counters in the group
+};
+
+#ifdef __linux__
+static int open_perf_event(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1; // The group starts once all members are attached
+    attr.exclude_kernel = 1;        // Allowed without privileges at the default paranoid level
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // This thread only, on any CPU
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void open_counters(TinyNN_PerfCounters* perf) {
+    static const uint64_t configs[TINYNN_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+    perf->leader_fd = -1;
+    int members = 0;
+    for (int i = 0; i < TINYNN_COUNTER_COUNT; i++) {
+        perf->fds[i] = open_perf_event(configs[i], perf->leader_fd);
+        perf->slots[i] = -1;
+        if (perf->fds[i] < 0) continue;
+        if (perf->leader_fd < 0) perf->leader_fd = perf->fds[i];
+        perf->slots[i] = members++;
+        perf->available |= 1 << i;
+    }
+    if (perf->leader_fd >= 0) {
+        ioctl(perf->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+static void read_counters(const TinyNN_PerfCounters* perf, unsigned long long* values) {
+    uint64_t buffer[1 + TINYNN_COUNTER_COUNT];
+    if (perf->leader_fd < 0 || read(perf->leader_fd, buffer, sizeof(buffer)) <= 0) return;
+    // buffer[0] is the number of events, the values follow in the order they were opened
+    for (int i = 0; i < TINYNN_COUNTER_COUNT; i++) {
+        if (perf->slots[i] >= 0) values[i] = buffer[1 + perf->slots[i]];
+    }
+}
+
+static void close_counters(TinyNN_PerfCounters* perf) {
+    for (int i = 0; i < TINYNN_COUNTER_COUNT; i++) {
+        if (perf->fds[i] >= 0) close(perf->fds[i]);
+    }
+}
+#else
+static void open_counters(TinyNN_PerfCounters* perf) {
+    perf->leader_fd = -1;
+}
+
+static void read_counters(const TinyNN_PerfCounters* perf, unsigned long long* values) {
+    (void)perf;
+    (void)values;
+}
+
+static void close_counters(TinyNN_PerfCounters* perf) {
+    (void)perf;
+}
+#endif
+
+int enable_profiling(TinyNN_Model* model) {
+    if (model == NULL) return 0;
+    if (model->profile) {
+        reset_profile(model);
+        return 1;
+    }
+    TinyNN_Profile* profile = (TinyNN_Profile*)calloc(1, sizeof(TinyNN_Profile));
+    if (!profile) return 0;
+    profile->num_layers = model->hidden_layers + 1;
+    profile->layers = (TinyNN_LayerProfile*)calloc(profile->num_layers, sizeof(TinyNN_LayerProfile));
+    if (!profile->layers) {
+        free(profile);
+        return 0;
+    }
+    mutex_init(&profile->lock);
+    model->profile = profile;
+    reset_profile(model);
+    return 1;
+}
+
+void disable_profiling(TinyNN_Model* model) {
+    if (model == NULL || model->profile == NULL) return;
+    mutex_destroy(&model->profile->lock);
+    free(model->profile->layers);
+    free(model->profile);
+    model->profile = NULL;
+}
+
+void reset_profile(TinyNN_Model* model) {
+    TinyNN_Profile* profile = model ? model->profile : NULL;
+    if (profile == NULL) return;
+    mutex_lock(&profile->lock);
+    profile->counters_partial = 0;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < profile->num_layers; i++) {
+        memset(&profile->layers[i], 0, sizeof(TinyNN_LayerProfile));
+        profile->layers[i].input_size = prev_layer_size;
+        profile->layers[i].output_size = model->layer_sizes[i];
+        prev_layer_size = model->layer_sizes[i];
+    }
+    mutex_unlock(&profile->lock);
+}
+
+void profile_layer_begin(TinyNN_Context* ctx, TinyNN_LayerSample* sample) {
+    if (ctx->counters == NULL && thread_pool_size(ctx->pool) <= 1) {
+        // Opened by the thread that runs this context, which the counters then follow
+        ctx->counters = (TinyNN_PerfCounters*)calloc(1, sizeof(TinyNN_PerfCounters));
+        if (ctx->counters) open_counters(ctx->counters);
+    }
+    memset(sample->counters, 0, sizeof(sample->counters));
+    if (ctx->counters) read_counters(ctx->counters, sample->counters);
+    sample->start = get_time_seconds();
+}
+
+void profile_layer_end(TinyNN_Context* ctx, int layer, int batch_size, const TinyNN_LayerSample* sample) {
+    double seconds = get_time_seconds() - sample->start;
+    unsigned long long counters[TINYNN_COUNTER_COUNT] = {0};
+    int available = 0;
+    // The pool's workers run most of the layer out of sight of this thread's counters
+    int partial = thread_pool_size(ctx->pool) > 1;
+    if (ctx->counters && !partial) {
+        read_counters(ctx->counters, counters);
+        available = ctx->counters->available;
+    }
+
+    const TinyNN_Model* model = ctx->model;
+    TinyNN_Profile* profile = model->profile;
+    TinyNN_LayerProfile* entry = &profile->layers[layer];
+    // Sparse layers only multiply their nonzero weights
+    double weights = (double)entry->input_size * entry->output_size;
+    if (layer_is_sparse(model, layer)) weights *= 1.0 - model->sparse[layer].zero_fraction;
+    mutex_lock(&profile->lock);
+    entry->calls++;
+    entry->samples += batch_size;
+    entry->seconds += seconds;
+    entry->flops += 2.0 * weights * batch_size;
+    entry->weight_bytes += (double)layer_weight_bytes(model, layer);
+    for (int i = 0; i < TINYNN_COUNTER_COUNT; i++) {
+        if (available & (1 << i)) entry->counters[i] += counters[i] - sample->counters[i];
+    }
+    profile->counters_available |= available;
+    profile->counters_partial |= partial;
+    mutex_unlock(&profile->lock);
+}
+
+void close_context_counters(TinyNN_Context* ctx) {
+    if (ctx->counters == NULL) return;
+    close_counters(ctx->counters);
+    free(ctx->counters);
+    ctx->counters = NULL;
+}
+
+// Counters to report: none once a layer ran on several threads
+static int shown_counters(const TinyNN_Profile* profile) {
+    return profile->counters_partial ? 0 : profile->counters_available;
+}
+
+static double per_second(double amount, double seconds) {
+    return seconds > 0.0 ? amount / seconds : 0.0;
+}
+
+static void sum_layers(const TinyNN_Profile* profile, TinyNN_LayerProfile* total) {
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < profile->num_layers; i++) {
+        const TinyNN_LayerProfile* layer = &profile->layers[i];
+        total->calls += layer->calls;
+        total->samples += layer->samples;
+        total->seconds += layer->seconds;
+        total->flops += layer->flops;
+        total->weight_bytes += layer->weight_bytes;
+        for (int c = 0; c < TINYNN_COUNTER_COUNT; c++) total->counters[c] += layer->counters[c];
+    }
+}
+
+static void print_counter(FILE* fp, const TinyNN_Profile* profile, int counter, unsigned long long value) {
+    if (shown_counters(profile) & (1 << counter)) {
+        fprintf(fp, " %14llu", value);
+    } else {
+        fprintf(fp, " %14s", "n/a");
+    }
+}
+
+static void print_row(FILE* fp, const TinyNN_Profile* profile, const char* label, const char* shape,
+                      const char* format, const TinyNN_LayerProfile* layer, double total_seconds) {
+    fprintf(fp, "%-6s %-12s %-9s %9lld %10.3f %6.1f %9.2f %9.2f", label, shape, format, layer->samples,
+            layer->seconds * 1e3,
+            total_seconds > 0.0 ? 100.0 * layer->seconds / total_seconds : 0.0,
+            per_second(layer->flops, layer->seconds) * 1e-9, per_second(layer->weight_bytes, layer->seconds) * 1e-9);
+    print_counter(fp, profile, TINYNN_COUNTER_CYCLES, layer->counters[TINYNN_COUNTER_CYCLES]);
+    print_counter(fp, profile, TINYNN_COUNTER_INSTRUCTIONS, layer->counters[TINYNN_COUNTER_INSTRUCTIONS]);
+    if ((shown_counters(profile) & 3) == 3 && layer->counters[TINYNN_COUNTER_CYCLES] > 0) {
+        fprintf(fp, " %5.2f", (double)layer->counters[TINYNN_COUNTER_INSTRUCTIONS] /
+                              (double)layer->counters[TINYNN_COUNTER_CYCLES]);
+    } else {
+        fprintf(fp, " %5s", "n/a");
+    }
+    print_counter(fp, profile, TINYNN_COUNTER_LLC_MISSES, layer->counters[TINYNN_COUNTER_LLC_MISSES]);
+    fprintf(fp, "\n");
+}
+
+void print_profile(const TinyNN_Model* model, FILE* fp) {
+    const TinyNN_Profile* profile = model ? model->profile : NULL;
+    if (profile == NULL) {
+        fprintf(fp, "Profiling is not enabled for this model.\n");
+        return;
+    }
+    TinyNN_LayerProfile total;
+    sum_layers(profile, &total);
+
+    fprintf(fp, "%-6s %-12s %-9s %9s %10s %6s %9s %9s %14s %14s %5s %14s\n", "layer", "shape", "format", "samples",
+            "time (ms)", "%", "GFLOP/s", "GB/s", "cycles", "instructions", "IPC", "LLC misses");
+    for (int i = 0; i < profile->num_layers; i++) {
+        const TinyNN_LayerProfile* layer = &profile->layers[i];
+        char label[16], shape[32];
+        snprintf(label, sizeof(label), "%d", i);
+        snprintf(shape, sizeof(shape), "%dx%d", layer->output_size, layer->input_size);
+        print_row(fp, profile, label, shape, layer_format_name(model, i), layer, total.seconds);
+    }
+    total.samples = profile->layers[0].samples; // Every sample passes through every layer
+    print_row(fp, profile, "total", "", "", &total, total.seconds);
+    if (profile->counters_partial) {
+        fprintf(fp, "(hardware counters not shown: they only count the calling thread, and layers ran "
+                    "on a thread pool)\n");
+    } else if (profile->counters_available == 0) {
+        fprintf(fp, "(hardware counters unavailable: needs Linux and perf_event_open permission)\n");
+    }
+}
+
+static void print_json_counter(FILE* fp, const TinyNN_Profile* profile, const char* name, int counter,
+                               unsigned long long value) {
+    if (shown_counters(profile) & (1 << counter)) {
+        fprintf(fp, ", \"%s\": %llu", name, value);
+    } else {
+        fprintf(fp, ", \"%s\": null", name);
+    }
+}
+
+static void print_json_layer(FILE* fp, const TinyNN_Profile* profile, const TinyNN_LayerProfile* layer) {
+    fprintf(fp, "\"calls\": %lld, \"samples\": %lld, \"seconds\": %.9f, \"flops\": %.0f, \"weight_bytes\": %.0f, "
+            "\"gflops\": %.3f, \"weight_gbps\": %.3f",
+            layer->calls, layer->samples, layer->seconds, layer->flops, layer->weight_bytes,
+            per_second(layer->flops, layer->seconds) * 1e-9, per_second(layer->weight_bytes, layer->seconds) * 1e-9);
+    print_json_counter(fp, profile, "cycles", TINYNN_COUNTER_CYCLES, layer->counters[TINYNN_COUNTER_CYCLES]);
+    print_json_counter(fp, profile, "instructions", TINYNN_COUNTER_INSTRUCTIONS,
+                       layer->counters[TINYNN_COUNTER_INSTRUCTIONS]);
+    print_json_counter(fp, profile, "llc_misses", TINYNN_COUNTER_LLC_MISSES,
+                       layer->counters[TINYNN_COUNTER_LLC_MISSES]);
+}
+
+void print_profile_json(const TinyNN_Model* model, FILE* fp) {
+    const TinyNN_Profile* profile = model ? model->profile : NULL;
+    if (profile == NULL) {
+        fprintf(fp, "null\n");
+        return;
+    }
+    TinyNN_LayerProfile total;
+    sum_layers(profile, &total);
+    total.samples = profile->layers[0].samples;
+
+    fprintf(fp, "{\"weights\": \"%s\", \"kernels\": \"%s\", \"layers\": [", weight_type_name(model->weight_type),
+            model->kernels ? model->kernels->name : "unknown");
+    for (int i = 0; i < profile->num_layers; i++) {
+        const TinyNN_LayerProfile* layer = &profile->layers[i];
+        fprintf(fp, "%s\n  {\"layer\": %d, \"inputs\": %d, \"outputs\": %d, \"format\": \"%s\", ", i == 0 ? "" : ",",
+                i, layer->input_size, layer->output_size, layer_format_name(model, i));
+        print_json_layer(fp, profile, layer);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "],\n \"total\": {");
+    print_json_layer(fp, profile, &total);
+    fprintf(fp, "}}\n");
+}
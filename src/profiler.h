@@ -0,0 +1,75 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include "model.h"
+#include "threads.h"
+
+// Opt-in per-layer profiling of forward passes. While a model has a profile, every layer
+// of every forward pass adds its wall time, work and (on Linux) hardware counter deltas to
+// the model's report. Without one, the layer loop only tests a NULL pointer per layer.
+
+typedef enum {
+    TINYNN_COUNTER_CYCLES = 0,
+    TINYNN_COUNTER_INSTRUCTIONS = 1,
+    TINYNN_COUNTER_LLC_MISSES = 2,
+    TINYNN_COUNTER_COUNT = 3
+} TinyNN_Counter;
+
+typedef struct {
+    int input_size;
+    int output_size;
+    long long calls;            // Times the layer ran (once per forward pass or batch chunk)
+    long long samples;
+    double seconds;
+    double flops;               // 2 * inputs * outputs per sample, 2 * nonzero weights if sparse
+    double weight_bytes;        // Stored weight bytes read, summed over calls
+    unsigned long long counters[TINYNN_COUNTER_COUNT];
+} TinyNN_LayerProfile;
+
+struct TinyNN_Profile {
+    int num_layers;
+    TinyNN_LayerProfile* layers;
+    // Bit i set when counter i was measured. Counters need Linux and permission to use
+    // perf_event_open (kernel.perf_event_paranoid <= 2); otherwise only times are recorded.
+    int counters_available;
+    // Set when a layer ran on a thread pool of several threads. The counters only follow the
+    // thread that opened them, so the report shows them as n/a rather than a partial count.
+    int counters_partial;
+    TinyNN_Mutex lock;          // Contexts on different threads report into the same profile
+};
+
+// Taken at the start of a layer
+typedef struct {
+    double start;
+    unsigned long long counters[TINYNN_COUNTER_COUNT];
+} TinyNN_LayerSample;
+
+/**
+ * @brief Starts collecting a per-layer report for 'model' (or clears the existing one).
+ * Call it while no forward pass is running on the model.
+ *
+ * Hardware counters are opened per context by the thread that first runs it with profiling
+ * on, and only count that thread. Contexts with a pool of several threads therefore record
+ * times only, and the report shows the counters as n/a.
+ * @return 1 on success, 0 if out of memory.
+ */
+int enable_profiling(TinyNN_Model* model);
+
+// Stops profiling and frees the report. Call it while no forward pass is running.
+void disable_profiling(TinyNN_Model* model);
+
+// Zeroes the numbers collected so far, keeping profiling on.
+void reset_profile(TinyNN_Model* model);
+
+// Writes the report as an aligned table, or as one JSON object.
+void print_profile(const TinyNN_Model* model, FILE* fp);
+void print_profile_json(const TinyNN_Model* model, FILE* fp);
+
+// Used by the layer loop in model.c
+void profile_layer_begin(TinyNN_Context* ctx, TinyNN_LayerSample* sample);
+void profile_layer_end(TinyNN_Context* ctx, int layer, int batch_size, const TinyNN_LayerSample* sample);
+// Closes the counters a context opened
+void close_context_counters(TinyNN_Context* ctx);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "quantize.h"
+#include "utils.h"
+#include "pack.h"
+#include "sparse.h"
+
+// Largest |activation| reaching each layer's input across the calibration set.
+// Layers are run one at a time with the fp32 kernels so the intermediate values are visible.
+static int calibrate_input_ranges(const TinyNN_Model* model, const float* inputs, int count, float* max_abs) {
+    int total_layers = model->hidden_layers + 1;
+    int max_width = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        if (model->layer_sizes[i] > max_width) max_width = model->layer_sizes[i];
+    }
+    float* buffers[2];
+    buffers[0] = (float*)malloc(sizeof(float) * max_width);
+    buffers[1] = (float*)malloc(sizeof(float) * max_width);
+    if (!buffers[0] || !buffers[1]) {
+        free(buffers[0]);
+        free(buffers[1]);
+        return 0;
+    }
+
+    for (int i = 0; i < total_layers; i++) max_abs[i] = 0.0f;
+
+    for (int n = 0; n < count; n++) {
+        const float* current_input = inputs + (size_t)n * model->input_size;
+        int current_input_size = model->input_size;
+        for (int i = 0; i < total_layers; i++) {
+            for (int k = 0; k < current_input_size; k++) {
+                float a = fabsf(current_input[k]);
+                if (a > max_abs[i]) max_abs[i] = a;
+            }
+            // The output layer's activations are never quantized, so stop before it
+            if (i == total_layers - 1) break;
+            float* layer_output = buffers[i & 1];
+            TinyNN_Activation activation = model->activations[i];
+            model->kernels->dense(model->weights[i], model->biases[i], current_input, layer_output,
+                                  model->layer_sizes[i], current_input_size,
+                                  activation == TINYNN_ACT_SOFTMAX ? TINYNN_ACT_NONE : activation);
+            if (activation == TINYNN_ACT_SOFTMAX) model->kernels->softmax(layer_output, model->layer_sizes[i]);
+            current_input = layer_output;
+            current_input_size = model->layer_sizes[i];
+        }
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+    return 1;
+}
+
+int quantize_model(TinyNN_Model* model, const float* calibration_inputs, int calibration_count) {
+    if (model == NULL || model->weight_type != TINYNN_WEIGHTS_FP32) {
+        fprintf(stderr, "ERROR: Only fp32 models can be quantized\n");
+        return 0;
+    }
+    if (model->kernels == NULL) model->kernels = select_kernels();
+    // Quantization reads the weights row by row
+    if (!unpack_model_weights(model) || !densify_model_weights(model)) return 0;
+
+    int total_layers = model->hidden_layers + 1;
+    float* input_ranges = (float*)calloc(total_layers, sizeof(float));
+    TinyNN_QuantLayer* quant = (TinyNN_QuantLayer*)calloc(total_layers, sizeof(TinyNN_QuantLayer));
+    if (!input_ranges || !quant) {
+        free(input_ranges);
+        free(quant);
+        return 0;
+    }
+    if (calibration_inputs && calibration_count > 0 &&
+        !calibrate_input_ranges(model, calibration_inputs, calibration_count, input_ranges)) {
+        free(input_ranges);
+        free(quant);
+        return 0;
+    }
+
+    int prev_layer_size = model->input_size;
+    int ok = 1;
+    for (int i = 0; i < total_layers && ok; i++) {
+        int rows = model->layer_sizes[i];
+        int cols = prev_layer_size;
+        int padded_cols = (cols + INT8_COLUMN_PADDING - 1) / INT8_COLUMN_PADDING * INT8_COLUMN_PADDING;
+        TinyNN_QuantLayer* q = &quant[i];
+        q->padded_cols = padded_cols;
+        q->owns_memory = 1;
+        q->input_scale = input_ranges[i] > 0.0f ? input_ranges[i] / 127.0f : 0.0f;
+        q->weights = (int8_t*)aligned_malloc((size_t)rows * padded_cols, 64);
+        q->scales = (float*)aligned_malloc(sizeof(float) * rows, 64);
+        if (!q->weights || !q->scales) {
+            ok = 0;
+            break;
+        }
+
+        for (int j = 0; j < rows; j++) {
+            const float* w = model->weights[i] + (size_t)j * cols;
+            int8_t* qw = q->weights + (size_t)j * padded_cols;
+            float max_abs = 0.0f;
+            for (int k = 0; k < cols; k++) {
+                if (fabsf(w[k]) > max_abs) max_abs = fabsf(w[k]);
+            }
+            float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+            float inverse = 1.0f / scale;
+            for (int k = 0; k < cols; k++) {
+                long v = lrintf(w[k] * inverse);
+                qw[k] = (int8_t)(v > 127 ? 127 : (v < -127 ? -127 : v));
+            }
+            memset(qw + cols, 0, (size_t)(padded_cols - cols));
+            q->scales[j] = scale;
+        }
+        prev_layer_size = rows;
+    }
+    free(input_ranges);
+
+    if (!ok) {
+        for (int i = 0; i < total_layers; i++) {
+            aligned_free(quant[i].weights);
+            aligned_free(quant[i].scales);
+        }
+        free(quant);
+        return 0;
+    }
+
+    // Drop the fp32 weights; mapped ones go away with the mapping in free_model()
+    for (int i = 0; i < total_layers; i++) {
+        if (!points_into_mapping(model, model->weights[i])) free(model->weights[i]);
+        model->weights[i] = NULL;
+    }
+    model->quant = quant;
+    model->weight_type = TINYNN_WEIGHTS_INT8;
+    return 1;
+}
@@ -0,0 +1,20 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "model.h"
+
+/**
+ * @brief Converts a loaded fp32 model to INT8 weights in place.
+ * Each output row gets its own symmetric scale (max |w| / 127). The fp32 weight
+ * arrays are released afterwards; biases stay in fp32.
+ *
+ * @param calibration_inputs Optional row-major [calibration_count][input_size] samples.
+ *                           When given, they are run through the fp32 model and the
+ *                           largest activation seen at each layer's input fixes that
+ *                           layer's activation scale. When NULL, activations are
+ *                           scaled per sample at inference time instead.
+ * @return 1 on success, 0 on failure (the model is left unchanged).
+ */
+int quantize_model(TinyNN_Model* model, const float* calibration_inputs, int calibration_count);
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "row_reader.h"
+#include "csv_parser.h"
+#include "threads.h"
+#include "utils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// Initial CSV buffer size; it grows only if a single line is longer than this
+#define READ_CHUNK (1 << 20)
+// Skipped rows reported one by one; the rest are only counted
+#define MAX_REPORTED_ROWS 10
+
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+TinyNN_RowReader* open_row_reader(const char* path, int cols, TinyNN_RowFormat format) {
+    TinyNN_RowReader* reader = (TinyNN_RowReader*)calloc(1, sizeof(TinyNN_RowReader));
+    if (!reader) return NULL;
+    reader->cols = cols;
+    reader->format = format;
+    reader->line = 1;
+
+    if (strcmp(path, "-") == 0) {
+        reader->fp = stdin;
+        reader->name = "<stdin>";
+        #ifdef _WIN32
+        if (format == TINYNN_ROWS_BINARY) _setmode(_fileno(stdin), _O_BINARY);
+        #endif
+    } else {
+        reader->fp = fopen(path, format == TINYNN_ROWS_BINARY ? "rb" : "r");
+        reader->name = path;
+        reader->owns_file = 1;
+    }
+    if (!reader->fp) {
+        fprintf(stderr, "ERROR: Could not open input file %s\n", path);
+        free(reader);
+        return NULL;
+    }
+
+    if (format == TINYNN_ROWS_CSV) {
+        reader->capacity = READ_CHUNK;
+        reader->buffer = (char*)malloc(reader->capacity);
+        if (!reader->buffer) {
+            close_row_reader(reader);
+            return NULL;
+        }
+    }
+    return reader;
+}
+
+void close_row_reader(TinyNN_RowReader* reader) {
+    if (reader == NULL) return;
+    if (reader->owns_file) fclose(reader->fp);
+    free(reader->buffer);
+    free(reader);
+}
+
+int parse_row_format(const char* name, TinyNN_RowFormat* format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = TINYNN_ROWS_CSV;
+    } else if (strcmp(name, "bin") == 0 || strcmp(name, "binary") == 0) {
+        *format = TINYNN_ROWS_BINARY;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int read_binary_rows(TinyNN_RowReader* reader, float* rows, int max_rows) {
+    size_t row_bytes = sizeof(float) * reader->cols;
+    size_t wanted = row_bytes * max_rows;
+    size_t got = 0;
+    // Pipes can return short reads, so keep going until the batch is full or input ends
+    while (got < wanted) {
+        size_t n = fread((char*)rows + got, 1, wanted - got, reader->fp);
+        if (n == 0) break;
+        got += n;
+    }
+    if (ferror(reader->fp)) {
+        fprintf(stderr, "ERROR: Failed reading %s\n", reader->name);
+        return -1;
+    }
+    if (got % row_bytes != 0) {
+        fprintf(stderr, "ERROR: %s ends with a partial row (%zu of %zu bytes)\n",
+                reader->name, got % row_bytes, row_bytes);
+        return -1;
+    }
+
+    int count = (int)(got / row_bytes);
+    if (!host_is_little_endian()) {
+        uint32_t* words = (uint32_t*)rows;
+        for (size_t i = 0; i < (size_t)count * reader->cols; i++) {
+            uint32_t v = words[i];
+            words[i] = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+        }
+    }
+    return count;
+}
+
+// Moves unparsed bytes to the front of the buffer and reads more after them
+static int fill_buffer(TinyNN_RowReader* reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == reader->capacity) {
+        // One line fills the whole buffer
+        char* grown = (char*)realloc(reader->buffer, reader->capacity * 2);
+        if (!grown) return 0;
+        reader->buffer = grown;
+        reader->capacity *= 2;
+    }
+    size_t n = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->fp);
+    if (n == 0) {
+        if (ferror(reader->fp)) {
+            fprintf(stderr, "ERROR: Failed reading %s\n", reader->name);
+            return 0;
+        }
+        reader->eof = 1;
+    }
+    reader->end += n;
+    return 1;
+}
+
+int read_rows(TinyNN_RowReader* reader, float* rows, int max_rows) {
+    if (reader->format == TINYNN_ROWS_BINARY) return read_binary_rows(reader, rows, max_rows);
+
+    int count = 0;
+    while (count < max_rows) {
+        char* line = reader->buffer + reader->start;
+        char* line_end = (char*)memchr(line, '\n', reader->end - reader->start);
+        if (line_end == NULL) {
+            if (!reader->eof) {
+                if (!fill_buffer(reader)) return -1;
+                continue;
+            }
+            if (reader->start == reader->end) break;
+            line_end = reader->buffer + reader->end; // Last line without a newline
+        }
+
+        long long line_number = reader->line++;
+        int column = 0;
+        int values = parse_float_line(line, line_end, rows + (size_t)count * reader->cols, reader->cols, &column);
+        reader->start = (size_t)(line_end - reader->buffer);
+        if (reader->start < reader->end) reader->start++;
+
+        if (values == 0) continue;
+        if (values < 0 || values != reader->cols) {
+            const char* level = reader->skip_invalid ? "WARNING" : "ERROR";
+            if (!reader->skip_invalid || reader->skipped < MAX_REPORTED_ROWS) {
+                if (values < 0) {
+                    fprintf(stderr, "%s: %s line %lld, column %d: malformed value\n", level, reader->name,
+                            line_number, column);
+                } else {
+                    fprintf(stderr, "%s: %s line %lld has %d values, expected %d\n", level, reader->name,
+                            line_number, values, reader->cols);
+                }
+            }
+            if (!reader->skip_invalid) return -1;
+            if (++reader->skipped == MAX_REPORTED_ROWS) {
+                fprintf(stderr, "WARNING: Further rows of %s that do not fit are skipped silently\n", reader->name);
+            }
+            continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+// --- Background batch reader ---
+
+struct TinyNN_BatchReader {
+    TinyNN_RowReader* rows;
+    int batch_rows;
+    float* buffers[2];
+    int counts[2];        // Rows in each filled buffer, -1 for an error
+    int filled[2];        // 1 once the reader thread has filled the buffer, until it is handed back
+    long long skipped;    // The row reader's count, copied under the lock
+    int next;             // Buffer the caller takes next
+    int held;             // Buffer the caller holds, -1 if none
+    int stop;
+    TinyNN_Mutex mutex;
+    TinyNN_Cond changed;
+    TinyNN_Thread thread;
+    int started;
+};
+
+// Fills the buffers in turn until the input ends, fails or the reader is closed
+static void* batch_reader_main(void* arg) {
+    TinyNN_BatchReader* reader = (TinyNN_BatchReader*)arg;
+    for (int b = 0;; b ^= 1) {
+        mutex_lock(&reader->mutex);
+        while (reader->filled[b] && !reader->stop) cond_wait(&reader->changed, &reader->mutex);
+        int stop = reader->stop;
+        mutex_unlock(&reader->mutex);
+        if (stop) break;
+
+        // The caller never touches an unfilled buffer, so it is parsed into without the lock
+        int count = read_rows(reader->rows, reader->buffers[b], reader->batch_rows);
+
+        mutex_lock(&reader->mutex);
+        reader->counts[b] = count;
+        reader->filled[b] = 1;
+        reader->skipped = reader->rows->skipped;
+        cond_broadcast(&reader->changed);
+        mutex_unlock(&reader->mutex);
+        if (count <= 0) break;
+    }
+    return NULL;
+}
+
+TinyNN_BatchReader* open_batch_reader(const char* path, int cols, TinyNN_RowFormat format, int batch_rows,
+                                      int skip_invalid) {
+    if (batch_rows <= 0) return NULL;
+    TinyNN_BatchReader* reader = (TinyNN_BatchReader*)calloc(1, sizeof(TinyNN_BatchReader));
+    if (!reader) return NULL;
+    reader->batch_rows = batch_rows;
+    reader->held = -1;
+    mutex_init(&reader->mutex);
+    cond_init(&reader->changed);
+    reader->rows = open_row_reader(path, cols, format);
+    if (!reader->rows) {
+        close_batch_reader(reader);
+        return NULL;
+    }
+    reader->rows->skip_invalid = skip_invalid;
+    for (int b = 0; b < 2; b++) {
+        reader->buffers[b] = (float*)aligned_malloc(sizeof(float) * (size_t)batch_rows * cols, 64);
+        if (!reader->buffers[b]) {
+            close_batch_reader(reader);
+            return NULL;
+        }
+    }
+    if (!thread_create(&reader->thread, batch_reader_main, reader)) {
+        fprintf(stderr, "ERROR: Could not start the reader thread for %s\n", path);
+        close_batch_reader(reader);
+        return NULL;
+    }
+    reader->started = 1;
+    return reader;
+}
+
+int next_batch(TinyNN_BatchReader* reader, const float** rows) {
+    mutex_lock(&reader->mutex);
+    if (reader->held >= 0) {
+        reader->filled[reader->held] = 0;
+        reader->held = -1;
+        cond_broadcast(&reader->changed);
+    }
+    int b = reader->next;
+    while (!reader->filled[b]) cond_wait(&reader->changed, &reader->mutex);
+    int count = reader->counts[b];
+    if (count > 0) {
+        // The end of the input and errors stay in place, so later calls return them again
+        reader->held = b;
+        reader->next = b ^ 1;
+        *rows = reader->buffers[b];
+    }
+    mutex_unlock(&reader->mutex);
+    return count;
+}
+
+long long batch_reader_skipped(TinyNN_BatchReader* reader) {
+    mutex_lock(&reader->mutex);
+    long long skipped = reader->skipped;
+    mutex_unlock(&reader->mutex);
+    return skipped;
+}
+
+void close_batch_reader(TinyNN_BatchReader* reader) {
+    if (reader == NULL) return;
+    if (reader->started) {
+        mutex_lock(&reader->mutex);
+        reader->stop = 1;
+        cond_broadcast(&reader->changed);
+        mutex_unlock(&reader->mutex);
+        thread_join(reader->thread);
+    }
+    close_row_reader(reader->rows);
+    for (int b = 0; b < 2; b++) aligned_free(reader->buffers[b]);
+    mutex_destroy(&reader->mutex);
+    cond_destroy(&reader->changed);
+    free(reader);
+}
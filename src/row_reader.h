@@ -0,0 +1,75 @@
+#ifndef ROW_READER_H
+#define ROW_READER_H
+
+#include <stdio.h>
+
+// Sequential reader for input samples too large to load at once. Rows are pulled
+// from a file or stdin a batch at a time through a fixed-size buffer.
+
+typedef enum {
+    TINYNN_ROWS_CSV = 0,     // One sample per line, values separated by commas/spaces/tabs
+    TINYNN_ROWS_BINARY = 1   // Raw little-endian float32, 'cols' values per sample
+} TinyNN_RowFormat;
+
+typedef struct {
+    FILE* fp;
+    int owns_file;        // 0 for stdin
+    const char* name;     // For error messages
+    TinyNN_RowFormat format;
+    int cols;
+    char* buffer;         // CSV only: unparsed bytes are buffer[start, end)
+    size_t capacity;
+    size_t start;
+    size_t end;
+    int eof;
+    long long line;       // Line number of the next CSV line
+    int skip_invalid;     // 1: report CSV rows of the wrong width or with malformed values, then skip them
+    long long skipped;    // Rows skipped so far
+} TinyNN_RowReader;
+
+/**
+ * @brief Opens 'path' ("-" for stdin) for reading rows of 'cols' values.
+ * @return The reader, or NULL if the file cannot be opened.
+ */
+TinyNN_RowReader* open_row_reader(const char* path, int cols, TinyNN_RowFormat format);
+
+/**
+ * @brief Reads up to 'max_rows' rows into 'rows' (row-major, max_rows * cols floats).
+ * Blank CSV lines are skipped. A malformed value or a row with the wrong number of values
+ * is reported on stderr with its line (or row) number, and is an error unless
+ * reader->skip_invalid is set.
+ * @return The number of rows read, 0 at the end of the input, or -1 on error.
+ */
+int read_rows(TinyNN_RowReader* reader, float* rows, int max_rows);
+
+void close_row_reader(TinyNN_RowReader* reader);
+
+// Reads batches of rows on a background thread, so parsing the next batch overlaps with
+// whatever the caller does with the current one. Two aligned batch buffers take turns: the
+// reader fills one while the caller holds the other. Memory stays at the two batches plus
+// the row reader's chunk buffer, however large the input is.
+typedef struct TinyNN_BatchReader TinyNN_BatchReader;
+
+/**
+ * @brief Opens 'path' like open_row_reader() and starts reading batches of up to
+ * 'batch_rows' rows. With 'skip_invalid', CSV rows of the wrong width (or with malformed
+ * values) are reported and skipped instead of ending the input with an error.
+ * @return The reader, or NULL if the file cannot be opened.
+ */
+TinyNN_BatchReader* open_batch_reader(const char* path, int cols, TinyNN_RowFormat format, int batch_rows,
+                                      int skip_invalid);
+/**
+ * @brief Hands over the next batch: '*rows' points to its rows (row-major, 64-byte aligned),
+ * valid until the next call. The batch before it is given back to the reader to refill.
+ * @return The number of rows, 0 at the end of the input, or -1 on error (already reported).
+ */
+int next_batch(TinyNN_BatchReader* reader, const float** rows);
+// Rows skipped so far (as of the last batch read)
+long long batch_reader_skipped(TinyNN_BatchReader* reader);
+// Stops the background thread, even before the end of the input.
+void close_batch_reader(TinyNN_BatchReader* reader);
+
+// Parses "csv" or "bin"/"binary". Returns 1 on success.
+int parse_row_format(const char* name, TinyNN_RowFormat* format);
+
+#endif
@@ -0,0 +1,854 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "server.h"
+#include "model.h"
+#include "model_binary.h"
+#include "model_manager.h"
+#include "model_registry.h"
+#include "threads.h"
+#include "numa.h"
+#include "utils.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#endif
+
+#define DEFAULT_SOCKET_PATH "/tmp/tinynn.sock"
+#define DEFAULT_MODEL_ROOT "models"
+#define DEFAULT_MAX_BATCH 32
+#define DEFAULT_MAX_DELAY_US 500
+#define ACCEPT_POLL_MS 200       // Longest the accept loop goes without checking for shutdown
+#define IDLE_RELEASE_SECONDS 5.0 // An idle queue lets go of its model so the registry can evict it
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifdef _WIN32
+
+int run_server_mode(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "ERROR: Server mode needs POSIX sockets and is not available on Windows\n");
+    return 1;
+}
+
+int connect_to_server(const char* socket_path, int port) {
+    (void)socket_path;
+    (void)port;
+    return -1;
+}
+
+void close_server_connection(int fd) { (void)fd; }
+
+int send_request(int fd, uint32_t id, const char* model, const float* input, int input_count) {
+    (void)fd; (void)id; (void)model; (void)input; (void)input_count;
+    return 0;
+}
+
+int read_response(int fd, TinyNN_Response* response, float* outputs, int max_outputs) {
+    (void)fd; (void)response; (void)outputs; (void)max_outputs;
+    return 0;
+}
+
+#else
+
+// --- Socket I/O ---
+
+static int send_all(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t sent = send(fd, p, size, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 0;
+        p += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+static int recv_all(int fd, void* data, size_t size) {
+    char* p = (char*)data;
+    while (size > 0) {
+        ssize_t got = recv(fd, p, size, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        p += got;
+        size -= (size_t)got;
+    }
+    return 1;
+}
+
+// Small requests and replies must not wait for Nagle's algorithm
+static void set_no_delay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int connect_to_server(const char* socket_path, int port) {
+    int fd;
+    if (socket_path) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, socket_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        set_no_delay(fd);
+    }
+    return fd;
+}
+
+void close_server_connection(int fd) {
+    if (fd >= 0) close(fd);
+}
+
+int send_request(int fd, uint32_t id, const char* model, const float* input, int input_count) {
+    size_t name_length = strlen(model);
+    if (name_length > 0xFFFF || input_count < 0) return 0;
+    // One send per request: header, name and inputs staged together
+    size_t size = TINYNN_MESSAGE_HEADER_SIZE + name_length + sizeof(float) * (size_t)input_count;
+    unsigned char* message = (unsigned char*)malloc(size);
+    if (!message) return 0;
+    memcpy(message, TINYNN_REQUEST_MAGIC, 4);
+    put_u32(message + 4, id);
+    put_u32(message + 8, (uint32_t)input_count);
+    put_u32(message + 12, (uint32_t)name_length);
+    memcpy(message + TINYNN_MESSAGE_HEADER_SIZE, model, name_length);
+    if (input_count > 0) {
+        memcpy(message + TINYNN_MESSAGE_HEADER_SIZE + name_length, input, sizeof(float) * (size_t)input_count);
+    }
+    int sent = send_all(fd, message, size);
+    free(message);
+    return sent;
+}
+
+int read_response(int fd, TinyNN_Response* response, float* outputs, int max_outputs) {
+    unsigned char header[TINYNN_MESSAGE_HEADER_SIZE];
+    if (!recv_all(fd, header, sizeof(header)) || memcmp(header, TINYNN_RESPONSE_MAGIC, 4) != 0) return 0;
+    response->id = get_u32(header + 4);
+    response->status = get_u32(header + 8);
+    response->count = get_u32(header + 12);
+    if (response->status != TINYNN_STATUS_OK) return 1;
+
+    uint32_t kept = response->count < (uint32_t)max_outputs ? response->count : (uint32_t)max_outputs;
+    if (kept > 0 && !recv_all(fd, outputs, sizeof(float) * kept)) return 0;
+    for (uint32_t i = kept; i < response->count; i++) {
+        float dropped;
+        if (!recv_all(fd, &dropped, sizeof(dropped))) return 0;
+    }
+    return 1;
+}
+
+// --- Server state ---
+
+typedef struct {
+    const char* socket_path;
+    int port;                 // > 0: listen on 127.0.0.1:port instead of the socket
+    const char* model_root;
+    int max_batch;
+    double max_delay;         // Seconds
+    int quiet;
+    TinyNN_RegistryOptions registry;
+} ServerOptions;
+
+typedef struct Connection {
+    int fd;
+    TinyNN_Thread thread;
+    TinyNN_Mutex write_lock;  // Replies come from the batch workers of every model it uses
+    int broken;               // A reply could not be sent; later ones are dropped
+    volatile int pending;     // Requests queued but not answered yet
+    volatile int done;        // The reader has stopped
+    struct Server* server;
+    struct Connection* next;
+} Connection;
+
+typedef struct PendingRequest {
+    Connection* conn;
+    uint32_t id;
+    int input_count;
+    double enqueued;
+    struct PendingRequest* next;
+    float input[];
+} PendingRequest;
+
+// One thread that takes batches off a model's queue and runs them
+typedef struct BatchWorker {
+    struct BatchQueue* queue;
+    int node;                 // NUMA node the worker runs on, -1 if it is not pinned
+    TinyNN_Thread thread;
+    TinyNN_Model* model;      // Held from the registry while the context exists
+    TinyNN_Context* ctx;      // Built on the worker's node, so it uses that node's weights
+    float* inputs;            // [max_batch][input_size]
+    float* outputs;           // [max_batch][output_size]
+    unsigned char* reply;     // Header plus one output row
+    PendingRequest** batch;
+    double last_batch;
+    long long requests;
+    long long batches;
+} BatchWorker;
+
+// Requests for one model and the workers that batch them: one, or one per NUMA node
+// when the weights are replicated, all taking from the same queue
+typedef struct BatchQueue {
+    char path[SAFE_PATH_MAX];
+    struct Server* server;
+    TinyNN_Mutex lock;
+    TinyNN_Cond ready;
+    PendingRequest* head;
+    PendingRequest* tail;
+    int length;
+    int stop;
+    BatchWorker* workers;
+    int worker_count;
+    struct BatchQueue* next;
+} BatchQueue;
+
+typedef struct Server {
+    ServerOptions options;
+    TinyNN_Registry* registry;
+    TinyNN_Mutex lock;        // Guards the queue list
+    BatchQueue* queues;
+    Connection* connections;  // Only touched by the accept loop
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// --- Replies ---
+
+// Sends one reply and retires the request
+static void finish_request(BatchWorker* worker, PendingRequest* request, uint32_t status, uint32_t count,
+                           const float* outputs) {
+    Connection* conn = request->conn;
+    unsigned char* reply = worker->reply;
+    memcpy(reply, TINYNN_RESPONSE_MAGIC, 4);
+    put_u32(reply + 4, request->id);
+    put_u32(reply + 8, status);
+    put_u32(reply + 12, count);
+    size_t size = TINYNN_MESSAGE_HEADER_SIZE;
+    if (status == TINYNN_STATUS_OK) {
+        memcpy(reply + size, outputs, sizeof(float) * count);
+        size += sizeof(float) * count;
+    }
+    mutex_lock(&conn->write_lock);
+    if (!conn->broken && !send_all(conn->fd, reply, size)) conn->broken = 1;
+    mutex_unlock(&conn->write_lock);
+    atomic_add_int(&conn->pending, -1);
+    free(request);
+}
+
+// Replies sent by a connection's reader, before a request reaches a queue
+static void reply_error(Connection* conn, uint32_t id, uint32_t status) {
+    unsigned char reply[TINYNN_MESSAGE_HEADER_SIZE];
+    memcpy(reply, TINYNN_RESPONSE_MAGIC, 4);
+    put_u32(reply + 4, id);
+    put_u32(reply + 8, status);
+    put_u32(reply + 12, 0);
+    mutex_lock(&conn->write_lock);
+    if (!conn->broken && !send_all(conn->fd, reply, sizeof(reply))) conn->broken = 1;
+    mutex_unlock(&conn->write_lock);
+}
+
+// --- Batching ---
+
+// Lets go of the model and the buffers sized for it
+static void unpin_model(BatchWorker* worker) {
+    free_context(worker->ctx);
+    free(worker->inputs);
+    free(worker->outputs);
+    free(worker->reply);
+    worker->ctx = NULL;
+    worker->inputs = NULL;
+    worker->outputs = NULL;
+    worker->reply = NULL;
+    if (worker->model) registry_release(worker->queue->server->registry, worker->model);
+    worker->model = NULL;
+}
+
+// Acquires the current version of the model every batch, so reloads are picked up between
+// batches. The version the context was built for stays held until it is replaced.
+static int pin_current_model(BatchWorker* worker) {
+    TinyNN_Registry* registry = worker->queue->server->registry;
+    TinyNN_Model* model = registry_acquire(registry, worker->queue->path);
+    if (model && model == worker->model) {
+        registry_release(registry, model);
+        return 1;
+    }
+    unpin_model(worker);
+    if (!model) return 0;
+
+    int max_batch = worker->queue->server->options.max_batch;
+    worker->model = model;
+    worker->ctx = create_context(model, max_batch);
+    worker->inputs = (float*)malloc(sizeof(float) * (size_t)max_batch * model->input_size);
+    worker->outputs = (float*)malloc(sizeof(float) * (size_t)max_batch * model->output_size);
+    worker->reply = (unsigned char*)malloc(TINYNN_MESSAGE_HEADER_SIZE + sizeof(float) * (size_t)model->output_size);
+    if (!worker->ctx || !worker->inputs || !worker->outputs || !worker->reply) {
+        unpin_model(worker);
+        return 0;
+    }
+    return 1;
+}
+
+static void run_batch(BatchWorker* worker, int count) {
+    PendingRequest** batch = worker->batch;
+    if (!pin_current_model(worker)) {
+        // No reply buffer without a model; error replies are header-only
+        unsigned char header[TINYNN_MESSAGE_HEADER_SIZE];
+        worker->reply = header;
+        for (int i = 0; i < count; i++) finish_request(worker, batch[i], TINYNN_STATUS_LOAD_FAILED, 0, NULL);
+        worker->reply = NULL;
+        return;
+    }
+
+    const TinyNN_Model* model = worker->model;
+    int input_size = model->input_size;
+    int output_size = model->output_size;
+    int rows = 0;
+    for (int i = 0; i < count; i++) {
+        PendingRequest* request = batch[i];
+        if (request->input_count != input_size) {
+            finish_request(worker, request, TINYNN_STATUS_BAD_INPUT_SIZE, (uint32_t)input_size, NULL);
+            continue;
+        }
+        memcpy(worker->inputs + (size_t)rows * input_size, request->input, sizeof(float) * input_size);
+        batch[rows++] = request;
+    }
+    if (rows > 0) {
+        forward_pass_batch_into(worker->ctx, worker->inputs, rows, worker->outputs);
+        for (int i = 0; i < rows; i++) {
+            finish_request(worker, batch[i], TINYNN_STATUS_OK, (uint32_t)output_size,
+                           worker->outputs + (size_t)i * output_size);
+        }
+    }
+    worker->requests += count;
+    worker->batches++;
+}
+
+static void* worker_main(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    BatchQueue* queue = worker->queue;
+    const ServerOptions* options = &queue->server->options;
+    // Contexts are built on the worker's own thread, so pinning it first makes
+    // create_context() pick the weights on its node
+    if (worker->node >= 0 && !numa_bind_thread_to_node(worker->node)) {
+        fprintf(stderr, "WARNING: Could not pin the batch worker of %s to NUMA node %d\n", queue->path, worker->node);
+    }
+    mutex_lock(&queue->lock);
+    while (!queue->stop) {
+        if (queue->head == NULL) {
+            cond_wait_timeout(&queue->ready, &queue->lock, IDLE_RELEASE_SECONDS);
+            if (queue->head == NULL && worker->model &&
+                get_time_seconds() - worker->last_batch >= IDLE_RELEASE_SECONDS) {
+                mutex_unlock(&queue->lock);
+                unpin_model(worker);
+                mutex_lock(&queue->lock);
+            }
+            continue;
+        }
+
+        // Wait for a full batch, but no longer than max_delay after the oldest request arrived
+        double deadline = queue->head->enqueued + options->max_delay;
+        while (queue->length < options->max_batch && !queue->stop) {
+            double remaining = deadline - get_time_seconds();
+            if (remaining <= 0.0) break;
+            cond_wait_timeout(&queue->ready, &queue->lock, remaining);
+        }
+        if (queue->stop) break;
+
+        int count = 0;
+        while (queue->head && count < options->max_batch) {
+            worker->batch[count++] = queue->head;
+            queue->head = queue->head->next;
+            queue->length--;
+        }
+        if (queue->head == NULL) queue->tail = NULL;
+        // Another worker took the requests while this one waited
+        if (count == 0) continue;
+        // Whatever is left is a batch for the next idle worker
+        if (queue->head) cond_signal(&queue->ready);
+        mutex_unlock(&queue->lock);
+
+        run_batch(worker, count);
+        worker->last_batch = get_time_seconds();
+        mutex_lock(&queue->lock);
+    }
+    mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+static void enqueue_request(BatchQueue* queue, PendingRequest* request) {
+    request->enqueued = get_time_seconds();
+    request->next = NULL;
+    mutex_lock(&queue->lock);
+    if (queue->tail) queue->tail->next = request;
+    else queue->head = request;
+    queue->tail = request;
+    queue->length++;
+    // The worker only needs waking for the first request and for a full batch
+    if (queue->length == 1 || queue->length >= queue->server->options.max_batch) cond_signal(&queue->ready);
+    mutex_unlock(&queue->lock);
+}
+
+// Model names are paths below the model root: no absolute paths and no '..'
+static int is_safe_model_name(const char* name) {
+    if (name[0] == '\0' || name[0] == '/' || strchr(name, '\\')) return 0;
+    for (const char* p = name; *p; p++) {
+        if (p[0] == '.' && p[1] == '.' && (p == name || p[-1] == '/') && (p[2] == '\0' || p[2] == '/')) return 0;
+    }
+    return 1;
+}
+
+static int model_exists(const char* path) {
+    if (is_binary_model_file(path)) return 1;
+    char filepath[SAFE_PATH_MAX + 32];
+    snprintf(filepath, sizeof(filepath), "%s/%s", path, TNN_DIR_FILENAME);
+    if (is_binary_model_file(filepath)) return 1;
+    snprintf(filepath, sizeof(filepath), "%s/architecture.txt", path);
+    FILE* fp = fopen(filepath, "r");
+    if (!fp) return 0;
+    fclose(fp);
+    return 1;
+}
+
+// Stops a queue's workers and frees it. Requests still queued are dropped with their
+// connections. Returns the requests and batches the workers ran.
+static void stop_queue(BatchQueue* queue, long long* requests, long long* batches) {
+    mutex_lock(&queue->lock);
+    queue->stop = 1;
+    cond_broadcast(&queue->ready);
+    mutex_unlock(&queue->lock);
+    for (int i = 0; i < queue->worker_count; i++) {
+        BatchWorker* worker = &queue->workers[i];
+        thread_join(worker->thread);
+        unpin_model(worker);
+        *requests += worker->requests;
+        *batches += worker->batches;
+    }
+    while (queue->head) {
+        PendingRequest* next = queue->head->next;
+        free(queue->head);
+        queue->head = next;
+    }
+    for (int i = 0; i < queue->worker_count; i++) free(queue->workers[i].batch);
+    mutex_destroy(&queue->lock);
+    cond_destroy(&queue->ready);
+    free(queue->workers);
+    free(queue);
+}
+
+// Creates the queue of a model and starts its workers: one per NUMA node with CPUs when
+// the weights are replicated, so every node serves from its own copy
+static BatchQueue* start_queue(Server* server, const char* path) {
+    int replicate = server->options.registry.load_options.numa == TINYNN_NUMA_REPLICATE && numa_node_count() > 1;
+    int nodes = replicate ? numa_node_count() : 1;
+    BatchQueue* queue = (BatchQueue*)calloc(1, sizeof(BatchQueue));
+    if (queue) queue->workers = (BatchWorker*)calloc(nodes, sizeof(BatchWorker));
+    if (!queue || !queue->workers) {
+        free(queue);
+        return NULL;
+    }
+    snprintf(queue->path, sizeof(queue->path), "%s", path);
+    queue->server = server;
+    mutex_init(&queue->lock);
+    cond_init(&queue->ready);
+
+    int cpu;
+    for (int node = 0; node < nodes; node++) {
+        if (replicate && numa_node_cpus(node, &cpu, 1) == 0) continue;
+        BatchWorker* worker = &queue->workers[queue->worker_count];
+        worker->queue = queue;
+        worker->node = replicate ? node : -1;
+        worker->batch = (PendingRequest**)malloc(sizeof(PendingRequest*) * server->options.max_batch);
+        if (!worker->batch || !thread_create(&worker->thread, worker_main, worker)) {
+            fprintf(stderr, "ERROR: Could not start the batch worker for %s\n", path);
+            free(worker->batch);
+            long long requests = 0, batches = 0;
+            stop_queue(queue, &requests, &batches);
+            return NULL;
+        }
+        queue->worker_count++;
+    }
+    return queue;
+}
+
+// Finds or starts the queue for a model name. Returns NULL if there is no such model.
+static BatchQueue* get_queue(Server* server, const char* name) {
+    char path[SAFE_PATH_MAX];
+    if (!is_safe_model_name(name)) return NULL;
+    int length = snprintf(path, sizeof(path), "%s/%s", server->options.model_root, name);
+    if (length < 0 || length >= (int)sizeof(path)) return NULL;
+
+    mutex_lock(&server->lock);
+    BatchQueue* queue = server->queues;
+    while (queue && strcmp(queue->path, path) != 0) queue = queue->next;
+    if (queue || !model_exists(path)) {
+        mutex_unlock(&server->lock);
+        return queue;
+    }
+
+    queue = start_queue(server, path);
+    if (!queue) {
+        mutex_unlock(&server->lock);
+        return NULL;
+    }
+    queue->next = server->queues;
+    server->queues = queue;
+    mutex_unlock(&server->lock);
+    return queue;
+}
+
+// --- Connections ---
+
+// Reads requests until the client disconnects or sends a malformed one
+static void* connection_main(void* arg) {
+    Connection* conn = (Connection*)arg;
+    Server* server = conn->server;
+    unsigned char header[TINYNN_MESSAGE_HEADER_SIZE];
+    char name[SAFE_PATH_MAX];
+
+    while (recv_all(conn->fd, header, sizeof(header))) {
+        uint32_t id = get_u32(header + 4);
+        uint32_t input_count = get_u32(header + 8);
+        uint32_t name_length = get_u32(header + 12) & 0xFFFF;
+        if (memcmp(header, TINYNN_REQUEST_MAGIC, 4) != 0 || input_count > TINYNN_MAX_REQUEST_INPUTS ||
+            name_length >= sizeof(name)) {
+            reply_error(conn, id, TINYNN_STATUS_BAD_REQUEST);
+            break;
+        }
+        PendingRequest* request = (PendingRequest*)malloc(sizeof(PendingRequest) + sizeof(float) * input_count);
+        if (!request) break;
+        if (!recv_all(conn->fd, name, name_length) ||
+            !recv_all(conn->fd, request->input, sizeof(float) * input_count)) {
+            free(request);
+            break;
+        }
+        name[name_length] = '\0';
+        request->conn = conn;
+        request->id = id;
+        request->input_count = (int)input_count;
+
+        BatchQueue* queue = get_queue(server, name);
+        if (!queue) {
+            free(request);
+            reply_error(conn, id, TINYNN_STATUS_UNKNOWN_MODEL);
+            continue;
+        }
+        atomic_add_int(&conn->pending, 1);
+        enqueue_request(queue, request);
+    }
+    atomic_store_int(&conn->done, 1);
+    return NULL;
+}
+
+// Frees a connection whose reader thread has been joined
+static void release_connection(Connection* conn) {
+    close(conn->fd);
+    mutex_destroy(&conn->write_lock);
+    free(conn);
+}
+
+static void free_connection(Connection* conn) {
+    thread_join(conn->thread);
+    release_connection(conn);
+}
+
+// Frees connections whose client has gone and whose replies have all been sent
+static void reap_connections(Server* server) {
+    Connection** link = &server->connections;
+    while (*link) {
+        Connection* conn = *link;
+        if (atomic_load_int(&conn->done) && atomic_load_int(&conn->pending) == 0) {
+            *link = conn->next;
+            free_connection(conn);
+        } else {
+            link = &conn->next;
+        }
+    }
+}
+
+static void accept_connection(Server* server, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    if (server->options.port > 0) set_no_delay(fd);
+    Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+    if (!conn) {
+        close(fd);
+        return;
+    }
+    conn->fd = fd;
+    conn->server = server;
+    mutex_init(&conn->write_lock);
+    if (!thread_create(&conn->thread, connection_main, conn)) {
+        mutex_destroy(&conn->write_lock);
+        close(fd);
+        free(conn);
+        return;
+    }
+    conn->next = server->connections;
+    server->connections = conn;
+}
+
+static int open_listener(const ServerOptions* options) {
+    int fd;
+    if (options->port > 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)options->port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            fprintf(stderr, "ERROR: Could not listen on 127.0.0.1:%d: %s\n", options->port, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(options->socket_path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "ERROR: Socket path %s is too long\n", options->socket_path);
+            return -1;
+        }
+        strcpy(addr.sun_path, options->socket_path);
+        // A socket file left behind by an earlier server would make bind() fail
+        struct stat st;
+        if (stat(options->socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(options->socket_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            fprintf(stderr, "ERROR: Could not listen on %s: %s\n", options->socket_path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Command line ---
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s serve [options]\n"
+        "Serves models to local clients, batching concurrent requests per model.\n"
+        "\n"
+        "  -s, --socket <path>         Unix domain socket to listen on (default %s)\n"
+        "  -P, --port <n>              Listen on 127.0.0.1:<n> TCP instead of the socket\n"
+        "  -r, --root <dir>            Directory request model names are resolved in (default %s)\n"
+        "  -b, --max-batch <n>         Most requests coalesced into one forward pass (default %d)\n"
+        "  -d, --max-delay <us>        Longest a request waits for its batch to fill (default %d)\n"
+        "      --budget <MB>           Resident model memory budget, 0 = no limit (default 0)\n"
+        "      --no-watch              Do not reload models when their files change\n"
+        "  -t, --threads <n>           Inference threads per model, 0 = one per CPU (default 1)\n"
+        "  -w, --weights <type>        Weight storage: fp32, fp16, bf16 or int8 (default fp32)\n"
+        "      --numa <mode>           Weight placement on NUMA machines: off, interleave, or replicate\n"
+        "                              with one copy and one batch worker per node (default off)\n"
+        "  -q, --quiet                 Do not print the summary on stderr at shutdown\n"
+        "  -h, --help                  Show this help\n",
+        program, DEFAULT_SOCKET_PATH, DEFAULT_MODEL_ROOT, DEFAULT_MAX_BATCH, DEFAULT_MAX_DELAY_US);
+}
+
+// Returns 1 if argv[*i] is 'short_name' or 'long_name' and stores the following argument
+static int flag_value(int argc, char** argv, int* i, const char* short_name, const char* long_name,
+                      const char** value) {
+    if (!(short_name && strcmp(argv[*i], short_name) == 0) && strcmp(argv[*i], long_name) != 0) return 0;
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "ERROR: %s needs a value\n", argv[*i]);
+        *value = NULL;
+        return 1;
+    }
+    *value = argv[++*i];
+    return 1;
+}
+
+static int parse_options(int argc, char** argv, ServerOptions* options) {
+    options->socket_path = DEFAULT_SOCKET_PATH;
+    options->port = 0;
+    options->model_root = DEFAULT_MODEL_ROOT;
+    options->max_batch = DEFAULT_MAX_BATCH;
+    options->max_delay = DEFAULT_MAX_DELAY_US * 1e-6;
+    options->quiet = 0;
+    options->registry = default_registry_options();
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = NULL;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            return 0;
+        } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--quiet") == 0) {
+            options->quiet = 1;
+        } else if (strcmp(argv[i], "--no-watch") == 0) {
+            options->registry.watch = 0;
+        } else if (flag_value(argc, argv, &i, "-s", "--socket", &value)) {
+            if (!value) return 0;
+            options->socket_path = value;
+        } else if (flag_value(argc, argv, &i, "-P", "--port", &value)) {
+            if (!value || (options->port = atoi(value)) <= 0 || options->port > 65535) {
+                fprintf(stderr, "ERROR: --port needs a port number\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-r", "--root", &value)) {
+            if (!value) return 0;
+            options->model_root = value;
+        } else if (flag_value(argc, argv, &i, "-b", "--max-batch", &value)) {
+            if (!value || (options->max_batch = atoi(value)) <= 0) {
+                fprintf(stderr, "ERROR: --max-batch needs a positive number\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-d", "--max-delay", &value)) {
+            if (!value || atoi(value) < 0) {
+                fprintf(stderr, "ERROR: --max-delay needs a number of microseconds\n");
+                return 0;
+            }
+            options->max_delay = atoi(value) * 1e-6;
+        } else if (flag_value(argc, argv, &i, NULL, "--budget", &value)) {
+            if (!value || atoi(value) < 0) {
+                fprintf(stderr, "ERROR: --budget needs a number of megabytes\n");
+                return 0;
+            }
+            options->registry.memory_budget = (size_t)atoi(value) << 20;
+        } else if (flag_value(argc, argv, &i, "-t", "--threads", &value)) {
+            if (!value) return 0;
+            options->registry.load_options.num_threads = atoi(value);
+        } else if (flag_value(argc, argv, &i, NULL, "--numa", &value)) {
+            if (!value || !parse_numa_mode(value, &options->registry.load_options.numa)) {
+                fprintf(stderr, "ERROR: --numa needs off, interleave or replicate\n");
+                return 0;
+            }
+        } else if (flag_value(argc, argv, &i, "-w", "--weights", &value)) {
+            if (!value || !parse_weight_type(value, &options->registry.load_options.weight_type)) {
+                fprintf(stderr, "ERROR: Unknown weight type '%s'\n", value ? value : "");
+                return 0;
+            }
+        } else {
+            fprintf(stderr, "ERROR: Unknown argument '%s'\n", argv[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int run_server_mode(int argc, char** argv) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    if (!parse_options(argc, argv, &server.options)) {
+        print_usage("tinynn");
+        return 1;
+    }
+
+    // Replies to clients that went away must fail with EPIPE instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    server.registry = create_model_registry(&server.options.registry);
+    if (!server.registry) return 1;
+    mutex_init(&server.lock);
+    int listen_fd = open_listener(&server.options);
+    if (listen_fd < 0) {
+        free_model_registry(server.registry);
+        mutex_destroy(&server.lock);
+        return 1;
+    }
+    if (!server.options.quiet) {
+        if (server.options.port > 0) {
+            fprintf(stderr, "Serving %s on 127.0.0.1:%d", server.options.model_root, server.options.port);
+        } else {
+            fprintf(stderr, "Serving %s on %s", server.options.model_root, server.options.socket_path);
+        }
+        fprintf(stderr, " (max batch %d, max delay %.0f us", server.options.max_batch,
+                server.options.max_delay * 1e6);
+        if (server.options.registry.load_options.numa != TINYNN_NUMA_OFF) {
+            fprintf(stderr, ", NUMA %s over %d nodes", numa_mode_name(server.options.registry.load_options.numa),
+                    numa_node_count());
+        }
+        fprintf(stderr, ")\n");
+    }
+
+    while (!stop_requested) {
+        struct pollfd pfd;
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) > 0) accept_connection(&server, listen_fd);
+        reap_connections(&server);
+    }
+
+    // Shutdown: stop accepting and unblock the readers. Once every reader has exited, no
+    // thread looks up or fills a queue, so the queues can be stopped; the connections are
+    // freed last, as the workers reply on them until then.
+    close(listen_fd);
+    if (server.options.port <= 0) unlink(server.options.socket_path);
+    for (Connection* conn = server.connections; conn; conn = conn->next) shutdown(conn->fd, SHUT_RDWR);
+    for (Connection* conn = server.connections; conn; conn = conn->next) thread_join(conn->thread);
+    mutex_lock(&server.lock);
+    BatchQueue* queues = server.queues;
+    server.queues = NULL;
+    mutex_unlock(&server.lock);
+    long long requests = 0, batches = 0;
+    while (queues) {
+        BatchQueue* queue = queues;
+        queues = queue->next;
+        stop_queue(queue, &requests, &batches);
+    }
+    while (server.connections) {
+        Connection* next = server.connections->next;
+        release_connection(server.connections);
+        server.connections = next;
+    }
+    if (!server.options.quiet) {
+        fprintf(stderr, "Served %lld requests in %lld batches (%.1f requests per batch)\n", requests, batches,
+                batches > 0 ? (double)requests / batches : 0.0);
+    }
+    free_model_registry(server.registry);
+    mutex_destroy(&server.lock);
+    return 0;
+}
+
+#endif
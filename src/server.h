@@ -0,0 +1,62 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+// Local inference server ("tinynn serve"). Clients connect over a Unix domain socket or
+// localhost TCP and send single-sample requests. Requests for the same model are queued
+// and coalesced into batches, so one forward pass serves many clients at once.
+//
+// Protocol: every message starts with a 16-byte header of little-endian u32 fields, and
+// a connection may have any number of requests in flight. Replies carry the request's id
+// and can arrive out of order when one connection uses several models.
+//
+//   Request:  "TNNQ", id, input_count, name_length (u16) + 2 reserved bytes,
+//             then the model name (name_length bytes, no terminator),
+//             then input_count float32 values
+//   Response: "TNNR", id, status, count,
+//             then count float32 outputs when status is TINYNN_STATUS_OK
+//
+// The model name is a model directory or .tnn file relative to the server's model root.
+
+#define TINYNN_REQUEST_MAGIC "TNNQ"
+#define TINYNN_RESPONSE_MAGIC "TNNR"
+#define TINYNN_MESSAGE_HEADER_SIZE 16
+#define TINYNN_MAX_REQUEST_INPUTS (1 << 24)
+
+// Response status codes
+#define TINYNN_STATUS_OK 0
+#define TINYNN_STATUS_BAD_REQUEST 1      // Malformed header; the server closes the connection
+#define TINYNN_STATUS_UNKNOWN_MODEL 2    // No such model under the model root
+#define TINYNN_STATUS_BAD_INPUT_SIZE 3   // 'count' holds the input size the model expects
+#define TINYNN_STATUS_LOAD_FAILED 4
+
+typedef struct {
+    uint32_t id;
+    uint32_t status;
+    uint32_t count;
+} TinyNN_Response;
+
+/**
+ * @brief Runs the server selected by 'tinynn serve'. Serves until SIGINT or SIGTERM.
+ * 'argv[0]' is the subcommand name; run 'tinynn serve --help' for the flags.
+ * @return The process exit code: 0 after a clean shutdown, 1 on any error.
+ */
+int run_server_mode(int argc, char** argv);
+
+// --- Client side, used by tools/tinynn_loadgen.c ---
+
+// Connects to the server's Unix socket at 'socket_path' or, when it is NULL, to
+// 127.0.0.1:'port'. Returns the socket, or -1 on failure.
+int connect_to_server(const char* socket_path, int port);
+void close_server_connection(int fd);
+// Sends one request. Returns 1 on success.
+int send_request(int fd, uint32_t id, const char* model, const float* input, int input_count);
+/**
+ * @brief Reads one response. Up to 'max_outputs' outputs are stored in 'outputs'; any
+ * beyond that are read and dropped.
+ * @return 1 on success, 0 if the connection failed or the reply was malformed.
+ */
+int read_response(int fd, TinyNN_Response* response, float* outputs, int max_outputs);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sparse.h"
+#include "pack.h"
+#include "utils.h"
+
+float default_sparse_threshold(void) {
+    const char* value = getenv("TINYNN_SPARSE");
+    if (value && value[0] != '\0') return (float)atof(value);
+    return DEFAULT_SPARSE_THRESHOLD;
+}
+
+int layer_is_sparse(const TinyNN_Model* model, int layer) {
+    return model->sparse != NULL && model->sparse[layer].block_rows != 0;
+}
+
+size_t sparse_layer_bytes(const TinyNN_SparseLayer* layer, int rows) {
+    size_t block_row_count = ((size_t)rows + layer->block_rows - 1) / layer->block_rows;
+    return (size_t)layer->block_count * (sizeof(int32_t) + sizeof(float) * layer->block_rows) +
+           (block_row_count + 1) * sizeof(int32_t);
+}
+
+void sparse_to_dense(const TinyNN_SparseLayer* layer, int rows, int cols, float* weights) {
+    int block_rows = layer->block_rows;
+    memset(weights, 0, sizeof(float) * (size_t)rows * cols);
+    for (int j = 0, b = 0; j < rows; j += block_rows, b++) {
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        for (int32_t i = layer->block_ptr[b]; i < layer->block_ptr[b + 1]; i++) {
+            for (int r = 0; r < valid; r++) {
+                weights[(size_t)(j + r) * cols + layer->columns[i]] = layer->values[(size_t)i * block_rows + r];
+            }
+        }
+    }
+}
+
+static void free_sparse_layer(TinyNN_SparseLayer* layer) {
+    free(layer->block_ptr);
+    free(layer->columns);
+    aligned_free(layer->values);
+    memset(layer, 0, sizeof(*layer));
+}
+
+void free_sparse_layers(TinyNN_Model* model) {
+    if (model->sparse == NULL) return;
+    for (int i = 0; i <= model->hidden_layers; i++) free_sparse_layer(&model->sparse[i]);
+    free(model->sparse);
+    model->sparse = NULL;
+}
+
+// 1 if any of the 'valid' rows starting at 'w' has a nonzero weight in column k
+static int block_is_nonzero(const float* w, int cols, int valid, int k) {
+    for (int r = 0; r < valid; r++) {
+        if (w[(size_t)r * cols + k] != 0.0f) return 1;
+    }
+    return 0;
+}
+
+// Blocks of block_rows x 1 that would be stored, i.e. that hold at least one nonzero weight
+static size_t count_blocks(const float* weights, int rows, int cols, int block_rows) {
+    size_t blocks = 0;
+    for (int j = 0; j < rows; j += block_rows) {
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        const float* w = weights + (size_t)j * cols;
+        for (int k = 0; k < cols; k++) blocks += block_is_nonzero(w, cols, valid, k);
+    }
+    return blocks;
+}
+
+static int build_sparse_layer(const float* weights, int rows, int cols, int block_rows, size_t blocks,
+                              TinyNN_SparseLayer* layer) {
+    int block_row_count = (rows + block_rows - 1) / block_rows;
+    size_t allocated = blocks > 0 ? blocks : 1;
+    layer->block_ptr = (int32_t*)malloc(sizeof(int32_t) * (block_row_count + 1));
+    layer->columns = (int32_t*)malloc(sizeof(int32_t) * allocated);
+    layer->values = (float*)aligned_malloc(sizeof(float) * allocated * block_rows, 64);
+    if (!layer->block_ptr || !layer->columns || !layer->values) {
+        free_sparse_layer(layer);
+        return 0;
+    }
+
+    int32_t i = 0;
+    for (int b = 0; b < block_row_count; b++) {
+        int j = b * block_rows;
+        int valid = rows - j < block_rows ? rows - j : block_rows;
+        const float* w = weights + (size_t)j * cols;
+        layer->block_ptr[b] = i;
+        for (int k = 0; k < cols; k++) {
+            if (!block_is_nonzero(w, cols, valid, k)) continue;
+            layer->columns[i] = k;
+            float* v = layer->values + (size_t)i * block_rows;
+            for (int r = 0; r < block_rows; r++) v[r] = r < valid ? w[(size_t)r * cols + k] : 0.0f;
+            i++;
+        }
+    }
+    layer->block_ptr[block_row_count] = i;
+    layer->block_rows = block_rows;
+    layer->block_count = i;
+    return 1;
+}
+
+int sparsify_model_weights(TinyNN_Model* model, float threshold) {
+    if (model == NULL || model->weight_type != TINYNN_WEIGHTS_FP32 || threshold <= 0.0f || threshold > 1.0f) {
+        return 0;
+    }
+
+    int total_layers = model->hidden_layers + 1;
+    int converted = 0;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        int rows = model->layer_sizes[i];
+        int cols = prev_layer_size;
+        prev_layer_size = rows;
+        if (layer_is_sparse(model, i) || (size_t)rows * cols < SPARSE_MIN_WEIGHTS) continue;
+
+        // Packed layers are scanned in row-major order like the others
+        const float* weights = model->weights[i];
+        float* unpacked = NULL;
+        if (weights == NULL) {
+            unpacked = (float*)malloc(sizeof(float) * (size_t)rows * cols);
+            if (!unpacked) return -1;
+            unpack_layer(model->packed_weights[i], rows, cols, unpacked);
+            weights = unpacked;
+        }
+
+        size_t count = (size_t)rows * cols;
+        size_t zeros = 0;
+        for (size_t k = 0; k < count; k++) zeros += weights[k] == 0.0f;
+        float zero_fraction = count > 0 ? (float)((double)zeros / count) : 0.0f;
+        if (zero_fraction < threshold) {
+            free(unpacked);
+            continue;
+        }
+
+        // Pick the smallest layout: a CSR entry costs a value and a column, a block costs
+        // block_rows values (zeros included) and one column
+        size_t best_blocks = count - zeros;
+        int best_rows = 1;
+        size_t best_bytes = best_blocks * (sizeof(int32_t) + sizeof(float));
+        for (int block_rows = 4; block_rows <= SPARSE_MAX_BLOCK_ROWS; block_rows *= 2) {
+            size_t blocks = count_blocks(weights, rows, cols, block_rows);
+            size_t bytes = blocks * (sizeof(int32_t) + sizeof(float) * block_rows);
+            if (bytes <= best_bytes) {
+                best_blocks = blocks;
+                best_rows = block_rows;
+                best_bytes = bytes;
+            }
+        }
+        if (best_blocks > INT32_MAX) {
+            free(unpacked);
+            continue;
+        }
+
+        if (model->sparse == NULL) {
+            model->sparse = (TinyNN_SparseLayer*)calloc(total_layers, sizeof(TinyNN_SparseLayer));
+            if (!model->sparse) {
+                free(unpacked);
+                return -1;
+            }
+        }
+        if (!build_sparse_layer(weights, rows, cols, best_rows, best_blocks, &model->sparse[i])) {
+            free(unpacked);
+            return -1;
+        }
+        model->sparse[i].zero_fraction = zero_fraction;
+        free(unpacked);
+
+        // Mapped arrays go away with the mapping in free_model()
+        if (model->weights[i]) {
+            if (!points_into_mapping(model, model->weights[i])) free(model->weights[i]);
+            model->weights[i] = NULL;
+        }
+        if (model->packed_weights && model->packed_weights[i]) {
+            if (!points_into_mapping(model, model->packed_weights[i])) aligned_free(model->packed_weights[i]);
+            model->packed_weights[i] = NULL;
+        }
+        converted++;
+    }
+    return converted;
+}
+
+int densify_model_weights(TinyNN_Model* model) {
+    if (model == NULL || model->sparse == NULL) return 1;
+
+    int total_layers = model->hidden_layers + 1;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < total_layers; i++) {
+        int rows = model->layer_sizes[i];
+        int cols = prev_layer_size;
+        prev_layer_size = rows;
+        if (!layer_is_sparse(model, i)) continue;
+
+        float* weights = (float*)malloc(sizeof(float) * (size_t)rows * cols);
+        if (!weights) return 0;
+        sparse_to_dense(&model->sparse[i], rows, cols, weights);
+        if (model->packed_weights) {
+            float* panels = (float*)aligned_malloc(sizeof(float) * packed_layer_floats(rows, cols), 64);
+            if (!panels) {
+                free(weights);
+                return 0;
+            }
+            pack_layer(weights, rows, cols, panels);
+            free(weights);
+            model->packed_weights[i] = panels;
+        } else {
+            model->weights[i] = weights;
+        }
+        // The layer is dense from here on, even if a later one runs out of memory
+        free_sparse_layer(&model->sparse[i]);
+    }
+    free_sparse_layers(model);
+    return 1;
+}
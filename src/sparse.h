@@ -0,0 +1,51 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <stddef.h>
+#include "model.h"
+
+// Load-time sparse storage for pruned fp32 layers. A layer whose share of zero weights
+// reaches the threshold keeps only its nonzero blocks (see SPARSE_MAX_BLOCK_ROWS in
+// kernels.h) and runs through the sparse kernels; the other layers stay dense.
+
+#define DEFAULT_SPARSE_THRESHOLD 0.8f
+
+// Layers with fewer weights stay dense whatever their sparsity: they run from cache, where
+// the dense kernels do several times more multiply-adds per cycle than the sparse ones
+#ifndef SPARSE_MIN_WEIGHTS
+#define SPARSE_MIN_WEIGHTS 65536
+#endif
+
+// DEFAULT_SPARSE_THRESHOLD, or the fraction in the TINYNN_SPARSE environment variable
+// (TINYNN_SPARSE=0 keeps every layer dense)
+float default_sparse_threshold(void);
+
+/**
+ * @brief Stores every fp32 layer of at least SPARSE_MIN_WEIGHTS weights that has at least
+ * 'threshold' zero weights in sparse form.
+ * Each such layer gets whichever of CSR, 4x1 and 8x1 blocks is smallest; ties go to the
+ * bigger blocks, which the kernels run faster. Row-major and packed layers are both
+ * read, and the dense copy is released. A threshold <= 0 or > 1 converts nothing.
+ * @return The number of layers converted, or -1 if out of memory (layers converted
+ * before that stay sparse, the rest stay dense).
+ */
+int sparsify_model_weights(TinyNN_Model* model, float threshold);
+
+/**
+ * @brief Turns the sparse layers back into dense ones (packed if the model is packed,
+ * row-major otherwise) and drops model->sparse.
+ * Conversions to other weight types need this, like unpack_model_weights().
+ * @return 1 on success (or if nothing was sparse), 0 if out of memory.
+ */
+int densify_model_weights(TinyNN_Model* model);
+
+// 1 if 'layer' is stored sparse
+int layer_is_sparse(const TinyNN_Model* model, int layer);
+// Bytes of blocks, columns and block pointers a sparse layer with 'rows' rows stores
+size_t sparse_layer_bytes(const TinyNN_SparseLayer* layer, int rows);
+// Expands a sparse layer into row-major weights [rows][cols]
+void sparse_to_dense(const TinyNN_SparseLayer* layer, int rows, int cols, float* weights);
+// Frees model->sparse and every layer in it
+void free_sparse_layers(TinyNN_Model* model);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "streaming.h"
+#include "threads.h"
+#include "utils.h"
+#include "pack.h"
+#include "sparse.h"
+
+// Pages are touched this far apart when a layer is read in; 4 KB is the smallest page
+// size of every supported platform
+#define TOUCH_STRIDE 4096
+
+struct TinyNN_Stream {
+    int window;
+    int layer_count;
+    const unsigned char** span_start; // Per layer: first byte of its weight, scale and bias
+    size_t* span_size;                // sections, which the file stores next to each other
+    TinyNN_Thread thread;
+    TinyNN_Mutex lock;
+    TinyNN_Cond changed;
+    // Layers are numbered by position in the endless sequence of forward passes, so the
+    // window can wrap from the last layer to the first: layer = position % layer_count
+    long long current;    // Position of the layer running now, -1 before the first one
+    long long fetched;    // Every position below this has been read in
+    int stop;
+    TinyNN_StreamStats stats;
+};
+
+// Widens [*start, *end) to cover 'size' bytes at 'p'
+static void extend_span(const void* p, size_t size, const unsigned char** start, const unsigned char** end) {
+    const unsigned char* begin = (const unsigned char*)p;
+    if (*start == NULL || begin < *start) *start = begin;
+    if (begin + size > *end) *end = begin + size;
+}
+
+// Finds the mapped bytes of every layer. Returns 0 if any array lives outside the mapping.
+static int find_layer_spans(const TinyNN_Model* model, TinyNN_Stream* stream) {
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i < stream->layer_count; i++) {
+        size_t rows = (size_t)model->layer_sizes[i];
+        size_t cols = (size_t)prev_layer_size;
+        prev_layer_size = model->layer_sizes[i];
+        const unsigned char* start = NULL;
+        const unsigned char* end = NULL;
+        const void* arrays[3] = {model->biases[i], NULL, NULL};
+        size_t sizes[3] = {rows * sizeof(float), 0, 0};
+        switch (model->weight_type) {
+            case TINYNN_WEIGHTS_INT8:
+                arrays[1] = model->quant[i].weights;
+                sizes[1] = rows * model->quant[i].padded_cols;
+                arrays[2] = model->quant[i].scales;
+                sizes[2] = rows * sizeof(float);
+                break;
+            case TINYNN_WEIGHTS_FP16:
+            case TINYNN_WEIGHTS_BF16:
+                arrays[1] = model->half_weights[i];
+                sizes[1] = rows * cols * sizeof(uint16_t);
+                break;
+            default:
+                if (layer_is_sparse(model, i)) return 0;
+                if (model->packed_weights && model->packed_weights[i]) {
+                    arrays[1] = model->packed_weights[i];
+                    sizes[1] = packed_layer_floats((int)rows, (int)cols) * sizeof(float);
+                } else {
+                    arrays[1] = model->weights[i];
+                    sizes[1] = rows * cols * sizeof(float);
+                }
+                break;
+        }
+        for (int a = 0; a < 3; a++) {
+            if (sizes[a] == 0) continue;
+            if (!points_into_mapping(model, arrays[a])) return 0;
+            extend_span(arrays[a], sizes[a], &start, &end);
+        }
+        stream->span_start[i] = start;
+        stream->span_size[i] = (size_t)(end - start);
+    }
+    return 1;
+}
+
+// Reads a layer into memory: the hint starts large background reads, and touching every
+// page waits for them, so the forward pass finds the layer resident
+static void fetch_layer(const TinyNN_Stream* stream, int layer) {
+    const unsigned char* data = stream->span_start[layer];
+    size_t size = stream->span_size[layer];
+    prefetch_mapped_range(data, size);
+    unsigned int sum = 0;
+    for (size_t offset = 0; offset < size; offset += TOUCH_STRIDE) sum += data[offset];
+    sum += data[size - 1];
+    volatile unsigned int sink = sum;
+    (void)sink;
+}
+
+static void* prefetch_main(void* arg) {
+    TinyNN_Stream* stream = (TinyNN_Stream*)arg;
+    mutex_lock(&stream->lock);
+    for (;;) {
+        while (!stream->stop && stream->fetched >= stream->current + stream->window) {
+            cond_wait(&stream->changed, &stream->lock);
+        }
+        if (stream->stop) break;
+        long long position = stream->fetched;
+        int layer = (int)(position % stream->layer_count);
+        mutex_unlock(&stream->lock);
+
+        fetch_layer(stream, layer);
+
+        mutex_lock(&stream->lock);
+        // The forward pass may have skipped ahead in the meantime
+        if (stream->fetched < position + 1) stream->fetched = position + 1;
+        stream->stats.layers_fetched++;
+        stream->stats.bytes_fetched += (double)stream->span_size[layer];
+        cond_broadcast(&stream->changed);
+    }
+    mutex_unlock(&stream->lock);
+    return NULL;
+}
+
+static void free_stream(TinyNN_Stream* stream) {
+    free(stream->span_start);
+    free(stream->span_size);
+    free(stream);
+}
+
+int enable_streaming(TinyNN_Model* model, int window) {
+    if (model == NULL || model->stream != NULL || window < 1) return 0;
+    if (model->mapping == NULL) {
+        fprintf(stderr, "ERROR: Only models mapped from a .tnn file can stream\n");
+        return 0;
+    }
+
+    TinyNN_Stream* stream = (TinyNN_Stream*)calloc(1, sizeof(TinyNN_Stream));
+    if (!stream) return 0;
+    stream->window = window;
+    stream->layer_count = model->hidden_layers + 1;
+    stream->span_start = (const unsigned char**)calloc(stream->layer_count, sizeof(const unsigned char*));
+    stream->span_size = (size_t*)calloc(stream->layer_count, sizeof(size_t));
+    if (!stream->span_start || !stream->span_size) {
+        free_stream(stream);
+        return 0;
+    }
+    if (!find_layer_spans(model, stream)) {
+        fprintf(stderr, "ERROR: The model's weights were converted after loading, so they cannot stream\n");
+        free_stream(stream);
+        return 0;
+    }
+
+    // The thread starts on layer 0 right away, so the first forward pass does not wait long
+    stream->current = -1;
+    stream->fetched = 0;
+    mutex_init(&stream->lock);
+    cond_init(&stream->changed);
+    if (!thread_create(&stream->thread, prefetch_main, stream)) {
+        fprintf(stderr, "ERROR: Could not start the prefetch thread\n");
+        mutex_destroy(&stream->lock);
+        cond_destroy(&stream->changed);
+        free_stream(stream);
+        return 0;
+    }
+    model->stream = stream;
+    return 1;
+}
+
+void disable_streaming(TinyNN_Model* model) {
+    if (model == NULL || model->stream == NULL) return;
+    TinyNN_Stream* stream = model->stream;
+    mutex_lock(&stream->lock);
+    stream->stop = 1;
+    cond_broadcast(&stream->changed);
+    mutex_unlock(&stream->lock);
+    thread_join(stream->thread);
+    mutex_destroy(&stream->lock);
+    cond_destroy(&stream->changed);
+    free_stream(stream);
+    model->stream = NULL;
+}
+
+void stream_layer_begin(TinyNN_Stream* stream, int layer) {
+    mutex_lock(&stream->lock);
+    // Normally the next position; a pass that started over lands on the next matching one
+    long long position = stream->current + 1;
+    while (position % stream->layer_count != layer) position++;
+    stream->current = position;
+    if (stream->fetched < position) stream->fetched = position;
+    cond_broadcast(&stream->changed);
+
+    if (stream->fetched <= position) {
+        double start = get_time_seconds();
+        while (!stream->stop && stream->fetched <= position) cond_wait(&stream->changed, &stream->lock);
+        stream->stats.wait_seconds += get_time_seconds() - start;
+    }
+    mutex_unlock(&stream->lock);
+}
+
+void stream_layer_end(TinyNN_Stream* stream, int layer) {
+    // A model that fits in the window stays resident
+    if (stream->layer_count <= stream->window) return;
+    release_mapped_range(stream->span_start[layer], stream->span_size[layer]);
+}
+
+int get_stream_stats(const TinyNN_Model* model, TinyNN_StreamStats* stats) {
+    if (model == NULL || model->stream == NULL) return 0;
+    mutex_lock(&model->stream->lock);
+    *stats = model->stream->stats;
+    mutex_unlock(&model->stream->lock);
+    return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include "model.h"
+
+// Out-of-core execution for models larger than memory. The weights stay in the mapped
+// .tnn file and only a window of consecutive layers is resident at a time: while layer i
+// runs, a background thread reads in the next window - 1 layers (wrapping around to layer
+// 0 for the next forward pass), and the pages of each layer are released as soon as it
+// has run. Peak memory is therefore about the biggest 'window' consecutive layers, and
+// the file is read front to back at close to sequential disk speed.
+//
+// Streaming is tuned for one forward pass at a time. Concurrent contexts still get
+// correct results, since released pages are simply read again, but the prefetching then
+// only follows whichever context started a layer last.
+
+#define DEFAULT_STREAM_WINDOW 2
+
+typedef struct {
+    long long layers_fetched;   // Layers read in by the prefetch thread
+    double bytes_fetched;
+    double wait_seconds;        // Time forward passes spent waiting for a layer to arrive
+} TinyNN_StreamStats;
+
+/**
+ * @brief Starts streaming a model loaded with create_model_from_binary_streaming().
+ * Every weight, scale and bias array must still point into the mapped file, so the model
+ * must run in the type and layout the file stores (no packing, sparsity or conversion).
+ * @param window Layers resident at once, at least 1. 1 reads each layer only when it is
+ *               reached; 2 or more overlap reading with computing.
+ * @return 1 on success, 0 if the model cannot stream or the thread could not start.
+ */
+int enable_streaming(TinyNN_Model* model, int window);
+
+// Stops the prefetch thread. Call it while no forward pass is running; free_model() does.
+void disable_streaming(TinyNN_Model* model);
+
+// Called by the layer loop around every layer of a streaming model: waits until the
+// layer's weights are resident and moves the prefetch window, then releases them again.
+void stream_layer_begin(TinyNN_Stream* stream, int layer);
+void stream_layer_end(TinyNN_Stream* stream, int layer);
+
+// Totals since streaming started. Returns 0 if the model is not streaming.
+int get_stream_stats(const TinyNN_Model* model, TinyNN_StreamStats* stats);
+
+#endif
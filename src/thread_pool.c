@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include "thread_pool.h"
+#include "threads.h"
+
+// How long an idle worker polls for the next job before sleeping on the condition
+// variable. Layers of one forward pass follow each other within microseconds, so this
+// covers the gap between them without keeping cores busy between requests.
+#define POOL_SPIN_ITERATIONS 4000
+
+// What a worker needs to start: its pool, and the CPU to pin itself to (-1 = any)
+typedef struct {
+    struct TinyNN_ThreadPool* pool;
+    int cpu;
+} WorkerStart;
+
+struct TinyNN_ThreadPool {
+    int num_threads;          // Including the thread that submits jobs
+    int worker_count;         // Workers actually started (num_threads - 1)
+    TinyNN_Thread* workers;
+    WorkerStart* starts;
+    TinyNN_Mutex submit_lock; // Serializes jobs from different submitting threads
+    TinyNN_Mutex mutex;       // Protects sleeping workers against missed wake-ups
+    TinyNN_Cond wake;
+
+    // Current job. Written by the submitter before 'generation' is bumped.
+    thread_pool_task_fn fn;
+    void* arg;
+    int task_count;
+    volatile int next_task;   // Next task index to hand out
+    volatile int pending;     // Workers that have not finished with the current job yet
+    volatile int generation;  // Incremented once per job; workers wait for it to change
+    volatile int shutdown;
+};
+
+static void run_tasks(TinyNN_ThreadPool* pool) {
+    for (;;) {
+        int task = atomic_add_int(&pool->next_task, 1);
+        if (task >= pool->task_count) break;
+        pool->fn(pool->arg, task);
+    }
+}
+
+static void* worker_main(void* param) {
+    WorkerStart* start = (WorkerStart*)param;
+    TinyNN_ThreadPool* pool = start->pool;
+    // Pinning is best effort: a worker that cannot be pinned still runs
+    if (start->cpu >= 0) pin_thread_to_cpus(&start->cpu, 1);
+    int seen = 0;
+    for (;;) {
+        // Spin first so back-to-back jobs are picked up without a wake-up, then sleep
+        int spins = 0;
+        while (atomic_load_int(&pool->generation) == seen) {
+            if (++spins < POOL_SPIN_ITERATIONS) {
+                cpu_relax();
+                continue;
+            }
+            mutex_lock(&pool->mutex);
+            while (atomic_load_int(&pool->generation) == seen) {
+                cond_wait(&pool->wake, &pool->mutex);
+            }
+            mutex_unlock(&pool->mutex);
+        }
+        // The submitter waits for every worker before starting the next job, so no
+        // generation is ever skipped
+        seen++;
+        if (atomic_load_int(&pool->shutdown)) return NULL;
+        run_tasks(pool);
+        atomic_add_int(&pool->pending, -1);
+    }
+}
+
+// Publishes a new generation and wakes any sleeping workers
+static void publish_job(TinyNN_ThreadPool* pool) {
+    mutex_lock(&pool->mutex);
+    atomic_add_int(&pool->generation, 1);
+    cond_broadcast(&pool->wake);
+    mutex_unlock(&pool->mutex);
+}
+
+TinyNN_ThreadPool* create_thread_pool(int num_threads) {
+    return create_pinned_thread_pool(num_threads, NULL, 0);
+}
+
+TinyNN_ThreadPool* create_pinned_thread_pool(int num_threads, const int* cpus, int num_cpus) {
+    if (num_threads <= 0) num_threads = cpus && num_cpus > 0 ? num_cpus : cpu_count();
+
+    TinyNN_ThreadPool* pool = (TinyNN_ThreadPool*)calloc(1, sizeof(TinyNN_ThreadPool));
+    if (!pool) return NULL;
+    pool->num_threads = num_threads;
+    mutex_init(&pool->submit_lock);
+    mutex_init(&pool->mutex);
+    cond_init(&pool->wake);
+    if (num_threads == 1) return pool;
+
+    pool->workers = (TinyNN_Thread*)malloc(sizeof(TinyNN_Thread) * (num_threads - 1));
+    pool->starts = (WorkerStart*)malloc(sizeof(WorkerStart) * (num_threads - 1));
+    if (!pool->workers || !pool->starts) {
+        free_thread_pool(pool);
+        return NULL;
+    }
+    for (int i = 0; i < num_threads - 1; i++) {
+        pool->starts[i].pool = pool;
+        pool->starts[i].cpu = cpus && num_cpus > 0 ? cpus[(i + 1) % num_cpus] : -1;
+        if (!thread_create(&pool->workers[i], worker_main, &pool->starts[i])) {
+            free_thread_pool(pool);
+            return NULL;
+        }
+        pool->worker_count++;
+    }
+    return pool;
+}
+
+void free_thread_pool(TinyNN_ThreadPool* pool) {
+    if (pool == NULL) return;
+    if (pool->worker_count > 0) {
+        atomic_store_int(&pool->shutdown, 1);
+        publish_job(pool);
+        for (int i = 0; i < pool->worker_count; i++) {
+            thread_join(pool->workers[i]);
+        }
+    }
+    free(pool->workers);
+    free(pool->starts);
+    cond_destroy(&pool->wake);
+    mutex_destroy(&pool->mutex);
+    mutex_destroy(&pool->submit_lock);
+    free(pool);
+}
+
+int thread_pool_size(const TinyNN_ThreadPool* pool) {
+    return pool ? pool->num_threads : 1;
+}
+
+void thread_pool_run(TinyNN_ThreadPool* pool, thread_pool_task_fn fn, void* arg, int task_count) {
+    if (task_count <= 0) return;
+    if (pool == NULL || pool->worker_count == 0 || task_count == 1) {
+        for (int task = 0; task < task_count; task++) fn(arg, task);
+        return;
+    }
+
+    mutex_lock(&pool->submit_lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->task_count = task_count;
+    atomic_store_int(&pool->next_task, 0);
+    atomic_store_int(&pool->pending, pool->worker_count);
+    publish_job(pool);
+
+    // The caller works on the job too, then waits until every worker has let go of it
+    run_tasks(pool);
+    int spins = 0;
+    while (atomic_load_int(&pool->pending) > 0) {
+        // Yield once the wait gets long so a sleeping worker on a busy core can run
+        if (++spins < POOL_SPIN_ITERATIONS) cpu_relax();
+        else thread_yield();
+    }
+    mutex_unlock(&pool->submit_lock);
+}
@@ -0,0 +1,39 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent worker pool for splitting one piece of work (e.g. a layer) across cores.
+// Workers are started once and reused for every job, so running a job costs no thread
+// creation. Between jobs they spin for a short while before going to sleep, which keeps
+// back-to-back jobs (consecutive layers of one forward pass) cheap to hand out.
+
+typedef struct TinyNN_ThreadPool TinyNN_ThreadPool;
+
+// Runs task 'task' of a job. Tasks of one job may run concurrently on any thread.
+typedef void (*thread_pool_task_fn)(void* arg, int task);
+
+/**
+ * @brief Starts a pool that runs jobs on 'num_threads' threads, counting the caller.
+ * @param num_threads Total threads; <= 0 uses one per logical CPU. 1 starts no workers
+ *                    and runs every job inline on the calling thread.
+ * @return The pool, or NULL on failure.
+ */
+TinyNN_ThreadPool* create_thread_pool(int num_threads);
+/**
+ * @brief Like create_thread_pool(), with every worker pinned to one of 'cpus': worker i
+ * runs on cpus[(i + 1) % num_cpus], which leaves cpus[0] to the thread that submits jobs.
+ * num_threads <= 0 starts one thread per listed CPU.
+ */
+TinyNN_ThreadPool* create_pinned_thread_pool(int num_threads, const int* cpus, int num_cpus);
+void free_thread_pool(TinyNN_ThreadPool* pool);
+
+// Threads a job is spread over, including the calling thread.
+int thread_pool_size(const TinyNN_ThreadPool* pool);
+
+/**
+ * @brief Runs fn(arg, 0) ... fn(arg, task_count - 1) and returns once all have finished.
+ * The calling thread takes tasks too. Jobs submitted from several threads at once are
+ * run one after another. A NULL pool runs the tasks inline.
+ */
+void thread_pool_run(TinyNN_ThreadPool* pool, thread_pool_task_fn fn, void* arg, int task_count);
+
+#endif
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+#include "threads.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// Largest CPU number pin_thread_to_cpus() can name
+#define MAX_PINNED_CPU 1023
+
+#ifdef _WIN32
+
+// Win32 thread entry points have a different signature, so route through a trampoline
+typedef struct {
+    thread_fn fn;
+    void* arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+int thread_create(TinyNN_Thread* thread, thread_fn fn, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) return 0;
+    start->fn = fn;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void thread_join(TinyNN_Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void mutex_init(TinyNN_Mutex* mutex) { InitializeCriticalSection(mutex); }
+void mutex_lock(TinyNN_Mutex* mutex) { EnterCriticalSection(mutex); }
+void mutex_unlock(TinyNN_Mutex* mutex) { LeaveCriticalSection(mutex); }
+void mutex_destroy(TinyNN_Mutex* mutex) { DeleteCriticalSection(mutex); }
+
+void cond_init(TinyNN_Cond* cond) { InitializeConditionVariable(cond); }
+void cond_wait(TinyNN_Cond* cond, TinyNN_Mutex* mutex) { SleepConditionVariableCS(cond, mutex, INFINITE); }
+void cond_wait_timeout(TinyNN_Cond* cond, TinyNN_Mutex* mutex, double seconds) {
+    // Millisecond resolution; round up so short waits do not turn into busy loops
+    DWORD ms = seconds > 0.0 ? (DWORD)(seconds * 1000.0) + 1 : 0;
+    SleepConditionVariableCS(cond, mutex, ms);
+}
+void cond_signal(TinyNN_Cond* cond) { WakeConditionVariable(cond); }
+void cond_broadcast(TinyNN_Cond* cond) { WakeAllConditionVariable(cond); }
+void cond_destroy(TinyNN_Cond* cond) { (void)cond; }
+
+int atomic_add_int(volatile int* target, int value) {
+    return (int)InterlockedExchangeAdd((volatile LONG*)target, value);
+}
+
+int atomic_load_int(volatile int* target) {
+    return (int)InterlockedCompareExchange((volatile LONG*)target, 0, 0);
+}
+
+void atomic_store_int(volatile int* target, int value) {
+    InterlockedExchange((volatile LONG*)target, value);
+}
+
+void cpu_relax(void) {
+    YieldProcessor();
+}
+
+void thread_yield(void) {
+    SwitchToThread();
+}
+
+void thread_sleep_ms(int ms) {
+    Sleep((DWORD)ms);
+}
+
+int cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+int allowed_cpus(int* cpus, int max) {
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    int count = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8) && count < max; cpu++) {
+            if (process_mask & ((DWORD_PTR)1 << cpu)) cpus[count++] = cpu;
+        }
+    }
+    if (count == 0) {
+        int n = cpu_count();
+        for (; count < n && count < max; count++) cpus[count] = count;
+    }
+    return count;
+}
+
+int pin_thread_to_cpus(const int* cpus, int count) {
+    // One affinity mask covers the first processor group, i.e. 64 CPUs
+    DWORD_PTR mask = 0;
+    for (int i = 0; i < count; i++) {
+        if (cpus[i] >= 0 && cpus[i] < (int)(sizeof(DWORD_PTR) * 8)) mask |= (DWORD_PTR)1 << cpus[i];
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+#else // POSIX
+
+int thread_create(TinyNN_Thread* thread, thread_fn fn, void* arg) {
+    return pthread_create(thread, NULL, fn, arg) == 0;
+}
+
+void thread_join(TinyNN_Thread thread) {
+    pthread_join(thread, NULL);
+}
+
+void mutex_init(TinyNN_Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+void mutex_lock(TinyNN_Mutex* mutex) { pthread_mutex_lock(mutex); }
+void mutex_unlock(TinyNN_Mutex* mutex) { pthread_mutex_unlock(mutex); }
+void mutex_destroy(TinyNN_Mutex* mutex) { pthread_mutex_destroy(mutex); }
+
+void cond_init(TinyNN_Cond* cond) { pthread_cond_init(cond, NULL); }
+void cond_wait(TinyNN_Cond* cond, TinyNN_Mutex* mutex) { pthread_cond_wait(cond, mutex); }
+void cond_wait_timeout(TinyNN_Cond* cond, TinyNN_Mutex* mutex, double seconds) {
+    // pthread_cond_timedwait takes an absolute CLOCK_REALTIME deadline
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (seconds < 0.0) seconds = 0.0;
+    long long nsec = deadline.tv_nsec + (long long)(seconds * 1e9);
+    deadline.tv_sec += (time_t)(nsec / 1000000000LL);
+    deadline.tv_nsec = (long)(nsec % 1000000000LL);
+    pthread_cond_timedwait(cond, mutex, &deadline);
+}
+void cond_signal(TinyNN_Cond* cond) { pthread_cond_signal(cond); }
+void cond_broadcast(TinyNN_Cond* cond) { pthread_cond_broadcast(cond); }
+void cond_destroy(TinyNN_Cond* cond) { pthread_cond_destroy(cond); }
+
+int atomic_add_int(volatile int* target, int value) {
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+int atomic_load_int(volatile int* target) {
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+void atomic_store_int(volatile int* target, int value) {
+    __atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+void cpu_relax(void) {
+    #if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+    #elif defined(__aarch64__)
+    __asm__ volatile("yield");
+    #endif
+}
+
+void thread_yield(void) {
+    sched_yield();
+}
+
+void thread_sleep_ms(int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+int cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+int allowed_cpus(int* cpus, int max) {
+    int count = 0;
+#ifdef __linux__
+    unsigned long mask[(MAX_PINNED_CPU + 1) / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    // Returns the bytes of the mask the kernel filled in
+    long bytes = syscall(__NR_sched_getaffinity, 0, sizeof(mask), mask);
+    for (int cpu = 0; bytes > 0 && cpu < (int)bytes * 8 && count < max; cpu++) {
+        if (mask[cpu / (8 * sizeof(unsigned long))] & (1UL << (cpu % (8 * sizeof(unsigned long))))) {
+            cpus[count++] = cpu;
+        }
+    }
+#endif
+    if (count == 0) {
+        int n = cpu_count();
+        for (; count < n && count < max; count++) cpus[count] = count;
+    }
+    return count;
+}
+
+int pin_thread_to_cpus(const int* cpus, int count) {
+#ifdef __linux__
+    // The raw system call takes a plain bit mask and needs no _GNU_SOURCE
+    unsigned long mask[(MAX_PINNED_CPU + 1) / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    int any = 0;
+    for (int i = 0; i < count; i++) {
+        if (cpus[i] < 0 || cpus[i] > MAX_PINNED_CPU) continue;
+        mask[cpus[i] / (8 * sizeof(unsigned long))] |= 1UL << (cpus[i] % (8 * sizeof(unsigned long)));
+        any = 1;
+    }
+    // pid 0 is the calling thread
+    return any && syscall(__NR_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+#else
+    (void)cpus;
+    (void)count;
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+// Minimal portable threading layer: Win32 threads on Windows, pthreads elsewhere.
+
+#ifdef _WIN32
+    #include <windows.h>
+    typedef HANDLE TinyNN_Thread;
+    typedef CRITICAL_SECTION TinyNN_Mutex;
+    typedef CONDITION_VARIABLE TinyNN_Cond;
+#else
+    #include <pthread.h>
+    typedef pthread_t TinyNN_Thread;
+    typedef pthread_mutex_t TinyNN_Mutex;
+    typedef pthread_cond_t TinyNN_Cond;
+#endif
+
+typedef void* (*thread_fn)(void* arg);
+
+// Returns 1 on success, 0 on failure.
+int thread_create(TinyNN_Thread* thread, thread_fn fn, void* arg);
+void thread_join(TinyNN_Thread thread);
+
+void mutex_init(TinyNN_Mutex* mutex);
+void mutex_lock(TinyNN_Mutex* mutex);
+void mutex_unlock(TinyNN_Mutex* mutex);
+void mutex_destroy(TinyNN_Mutex* mutex);
+
+void cond_init(TinyNN_Cond* cond);
+void cond_wait(TinyNN_Cond* cond, TinyNN_Mutex* mutex);
+// Like cond_wait(), but also returns once about 'seconds' have passed without a signal.
+void cond_wait_timeout(TinyNN_Cond* cond, TinyNN_Mutex* mutex, double seconds);
+void cond_signal(TinyNN_Cond* cond);
+void cond_broadcast(TinyNN_Cond* cond);
+void cond_destroy(TinyNN_Cond* cond);
+
+// Sequentially consistent atomics on plain ints.
+int atomic_add_int(volatile int* target, int value); // Returns the previous value
+int atomic_load_int(volatile int* target);
+void atomic_store_int(volatile int* target, int value);
+
+// Hint to the CPU that the caller is busy-waiting (x86 'pause'); a no-op elsewhere.
+void cpu_relax(void);
+// Gives up the rest of the caller's time slice.
+void thread_yield(void);
+// Suspends the caller for about 'ms' milliseconds.
+void thread_sleep_ms(int ms);
+
+// Number of logical CPUs available to this process (at least 1).
+int cpu_count(void);
+// Stores the numbers of the CPUs the calling thread may run on (its affinity mask, which
+// taskset or a cgroup cpuset may narrow), lowest first, in 'cpus' (at most 'max').
+// Returns how many were stored; where the mask cannot be read, CPUs 0..cpu_count()-1.
+int allowed_cpus(int* cpus, int max);
+// Restricts the calling thread to the given CPUs. Returns 1 on success, 0 where the
+// platform cannot pin threads (macOS) or none of the CPUs exist.
+int pin_thread_to_cpus(const int* cpus, int count);
+
+#endif
@@ -1,26 +1,249 @@
-#include <math.h>
-#include "utils.h"
-
-float relu(float x) {
-    return x > 0 ? x : 0;
-}
-
-float sigmoid(float x) {
-    return 1.0f / (1.0f + expf(-x));
-}
-
-void softmax(float* input, int length) {
-    float max = input[0];
-    for (int i = 1; i < length; i++) {
-        if (input[i] > max) max = input[i];
-    }
-
-    float sum = 0.0f;
-    for (int i = 0; i < length; i++) {
-        input[i] = expf(input[i] - max);
-        sum += input[i];
-    }
-    for (int i = 0; i < length; i++) {
-        input[i] /= sum;
-    }
-}
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+#include "utils.h"
+
+float relu(float x) {
+    return x > 0 ? x : 0;
+}
+
+float sigmoid(float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+void softmax(float* input, int length) {
+    float max = input[0];
+    for (int i = 1; i < length; i++) {
+        if (input[i] > max) max = input[i];
+    }
+
+    float sum = 0.0f;
+    for (int i = 0; i < length; i++) {
+        input[i] = expf(input[i] - max);
+        sum += input[i];
+    }
+    for (int i = 0; i < length; i++) {
+        input[i] /= sum;
+    }
+}
+
+float log_sum_exp(const float* input, int length) {
+    float max = input[0];
+    for (int i = 1; i < length; i++) {
+        if (input[i] > max) max = input[i];
+    }
+
+    // Shifted by the maximum so the sum neither overflows nor is all zeros
+    float sum = 0.0f;
+    for (int i = 0; i < length; i++) {
+        sum += expf(input[i] - max);
+    }
+    return max + logf(sum);
+}
+
+void log_softmax(float* input, int length) {
+    float lse = log_sum_exp(input, length);
+    for (int i = 0; i < length; i++) {
+        input[i] -= lse;
+    }
+}
+
+// Orders candidates worst first: smaller value, or the same value at a higher index
+static int ranks_below(const float* values, int a, int b) {
+    return values[a] < values[b] || (values[a] == values[b] && a > b);
+}
+
+static void sift_down(const float* values, int* heap, int count, int i) {
+    for (;;) {
+        int worst = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < count && ranks_below(values, heap[left], heap[worst])) worst = left;
+        if (right < count && ranks_below(values, heap[right], heap[worst])) worst = right;
+        if (worst == i) return;
+        int t = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = t;
+        i = worst;
+    }
+}
+
+int top_k_indices(const float* values, int length, int k, int* indices) {
+    if (k > length) k = length;
+    if (k <= 0) return 0;
+
+    // Min-heap of the best k so far, worst at the root. Most values lose to the root
+    // with one comparison, so a pass costs little more than finding the maximum.
+    for (int i = 0; i < k; i++) indices[i] = i;
+    for (int i = k / 2 - 1; i >= 0; i--) sift_down(values, indices, k, i);
+    for (int i = k; i < length; i++) {
+        if (values[i] > values[indices[0]]) {
+            indices[0] = i;
+            sift_down(values, indices, k, 0);
+        }
+    }
+
+    // Pop the worst to the back until the array is sorted best first
+    for (int count = k - 1; count > 0; count--) {
+        int t = indices[0];
+        indices[0] = indices[count];
+        indices[count] = t;
+        sift_down(values, indices, count, 0);
+    }
+    return k;
+}
+
+
+void* aligned_malloc(size_t size, size_t alignment) {
+    if (size == 0) size = alignment;
+    #ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+    #else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0) return NULL;
+    return ptr;
+    #endif
+}
+
+void aligned_free(void* ptr) {
+    #ifdef _WIN32
+    _aligned_free(ptr);
+    #else
+    free(ptr);
+    #endif
+}
+
+void* map_file_readonly(const char* filepath, size_t* size_out) {
+    *size_out = 0;
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+    void* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // The view keeps the mapping alive
+    if (addr == NULL) return NULL;
+    *size_out = (size_t)size.QuadPart;
+    return addr;
+    #else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (addr == MAP_FAILED) return NULL;
+    *size_out = (size_t)st.st_size;
+    return addr;
+    #endif
+}
+
+void unmap_file(void* addr, size_t size) {
+    if (addr == NULL) return;
+    #ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(addr);
+    #else
+    munmap(addr, size);
+    #endif
+}
+
+// Mapped ranges are advised in whole pages; 4 KB is the smallest page size of every
+// supported platform, and a larger real page size only makes the rounding coarser
+#define MAPPED_PAGE_SIZE 4096
+
+void prefetch_mapped_range(const void* addr, size_t size) {
+    if (addr == NULL || size == 0) return;
+    #ifdef _WIN32
+    (void)addr;
+    (void)size;
+    #else
+    // Whole pages around the range
+    uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(MAPPED_PAGE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)addr + size + MAPPED_PAGE_SIZE - 1) & ~(uintptr_t)(MAPPED_PAGE_SIZE - 1);
+    madvise((void*)start, end - start, MADV_WILLNEED);
+    #endif
+}
+
+void release_mapped_range(const void* addr, size_t size) {
+    // Only pages entirely inside the range, so neighbouring data stays resident
+    uintptr_t start = ((uintptr_t)addr + MAPPED_PAGE_SIZE - 1) & ~(uintptr_t)(MAPPED_PAGE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)addr + size) & ~(uintptr_t)(MAPPED_PAGE_SIZE - 1);
+    if (addr == NULL || end <= start) return;
+    #ifdef _WIN32
+    // Unlocking pages that are not locked removes them from the working set
+    VirtualUnlock((void*)start, end - start);
+    #else
+    // The pages are unmodified file pages, so dropping them loses nothing
+    madvise((void*)start, end - start, MADV_DONTNEED);
+    #endif
+}
+
+FILE* begin_file_replace(const char* path, char** temp_path_out) {
+    size_t length = strlen(path);
+    char* temp_path = (char*)malloc(length + 5);
+    *temp_path_out = NULL;
+    if (!temp_path) return NULL;
+    memcpy(temp_path, path, length);
+    memcpy(temp_path + length, ".tmp", 5);
+    FILE* fp = fopen(temp_path, "wb");
+    if (!fp) {
+        free(temp_path);
+        return NULL;
+    }
+    *temp_path_out = temp_path;
+    return fp;
+}
+
+int finish_file_replace(FILE* fp, char* temp_path, const char* path, int ok) {
+    // The data must be on disk before the rename can make it the only copy
+    ok = ok && fflush(fp) == 0;
+    #ifdef _WIN32
+    ok = ok && _commit(_fileno(fp)) == 0;
+    #else
+    ok = ok && fsync(fileno(fp)) == 0;
+    #endif
+    if (fclose(fp) != 0) ok = 0;
+    #ifdef _WIN32
+    ok = ok && MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    #else
+    ok = ok && rename(temp_path, path) == 0;
+    #endif
+    if (!ok) remove(temp_path);
+    free(temp_path);
+    return ok;
+}
+
+double get_time_seconds(void) {
+    #ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+    #endif
+}
@@ -1,8 +1,45 @@
-#ifndef UTILS_H
-#define UTILS_H
-
-float relu(float x);
-float sigmoid(float x);
-void softmax(float* input, int length);
-
-#endif
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+float relu(float x);
+float sigmoid(float x);
+void softmax(float* input, int length);
+// log(sum(exp(input))), computed without overflow.
+float log_sum_exp(const float* input, int length);
+// input[i] = log(softmax(input)[i]), with one exp per element and no divisions.
+void log_softmax(float* input, int length);
+// Writes the indices of the 'k' largest values to 'indices', largest first; equal values
+// keep their order. Returns the number written, min(k, length).
+int top_k_indices(const float* values, int length, int k, int* indices);
+
+// Allocation helpers for SIMD/cache-line aligned buffers. Memory from
+// aligned_malloc() must be released with aligned_free().
+void* aligned_malloc(size_t size, size_t alignment);
+void aligned_free(void* ptr);
+
+// Maps a whole file read-only into memory. Stores the file size in 'size_out'.
+// Returns NULL on failure (or for an empty file). Release with unmap_file().
+void* map_file_readonly(const char* filepath, size_t* size_out);
+void unmap_file(void* addr, size_t size);
+// Hints for a range of a mapping from map_file_readonly(): start reading its pages from
+// the file in the background, or drop them from this process's memory (they are read
+// again on the next access). Both are only hints and never fail.
+void prefetch_mapped_range(const void* addr, size_t size);
+void release_mapped_range(const void* addr, size_t size);
+
+// Replaces a file that may be mapped without touching the mapped bytes: writing it in
+// place would change the contents under every existing mapping (a shorter file faults
+// them). begin_file_replace() opens '<path>.tmp' for writing and stores its malloc'ed name
+// in 'temp_path_out'. finish_file_replace() closes it and, if 'ok', flushes it to disk and
+// renames it over 'path'. Otherwise, or if that fails, only the temporary file is removed.
+// Returns 1 once 'path' holds the new contents. Frees the temporary name either way.
+FILE* begin_file_replace(const char* path, char** temp_path_out);
+int finish_file_replace(FILE* fp, char* temp_path, const char* path, int ok);
+
+// Monotonic wall-clock time in seconds, for measuring intervals.
+double get_time_seconds(void);
+
+#endif
@@ -0,0 +1,404 @@
+// tinynn_bench: reproducible inference benchmark over model shapes, batch sizes and
+// thread counts. Models are built in memory with fixed-seed random weights, so every
+// run on every machine measures exactly the same work.
+//
+// Usage: tinynn_bench [-p presets] [-s shape]... [-b batches] [-t threads] [-w types]
+//                     [--warmup n] [-r repetitions] [--seed n] [--prune f] [--json]
+//
+//   -p  Comma-separated generator presets (Micro, Small, Medium, Large, Huge) or "all".
+//       Defaults to all of them unless -s is given.
+//   -s  A custom shape: input size followed by every layer size, e.g. 784x256x128x10.
+//       May be repeated.
+//   -b  Comma-separated batch sizes, default 1,16,256.
+//   -t  Comma-separated thread counts, 0 = one per CPU. Default 1 and the CPU count.
+//   -w  Comma-separated weight types (fp32, fp16, bf16, int8), default fp32.
+//   --warmup  Untimed forward passes before each measurement, default 10.
+//   -r  Timed forward passes per measurement, default 100.
+//   --prune   Zero this fraction of every layer's weights, smallest magnitudes first, like a
+//             pruned model. Layers then load sparse as set by TINYNN_SPARSE (sparse.h).
+//   --json    Print one JSON document instead of a table.
+//
+// Every timed forward pass is measured on its own, so p50/p99 are per call (a call scores
+// one whole batch). Throughput figures use the mean call time. GB/s counts the layer
+// weights once per call, which is the traffic a forward pass cannot avoid.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "model.h"
+#include "generate_model.h"
+#include "pack.h"
+#include "sparse.h"
+#include "thread_pool.h"
+#include "threads.h"
+#include "utils.h"
+
+#define MAX_SHAPES 32
+#define MAX_LAYERS 64
+#define MAX_LIST 16
+#define DEFAULT_WARMUP 10
+#define DEFAULT_REPETITIONS 100
+#define DEFAULT_SEED 1234
+
+typedef struct {
+    char name[64];
+    int input_size;
+    int num_layers;
+    int layer_sizes[MAX_LAYERS];
+} BenchShape;
+
+typedef struct {
+    BenchShape shapes[MAX_SHAPES];
+    int shape_count;
+    int batches[MAX_LIST];
+    int batch_count;
+    int threads[MAX_LIST];
+    int thread_count;
+    TinyNN_WeightType types[MAX_LIST];
+    int type_count;
+    int warmup;
+    int repetitions;
+    unsigned int seed;
+    float prune;
+    int json;
+} BenchOptions;
+
+typedef struct {
+    double p50;
+    double p99;
+    double mean;
+} BenchTiming;
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [-p presets] [-s shape]... [-b batches] [-t threads] [-w types]\n"
+        "       [--warmup n] [-r repetitions] [--seed n] [--prune fraction] [--json]\n"
+        "  -p  Presets to run, comma-separated, or 'all' (default unless -s is given)\n"
+        "  -s  Custom shape 'input x layer x ... x output', e.g. 784x256x128x10\n"
+        "  -b  Batch sizes (default 1,16,256)\n"
+        "  -t  Thread counts, 0 = one per CPU (default 1 and the CPU count)\n"
+        "  -w  Weight types: fp32, fp16, bf16, int8 (default fp32)\n",
+        program);
+}
+
+static void add_preset(BenchOptions* options, const ModelPreset* preset) {
+    if (options->shape_count == MAX_SHAPES) return;
+    BenchShape* shape = &options->shapes[options->shape_count++];
+    snprintf(shape->name, sizeof(shape->name), "%s", preset->name);
+    shape->input_size = preset->input_size;
+    shape->num_layers = preset->num_layers;
+    for (int i = 0; i < preset->num_layers; i++) shape->layer_sizes[i] = preset->layer_sizes[i];
+}
+
+static int parse_presets(BenchOptions* options, char* list) {
+    for (char* name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        if (strcmp(name, "all") == 0) {
+            for (int i = 0; i < model_preset_count(); i++) add_preset(options, get_model_preset(i));
+            continue;
+        }
+        const ModelPreset* preset = find_model_preset(name);
+        if (!preset) {
+            fprintf(stderr, "Unknown preset '%s'.\n", name);
+            return 0;
+        }
+        add_preset(options, preset);
+    }
+    return 1;
+}
+
+// "784x256x10": the input size, then one size per layer
+static int parse_shape(BenchOptions* options, const char* text) {
+    if (options->shape_count == MAX_SHAPES) {
+        fprintf(stderr, "Too many shapes (at most %d).\n", MAX_SHAPES);
+        return 0;
+    }
+    BenchShape* shape = &options->shapes[options->shape_count];
+    int sizes[MAX_LAYERS + 1];
+    int count = 0;
+    const char* p = text;
+    for (;;) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || value > (1 << 24) || count == MAX_LAYERS + 1) {
+            fprintf(stderr, "Bad shape '%s' (expected e.g. 784x256x10).\n", text);
+            return 0;
+        }
+        sizes[count++] = (int)value;
+        if (*end == '\0') break;
+        if (*end != 'x' && *end != 'X') {
+            fprintf(stderr, "Bad shape '%s' (expected e.g. 784x256x10).\n", text);
+            return 0;
+        }
+        p = end + 1;
+    }
+    if (count < 2) {
+        fprintf(stderr, "Shape '%s' needs an input size and at least one layer.\n", text);
+        return 0;
+    }
+    snprintf(shape->name, sizeof(shape->name), "%s", text);
+    shape->input_size = sizes[0];
+    shape->num_layers = count - 1;
+    for (int i = 1; i < count; i++) shape->layer_sizes[i - 1] = sizes[i];
+    options->shape_count++;
+    return 1;
+}
+
+static int parse_int_list(const char* flag, char* list, int* values, int* count, int min_value) {
+    *count = 0;
+    for (char* item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        char* end;
+        long value = strtol(item, &end, 10);
+        if (end == item || *end != '\0' || value < min_value || *count == MAX_LIST) {
+            fprintf(stderr, "Bad value '%s' for %s.\n", item, flag);
+            return 0;
+        }
+        values[(*count)++] = (int)value;
+    }
+    return *count > 0;
+}
+
+static int parse_type_list(BenchOptions* options, char* list) {
+    options->type_count = 0;
+    for (char* item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        if (options->type_count == MAX_LIST || !parse_weight_type(item, &options->types[options->type_count])) {
+            fprintf(stderr, "Unknown weight type '%s'.\n", item);
+            return 0;
+        }
+        options->type_count++;
+    }
+    return options->type_count > 0;
+}
+
+static int parse_options(int argc, char** argv, BenchOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->batches[0] = 1;
+    options->batches[1] = 16;
+    options->batches[2] = 256;
+    options->batch_count = 3;
+    options->threads[0] = 1;
+    options->thread_count = 1;
+    if (cpu_count() > 1) options->threads[options->thread_count++] = cpu_count();
+    options->types[0] = TINYNN_WEIGHTS_FP32;
+    options->type_count = 1;
+    options->warmup = DEFAULT_WARMUP;
+    options->repetitions = DEFAULT_REPETITIONS;
+    options->seed = DEFAULT_SEED;
+
+    for (int i = 1; i < argc; i++) {
+        const char* flag = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(flag, "--json") == 0) {
+            options->json = 1;
+        } else if (strcmp(flag, "-p") == 0 && has_value) {
+            if (!parse_presets(options, argv[++i])) return 0;
+        } else if (strcmp(flag, "-s") == 0 && has_value) {
+            if (!parse_shape(options, argv[++i])) return 0;
+        } else if (strcmp(flag, "-b") == 0 && has_value) {
+            if (!parse_int_list(flag, argv[++i], options->batches, &options->batch_count, 1)) return 0;
+        } else if (strcmp(flag, "-t") == 0 && has_value) {
+            if (!parse_int_list(flag, argv[++i], options->threads, &options->thread_count, 0)) return 0;
+        } else if (strcmp(flag, "-w") == 0 && has_value) {
+            if (!parse_type_list(options, argv[++i])) return 0;
+        } else if (strcmp(flag, "--warmup") == 0 && has_value) {
+            options->warmup = atoi(argv[++i]);
+            if (options->warmup < 0) return 0;
+        } else if (strcmp(flag, "-r") == 0 && has_value) {
+            options->repetitions = atoi(argv[++i]);
+            if (options->repetitions <= 0) return 0;
+        } else if (strcmp(flag, "--seed") == 0 && has_value) {
+            options->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(flag, "--prune") == 0 && has_value) {
+            options->prune = (float)atof(argv[++i]);
+            if (options->prune < 0.0f || options->prune >= 1.0f) return 0;
+        } else {
+            return 0;
+        }
+    }
+    if (options->shape_count == 0) {
+        for (int i = 0; i < model_preset_count(); i++) add_preset(options, get_model_preset(i));
+    }
+    return 1;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an ascending array
+static double percentile(const double* sorted, int count, double p) {
+    int rank = (int)ceil(p * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+static BenchTiming time_forward_passes(TinyNN_Context* ctx, const float* inputs, int batch, float* outputs,
+                                       int warmup, int repetitions, double* samples) {
+    for (int i = 0; i < warmup; i++) forward_pass_batch_into(ctx, inputs, batch, outputs);
+
+    double total = 0.0;
+    for (int i = 0; i < repetitions; i++) {
+        double start = get_time_seconds();
+        forward_pass_batch_into(ctx, inputs, batch, outputs);
+        samples[i] = get_time_seconds() - start;
+        total += samples[i];
+    }
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+    BenchTiming timing;
+    timing.p50 = percentile(samples, repetitions, 0.50);
+    timing.p99 = percentile(samples, repetitions, 0.99);
+    timing.mean = total / repetitions;
+    return timing;
+}
+
+// The generated weights are uniform in [-1, 1], so zeroing |w| < fraction prunes that
+// share of them by magnitude. The model is then laid out as if it had been loaded.
+static int prune_model(TinyNN_Model* model, float fraction) {
+    if (!unpack_model_weights(model)) return 0;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        float* w = model->weights[i];
+        size_t count = (size_t)model->layer_sizes[i] * prev_layer_size;
+        for (size_t k = 0; k < count; k++) {
+            if (fabsf(w[k]) < fraction) w[k] = 0.0f;
+        }
+        prev_layer_size = model->layer_sizes[i];
+    }
+    if (sparsify_model_weights(model, default_sparse_threshold()) < 0) return 0;
+    return !packing_enabled() || pack_model_weights(model);
+}
+
+static double multiply_adds_per_sample(const TinyNN_Model* model) {
+    double total = 0.0;
+    int prev_layer_size = model->input_size;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        total += (double)prev_layer_size * model->layer_sizes[i];
+        prev_layer_size = model->layer_sizes[i];
+    }
+    return total;
+}
+
+static void print_header(const BenchOptions* options, const char* kernels) {
+    if (options->json) {
+        printf("{\n  \"kernels\": \"%s\",\n  \"cpus\": %d,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n"
+               "  \"seed\": %u,\n  \"prune\": %.3f,\n  \"results\": [",
+               kernels, cpu_count(), options->warmup, options->repetitions, options->seed, options->prune);
+        return;
+    }
+    printf("Kernels: %s, %d CPU%s, %d warmup + %d timed forward passes per row\n", kernels, cpu_count(),
+           cpu_count() == 1 ? "" : "s", options->warmup, options->repetitions);
+    if (options->prune > 0.0f) {
+        printf("Weights pruned to %.0f%% zeros; GFLOP/s counts the dense equivalent\n", options->prune * 100.0);
+    }
+    printf("\n");
+    printf("%-18s %-7s %7s %6s %11s %11s %12s %9s %8s\n", "model", "weights", "threads", "batch",
+           "p50 (us)", "p99 (us)", "samples/s", "GFLOP/s", "GB/s");
+}
+
+static void print_result(const BenchOptions* options, int index, const BenchShape* shape, const TinyNN_Model* model,
+                         int threads, int batch, BenchTiming timing) {
+    double samples_per_second = batch / timing.mean;
+    double gflops = 2.0 * multiply_adds_per_sample(model) * samples_per_second * 1e-9;
+    double gigabytes = (double)model_weight_bytes(model) / timing.mean * 1e-9;
+
+    if (options->json) {
+        printf("%s\n    {\"model\": \"%s\", \"input_size\": %d, \"layers\": [", index == 0 ? "" : ",",
+               shape->name, shape->input_size);
+        for (int i = 0; i < shape->num_layers; i++) printf(i == 0 ? "%d" : ", %d", shape->layer_sizes[i]);
+        printf("], \"weights\": \"%s\", \"threads\": %d, \"batch\": %d, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+               "\"mean_us\": %.3f, \"samples_per_sec\": %.1f, \"gflops\": %.3f, \"weight_gbps\": %.3f}",
+               weight_type_name(model->weight_type), threads, batch, timing.p50 * 1e6, timing.p99 * 1e6,
+               timing.mean * 1e6, samples_per_second, gflops, gigabytes);
+        return;
+    }
+    printf("%-18s %-7s %7d %6d %11.2f %11.2f %12.0f %9.2f %8.2f\n", shape->name,
+           weight_type_name(model->weight_type), threads, batch, timing.p50 * 1e6, timing.p99 * 1e6,
+           samples_per_second, gflops, gigabytes);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // One pool per requested thread count, shared by every model
+    TinyNN_ThreadPool* pools[MAX_LIST] = {NULL};
+    for (int t = 0; t < options.thread_count; t++) {
+        if (options.threads[t] == 1) continue;
+        pools[t] = create_thread_pool(options.threads[t]);
+        if (!pools[t]) {
+            fprintf(stderr, "Could not start %d threads.\n", options.threads[t]);
+            return 1;
+        }
+    }
+
+    int max_batch = 0;
+    for (int b = 0; b < options.batch_count; b++) {
+        if (options.batches[b] > max_batch) max_batch = options.batches[b];
+    }
+    double* samples = (double*)malloc(sizeof(double) * options.repetitions);
+    if (!samples) return 1;
+
+    print_header(&options, select_kernels()->name);
+    int status = 0;
+    int result_count = 0;
+    for (int s = 0; s < options.shape_count && status == 0; s++) {
+        const BenchShape* shape = &options.shapes[s];
+        int output_size = shape->layer_sizes[shape->num_layers - 1];
+        float* inputs = (float*)malloc(sizeof(float) * (size_t)max_batch * shape->input_size);
+        float* outputs = (float*)malloc(sizeof(float) * (size_t)max_batch * output_size);
+        if (!inputs || !outputs) {
+            fprintf(stderr, "Out of memory for shape %s.\n", shape->name);
+            free(inputs);
+            free(outputs);
+            status = 1;
+            break;
+        }
+        srand(options.seed);
+        for (size_t i = 0; i < (size_t)max_batch * shape->input_size; i++) {
+            inputs[i] = ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        }
+
+        for (int w = 0; w < options.type_count && status == 0; w++) {
+            TinyNN_Model* model = create_random_model(shape->input_size, shape->num_layers, shape->layer_sizes,
+                                                      options.seed);
+            if (!model || (options.prune > 0.0f && !prune_model(model, options.prune)) ||
+                !convert_model_weights(model, options.types[w])) {
+                fprintf(stderr, "Could not build %s model %s.\n", weight_type_name(options.types[w]), shape->name);
+                free_model(model);
+                status = 1;
+                break;
+            }
+            TinyNN_Context* ctx = create_context(model, max_batch);
+            if (!ctx) {
+                free_model(model);
+                status = 1;
+                break;
+            }
+            for (int t = 0; t < options.thread_count; t++) {
+                context_set_thread_pool(ctx, pools[t]);
+                for (int b = 0; b < options.batch_count; b++) {
+                    BenchTiming timing = time_forward_passes(ctx, inputs, options.batches[b], outputs,
+                                                             options.warmup, options.repetitions, samples);
+                    print_result(&options, result_count++, shape, model, thread_pool_size(pools[t]),
+                                 options.batches[b], timing);
+                    fflush(stdout);
+                }
+            }
+            free_context(ctx);
+            free_model(model);
+        }
+        free(inputs);
+        free(outputs);
+    }
+    if (options.json) printf("\n  ]\n}\n");
+
+    free(samples);
+    for (int t = 0; t < options.thread_count; t++) free_thread_pool(pools[t]);
+    return status;
+}
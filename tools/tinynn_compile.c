@@ -0,0 +1,304 @@
+// tinynn_compile: ahead-of-time compiler from a model to a standalone C source file.
+// The generated file needs nothing from tinyNN (only <math.h>): every layer shape is a
+// compile-time constant, the weights are embedded as aligned static const arrays, and
+// each layer is its own function with the bias and activation fused into the output loop.
+// Linked into a program, the model is ready the moment the program starts, with no
+// parsing, allocation or kernel dispatch at run time.
+//
+// Usage: tinynn_compile <model_path> [-o model.c] [-n name] [-H model.h]
+//
+//   -o  Source file to write (default <name>.c).
+//   -n  Prefix of the generated symbols (default: the model's file name).
+//   -H  Also write a header declaring the generated functions.
+//
+// The generated file defines, for a prefix 'name':
+//
+//   #define NAME_INPUT_SIZE / NAME_OUTPUT_SIZE
+//   int name_forward_pass_into(const float* input, float* output);
+//   int name_forward_pass_batch_into(const float* inputs, int batch_size, float* outputs);
+//
+// with the same contract as forward_pass_into() / forward_pass_batch_into() on a context
+// of the model, minus the context. Rows of every layer are padded with zeros to a multiple
+// of COMPILE_LANES so the dot products have no tail and the compiler can vectorize them
+// (build the result with -O2 or higher and -march for the target CPU). Only fp32 weights
+// can be compiled; the sums are grouped differently than in the engine's kernels, so
+// outputs may differ from them in the last bits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "model.h"
+#include "pack.h"
+
+// Independent accumulators per output, one vector of 8 floats
+#define COMPILE_LANES 8
+// Layers with at most this many (padded) inputs get their dot product fully unrolled
+#define MAX_UNROLLED_COLS 256
+#define MAX_NAME 64
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s <model_path> [-o model.c] [-n name] [-H model.h]\n", program);
+}
+
+static int padded(int count) {
+    return (count + COMPILE_LANES - 1) / COMPILE_LANES * COMPILE_LANES;
+}
+
+// C identifier from a model path: its last component without the extension, with every
+// other character turned into '_'
+static void default_name(const char* model_path, char* name) {
+    const char* start = model_path;
+    size_t length = strlen(model_path);
+    while (length > 1 && (model_path[length - 1] == '/' || model_path[length - 1] == '\\')) length--;
+    for (size_t i = 0; i < length; i++) {
+        if (model_path[i] == '/' || model_path[i] == '\\') start = model_path + i + 1;
+    }
+    length -= (size_t)(start - model_path);
+    if (length > 4 && strncmp(start + length - 4, ".tnn", 4) == 0) length -= 4;
+    if (length >= MAX_NAME - 7) length = MAX_NAME - 7;
+
+    size_t n = 0;
+    if (length == 0 || isdigit((unsigned char)start[0])) {
+        memcpy(name, "model_", 6);
+        n = 6;
+    }
+    for (size_t i = 0; i < length; i++) {
+        name[n++] = isalnum((unsigned char)start[i]) ? start[i] : '_';
+    }
+    name[n] = '\0';
+}
+
+static int valid_name(const char* name) {
+    if (!name[0] || strlen(name) >= MAX_NAME || isdigit((unsigned char)name[0])) return 0;
+    for (const char* c = name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_') return 0;
+    }
+    return 1;
+}
+
+// Hex float literals round-trip every weight exactly
+static void write_floats(FILE* out, const float* values, int count, int padded_count) {
+    for (int i = 0; i < padded_count; i++) {
+        if (i % 6 == 0) fputs("\n    ", out);
+        if (i < count) fprintf(out, "%af,", values[i]);
+        else fputs("0.0f,", out);
+        if (i % 6 != 5 && i + 1 < padded_count) fputc(' ', out);
+    }
+}
+
+static void write_weights(FILE* out, const TinyNN_Model* model, const char* name, const char* upper, int layer) {
+    int rows = model->layer_sizes[layer];
+    int cols = layer == 0 ? model->input_size : model->layer_sizes[layer - 1];
+    fprintf(out, "// Layer %d: %d x %d, rows padded to %d\n", layer, rows, cols, padded(cols));
+    fprintf(out, "%s_ALIGNED static const float %s_weights_%d[%d][%d] = {", upper, name, layer, rows, padded(cols));
+    for (int j = 0; j < rows; j++) {
+        fputs(j == 0 ? "\n  {" : "\n  }, {", out);
+        write_floats(out, model->weights[layer] + (size_t)j * cols, cols, padded(cols));
+    }
+    fputs("\n  }\n};\n", out);
+    fprintf(out, "%s_ALIGNED static const float %s_biases_%d[%d] = {", upper, name, layer, rows);
+    write_floats(out, model->biases[layer], rows, rows);
+    fputs("\n};\n\n", out);
+}
+
+// Softmax of 'count' values at 'v', as utils.c computes it
+static void write_softmax(FILE* out, const char* v, int count) {
+    fprintf(out, "    float max = %s[0];\n", v);
+    fprintf(out, "    for (int j = 1; j < %d; j++) {\n        if (%s[j] > max) max = %s[j];\n    }\n", count, v, v);
+    fputs("    float sum = 0.0f;\n", out);
+    fprintf(out, "    for (int j = 0; j < %d; j++) {\n        %s[j] = expf(%s[j] - max);\n        sum += %s[j];\n    }\n",
+            count, v, v, v);
+    fprintf(out, "    for (int j = 0; j < %d; j++) %s[j] /= sum;\n", count, v);
+}
+
+static void write_layer(FILE* out, const TinyNN_Model* model, const char* name, const char* upper, int layer) {
+    int rows = model->layer_sizes[layer];
+    int cols = padded(layer == 0 ? model->input_size : model->layer_sizes[layer - 1]);
+    int last = layer == model->hidden_layers;
+    TinyNN_Activation activation = model->activations ? model->activations[layer] : default_activation(model, layer);
+
+    fprintf(out, "static void %s_layer_%d(const float* %s_RESTRICT x, float* %s_RESTRICT y) {\n", name, layer, upper,
+            upper);
+    fprintf(out, "    for (int j = 0; j < %d; j++) {\n", rows);
+    fprintf(out, "        const float* w = %s_weights_%d[j];\n", name, layer);
+    fprintf(out, "        float acc[%d] = {0.0f};\n", COMPILE_LANES);
+    if (cols <= MAX_UNROLLED_COLS) {
+        for (int k = 0; k < cols; k += COMPILE_LANES) {
+            fprintf(out, "%s%s_STEP(%d)", k % (4 * COMPILE_LANES) == 0 ? "        " : " ", upper, k);
+            if (k % (4 * COMPILE_LANES) == 3 * COMPILE_LANES || k + COMPILE_LANES >= cols) fputc('\n', out);
+        }
+    } else {
+        fprintf(out, "        for (int k = 0; k < %d; k += %d) %s_STEP(k)\n", cols, COMPILE_LANES, upper);
+    }
+    fprintf(out, "        float s = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]))"
+                 " + %s_biases_%d[j];\n", name, layer);
+    switch (activation) {
+        case TINYNN_ACT_RELU:    fputs("        y[j] = s > 0.0f ? s : 0.0f;\n", out); break;
+        case TINYNN_ACT_SIGMOID: fputs("        y[j] = 1.0f / (1.0f + expf(-s));\n", out); break;
+        case TINYNN_ACT_TANH:    fputs("        y[j] = tanhf(s);\n", out); break;
+        default:                 fputs("        y[j] = s;\n", out); break;
+    }
+    fputs("    }\n", out);
+    if (activation == TINYNN_ACT_SOFTMAX) write_softmax(out, "y", rows);
+    // The next layer reads whole lanes; its padded weights are zero, so the pad must be too
+    if (!last && padded(rows) > rows) {
+        fprintf(out, "    for (int j = %d; j < %d; j++) y[j] = 0.0f;\n", rows, padded(rows));
+    }
+    fputs("}\n\n", out);
+}
+
+static void write_declarations(FILE* out, const TinyNN_Model* model, const char* name, const char* upper) {
+    fprintf(out, "#define %s_INPUT_SIZE %d\n", upper, model->input_size);
+    fprintf(out, "#define %s_OUTPUT_SIZE %d\n\n", upper, model->output_size);
+    fprintf(out, "// 'output' receives %s_OUTPUT_SIZE floats. Returns 1.\n", upper);
+    fprintf(out, "int %s_forward_pass_into(const float* input, float* output);\n", name);
+    fprintf(out, "// Row-major [batch_size][%s_INPUT_SIZE] in, [batch_size][%s_OUTPUT_SIZE] out. Returns 1,\n", upper,
+            upper);
+    fputs("// or 0 for a negative batch_size.\n", out);
+    fprintf(out, "int %s_forward_pass_batch_into(const float* inputs, int batch_size, float* outputs);\n", name);
+}
+
+static int write_source(FILE* out, const TinyNN_Model* model, const char* model_path, const char* name,
+                        const char* upper) {
+    int layers = model->hidden_layers + 1;
+    int width = padded(model->input_size);
+    for (int i = 0; i < model->hidden_layers; i++) {
+        if (padded(model->layer_sizes[i]) > width) width = padded(model->layer_sizes[i]);
+    }
+
+    fprintf(out, "// Generated by tinynn_compile from '%s'. Do not edit.\n", model_path);
+    fprintf(out, "// %d -> ", model->input_size);
+    for (int i = 0; i < layers; i++) {
+        TinyNN_Activation activation = model->activations ? model->activations[i] : default_activation(model, i);
+        fprintf(out, "%d (%s)%s", model->layer_sizes[i], activation_name(activation), i + 1 < layers ? " -> " : "\n");
+    }
+    fputs("\n#include <math.h>\n#include <string.h>\n\n", out);
+    write_declarations(out, model, name, upper);
+    fputs("\n#if defined(_MSC_VER)\n", out);
+    fprintf(out, "#define %s_ALIGNED __declspec(align(64))\n#define %s_RESTRICT __restrict\n#else\n", upper, upper);
+    fprintf(out, "#define %s_ALIGNED __attribute__((aligned(64)))\n#define %s_RESTRICT restrict\n#endif\n\n", upper, upper);
+    // Each lane accumulates its own column of a block, so the block is one vector FMA
+    fprintf(out, "#define %s_STEP(k) for (int l = 0; l < %d; l++) acc[l] += w[(k) + l] * x[(k) + l];\n\n", upper,
+            COMPILE_LANES);
+
+    for (int i = 0; i < layers; i++) write_weights(out, model, name, upper, i);
+    for (int i = 0; i < layers; i++) write_layer(out, model, name, upper, i);
+
+    fprintf(out, "int %s_forward_pass_into(const float* input, float* output) {\n", name);
+    fprintf(out, "    %s_ALIGNED float a[%d];\n", upper, width);
+    if (layers > 1) fprintf(out, "    %s_ALIGNED float b[%d];\n", upper, width);
+    fprintf(out, "    memcpy(a, input, sizeof(float) * %d);\n", model->input_size);
+    if (padded(model->input_size) > model->input_size) {
+        fprintf(out, "    for (int k = %d; k < %d; k++) a[k] = 0.0f;\n", model->input_size, padded(model->input_size));
+    }
+    for (int i = 0; i < layers; i++) {
+        const char* from = i % 2 == 0 ? "a" : "b";
+        const char* to = i + 1 == layers ? "output" : i % 2 == 0 ? "b" : "a";
+        fprintf(out, "    %s_layer_%d(%s, %s);\n", name, i, from, to);
+    }
+    fputs("    return 1;\n}\n\n", out);
+
+    fprintf(out, "int %s_forward_pass_batch_into(const float* inputs, int batch_size, float* outputs) {\n", name);
+    fputs("    if (batch_size < 0) return 0;\n", out);
+    fputs("    for (int n = 0; n < batch_size; n++) {\n", out);
+    fprintf(out, "        %s_forward_pass_into(inputs + (size_t)n * %d, outputs + (size_t)n * %d);\n", name,
+            model->input_size, model->output_size);
+    fputs("    }\n    return 1;\n}\n", out);
+    return ferror(out) == 0;
+}
+
+static int write_header(const char* path, const TinyNN_Model* model, const char* name, const char* upper) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Could not create '%s'.\n", path);
+        return 0;
+    }
+    fprintf(out, "// Generated by tinynn_compile. Do not edit.\n#ifndef %s_H\n#define %s_H\n\n", upper, upper);
+    write_declarations(out, model, name, upper);
+    fputs("\n#endif\n", out);
+    int ok = ferror(out) == 0;
+    if (fclose(out) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "Failed writing '%s'.\n", path);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* model_path = NULL;
+    const char* output_path = NULL;
+    const char* header_path = NULL;
+    char name[MAX_NAME] = "";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_path = argv[++i];
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) header_path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            if (!valid_name(argv[++i])) {
+                fprintf(stderr, "'%s' is not a valid C identifier.\n", argv[i]);
+                return 1;
+            }
+            strcpy(name, argv[i]);
+        }
+        else if (argv[i][0] != '-' && model_path == NULL) model_path = argv[i];
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (model_path == NULL) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!name[0]) default_name(model_path, name);
+    char upper[MAX_NAME];
+    for (size_t i = 0; i <= strlen(name); i++) upper[i] = (char)toupper((unsigned char)name[i]);
+    char default_output[MAX_NAME + 2];
+    if (!output_path) {
+        snprintf(default_output, sizeof(default_output), "%s.c", name);
+        output_path = default_output;
+    }
+
+    // Every layer dense and row-major: the generated loops read W[j][k] directly
+    TinyNN_LoadOptions options = default_load_options();
+    options.num_threads = 1;
+    options.sparse_threshold = 0.0f;
+    TinyNN_Model* model = create_model_with_options(model_path, &options);
+    if (!model) {
+        fprintf(stderr, "Failed to load model from '%s'.\n", model_path);
+        return 1;
+    }
+    if (model->weight_type != TINYNN_WEIGHTS_FP32) {
+        fprintf(stderr, "'%s' holds %s weights; only fp32 models can be compiled.\n", model_path,
+                weight_type_name(model->weight_type));
+        free_model(model);
+        return 1;
+    }
+    if (!unpack_model_weights(model)) {
+        fprintf(stderr, "Out of memory.\n");
+        free_model(model);
+        return 1;
+    }
+
+    FILE* out = fopen(output_path, "w");
+    if (!out) {
+        fprintf(stderr, "Could not create '%s'.\n", output_path);
+        free_model(model);
+        return 1;
+    }
+    int ok = write_source(out, model, model_path, name, upper);
+    if (fclose(out) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "Failed writing '%s'.\n", output_path);
+    if (ok && header_path) ok = write_header(header_path, model, name, upper);
+
+    if (ok) {
+        size_t parameters = 0;
+        for (int i = 0; i <= model->hidden_layers; i++) {
+            int cols = i == 0 ? model->input_size : model->layer_sizes[i - 1];
+            parameters += (size_t)model->layer_sizes[i] * (cols + 1);
+        }
+        printf("Compiled '%s' (%d layers, %zu parameters) into %s as %s_forward_pass_into().\n", model_path,
+               model->hidden_layers + 1, parameters, output_path, name);
+    }
+    free_model(model);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+// tinynn_loadgen: closed-loop load generator for 'tinynn serve'. Every connection keeps a
+// fixed number of requests in flight and sends the next one as soon as a reply arrives,
+// so the offered load follows what the server can sustain.
+//
+// Usage: tinynn_loadgen -m model [-s socket | -P port] [-c connections] [-n requests]
+//                       [-d depth] [--seed n]
+//
+//   -m  Model name, relative to the server's model root.
+//   -s  Server socket, default /tmp/tinynn.sock.
+//   -P  Connect to 127.0.0.1:<port> instead of the socket.
+//   -c  Concurrent connections, default 8.
+//   -n  Requests per connection, default 2000.
+//   -d  Requests each connection keeps in flight, default 1.
+//
+// Inputs are fixed-seed random values; the input size is learned from the server by
+// sending an empty request first. Latency is measured per request, from send to reply.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "server.h"
+#include "threads.h"
+#include "utils.h"
+
+#define DEFAULT_SOCKET_PATH "/tmp/tinynn.sock"
+#define DEFAULT_CONNECTIONS 8
+#define DEFAULT_REQUESTS 2000
+#define DEFAULT_DEPTH 1
+#define DEFAULT_SEED 1234
+
+typedef struct {
+    const char* model;
+    const char* socket_path;
+    int port;
+    int connections;
+    int requests;
+    int depth;
+    unsigned int seed;
+} LoadOptions;
+
+typedef struct {
+    const LoadOptions* options;
+    const float* input;
+    int input_size;
+    double* latencies;        // [requests]
+    int completed;
+    int failed;
+} Client;
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s -m model [-s socket | -P port] [-c connections] [-n requests] [-d depth] [--seed n]\n",
+        program);
+}
+
+static int parse_options(int argc, char** argv, LoadOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->socket_path = DEFAULT_SOCKET_PATH;
+    options->connections = DEFAULT_CONNECTIONS;
+    options->requests = DEFAULT_REQUESTS;
+    options->depth = DEFAULT_DEPTH;
+    options->seed = DEFAULT_SEED;
+
+    for (int i = 1; i < argc; i++) {
+        const char* flag = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(flag, "-m") == 0 && has_value) {
+            options->model = argv[++i];
+        } else if (strcmp(flag, "-s") == 0 && has_value) {
+            options->socket_path = argv[++i];
+        } else if (strcmp(flag, "-P") == 0 && has_value) {
+            options->port = atoi(argv[++i]);
+            if (options->port <= 0) return 0;
+        } else if (strcmp(flag, "-c") == 0 && has_value) {
+            options->connections = atoi(argv[++i]);
+            if (options->connections <= 0) return 0;
+        } else if (strcmp(flag, "-n") == 0 && has_value) {
+            options->requests = atoi(argv[++i]);
+            if (options->requests <= 0) return 0;
+        } else if (strcmp(flag, "-d") == 0 && has_value) {
+            options->depth = atoi(argv[++i]);
+            if (options->depth <= 0) return 0;
+        } else if (strcmp(flag, "--seed") == 0 && has_value) {
+            options->seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            return 0;
+        }
+    }
+    return options->model != NULL;
+}
+
+static int open_connection(const LoadOptions* options) {
+    return connect_to_server(options->port > 0 ? NULL : options->socket_path, options->port);
+}
+
+// Asks the server for the model's input size with a request that has no inputs
+static int probe_input_size(const LoadOptions* options) {
+    int fd = open_connection(options);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Could not connect to the server\n");
+        return 0;
+    }
+    TinyNN_Response response;
+    int input_size = 0;
+    if (send_request(fd, 0, options->model, NULL, 0) && read_response(fd, &response, NULL, 0)) {
+        if (response.status == TINYNN_STATUS_BAD_INPUT_SIZE) {
+            input_size = (int)response.count;
+        } else if (response.status == TINYNN_STATUS_UNKNOWN_MODEL) {
+            fprintf(stderr, "ERROR: The server has no model named '%s'\n", options->model);
+        } else {
+            fprintf(stderr, "ERROR: The server could not load '%s' (status %u)\n", options->model,
+                    response.status);
+        }
+    } else {
+        fprintf(stderr, "ERROR: No reply from the server\n");
+    }
+    close_server_connection(fd);
+    return input_size;
+}
+
+static void* client_main(void* arg) {
+    Client* client = (Client*)arg;
+    const LoadOptions* options = client->options;
+    int fd = open_connection(options);
+    if (fd < 0) {
+        client->failed = options->requests;
+        return NULL;
+    }
+
+    // Send times indexed by request id
+    double* sent_at = (double*)malloc(sizeof(double) * options->requests);
+    if (!sent_at) {
+        close_server_connection(fd);
+        client->failed = options->requests;
+        return NULL;
+    }
+    int sent = 0;
+    int received = 0;
+    while (received < options->requests) {
+        while (sent < options->requests && sent - received < options->depth) {
+            sent_at[sent] = get_time_seconds();
+            if (!send_request(fd, (uint32_t)sent, options->model, client->input, client->input_size)) break;
+            sent++;
+        }
+        TinyNN_Response response;
+        if (sent == received || !read_response(fd, &response, NULL, 0)) break;
+        double now = get_time_seconds();
+        received++;
+        if (response.status != TINYNN_STATUS_OK || response.id >= (uint32_t)sent) {
+            client->failed++;
+            continue;
+        }
+        client->latencies[client->completed++] = now - sent_at[response.id];
+    }
+    client->failed += options->requests - received;
+    free(sent_at);
+    close_server_connection(fd);
+    return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an ascending array
+static double percentile(const double* sorted, int count, double p) {
+    int rank = (int)ceil(p * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int input_size = probe_input_size(&options);
+    if (input_size <= 0) return 1;
+    float* input = (float*)malloc(sizeof(float) * input_size);
+    Client* clients = (Client*)calloc(options.connections, sizeof(Client));
+    TinyNN_Thread* threads = (TinyNN_Thread*)calloc(options.connections, sizeof(TinyNN_Thread));
+    double* latencies = (double*)malloc(sizeof(double) * (size_t)options.connections * options.requests);
+    if (!input || !clients || !threads || !latencies) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return 1;
+    }
+    srand(options.seed);
+    for (int i = 0; i < input_size; i++) input[i] = (float)rand() / RAND_MAX;
+
+    double start = get_time_seconds();
+    int started = 0;
+    for (int i = 0; i < options.connections; i++) {
+        clients[i].options = &options;
+        clients[i].input = input;
+        clients[i].input_size = input_size;
+        clients[i].latencies = latencies + (size_t)i * options.requests;
+        if (!thread_create(&threads[i], client_main, &clients[i])) break;
+        started++;
+    }
+    for (int i = 0; i < started; i++) thread_join(threads[i]);
+    double elapsed = get_time_seconds() - start;
+
+    // Gather every connection's samples into one array
+    int completed = 0;
+    int failed = 0;
+    for (int i = 0; i < started; i++) {
+        memmove(latencies + completed, clients[i].latencies, sizeof(double) * clients[i].completed);
+        completed += clients[i].completed;
+        failed += clients[i].failed;
+    }
+    failed += (options.connections - started) * options.requests;
+
+    printf("Model: %s (%d inputs), %d connections x %d requests, depth %d\n", options.model, input_size,
+           options.connections, options.requests, options.depth);
+    printf("Completed: %d, failed: %d, %.2f s\n", completed, failed, elapsed);
+    if (completed > 0) {
+        double total = 0.0;
+        for (int i = 0; i < completed; i++) total += latencies[i];
+        qsort(latencies, completed, sizeof(double), compare_doubles);
+        printf("Throughput: %.0f requests/s\n", completed / elapsed);
+        printf("Latency: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n", total / completed * 1e6,
+               percentile(latencies, completed, 0.50) * 1e6, percentile(latencies, completed, 0.99) * 1e6,
+               latencies[completed - 1] * 1e6);
+    }
+
+    free(input);
+    free(clients);
+    free(threads);
+    free(latencies);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+// tinynn_numa_bench: weight bandwidth per NUMA node with each placement of the weights.
+// A model is written to a temporary .tnn file (or taken from -m) and loaded once per
+// placement: off (wherever the loading thread's pages land, usually its own node),
+// interleave, and replicate. For every node, threads pinned to that node then run batch-1
+// forward passes on their own contexts, first one node at a time and then on all nodes
+// at once. Batch 1 reads every weight once per sample, so the rate at which a node gets
+// through the weights is its effective memory bandwidth for inference.
+//
+// Usage: tinynn_numa_bench [-m model] [-s shape] [-t threads] [-r passes] [-w type]
+//                          [--modes list] [--seed n]
+//
+//   -m  Model directory or .tnn file to load instead of a generated one.
+//   -s  Shape of the generated model, input size followed by every layer size
+//       (default 1024x4096x4096x4096x1024, about 168 MB of fp32 weights).
+//   -t  Threads per node, 0 = every CPU of the node (default 0).
+//   -r  Timed forward passes per thread (default 20), after 2 untimed ones.
+//   -w  Weight type: fp32, fp16, bf16 or int8 (default fp32).
+//   --modes  Comma-separated placements to compare (default off,interleave,replicate).
+//
+// "local" is the share of weight pages each node's threads read that sit on that node,
+// as reported by the kernel. On a machine with one node every placement is the same.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "model.h"
+#include "generate_model.h"
+#include "numa.h"
+#include "threads.h"
+#include "utils.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define MAX_LAYERS 64
+#define MAX_NODES 64
+#define MAX_MODES 3
+#define MAX_NODE_THREADS 1024
+#define DEFAULT_PASSES 20
+#define WARMUP_PASSES 2
+#define DEFAULT_SEED 1234
+#define PAGE_BYTES 4096
+
+typedef struct {
+    const char* model_path;
+    int input_size;
+    int num_layers;
+    int layer_sizes[MAX_LAYERS];
+    int threads;
+    int passes;
+    TinyNN_WeightType weight_type;
+    TinyNN_NumaMode modes[MAX_MODES];
+    int mode_count;
+    unsigned long long seed;
+} NumaBenchOptions;
+
+// One measuring thread
+typedef struct {
+    const TinyNN_Model* model;
+    int node;
+    int passes;
+    const float* input;
+    volatile int* ready;
+    volatile int* go;
+    int ok;
+} BenchThread;
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [-m model] [-s shape] [-t threads] [-r passes] [-w type] [--modes list] [--seed n]\n"
+        "  -m       Model to load instead of a generated one\n"
+        "  -s       Generated shape 'input x layer x ... x output' (default 1024x4096x4096x4096x1024)\n"
+        "  -t       Threads per node, 0 = every CPU of the node (default 0)\n"
+        "  -r       Timed forward passes per thread (default %d)\n"
+        "  -w       Weight type: fp32, fp16, bf16 or int8 (default fp32)\n"
+        "  --modes  Placements to compare (default off,interleave,replicate)\n",
+        program, DEFAULT_PASSES);
+}
+
+static int parse_shape(NumaBenchOptions* options, const char* text) {
+    int values[MAX_LAYERS + 1];
+    int count = 0;
+    const char* p = text;
+    while (*p && count <= MAX_LAYERS) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0) return 0;
+        values[count++] = (int)value;
+        p = end;
+        if (*p == 'x') p++;
+        else if (*p != '\0') return 0;
+    }
+    if (*p != '\0' || count < 2) return 0;
+    options->input_size = values[0];
+    options->num_layers = count - 1;
+    memcpy(options->layer_sizes, values + 1, sizeof(int) * (count - 1));
+    return 1;
+}
+
+static int parse_modes(NumaBenchOptions* options, char* list) {
+    options->mode_count = 0;
+    for (char* name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        if (options->mode_count == MAX_MODES || !parse_numa_mode(name, &options->modes[options->mode_count])) return 0;
+        options->mode_count++;
+    }
+    return options->mode_count > 0;
+}
+
+static int parse_options(int argc, char** argv, NumaBenchOptions* options) {
+    memset(options, 0, sizeof(*options));
+    parse_shape(options, "1024x4096x4096x4096x1024");
+    options->passes = DEFAULT_PASSES;
+    options->weight_type = TINYNN_WEIGHTS_FP32;
+    options->modes[0] = TINYNN_NUMA_OFF;
+    options->modes[1] = TINYNN_NUMA_INTERLEAVE;
+    options->modes[2] = TINYNN_NUMA_REPLICATE;
+    options->mode_count = 3;
+    options->seed = DEFAULT_SEED;
+
+    for (int i = 1; i < argc; i++) {
+        const char* flag = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(flag, "-m") == 0 && has_value) {
+            options->model_path = argv[++i];
+        } else if (strcmp(flag, "-s") == 0 && has_value) {
+            if (!parse_shape(options, argv[++i])) return 0;
+        } else if (strcmp(flag, "-t") == 0 && has_value) {
+            options->threads = atoi(argv[++i]);
+            if (options->threads < 0) return 0;
+        } else if (strcmp(flag, "-r") == 0 && has_value) {
+            options->passes = atoi(argv[++i]);
+            if (options->passes <= 0) return 0;
+        } else if (strcmp(flag, "-w") == 0 && has_value) {
+            if (!parse_weight_type(argv[++i], &options->weight_type)) return 0;
+        } else if (strcmp(flag, "--modes") == 0 && has_value) {
+            if (!parse_modes(options, argv[++i])) return 0;
+        } else if (strcmp(flag, "--seed") == 0 && has_value) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The array holding layer 'layer's weights in whatever form the model runs them
+static const void* layer_weight_data(const TinyNN_Model* model, int layer, size_t* bytes) {
+    *bytes = layer_weight_bytes(model, layer);
+    if (model->quant) {
+        *bytes = (size_t)model->layer_sizes[layer] * model->quant[layer].padded_cols; // Without the scales
+        return model->quant[layer].weights;
+    }
+    if (model->half_weights) return model->half_weights[layer];
+    if (model->sparse && model->sparse[layer].block_rows > 0) {
+        const TinyNN_SparseLayer* sparse = &model->sparse[layer];
+        *bytes = sizeof(float) * (size_t)sparse->block_count * sparse->block_rows;
+        return sparse->values;
+    }
+    if (model->packed_weights && model->packed_weights[layer]) return model->packed_weights[layer];
+    return model->weights[layer];
+}
+
+// Share of 'model's weight pages that sit on 'node' (-1 when the kernel does not say)
+static double local_page_share(const TinyNN_Model* model, int node) {
+    long long pages = 0, local = 0;
+    for (int i = 0; i <= model->hidden_layers; i++) {
+        size_t bytes;
+        const unsigned char* data = (const unsigned char*)layer_weight_data(model, i, &bytes);
+        for (size_t offset = 0; data && offset < bytes; offset += PAGE_BYTES) {
+            int page_node = numa_node_of_address(data + offset);
+            if (page_node < 0) return -1.0;
+            pages++;
+            if (page_node == node) local++;
+        }
+    }
+    return pages > 0 ? (double)local / pages : -1.0;
+}
+
+static void* bench_thread_main(void* arg) {
+    BenchThread* bench = (BenchThread*)arg;
+    numa_bind_thread_to_node(bench->node);
+    // Built after pinning, so a replicated model hands out this node's copy
+    TinyNN_Context* ctx = create_context(bench->model, 1);
+    float* output = ctx ? (float*)malloc(sizeof(float) * bench->model->output_size) : NULL;
+    bench->ok = ctx && output;
+    for (int i = 0; bench->ok && i < WARMUP_PASSES; i++) forward_pass_into(ctx, bench->input, output);
+    atomic_add_int(bench->ready, 1);
+    while (!atomic_load_int(bench->go)) cpu_relax();
+    for (int i = 0; bench->ok && i < bench->passes; i++) forward_pass_into(ctx, bench->input, output);
+    free(output);
+    free_context(ctx);
+    return NULL;
+}
+
+/**
+ * @brief Runs the threads of every node flagged in 'active' at once.
+ * @param seconds Receives the wall time of each active node's threads.
+ * @return 1 on success.
+ */
+static int run_nodes(const TinyNN_Model* model, const NumaBenchOptions* options, const float* input,
+                     const int* active, int nodes, double* seconds) {
+    BenchThread* benches = (BenchThread*)calloc((size_t)nodes * MAX_NODE_THREADS, sizeof(BenchThread));
+    TinyNN_Thread* threads = (TinyNN_Thread*)malloc(sizeof(TinyNN_Thread) * (size_t)nodes * MAX_NODE_THREADS);
+    int* per_node = (int*)calloc(nodes, sizeof(int));
+    int cpus[MAX_NODE_THREADS];
+    volatile int ready = 0, go = 0;
+    int started = 0, ok = benches && threads && per_node;
+
+    for (int node = 0; ok && node < nodes; node++) {
+        if (!active[node]) continue;
+        int count = numa_node_cpus(node, cpus, MAX_NODE_THREADS);
+        if (options->threads > 0) count = options->threads;
+        if (count > MAX_NODE_THREADS) count = MAX_NODE_THREADS;
+        for (int t = 0; ok && t < count; t++) {
+            BenchThread* bench = &benches[started];
+            bench->model = model;
+            bench->node = node;
+            bench->passes = options->passes;
+            bench->input = input;
+            bench->ready = &ready;
+            bench->go = &go;
+            if (!thread_create(&threads[started], bench_thread_main, bench)) ok = 0;
+            else started++;
+        }
+        per_node[node] = count;
+    }
+    // Everyone starts together once all contexts are built and warm
+    while (atomic_load_int(&ready) < started) thread_sleep_ms(1);
+    double start = get_time_seconds();
+    atomic_store_int(&go, 1);
+    // Threads are joined node by node, so a node's time is when its last thread finished
+    int index = 0;
+    for (int node = 0; per_node && node < nodes; node++) {
+        for (int t = 0; t < per_node[node] && index < started; t++) {
+            thread_join(threads[index]);
+            if (!benches[index].ok) ok = 0;
+            index++;
+        }
+        seconds[node] = get_time_seconds() - start;
+    }
+    while (index < started) thread_join(threads[index++]);
+    free(benches);
+    free(threads);
+    free(per_node);
+    return ok;
+}
+
+static void print_row(const char* mode, const char* run, int node, int threads, double gbps, double local) {
+    char node_label[16];
+    char share[16];
+    if (node >= 0) snprintf(node_label, sizeof(node_label), "%d", node);
+    else snprintf(node_label, sizeof(node_label), "-");
+    if (local >= 0.0) snprintf(share, sizeof(share), "%5.1f%%", local * 100.0);
+    else snprintf(share, sizeof(share), "%6s", "n/a");
+    printf("%-11s %-8s %4s %8d %10.2f %8s\n", mode, run, node_label, threads, gbps, share);
+}
+
+static int bench_mode(const NumaBenchOptions* options, const char* path, TinyNN_NumaMode mode, const float* input) {
+    TinyNN_LoadOptions load = default_load_options();
+    load.weight_type = options->weight_type;
+    load.num_threads = 1;
+    load.numa = mode;
+    TinyNN_Model* model = create_model_with_options(path, &load);
+    if (!model) {
+        fprintf(stderr, "Could not load %s with NUMA placement %s.\n", path, numa_mode_name(mode));
+        return 0;
+    }
+
+    int nodes = numa_node_count();
+    if (nodes > MAX_NODES) nodes = MAX_NODES;
+    int active[MAX_NODES];
+    int threads[MAX_NODES];
+    double local[MAX_NODES];
+    double seconds[MAX_NODES];
+    double bytes_per_pass = (double)model_weight_bytes(model);
+    int cpus[MAX_NODE_THREADS];
+    for (int node = 0; node < nodes; node++) {
+        threads[node] = options->threads > 0 ? options->threads : numa_node_cpus(node, cpus, MAX_NODE_THREADS);
+        const TinyNN_Model* copy = numa_model_on_node(model, node);
+        local[node] = threads[node] > 0 && copy ? local_page_share(copy, node) : -1.0;
+    }
+
+    int ok = 1;
+    double total = 0.0;
+    for (int pass = 0; pass <= nodes && ok; pass++) {
+        // One node alone first, then every node at once
+        int all = pass == nodes;
+        for (int node = 0; node < nodes; node++) active[node] = threads[node] > 0 && (all || node == pass);
+        if (!all && !active[pass]) continue;
+        if (all && nodes == 1) break;
+        ok = run_nodes(model, options, input, active, nodes, seconds);
+        for (int node = 0; ok && node < nodes; node++) {
+            if (!active[node]) continue;
+            double gbps = bytes_per_pass * threads[node] * options->passes / seconds[node] / 1e9;
+            if (all) total += gbps;
+            print_row(numa_mode_name(mode), all ? "all" : "alone", node, threads[node], gbps, local[node]);
+        }
+    }
+    if (ok && nodes > 1) {
+        int total_threads = 0;
+        for (int node = 0; node < nodes; node++) total_threads += threads[node];
+        print_row(numa_mode_name(mode), "total", -1, total_threads, total, -1.0);
+    }
+    fflush(stdout);
+    free_model(model);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    NumaBenchOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // A generated model goes through a file like any other, so every placement loads it
+    char temp_path[512];
+    const char* path = options.model_path;
+    if (!path) {
+        const char* dir = getenv("TMPDIR");
+        #ifdef _WIN32
+        snprintf(temp_path, sizeof(temp_path), "%s\\tinynn_numa_bench.tnn", dir ? dir : ".");
+        #else
+        snprintf(temp_path, sizeof(temp_path), "%s/tinynn_numa_bench_%d.tnn", dir ? dir : "/tmp", (int)getpid());
+        #endif
+        TinyNN_GeneratorOptions generator;
+        memset(&generator, 0, sizeof(generator));
+        generator.input_size = options.input_size;
+        generator.num_layers = options.num_layers;
+        generator.layer_sizes = options.layer_sizes;
+        generator.seed = options.seed;
+        generator.distribution = TINYNN_DIST_XAVIER;
+        generator.num_threads = 0;
+        if (!generate_model_binary(temp_path, &generator)) {
+            fprintf(stderr, "Could not write the model to %s.\n", temp_path);
+            return 1;
+        }
+        path = temp_path;
+    }
+
+    int input_size = options.input_size;
+    if (options.model_path) {
+        TinyNN_Model* probe = create_model_from_path(path);
+        input_size = probe ? probe->input_size : 0;
+        free_model(probe);
+    }
+    float* input = input_size > 0 ? (float*)malloc(sizeof(float) * input_size) : NULL;
+    int status = input ? 0 : 1;
+    for (int i = 0; i < input_size && input; i++) input[i] = (float)((i * 37) % 101) / 50.0f - 1.0f;
+
+    if (status == 0) {
+        printf("%d NUMA node%s, %s weights, %d passes per thread, batch 1\n", numa_node_count(),
+               numa_node_count() == 1 ? "" : "s", weight_type_name(options.weight_type), options.passes);
+        printf("%-11s %-8s %4s %8s %10s %8s\n", "placement", "run", "node", "threads", "GB/s", "local");
+    }
+    for (int m = 0; m < options.mode_count && status == 0; m++) {
+        if (!bench_mode(&options, path, options.modes[m], input)) status = 1;
+    }
+
+    free(input);
+    if (!options.model_path) remove(temp_path);
+    return status;
+}
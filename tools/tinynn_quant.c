@@ -0,0 +1,179 @@
+// tinynn_quant: converts an fp32 model to INT8 (or FP16 / BF16 storage) and reports
+// the accuracy delta against the fp32 forward pass on an input set.
+//
+// Usage: tinynn_quant <model_path> [-t int8|fp16|bf16] [-c calibration.csv] [-e eval.csv] [-o output.tnn]
+//
+//   -t  Target weight type, int8 by default.
+//   -c  Rows used to calibrate per-layer INT8 activation scales. Without it, activations
+//       are scaled per sample at inference time.
+//   -e  Rows to compare fp32 and INT8 outputs on. Defaults to the calibration set,
+//       or to 256 random inputs in [-1, 1] if neither file is given.
+//   -o  Write the quantized model to this .tnn file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "model.h"
+#include "model_binary.h"
+#include "quantize.h"
+#include "csv_parser.h"
+#include "utils.h"
+
+#define RANDOM_EVAL_ROWS 256
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s <model_path> [-t int8|fp16|bf16] [-c calibration.csv] [-e eval.csv] [-o output.tnn]\n",
+            program);
+}
+
+static int argmax(const float* values, int count) {
+    int best = 0;
+    for (int i = 1; i < count; i++) {
+        if (values[i] > values[best]) best = i;
+    }
+    return best;
+}
+
+// Average seconds per sample for one forward_pass_into() over every row
+static double time_per_sample(TinyNN_Context* ctx, const float* inputs, int rows, float* outputs) {
+    const TinyNN_Model* model = ctx->model;
+    double start = get_time_seconds();
+    for (int n = 0; n < rows; n++) {
+        forward_pass_into(ctx, inputs + (size_t)n * model->input_size, outputs + (size_t)n * model->output_size);
+    }
+    return (get_time_seconds() - start) / rows;
+}
+
+int main(int argc, char** argv) {
+    const char* model_path = NULL;
+    const char* calibration_path = NULL;
+    const char* eval_path = NULL;
+    const char* output_path = NULL;
+    TinyNN_WeightType target_type = TINYNN_WEIGHTS_INT8;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (!parse_weight_type(argv[++i], &target_type) || target_type == TINYNN_WEIGHTS_FP32) {
+                fprintf(stderr, "Unknown target type '%s' (expected int8, fp16 or bf16).\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) calibration_path = argv[++i];
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) eval_path = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_path = argv[++i];
+        else if (argv[i][0] != '-' && model_path == NULL) model_path = argv[i];
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (model_path == NULL) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Two copies: the fp32 reference and the one that gets converted
+    TinyNN_Model* reference = create_model_from_path(model_path);
+    TinyNN_Model* quantized = create_model_from_path(model_path);
+    if (!reference || !quantized) {
+        fprintf(stderr, "Failed to load model from '%s'.\n", model_path);
+        free_model(reference);
+        free_model(quantized);
+        return 1;
+    }
+
+    int calibration_rows = 0;
+    float* calibration = NULL;
+    if (calibration_path) {
+        calibration = load_float_rows(calibration_path, reference->input_size, &calibration_rows);
+        if (!calibration) return 1;
+    }
+
+    int eval_rows = 0;
+    float* eval = NULL;
+    if (eval_path) {
+        eval = load_float_rows(eval_path, reference->input_size, &eval_rows);
+        if (!eval) return 1;
+    } else if (calibration) {
+        eval = calibration;
+        eval_rows = calibration_rows;
+    } else {
+        eval_rows = RANDOM_EVAL_ROWS;
+        eval = (float*)malloc(sizeof(float) * eval_rows * reference->input_size);
+        if (!eval) return 1;
+        srand(1234);
+        for (int i = 0; i < eval_rows * reference->input_size; i++) {
+            eval[i] = ((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+        }
+        printf("No input set given, evaluating on %d random inputs.\n", eval_rows);
+    }
+
+    int converted;
+    if (target_type == TINYNN_WEIGHTS_INT8) {
+        printf("Quantizing '%s' (%s activation scales)...\n", model_path,
+               calibration ? "calibrated" : "per-sample");
+        converted = quantize_model(quantized, calibration, calibration_rows);
+    } else {
+        printf("Converting '%s' to %s weights...\n", model_path, weight_type_name(target_type));
+        converted = convert_model_weights(quantized, target_type);
+    }
+    if (!converted) {
+        fprintf(stderr, "Conversion failed.\n");
+        return 1;
+    }
+
+    TinyNN_Context* reference_ctx = create_context(reference, 1);
+    TinyNN_Context* quantized_ctx = create_context(quantized, 1);
+    float* reference_out = (float*)malloc(sizeof(float) * eval_rows * reference->output_size);
+    float* quantized_out = (float*)malloc(sizeof(float) * eval_rows * reference->output_size);
+    if (!reference_ctx || !quantized_ctx || !reference_out || !quantized_out) return 1;
+
+    double fp32_time = time_per_sample(reference_ctx, eval, eval_rows, reference_out);
+    double converted_time = time_per_sample(quantized_ctx, eval, eval_rows, quantized_out);
+
+    double max_error = 0.0, sum_error = 0.0, sum_squared = 0.0;
+    int top1_matches = 0;
+    for (int n = 0; n < eval_rows; n++) {
+        const float* r = reference_out + (size_t)n * reference->output_size;
+        const float* q = quantized_out + (size_t)n * reference->output_size;
+        for (int j = 0; j < reference->output_size; j++) {
+            double error = fabs((double)r[j] - (double)q[j]);
+            if (error > max_error) max_error = error;
+            sum_error += error;
+            sum_squared += error * error;
+        }
+        if (argmax(r, reference->output_size) == argmax(q, reference->output_size)) top1_matches++;
+    }
+    double values = (double)eval_rows * reference->output_size;
+
+    printf("\n--- %s vs fp32 (%d samples, kernels: %s) ---\n", weight_type_name(target_type), eval_rows,
+           quantized->kernels->name);
+    printf("  Weight bytes      : %zu -> %zu (%.2fx smaller)\n", model_weight_bytes(reference), model_weight_bytes(quantized),
+           (double)model_weight_bytes(reference) / (double)model_weight_bytes(quantized));
+    printf("  Max abs error     : %.6g\n", max_error);
+    printf("  Mean abs error    : %.6g\n", sum_error / values);
+    printf("  RMS error         : %.6g\n", sqrt(sum_squared / values));
+    printf("  Top-1 agreement   : %.2f%% (%d/%d)\n", 100.0 * top1_matches / eval_rows, top1_matches, eval_rows);
+    printf("  Latency per sample: %.2f us fp32, %.2f us %s\n", fp32_time * 1e6, converted_time * 1e6,
+           weight_type_name(target_type));
+
+    int status = 0;
+    if (output_path) {
+        if (save_model_binary(quantized, output_path)) {
+            printf("\nWrote %s model to %s\n", weight_type_name(target_type), output_path);
+        } else {
+            status = 1;
+        }
+    }
+
+    free(reference_out);
+    free(quantized_out);
+    free_context(reference_ctx);
+    free_context(quantized_ctx);
+    if (eval != calibration) free(eval);
+    free(calibration);
+    free_model(reference);
+    free_model(quantized);
+    return status;
+}